@@ -0,0 +1,186 @@
+// LUDA::Allocator: raw allocation rate against the system allocator, executor workloads
+// on the pool against Lua's own l_alloc, and the pool's fragmentation after a Lua workload
+// that builds and drops many small objects
+#include "Fixtures.h"
+
+#include <Executor/Allocator.h>
+#include <Executor/Libraries/functions.hpp>
+#include <Executor/Libraries/strings.hpp>
+#include <Executor/Libraries/xrefs.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace bench {
+
+    // Sizes of the blocks Lua asks for most: strings, tables, closures, node arrays
+    static std::vector<size_t> SmallSizes(size_t count) {
+        std::mt19937 rng(27);
+        std::vector<size_t> sizes(count);
+        for (size_t& size : sizes) {
+            size = 16 + rng() % 240;
+        }
+        return sizes;
+    }
+
+    // Allocate a window of live blocks and keep replacing the oldest, like a young generation
+    template <typename Alloc, typename Free>
+    static void Churn(benchmark::State& state, Alloc&& allocate, Free&& release) {
+        constexpr size_t kLive = 4096;
+        std::vector<size_t> sizes = SmallSizes(1 << 16);
+        std::vector<void*> live(kLive, nullptr);
+        size_t next = 0;
+        for (auto _ : state) {
+            for (size_t i = 0; i < sizes.size(); i++) {
+                size_t slot = i % kLive;
+                if (live[slot] != nullptr) {
+                    release(live[slot], sizes[(i + sizes.size() - kLive) % sizes.size()]);
+                }
+                live[slot] = allocate(sizes[i]);
+                benchmark::DoNotOptimize(live[slot]);
+            }
+            next += sizes.size();
+        }
+        for (size_t slot = 0; slot < kLive; slot++) {
+            if (live[slot] != nullptr) {
+                release(live[slot], sizes[(next + slot - kLive) % sizes.size()]);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(sizes.size()));
+    }
+
+    static void BM_AllocatorChurn(benchmark::State& state) {
+        LUDA::Allocator pool;
+        Churn(state,
+            [&](size_t size) { return LUDA::Allocator::alloc(&pool, nullptr, 0, size); },
+            [&](void* ptr, size_t size) { LUDA::Allocator::alloc(&pool, ptr, size, 0); });
+    }
+    BENCHMARK(BM_AllocatorChurn)->Unit(benchmark::kMicrosecond);
+
+    static void BM_SystemChurn(benchmark::State& state) {
+        Churn(state,
+            [](size_t size) { return malloc(size); },
+            [](void* ptr, size_t) { free(ptr); });
+    }
+    BENCHMARK(BM_SystemChurn)->Unit(benchmark::kMicrosecond);
+
+    // Stores the value on top of the stack as global table.name
+    static void SetField(lua_State* L, const char* table, const char* name) {
+        if (lua_getglobal(L, table) == LUA_TNIL) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setglobal(L, table);
+        }
+        lua_insert(L, -2);
+        lua_setfield(L, -2, name);
+        lua_pop(L, 1);
+    }
+
+    // A state over the pool (range 0) or over l_alloc as luaL_newstate sets it up (range 1),
+    // with the bindings the workloads below call, registered as the executor does
+    static lua_State* WorkloadState(benchmark::State& state, LUDA::Allocator& pool) {
+        LUDA::set_backend(&database());
+        bool onPool = state.range(0) == 0;
+        state.SetLabel(onPool ? "pool" : "l_alloc");
+        lua_State* L = onPool ? lua_newstate(LUDA::Allocator::alloc, &pool, luaL_makeseed(nullptr)) : luaL_newstate();
+        luaL_openlibs(L);
+        LUDA::Library::register_array_type(L);
+        LUDA::Library::register_records_type(L);
+        lua_pushcfunction(L, LUDA::Library::c_u64array_new);
+        SetField(L, "luda", "u64array");
+        lua_pushcfunction(L, LUDA::Library::c_u32array_new);
+        SetField(L, "luda", "u32array");
+        lua_pushcfunction(L, LUDA::Library::c_u8array_new);
+        SetField(L, "luda", "u8array");
+        LUDA::Library::push_binding<&LUDA::Library::search_strings>(L);
+        SetField(L, "strings", "search");
+        LUDA::Library::push_binding<&LUDA::Library::get_xrefs>(L);
+        SetField(L, "xrefs", "get");
+        LUDA::Library::push_binding<&LUDA::Library::get_function>(L);
+        lua_setglobal(L, "get_function");
+        return L;
+    }
+
+    // One iteration is one run of `script` on a state kept across iterations, like the
+    // executor's
+    static void RunWorkload(benchmark::State& state, const std::string& script, int64_t items) {
+        LUDA::Allocator pool;
+        lua_State* L = WorkloadState(state, pool);
+        for (auto _ : state) {
+            if (luaL_dostring(L, script.c_str()) != LUA_OK) {
+                state.SkipWithError(lua_tostring(L, -1));
+                break;
+            }
+        }
+        lua_close(L);
+        state.SetItemsProcessed(state.iterations() * items);
+    }
+
+    // Record blocks of the 50k database strings, read row by row
+    static void BM_WorkloadStringsSearch(benchmark::State& state) {
+        RunWorkload(state,
+            "local n = 0\n"
+            "for _, s in ipairs(strings.search('')) do n = n + #s.string + (s.address & 1) end\n"
+            "assert(#strings.search('needle') == " + std::to_string(kStringCount / 100) + " and n > 0)",
+            kStringCount);
+    }
+    BENCHMARK(BM_WorkloadStringsSearch)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+    // The same strings as a table per row, then split into words: many small tables and strings
+    static void BM_WorkloadStringRows(benchmark::State& state) {
+        RunWorkload(state,
+            "local found = strings.search(''):totable()\n"
+            "local words = 0\n"
+            "for _, s in ipairs(found) do for w in s.string:gmatch('%a+') do words = words + 1 end end\n"
+            "assert(#found == " + std::to_string(kStringCount) + " and words > 0)",
+            kStringCount);
+    }
+    BENCHMARK(BM_WorkloadStringRows)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+    // Functions looked up by formatted names and the callers of the hot one: short-lived
+    // strings next to one 800 KB array
+    static void BM_WorkloadLookups(benchmark::State& state) {
+        RunWorkload(state,
+            "local get, fmt, base = get_function, string.format, " + hex(kText) + "\n"
+            "for i = 0, 9999 do get(fmt('sub_%X', base + (i * 7 % " + std::to_string(kFunctionCount) + ") * " +
+            std::to_string(kFunctionSize) + ")) end\n"
+            "assert(#xrefs.get(" + hex(kHotTarget) + ") == " + std::to_string(kHotXrefs) + ")",
+            10000);
+    }
+    BENCHMARK(BM_WorkloadLookups)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+    // A Lua state on the pool: build 100k small tables and strings, keep every tenth,
+    // collect, and report how much of the reserved pool memory is left idle
+    static void BM_AllocatorLuaFragmentation(benchmark::State& state) {
+        static const char* kScript =
+            "local keep = {}\n"
+            "for i = 1, 100000 do local t = { i, tostring(i), name = 'n' .. i }\n"
+            "  if i % 10 == 0 then keep[#keep + 1] = t end end\n"
+            "collectgarbage()\n"
+            "return #keep";
+        double fragmentation = 0;
+        double reserved = 0;
+        for (auto _ : state) {
+            LUDA::Allocator pool;
+            lua_State* L = lua_newstate(LUDA::Allocator::alloc, &pool, 0);
+            luaL_openlibs(L);
+            if (luaL_dostring(L, kScript) != 0) {
+                state.SkipWithError("script failed");
+                lua_close(L);
+                return;
+            }
+            fragmentation = pool.fragmentation();
+            reserved = static_cast<double>(pool.stats().small_reserved);
+            lua_close(L);
+        }
+        state.SetItemsProcessed(state.iterations() * 100000);
+        state.counters["fragmentation"] = fragmentation;
+        state.counters["pool_reserved"] = benchmark::Counter(reserved, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+    }
+    BENCHMARK(BM_AllocatorLuaFragmentation)->Unit(benchmark::kMillisecond);
+
+} // namespace bench
@@ -0,0 +1,57 @@
+// Typed arrays against the Lua-table code they replace: two 100k address sets sorted,
+// deduplicated, intersected and filtered to a window
+#include "Fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+namespace bench {
+
+    constexpr int64_t kElements = 100000;
+
+    // Two overlapping sets of scattered, 8-aligned addresses
+    static const std::string kSets =
+        "local N = " + std::to_string(kElements) + "\n"
+        "local function addresses(seed) local t = {} for i = 1, N do t[i] = " + hex(kText) +
+        " + (i * seed % 0x400000) // 8 * 8 end return t end\n"
+        "local ta, tb = addresses(2654435761), addresses(40503)\n";
+
+    static void BM_ArraySetOps(benchmark::State& state) {
+        RunScript(state, kSets +
+            "local a, b = luda.u64array(ta):unique(), luda.u64array(tb):unique()\n"
+            "local both, either, only = a:intersect(b), a:union(b), a:difference(b)\n"
+            "local lo = " + hex(kText) + " + 0x100000\n"
+            "local near = both:filter(both:mask(\"in\", lo, lo + 0x100000))\n"
+            "assert(#both > 0 and #near > 0)",
+            0, 2 * kElements);
+    }
+    BENCHMARK(BM_ArraySetOps)->Unit(benchmark::kMicrosecond);
+
+    static void BM_TableSetOps(benchmark::State& state) {
+        RunScript(state, kSets +
+            "local function unique(t) table.sort(t) local out = {} for i = 1, #t do\n"
+            "  if t[i] ~= out[#out] then out[#out + 1] = t[i] end end return out end\n"
+            "local function merge(a, b, keep_a, keep_both, keep_b) local out, i, j = {}, 1, 1\n"
+            "  while a[i] or b[j] do local x, y = a[i], b[j]\n"
+            "    if y == nil or (x ~= nil and x < y) then if keep_a then out[#out + 1] = x end i = i + 1\n"
+            "    elseif x == nil or y < x then if keep_b then out[#out + 1] = y end j = j + 1\n"
+            "    else if keep_both then out[#out + 1] = x end i, j = i + 1, j + 1 end end\n"
+            "  return out end\n"
+            "local a, b = unique(ta), unique(tb)\n"
+            "local both, either, only = merge(a, b, false, true, false), merge(a, b, true, true, true), merge(a, b, true, false, false)\n"
+            "local lo = " + hex(kText) + " + 0x100000\n"
+            "local near = {} for _, ea in ipairs(both) do if ea >= lo and ea < lo + 0x100000 then near[#near + 1] = ea end end\n"
+            "assert(#both > 0 and #near > 0)",
+            0, 2 * kElements);
+    }
+    BENCHMARK(BM_TableSetOps)->Unit(benchmark::kMicrosecond);
+
+    // The set operation alone, on inputs built once outside the loop
+    static void BM_ArrayIntersect(benchmark::State& state) {
+        RunScript(state, kSets +
+            "local a, b = luda.u64array(ta):unique(), luda.u64array(tb):unique()\n"
+            "for r = 1, 100 do a:intersect(b) end",
+            0, 100 * 2 * kElements);
+    }
+    BENCHMARK(BM_ArrayIntersect)->Unit(benchmark::kMicrosecond);
+
+} // namespace bench
@@ -0,0 +1,45 @@
+// assemble, assemble_many and patch.asm_at on the stubs of a patch script: a call at each
+// of 1000 sites. The executor outlives iterations, so after the first one these are cache
+// hits, like a script run again on the same database.
+#include "Fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+#ifdef LUDA_WITH_KEYSTONE
+namespace bench {
+
+    static const std::string kSites =
+        "local sites = {} for i = 1, 1000 do sites[i] = " + hex(kText) + " + i * " + std::to_string(kFunctionSize) + " end\n";
+
+    static void BM_AssembleEach(benchmark::State& state) {
+        RunScript(state, kSites +
+            "for i = 1, #sites do assert(assemble(\"call " + hex(kHotTarget) + "\", sites[i])) end",
+            0, 1000);
+    }
+    BENCHMARK(BM_AssembleEach)->Unit(benchmark::kMicrosecond);
+
+    static void BM_AssembleMany(benchmark::State& state) {
+        RunScript(state, kSites +
+            "local codes = {} for i = 1, #sites do codes[i] = \"call " + hex(kHotTarget) + "\" end\n"
+            "assert(assemble_many(codes, sites))",
+            0, 1000);
+    }
+    BENCHMARK(BM_AssembleMany)->Unit(benchmark::kMicrosecond);
+
+    // The same stubs written by patch.asm_at, against assemble + memory.write per site
+    static void BM_PatchAsmAt(benchmark::State& state) {
+        RunScript(state, kSites +
+            "assert(patch.asm_at(sites, \"call " + hex(kHotTarget) + "\"))",
+            0, 1000);
+    }
+    BENCHMARK(BM_PatchAsmAt)->Unit(benchmark::kMicrosecond);
+
+    static void BM_PatchEachSite(benchmark::State& state) {
+        RunScript(state, kSites +
+            "for i = 1, #sites do memory.write(sites[i], assert(assemble(\"call " + hex(kHotTarget) + "\", sites[i]))) end",
+            0, 1000);
+    }
+    BENCHMARK(BM_PatchEachSite)->Unit(benchmark::kMicrosecond);
+
+} // namespace bench
+#endif
@@ -0,0 +1,106 @@
+// The Lua bindings, driven through whole script runs like a client would
+#include "Fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+namespace bench {
+
+    static void BM_MemoryRead(benchmark::State& state) {
+        int64_t size = state.range(0);
+        RunScript(state, "memory.read(" + hex(kText) + ", " + std::to_string(size) + ")", size, 0);
+    }
+    BENCHMARK(BM_MemoryRead)->Arg(4 << 10)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+
+    static void BM_MemoryReadBuffer(benchmark::State& state) {
+        int64_t size = state.range(0);
+        RunScript(state, "memory.read_buffer(" + hex(kText) + ", " + std::to_string(size) + ")", size, 0);
+    }
+    BENCHMARK(BM_MemoryReadBuffer)->Arg(4 << 10)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+
+    static void BM_MemoryWrite(benchmark::State& state) {
+        int64_t size = state.range(0);
+        std::string script =
+            "local t = {} for i = 1, " + std::to_string(size) + " do t[i] = i & 0xFF end\n"
+            "memory.write(" + hex(kRdata - 0x10000) + ", t)";
+        RunScript(state, script, size, 0);
+    }
+    BENCHMARK(BM_MemoryWrite)->Arg(4 << 10)->Arg(64 << 10)->Unit(benchmark::kMicrosecond);
+
+    static void BM_XrefsGet(benchmark::State& state) {
+        RunScript(state, "assert(#xrefs.get(" + hex(kHotTarget) + ") == " + std::to_string(kHotXrefs) + ")", 0, kHotXrefs);
+    }
+    BENCHMARK(BM_XrefsGet)->Unit(benchmark::kMicrosecond);
+
+    // Many small lookups, the per-call cost of a binding
+    static void BM_XrefsGetSmall(benchmark::State& state) {
+        std::string script =
+            "local get, base = xrefs.get, " + hex(kRdata) + "\n"
+            "for i = 0, 9999 do get(base + i * 8) end";
+        RunScript(state, script, 0, 10000);
+    }
+    BENCHMARK(BM_XrefsGetSmall)->Unit(benchmark::kMicrosecond);
+
+    static void BM_StringsSearch(benchmark::State& state) {
+        RunScript(state, "assert(#strings.search(\"needle\") == " + std::to_string(kStringCount / 100) + ")", 0, kStringCount);
+    }
+    BENCHMARK(BM_StringsSearch)->Unit(benchmark::kMicrosecond);
+
+    static void BM_StringsSearchExact(benchmark::State& state) {
+        RunScript(state, "assert(#strings.search(\"0: needle in rax, qword ptr [rbx+0x18]\", true) == 1)", 0, kStringCount);
+    }
+    BENCHMARK(BM_StringsSearchExact)->Unit(benchmark::kMicrosecond);
+
+    // Reading fields back out of the result rows
+    static void BM_StringsSearchRows(benchmark::State& state) {
+        std::string script =
+            "local n = 0 for _, s in ipairs(strings.search(\"\")) do n = n + #s.string + (s.address & 1) end\n"
+            "assert(n > 0)";
+        RunScript(state, script, 0, kStringCount);
+    }
+    BENCHMARK(BM_StringsSearchRows)->Unit(benchmark::kMicrosecond);
+
+    static void BM_GetFunctionByAddress(benchmark::State& state) {
+        std::string script =
+            "local get, base = get_function, " + hex(kText) + "\n"
+            "for i = 0, 9999 do get(base + i * 331) end";
+        RunScript(state, script, 0, 10000);
+    }
+    BENCHMARK(BM_GetFunctionByAddress)->Unit(benchmark::kMicrosecond);
+
+    static void BM_GetFunctionByName(benchmark::State& state) {
+        std::string script =
+            "local get, fmt, base = get_function, string.format, " + hex(kText) + "\n"
+            "for i = 0, 9999 do get(fmt(\"sub_%X\", base + (i * 7 % " + std::to_string(kFunctionCount) + ") * " +
+            std::to_string(kFunctionSize) + ")) end";
+        RunScript(state, script, 0, 10000);
+    }
+    BENCHMARK(BM_GetFunctionByName)->Unit(benchmark::kMicrosecond);
+
+    static void BM_Hex(benchmark::State& state) {
+        RunScript(state, "local hex = hex for i = 1, 10000 do hex(i * 0x10001) end", 0, 10000);
+    }
+    BENCHMARK(BM_Hex)->Unit(benchmark::kMicrosecond);
+
+    // 64 KB of code bytes as hexdump lines, against the per-byte string.format loop it replaces
+    static void BM_Hexdump(benchmark::State& state) {
+        RunScript(state, "local text = hexdump(" + hex(kText) + ", 0x10000)", 0x10000, 0x1000);
+    }
+    BENCHMARK(BM_Hexdump)->Unit(benchmark::kMicrosecond);
+
+    static void BM_LuaHexdump(benchmark::State& state) {
+        RunScript(state,
+            "local bytes, fmt, lines = memory.read(" + hex(kText) + ", 0x10000), string.format, {}\n"
+            "for o = 0, 0xFFFF, 16 do local cells = {} for i = 1, 16 do cells[i] = fmt(\"%02X\", bytes[o + i]) end\n"
+            "  lines[#lines + 1] = fmt(\"%08X  %s\", " + hex(kText) + " + o, table.concat(cells, \" \")) end\n"
+            "local text = table.concat(lines, \"\\n\")",
+            0x10000, 0x1000);
+    }
+    BENCHMARK(BM_LuaHexdump)->Unit(benchmark::kMicrosecond);
+
+    // Floor for everything above: load, sandbox environment and result reporting
+    static void BM_EmptyScript(benchmark::State& state) {
+        RunScript(state, "local x = 1", 0, 0);
+    }
+    BENCHMARK(BM_EmptyScript)->Unit(benchmark::kMicrosecond);
+
+} // namespace bench
@@ -0,0 +1,131 @@
+// luda.eamap and luda.rangeset against what scripts write without them: Lua tables
+// keyed by address, plus a sorted key array where order matters
+#include "Fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+namespace bench {
+
+    constexpr int64_t kEntries = 100000;
+    constexpr int64_t kQueries = 10000;
+
+    // Scattered, 8-aligned addresses in a 64 MB window
+    static const std::string kKeys =
+        "local N = " + std::to_string(kEntries) + "\n"
+        "local function key(i) return " + hex(kText) + " + (i * 2654435761 % 0x4000000) // 8 * 8 end\n";
+
+    // Sorted keys and a binary search, the usual way of getting order out of a table
+    static const std::string kSortedKeys =
+        "local function sorted(t) local k = {} for ea in pairs(t) do k[#k + 1] = ea end table.sort(k) return k end\n"
+        "local function lower_bound(k, ea) local lo, hi = 1, #k + 1\n"
+        "  while lo < hi do local mid = (lo + hi) // 2 if k[mid] < ea then lo = mid + 1 else hi = mid end end\n"
+        "  return lo end\n";
+
+    static void BM_EaMapInsert(benchmark::State& state) {
+        RunScript(state, kKeys + "local m = luda.eamap() for i = 1, N do m[key(i)] = i end", 0, kEntries);
+    }
+    BENCHMARK(BM_EaMapInsert)->Unit(benchmark::kMicrosecond);
+
+    static void BM_TableInsert(benchmark::State& state) {
+        RunScript(state, kKeys + "local m = {} for i = 1, N do m[key(i)] = i end", 0, kEntries);
+    }
+    BENCHMARK(BM_TableInsert)->Unit(benchmark::kMicrosecond);
+
+    // Build, then look every key up four times
+    static void BM_EaMapLookup(benchmark::State& state) {
+        RunScript(state, kKeys +
+            "local m = luda.eamap() for i = 1, N do m[key(i)] = i end\n"
+            "local n = 0 for r = 1, 4 do for i = 1, N do n = n + m[key(i)] end end", 0, 5 * kEntries);
+    }
+    BENCHMARK(BM_EaMapLookup)->Unit(benchmark::kMicrosecond);
+
+    static void BM_TableLookup(benchmark::State& state) {
+        RunScript(state, kKeys +
+            "local m = {} for i = 1, N do m[key(i)] = i end\n"
+            "local n = 0 for r = 1, 4 do for i = 1, N do n = n + m[key(i)] end end", 0, 5 * kEntries);
+    }
+    BENCHMARK(BM_TableLookup)->Unit(benchmark::kMicrosecond);
+
+    // Build, then visit every entry in 10k windows of 16 KB
+    static void BM_EaMapRange(benchmark::State& state) {
+        RunScript(state, kKeys +
+            "local m = luda.eamap() for i = 1, N do m[key(i)] = i end\n"
+            "local n = 0 for q = 1, " + std::to_string(kQueries) + " do local a = key(q * 7)\n"
+            "  for ea, v in m:range(a, a + 0x4000) do n = n + v end end", 0, kEntries + kQueries);
+    }
+    BENCHMARK(BM_EaMapRange)->Unit(benchmark::kMicrosecond);
+
+    static void BM_TableRange(benchmark::State& state) {
+        RunScript(state, kKeys + kSortedKeys +
+            "local m = {} for i = 1, N do m[key(i)] = i end\n"
+            "local k = sorted(m)\n"
+            "local n = 0 for q = 1, " + std::to_string(kQueries) + " do local a = key(q * 7)\n"
+            "  local i = lower_bound(k, a) while k[i] and k[i] < a + 0x4000 do n = n + m[k[i]] i = i + 1 end end",
+            0, kEntries + kQueries);
+    }
+    BENCHMARK(BM_TableRange)->Unit(benchmark::kMicrosecond);
+
+    // Build, then find the entry at or below 100k addresses ("which function is this in")
+    static void BM_EaMapFloor(benchmark::State& state) {
+        RunScript(state, kKeys +
+            "local m = luda.eamap() for i = 1, N do m[key(i)] = i end\n"
+            "local floor, n = m.floor, 0 for q = 1, N do local ea, v = floor(m, key(q) + 5) n = n + v end",
+            0, 2 * kEntries);
+    }
+    BENCHMARK(BM_EaMapFloor)->Unit(benchmark::kMicrosecond);
+
+    static void BM_TableFloor(benchmark::State& state) {
+        RunScript(state, kKeys + kSortedKeys +
+            "local m = {} for i = 1, N do m[key(i)] = i end\n"
+            "local k = sorted(m)\n"
+            "local n = 0 for q = 1, N do local ea = key(q) + 5 local i = lower_bound(k, ea + 1) - 1\n"
+            "  n = n + m[k[i]] end",
+            0, 2 * kEntries);
+    }
+    BENCHMARK(BM_TableFloor)->Unit(benchmark::kMicrosecond);
+
+    // Two sets of 10k ranges: union, intersection, difference and 100k membership tests
+    static const std::string kRangeInputs =
+        "local R = " + std::to_string(kQueries) + "\n"
+        "local function ranges(seed) local t = {} for i = 1, R do local s = " + hex(kText) +
+        " + (i * seed % 0x1000000) t[i] = { s, s + 0x100 + i % 0x300 } end return t end\n";
+
+    static void BM_RangeSetOps(benchmark::State& state) {
+        RunScript(state, kRangeInputs +
+            "local a, b = luda.rangeset(ranges(2654435761)), luda.rangeset(ranges(40503))\n"
+            "local u, x, d = a | b, a & b, a - b\n"
+            "local n = 0 for q = 1, 10 * R do if u:contains(" + hex(kText) + " + q * 167) then n = n + 1 end end",
+            0, 12 * kQueries);
+    }
+    BENCHMARK(BM_RangeSetOps)->Unit(benchmark::kMicrosecond);
+
+    // The same over sorted {start, end} lists in Lua
+    static void BM_RangeTableOps(benchmark::State& state) {
+        RunScript(state, kRangeInputs +
+            "local function normalize(t) table.sort(t, function(p, q) return p[1] < q[1] end)\n"
+            "  local out = {} for _, r in ipairs(t) do local last = out[#out]\n"
+            "    if last and last[2] >= r[1] then if r[2] > last[2] then last[2] = r[2] end\n"
+            "    else out[#out + 1] = { r[1], r[2] } end end return out end\n"
+            "local function union(a, b) local t = {} for _, r in ipairs(a) do t[#t + 1] = r end\n"
+            "  for _, r in ipairs(b) do t[#t + 1] = r end return normalize(t) end\n"
+            "local function intersect(a, b) local out, i, j = {}, 1, 1\n"
+            "  while a[i] and b[j] do local s, e = math.max(a[i][1], b[j][1]), math.min(a[i][2], b[j][2])\n"
+            "    if s < e then out[#out + 1] = { s, e } end if a[i][2] < b[j][2] then i = i + 1 else j = j + 1 end end\n"
+            "  return out end\n"
+            "local function subtract(a, b) local out, j = {}, 1\n"
+            "  for _, r in ipairs(a) do local s, e = r[1], r[2]\n"
+            "    while b[j] and b[j][2] <= s do j = j + 1 end\n"
+            "    local k = j while b[k] and b[k][1] < e do if b[k][1] > s then out[#out + 1] = { s, b[k][1] } end\n"
+            "      if b[k][2] > s then s = b[k][2] end k = k + 1 end\n"
+            "    if s < e then out[#out + 1] = { s, e } end end return out end\n"
+            "local function contains(t, ea) local lo, hi = 1, #t + 1\n"
+            "  while lo < hi do local mid = (lo + hi) // 2 if t[mid][2] <= ea then lo = mid + 1 else hi = mid end end\n"
+            "  return t[lo] ~= nil and t[lo][1] <= ea end\n"
+            "local a, b = normalize(ranges(2654435761)), normalize(ranges(40503))\n"
+            "local u, x, d = union(a, b), intersect(a, b), subtract(a, b)\n"
+            "local n = 0 for q = 1, 10 * R do if contains(u, " + hex(kText) + " + q * 167) then n = n + 1 end end",
+            0, 12 * kQueries);
+    }
+    BENCHMARK(BM_RangeTableOps)->Unit(benchmark::kMicrosecond);
+
+} // namespace bench
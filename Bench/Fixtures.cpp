@@ -0,0 +1,197 @@
+#include "Fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace bench {
+
+    static const char* const kMnemonics[] = { "mov", "lea", "call", "cmp", "jne", "add", "xor", "test", "push", "pop", "ret" };
+    static const char* const kOperands[] = { "rax, qword ptr [rbx+0x18]", "rcx, [rip+0x2a1f0]", "0x140012a40", "eax, 0xffffffff",
+        "0x1400013b0", "rsp, 0x28", "edx, edx", "r8d, r8d", "rbp", "rdi", "" };
+
+    static void build(LUDA::MemoryBackend& db) {
+        std::mt19937_64 rng(0x4C554441);
+        std::vector<uint8_t> image(kImageSize);
+        for (size_t i = 0; i < kRdata - kBase; i += 8) {
+            uint64_t word = rng();
+            for (size_t b = 0; b < 8; ++b) image[i + b] = static_cast<uint8_t>(word >> (b * 8));
+        }
+
+        db.add_segment(kText, kRdata, ".text");
+        db.add_segment(kRdata, kBase + kImageSize, ".rdata");
+
+        char name[64];
+        for (size_t i = 0; i < kFunctionCount; ++i) {
+            ea_t start = kText + i * kFunctionSize;
+            snprintf(name, sizeof(name), "sub_%llX", static_cast<unsigned long long>(start));
+            db.add_function(start, start + kFunctionSize, name);
+        }
+
+        // Call sites anywhere in .text
+        for (size_t i = 0; i < kHotXrefs; ++i) {
+            db.add_xref(kText + rng() % (kFunctionCount * kFunctionSize), kHotTarget, LUDA::XrefKind::code);
+        }
+
+        // Strings back to back in .rdata, each referenced from some function
+        size_t offset = kRdata - kBase;
+        for (size_t i = 0; i < kStringCount; ++i) {
+            int len = snprintf(name, sizeof(name), i % 100 == 0 ? "%zu: needle in %s" : "%zu: format %s",
+                i, kOperands[i % (sizeof(kOperands) / sizeof(kOperands[0]))]);
+            memcpy(&image[offset], name, static_cast<size_t>(len) + 1);
+            db.add_string(kBase + offset);
+            db.add_xref(kText + (i % kFunctionCount) * kFunctionSize + 16, kBase + offset, LUDA::XrefKind::data);
+            offset += static_cast<size_t>(len) + 1;
+        }
+
+        db.set_image(std::move(image), kBase);
+    }
+
+    LUDA::MemoryBackend& database() {
+        static LUDA::MemoryBackend* db = [] {
+            auto* created = new LUDA::MemoryBackend();
+            build(*created);
+            return created;
+        }();
+        return *db;
+    }
+
+    Executor& executor() {
+        static Executor* instance = [] {
+            LUDA::set_backend(&database());
+            auto* created = new Executor();
+            created->initialize();
+            return created;
+        }();
+        return *instance;
+    }
+
+    bool run(const std::string& script) {
+        return executor().run_script(script);
+    }
+
+    void RunScript(benchmark::State& state, const std::string& script, int64_t bytes, int64_t items) {
+        executor();
+        for (auto _ : state) {
+            if (!run(script)) {
+                state.SkipWithError("script failed");
+                return;
+            }
+        }
+        if (bytes) state.SetBytesProcessed(state.iterations() * bytes);
+        if (items) state.SetItemsProcessed(state.iterations() * items);
+    }
+
+    std::string listing(size_t size) {
+        std::mt19937 rng(7);
+        std::string text;
+        text.reserve(size + 128);
+        char line[160];
+        ea_t ea = kText;
+        while (text.size() < size) {
+            int n = snprintf(line, sizeof(line), "   %llx:\t%02x %02x %02x %02x \t%s\t%s\n",
+                static_cast<unsigned long long>(ea), static_cast<unsigned>(rng() & 0xFF), static_cast<unsigned>(rng() & 0xFF),
+                static_cast<unsigned>(rng() & 0xFF), static_cast<unsigned>(rng() & 0xFF),
+                kMnemonics[rng() % (sizeof(kMnemonics) / sizeof(kMnemonics[0]))],
+                kOperands[rng() % (sizeof(kOperands) / sizeof(kOperands[0]))]);
+            text.append(line, static_cast<size_t>(n));
+            ea += 4;
+        }
+        text.resize(size);
+        return text;
+    }
+
+    // What pseudocode() builds functions from: argument and local types, the registers named
+    // in local comments, and statements over those variables
+    static const char* const kTypes[] = { "__int64", "unsigned int", "int", "_QWORD *", "char *", "_BYTE *",
+        "unsigned __int8", "_DWORD *", "void *", "bool" };
+    static const char* const kRegisters[] = { "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r14", "r15" };
+    static const char* const kFormats[] = { "%s: bad header", "failed to open %s", "[%d] %s", "invalid size 0x%X" };
+
+    std::string pseudocode(size_t size) {
+        std::mt19937 rng(0x4C554441);
+        std::string text;
+        text.reserve(size + 4096);
+        char line[512];
+        auto pick = [&](auto& names) { return names[rng() % (sizeof(names) / sizeof(names[0]))]; };
+        auto callee = [&] { return static_cast<unsigned long long>(kText + rng() % kFunctionCount * kFunctionSize); };
+        for (ea_t ea = kText; text.size() < size; ea += kFunctionSize) {
+            unsigned args = 1 + rng() % 4;
+            unsigned vars = args + 2 + rng() % 8;
+            auto var = [&] {
+                unsigned index = rng() % vars;
+                char name[16];
+                snprintf(name, sizeof(name), index < args ? "a%u" : "v%u", index < args ? index + 1 : index);
+                return std::string(name);
+            };
+
+            snprintf(line, sizeof(line), "%s __fastcall sub_%llX(", pick(kTypes), static_cast<unsigned long long>(ea));
+            text += line;
+            for (unsigned i = 0; i < args; ++i) {
+                snprintf(line, sizeof(line), "%s%s a%u", i ? ", " : "", pick(kTypes), i + 1);
+                text += line;
+            }
+            text += ")\n{\n";
+            for (unsigned i = args; i < vars; ++i) {
+                snprintf(line, sizeof(line), "  %s v%u; // %s\n", pick(kTypes), i, pick(kRegisters));
+                text += line;
+            }
+            text += '\n';
+
+            unsigned statements = 4 + rng() % 16;
+            for (unsigned i = 0; i < statements; ++i) {
+                std::string a = var();
+                std::string b = var();
+                unsigned offset = rng() % 64 * 8;
+                switch (rng() % 10) {
+                case 0:
+                    snprintf(line, sizeof(line), "  %s = *(_QWORD *)(%s + 0x%X);\n", a.c_str(), b.c_str(), offset);
+                    break;
+                case 1:
+                    snprintf(line, sizeof(line), "  %s = sub_%llX(%s, %u);\n", a.c_str(), callee(), b.c_str(), offset);
+                    break;
+                case 2:
+                    snprintf(line, sizeof(line), "  if ( !%s )\n    return 0i64;\n", a.c_str());
+                    break;
+                case 3:
+                    snprintf(line, sizeof(line), "  *(_DWORD *)(%s + 0x%X) = %s;\n", a.c_str(), offset, b.c_str());
+                    break;
+                case 4:
+                    snprintf(line, sizeof(line), "  if ( %s >= *(unsigned int *)(%s + 0x%X) )\n  {\n    sub_%llX(%s);\n"
+                        "    goto LABEL_%u;\n  }\n", a.c_str(), b.c_str(), offset, callee(), a.c_str(), i + 1);
+                    break;
+                case 5:
+                    snprintf(line, sizeof(line), "  while ( %s < 0x%X )\n  {\n    %s = (_QWORD *)sub_%llX(%s, %s);\n"
+                        "    ++%s;\n  }\n", a.c_str(), offset, b.c_str(), callee(), b.c_str(), a.c_str(), a.c_str());
+                    break;
+                case 6:
+                    snprintf(line, sizeof(line), "  %s = %s & 0x%X;\n", a.c_str(), b.c_str(), static_cast<unsigned>(rng()));
+                    break;
+                case 7:
+                    snprintf(line, sizeof(line), "  memset(%s, 0, 0x%Xui64);\n", a.c_str(), offset);
+                    break;
+                case 8:
+                    snprintf(line, sizeof(line), "  sub_%llX(\"%s\", %s);\n", callee(), pick(kFormats), a.c_str());
+                    break;
+                default:
+                    snprintf(line, sizeof(line), "  for ( %s = 0; %s < 0x%X; ++%s )\n    *(_BYTE *)(%s + %s) ^= 0x%Xu;\n",
+                        a.c_str(), a.c_str(), offset, a.c_str(), b.c_str(), a.c_str(), static_cast<unsigned>(rng() % 256));
+                    break;
+                }
+                text += line;
+            }
+            text += "  return " + var() + ";\n}\n\n";
+        }
+        text.resize(size);
+        return text;
+    }
+
+    std::string hex(ea_t ea) {
+        char text[24];
+        snprintf(text, sizeof(text), "0x%llX", static_cast<unsigned long long>(ea));
+        return text;
+    }
+
+} // namespace bench
@@ -0,0 +1,49 @@
+#pragma once
+// Shared inputs for luda_bench: a synthetic database behind the in-memory backend,
+// an executor bound to it, and representative text for the socket paths.
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include <Executor/Executor.h>
+#include <Executor/MemoryBackend.h>
+
+namespace benchmark { class State; }
+
+namespace bench {
+
+    // Layout of the synthetic database
+    constexpr ea_t kBase = 0x140000000;
+    constexpr ea_t kText = kBase + 0x1000;            // .text, functions back to back
+    constexpr ea_t kRdata = kBase + 0x800000;         // .rdata, string literals
+    constexpr size_t kImageSize = 0x1000000;          // 16 MB
+    constexpr size_t kFunctionCount = 50000;
+    constexpr size_t kFunctionSize = 128;
+    constexpr size_t kStringCount = 50000;
+    constexpr size_t kHotXrefs = 100000;              // code xrefs to kHotTarget
+    constexpr ea_t kHotTarget = kText;
+
+    // 16 MB image, 50k named functions, 50k strings (one in 100 holds "needle"),
+    // 100k calls to kHotTarget and a data xref to every string. Built on first use.
+    LUDA::MemoryBackend& database();
+
+    // Initialized executor working on database()
+    Executor& executor();
+
+    // Runs `script`, false if it raised an error
+    bool run(const std::string& script);
+
+    // Benchmark body: one iteration is one run of `script`; bytes and items (if not 0)
+    // count what a run processed
+    void RunScript(benchmark::State& state, const std::string& script, int64_t bytes, int64_t items);
+
+    // Disassembly listing in objdump's layout, `size` bytes of it
+    std::string listing(size_t size);
+
+    // Decompiler output, functions in Hex-Rays' C-like layout, `size` bytes of it
+    std::string pseudocode(size_t size);
+
+    // "0x..." literal for scripts
+    std::string hex(ea_t ea);
+
+} // namespace bench
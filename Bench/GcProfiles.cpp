@@ -0,0 +1,42 @@
+// luda.gc profiles ("--@gc <profile>") on the two allocation-heavy workloads: a listing of
+// per-instruction rows, and every string in the database turned into row tables
+#include "Fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+namespace bench {
+
+    static const char* const kProfiles[] = { "default", "generational", "batch", "throughput", "lowmemory" };
+
+    static void RunWithProfile(benchmark::State& state, const std::string& script, int64_t items) {
+        const char* profile = kProfiles[state.range(0)];
+        state.SetLabel(profile);
+        RunScript(state, std::string("--@gc ") + profile + "\n" + script, 0, items);
+    }
+
+    // What a disassembly script holds: one table per instruction with its text fields. The
+    // in-memory backend has no decoder, so rows come from the code bytes, 4 per instruction.
+    static void BM_GcDisassemblyRows(benchmark::State& state) {
+        RunWithProfile(state,
+            "local code, rows = memory.read_buffer(" + hex(kText) + ", 0x80000), {}\n"
+            "local mnemonics = { 'mov', 'lea', 'call', 'cmp', 'jne', 'add', 'xor', 'test' }\n"
+            "for i = 1, #code - 3, 4 do\n"
+            "  rows[#rows + 1] = { ea = " + hex(kText) + " + i - 1, bytes = code:tostring(i, i + 3),\n"
+            "    mnemonic = mnemonics[code[i] % 8 + 1], operands = 'r' .. code[i + 1] .. ', 0x' .. hex(code[i + 2]) }\n"
+            "end\n"
+            "assert(#rows == 0x20000)",
+            0x20000);
+    }
+    BENCHMARK(BM_GcDisassemblyRows)->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
+
+    static void BM_GcStringsSearch(benchmark::State& state) {
+        RunWithProfile(state,
+            "local found = strings.search(\"\"):totable()\n"
+            "local words = 0\n"
+            "for _, s in ipairs(found) do for w in s.string:gmatch('%a+') do words = words + 1 end end\n"
+            "assert(#found == " + std::to_string(kStringCount) + " and words > 0)",
+            kStringCount);
+    }
+    BENCHMARK(BM_GcStringsSearch)->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
+
+} // namespace bench
@@ -0,0 +1,21 @@
+// luda_bench: Google Benchmark runner for the bindings and LudaSocket.
+// Machine-readable results: --benchmark_out=results.json --benchmark_out_format=json
+// (the `bench` target does this); compare two runs with benchmark's tools/compare.py.
+#include <benchmark/benchmark.h>
+
+#ifndef LUDA_BENCH_COMMIT
+#define LUDA_BENCH_COMMIT "unknown"
+#endif
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    // Tags every result file with the source it measured
+    benchmark::AddCustomContext("luda_commit", LUDA_BENCH_COMMIT);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
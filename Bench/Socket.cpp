@@ -0,0 +1,407 @@
+// LudaSocket code paths: JSON, frame decoding, HTTP parsing, compression, and the
+// whole send path over a loopback connection
+#include "Fixtures.h"
+
+#include <LudaSocket/json.h>
+#include <LudaSocket/wsframe.h>
+#include <LudaSocket/http.h>
+#include <LudaSocket/deflate.h>
+#include <LudaSocket/platform.h>
+
+#include <Executor/Allocator.h>
+#include <Executor/Libraries/msgpack.hpp>
+#include <Executor/Libraries/structs.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace bench {
+
+    static void BM_JsonEscape(benchmark::State& state) {
+        std::string text = listing(static_cast<size_t>(state.range(0)));
+        std::string out;
+        for (auto _ : state) {
+            out.clear();
+            luda::json::AppendEscaped(out, text);
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_JsonEscape)->Arg(64 << 10)->Arg(4 << 20)->Unit(benchmark::kMicrosecond);
+
+    static void BM_JsonCreateMessage(benchmark::State& state) {
+        std::string text = listing(static_cast<size_t>(state.range(0)));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(luda::json::CreateMessage("output", text));
+        }
+        state.SetBytesProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_JsonCreateMessage)->Arg(4 << 20)->Unit(benchmark::kMicrosecond);
+
+    // An execute request carrying a large script
+    static void BM_JsonParseRequest(benchmark::State& state) {
+        std::string request = "{\"type\":\"execute\",\"id\":42,\"options\":{\"gc\":\"batch\"},\"script\":\"" +
+            luda::json::Escape(listing(static_cast<size_t>(state.range(0)))) + "\"}";
+        luda::json::Handler ignore;
+        for (auto _ : state) {
+            if (!luda::json::Parse(request, ignore)) {
+                state.SkipWithError("parse failed");
+                return;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(request.size()));
+    }
+    BENCHMARK(BM_JsonParseRequest)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+
+    // Client-to-server frame: FIN + opcode, masked, 64-bit length
+    static std::vector<uint8_t> MaskedFrame(size_t size) {
+        const uint8_t mask[4] = { 0x37, 0xFA, 0x21, 0x3D };
+        std::vector<uint8_t> frame = { 0x81, 0xFF };
+        for (int i = 7; i >= 0; --i) frame.push_back(static_cast<uint8_t>(static_cast<uint64_t>(size) >> (i * 8)));
+        frame.insert(frame.end(), mask, mask + 4);
+        std::string text = listing(size);
+        for (size_t i = 0; i < size; ++i) frame.push_back(static_cast<uint8_t>(text[i]) ^ mask[i & 3]);
+        return frame;
+    }
+
+    // Arg: message size; fed in 64 KB reads like the socket hands it over
+    static void BM_FrameDecode(benchmark::State& state) {
+        std::vector<uint8_t> frame = MaskedFrame(static_cast<size_t>(state.range(0)));
+        luda::FrameDecoder decoder;
+        decoder.RequireMasked(true);
+        size_t messages = 0;
+        auto handler = [&](const luda::WsMessage& message) {
+            messages += message.size > 0;
+            return true;
+        };
+        for (auto _ : state) {
+            for (size_t offset = 0; offset < frame.size(); offset += 64 * 1024) {
+                size_t len = std::min<size_t>(64 * 1024, frame.size() - offset);
+                if (decoder.Feed(frame.data() + offset, len, handler) != luda::FrameDecoder::Result::Ok) {
+                    state.SkipWithError(decoder.Error());
+                    return;
+                }
+            }
+        }
+        benchmark::DoNotOptimize(messages);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame.size()));
+    }
+    BENCHMARK(BM_FrameDecode)->Arg(4 << 10)->Arg(4 << 20)->Unit(benchmark::kMicrosecond);
+
+    static void BM_HttpParsePipelined(benchmark::State& state) {
+        std::string body = "{\"script\":\"print(hex(image.base()))\"}";
+        std::string request = "POST /run HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: bench\r\n"
+            "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        std::string stream;
+        for (int i = 0; i < 1000; ++i) stream += request;
+
+        luda::HttpParser parser;
+        size_t requests = 0;
+        auto handler = [&](luda::HttpRequest&) {
+            requests++;
+            return true;
+        };
+        for (auto _ : state) {
+            parser.Feed(reinterpret_cast<const uint8_t*>(stream.data()), stream.size(), handler);
+        }
+        benchmark::DoNotOptimize(requests);
+        state.SetItemsProcessed(state.iterations() * 1000);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(stream.size()));
+    }
+    BENCHMARK(BM_HttpParsePipelined)->Unit(benchmark::kMicrosecond);
+
+    // Args: zlib level, corpus (0 disassembly listing, 1 decompiler pseudocode)
+    static void BM_DeflateCompress(benchmark::State& state) {
+        if (!luda::DeflateAvailable()) {
+            state.SkipWithError("built without zlib");
+            return;
+        }
+        bool pseudo = state.range(1) != 0;
+        std::string text = pseudo ? pseudocode(1 << 20) : listing(1 << 20);
+        state.SetLabel(pseudo ? "pseudocode" : "listing");
+        luda::MessageDeflate deflate;
+        luda::DeflateParams params;
+        params.serverNoContextTakeover = true;
+        deflate.Start(params, static_cast<int>(state.range(0)));
+        std::string out;
+        for (auto _ : state) {
+            deflate.Compress(reinterpret_cast<const uint8_t*>(text.data()), text.size(), out);
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+        state.counters["ratio"] = static_cast<double>(text.size()) / static_cast<double>(out.size());
+    }
+    BENCHMARK(BM_DeflateCompress)->ArgsProduct({ { 1, 6 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+
+    /*
+        Structured results: 5k function rows (integers, strings, a nested table and 16
+        bytes as a buffer), built once per run and encoded 10 times, by the MessagePack
+        encoder behind luda.emit or by the JSON encoder a script would otherwise write
+        itself.
+    */
+    constexpr int64_t kResultRows = 5000;
+    constexpr int64_t kEncodes = 10;
+
+    static const std::string kResults =
+        "local rows = {}\n"
+        "for i = 1, " + std::to_string(kResultRows) + " do\n"
+        "  local ea = " + hex(kText) + " + (i - 1) * 128\n"
+        "  rows[i] = { ea = ea, name = string.format(\"sub_%X\", ea), size = 128, library = i % 7 == 0,\n"
+        "    comment = \"calls \\\"helper\\\"\\tand returns\", refs = { ea + 16, ea + 32, ea + 48 },\n"
+        "    bytes = buffer.from(string.pack('<I8I8', ea, ~ea)) }\n"
+        "end\n";
+
+    // encode(value) -> size, luda.emit's encoding without the send: with no job running
+    // emit goes to every connected session, which would put the loopback benchmarks'
+    // client in this one
+    static int EncodeMessagePack(lua_State* L) {
+        static std::vector<uint8_t> out;
+        out.clear();
+        LUDA::Library::msgpack_encode(L, 1, out, 0);
+        lua_pushinteger(L, static_cast<lua_Integer>(out.size()));
+        return 1;
+    }
+
+    // On a state of its own over the executor's allocator, with the value types the
+    // executor registers
+    static void BM_EmitMessagePack(benchmark::State& state) {
+        LUDA::Allocator pool;
+        lua_State* L = lua_newstate(LUDA::Allocator::alloc, &pool, luaL_makeseed(nullptr));
+        luaL_openlibs(L);
+        LUDA::Library::register_buffer_type(L);
+        LUDA::Library::register_array_type(L);
+        LUDA::Library::register_records_type(L);
+        LUDA::Library::register_struct_type(L);
+        luaL_Reg buffer[] = { { "new", LUDA::Library::c_buffer_new }, { "from", LUDA::Library::c_buffer_from }, { nullptr, nullptr } };
+        luaL_newlib(L, buffer);
+        lua_setglobal(L, "buffer");
+        luaL_Reg luda[] = { { "u64array", LUDA::Library::c_u64array_new }, { "u32array", LUDA::Library::c_u32array_new },
+            { "u8array", LUDA::Library::c_u8array_new }, { nullptr, nullptr } };
+        luaL_newlib(L, luda);
+        lua_setglobal(L, "luda");
+        luaL_Reg structs[] = { { "compile", LUDA::Library::c_struct_compile }, { nullptr, nullptr } };
+        luaL_newlib(L, structs);
+        lua_setglobal(L, "struct");
+        lua_register(L, "encode", EncodeMessagePack);
+
+        std::string script = kResults +
+            "for _ = 1, " + std::to_string(kEncodes) + " do assert(encode(rows) > 0) end";
+        for (auto _ : state) {
+            if (luaL_dostring(L, script.c_str()) != LUA_OK) {
+                state.SkipWithError(lua_tostring(L, -1));
+                break;
+            }
+        }
+        lua_close(L);
+        state.SetItemsProcessed(state.iterations() * kResultRows * kEncodes);
+    }
+    BENCHMARK(BM_EmitMessagePack)->Unit(benchmark::kMicrosecond);
+
+    static void BM_EmitNaiveJson(benchmark::State& state) {
+        RunScript(state, kResults +
+            "local escapes = { ['\"'] = '\\\\\"', ['\\\\'] = '\\\\\\\\', ['\\n'] = '\\\\n', ['\\t'] = '\\\\t' }\n"
+            "local function quote(s)\n"
+            "  return '\"' .. s:gsub('[%c\"\\\\]', function(c) return escapes[c] or string.format('\\\\u%04x', c:byte()) end) .. '\"'\n"
+            "end\n"
+            "local function encode(v, out)\n"
+            "  local t = type(v)\n"
+            "  if t == 'table' and #v > 0 then\n"
+            "    out[#out + 1] = '['\n"
+            "    for i = 1, #v do if i > 1 then out[#out + 1] = ',' end encode(v[i], out) end\n"
+            "    out[#out + 1] = ']'\n"
+            "  elseif t == 'table' then\n"
+            "    out[#out + 1] = '{'\n"
+            "    local first = true\n"
+            "    for k, x in pairs(v) do\n"
+            "      if not first then out[#out + 1] = ',' end\n"
+            "      first = false\n"
+            "      out[#out + 1] = quote(tostring(k)) .. ':'\n"
+            "      encode(x, out)\n"
+            "    end\n"
+            "    out[#out + 1] = '}'\n"
+            "  elseif t == 'string' then out[#out + 1] = quote(v)\n"
+            "  elseif t == 'userdata' then\n"
+            "    out[#out + 1] = '\"' .. v:tostring():gsub('.', function(c) return string.format('%02x', c:byte()) end) .. '\"'\n"
+            "  else out[#out + 1] = tostring(v) end\n"
+            "end\n"
+            "for _ = 1, " + std::to_string(kEncodes) + " do\n"
+            "  local out = {}\n"
+            "  encode(rows, out)\n"
+            "  assert(#table.concat(out) > 0)\n"
+            "end",
+            0, kResultRows * kEncodes);
+    }
+    BENCHMARK(BM_EmitNaiveJson)->Unit(benchmark::kMicrosecond);
+
+    /*
+        A raw WebSocket client on loopback. A reader thread drains whatever the server
+        sends and counts the frames at least `minSize` long once all their bytes are in,
+        so a benchmark iteration covers escaping, framing, the outbox and the kernel.
+    */
+    class LoopbackClient {
+    public:
+        static LoopbackClient& Get() {
+            static LoopbackClient* client = new LoopbackClient();
+            return *client;
+        }
+
+        bool Connected() const { return m_socket != INVALID_SOCKET; }
+
+        // Frames from now on count if their payload is at least `minSize`
+        void Watch(size_t minSize) { m_minSize = minSize; }
+
+        // Wait until `count` large frames have arrived in total; false if the server hung up
+        bool WaitFor(uint64_t count) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_arrived.wait(lock, [&] { return m_frames >= count || m_closed; });
+            return m_frames >= count;
+        }
+
+        uint64_t Frames() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_frames;
+        }
+
+    private:
+        LoopbackClient() {
+            uint16_t port = 0;
+            for (uint16_t candidate = 18080; candidate < 18112 && port == 0; ++candidate) {
+                if (luda::Start(candidate)) port = candidate;
+            }
+            if (port == 0) return;
+
+            SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (s == INVALID_SOCKET || connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+                if (s != INVALID_SOCKET) closesocket(s);
+                return;
+            }
+
+            std::string handshake = "GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+            luda::net::Send(s, handshake.data(), handshake.size());
+            std::string response;
+            char c;
+            while (response.find("\r\n\r\n") == std::string::npos && luda::net::Recv(s, &c, 1) == 1) {
+                response += c;
+            }
+            if (response.compare(0, 12, "HTTP/1.1 101") != 0) {
+                closesocket(s);
+                return;
+            }
+
+            m_socket = s;
+            std::thread(&LoopbackClient::ReadLoop, this).detach();
+            // The connection is registered once the loop thread handled the handshake
+            while (luda::SessionCount() == 0) std::this_thread::yield();
+        }
+
+        void ReadLoop() {
+            std::vector<uint8_t> buffer(256 * 1024);
+            size_t have = 0;
+            uint64_t remaining = 0;   // payload bytes of the current frame still to come
+            bool counted = false;     // the current frame is one we count
+            while (true) {
+                int n = luda::net::Recv(m_socket, buffer.data() + have, buffer.size() - have);
+                if (n <= 0) break;
+                have += static_cast<size_t>(n);
+
+                size_t pos = 0;
+                while (true) {
+                    if (remaining > 0) {
+                        size_t take = static_cast<size_t>(std::min<uint64_t>(remaining, have - pos));
+                        remaining -= take;
+                        pos += take;
+                        if (remaining > 0) break;
+                        if (counted) Count();
+                        continue;
+                    }
+                    if (have - pos < 2) break;
+                    uint8_t len7 = buffer[pos + 1] & 0x7F;
+                    size_t headLen = 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0);
+                    if (have - pos < headLen) break;
+                    uint64_t len = len7;
+                    if (len7 >= 126) {
+                        len = 0;
+                        for (size_t i = 2; i < headLen; ++i) len = (len << 8) | buffer[pos + i];
+                    }
+                    pos += headLen;
+                    remaining = len;
+                    counted = len >= m_minSize.load();
+                    if (remaining == 0 && counted) Count();
+                }
+                memmove(buffer.data(), buffer.data() + pos, have - pos);
+                have -= pos;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_arrived.notify_all();
+        }
+
+        void Count() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_frames++;
+            m_arrived.notify_all();
+        }
+
+        SOCKET m_socket = INVALID_SOCKET;
+        std::atomic<size_t> m_minSize{ SIZE_MAX };
+        std::mutex m_mutex;
+        std::condition_variable m_arrived;
+        uint64_t m_frames = 0;
+        bool m_closed = false;
+    };
+
+    // Text message to every client: JSON escaping, framing and the outbox, delivered
+    static void BM_SendOutputLoopback(benchmark::State& state) {
+        LoopbackClient& client = LoopbackClient::Get();
+        if (!client.Connected()) {
+            state.SkipWithError("no loopback connection");
+            return;
+        }
+        size_t size = static_cast<size_t>(state.range(0));
+        std::string text = listing(size);
+        client.Watch(size);
+        uint64_t frames = client.Frames();
+        for (auto _ : state) {
+            luda::SendOutput(text);
+            if (!client.WaitFor(++frames)) {
+                state.SkipWithError("connection closed");
+                return;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size));
+    }
+    BENCHMARK(BM_SendOutputLoopback)->Arg(64 << 10)->Arg(4 << 20)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+    // Binary message, written from the caller's buffer
+    static void BM_SendBinaryLoopback(benchmark::State& state) {
+        LoopbackClient& client = LoopbackClient::Get();
+        if (!client.Connected()) {
+            state.SkipWithError("no loopback connection");
+            return;
+        }
+        size_t size = static_cast<size_t>(state.range(0));
+        const std::vector<uint8_t>& image = database().image();
+        client.Watch(size);
+        uint64_t frames = client.Frames();
+        for (auto _ : state) {
+            luda::SendBinary(luda::BinaryKind::Memory, luda::BinaryEncoding::Raw, image.data(), size, kBase);
+            if (!client.WaitFor(++frames)) {
+                state.SkipWithError("connection closed");
+                return;
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size));
+    }
+    BENCHMARK(BM_SendBinaryLoopback)->Arg(64 << 10)->Arg(4 << 20)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+} // namespace bench
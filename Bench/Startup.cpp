@@ -0,0 +1,70 @@
+// Executor startup with a user prelude: running the prelude cold against restoring the
+// snapshot it left behind. Both start from a fresh state with the standard libraries.
+#include "Fixtures.h"
+
+#include <Executor/Snapshot.h>
+
+#include <benchmark/benchmark.h>
+
+namespace bench {
+
+    // Helpers with shared upvalues and tables that take real work to build, like a
+    // prelude of lookup tables and wrappers
+    static const std::string kPrelude =
+        "local registers = {}\n"
+        "for i, r in ipairs({ 'rax', 'rbx', 'rcx', 'rdx', 'rsi', 'rdi', 'rbp', 'rsp' }) do registers[r] = i end\n"
+        "opcodes = {}\n"
+        "for i = 0, 20000 do opcodes[string.format('op_%04X', i)] = { id = i, name = 'op' .. i, size = i % 15 + 1 } end\n"
+        "local calls = 0\n"
+        "helpers = {}\n"
+        "for i = 1, 300 do helpers['h' .. i] = function(x) calls = calls + 1 return x + i + (registers.rax or 0) end end\n"
+        "function count_calls() return calls end\n";
+
+    static lua_State* baseline_state() {
+        lua_State* L = luaL_newstate();
+        luaL_openlibs(L);
+        LUDA::Snapshot::capture_baseline(L);
+        return L;
+    }
+
+    static void BM_PreludeCold(benchmark::State& state) {
+        for (auto _ : state) {
+            lua_State* L = baseline_state();
+            if (luaL_loadbuffer(L, kPrelude.data(), kPrelude.size(), "@prelude") != 0 || lua_pcall(L, 0, 0, 0) != 0) {
+                state.SkipWithError("prelude failed");
+                lua_close(L);
+                return;
+            }
+            lua_close(L);
+        }
+    }
+    BENCHMARK(BM_PreludeCold)->Unit(benchmark::kMicrosecond);
+
+    static void BM_PreludeRestore(benchmark::State& state) {
+        uint64_t source_hash = LUDA::Snapshot::hash(kPrelude);
+        std::string blob, error;
+        {
+            lua_State* L = baseline_state();
+            bool saved = luaL_loadbuffer(L, kPrelude.data(), kPrelude.size(), "@prelude") == 0 && lua_pcall(L, 0, 0, 0) == 0 &&
+                LUDA::Snapshot::save(L, source_hash, blob, error);
+            lua_close(L);
+            if (!saved) {
+                state.SkipWithError("snapshot failed");
+                return;
+            }
+        }
+
+        for (auto _ : state) {
+            lua_State* L = baseline_state();
+            if (!LUDA::Snapshot::restore(L, blob, source_hash, error)) {
+                state.SkipWithError("restore failed");
+                lua_close(L);
+                return;
+            }
+            lua_close(L);
+        }
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(blob.size()));
+    }
+    BENCHMARK(BM_PreludeRestore)->Unit(benchmark::kMicrosecond);
+
+} // namespace bench
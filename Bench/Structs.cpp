@@ -0,0 +1,56 @@
+// struct.compile against the Lua it replaces: 100k pointer-table entries read from the
+// database, and 100k 16-byte records parsed out of a buffer
+#include "Fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+namespace bench {
+
+    constexpr int64_t kEntries = 100000;
+
+    static void BM_StructPointerTable(benchmark::State& state) {
+        RunScript(state,
+            "local entry = struct.compile(\"u64 target\")\n"
+            "local targets = entry:decode_many(" + hex(kText) + ", " + std::to_string(kEntries) + "):column(\"target\")\n"
+            "assert(#targets == " + std::to_string(kEntries) + ")",
+            kEntries * 8, kEntries);
+    }
+    BENCHMARK(BM_StructPointerTable)->Unit(benchmark::kMicrosecond);
+
+    // memory.read and little-endian assembly by hand, the pre-struct way
+    static void BM_LuaPointerTable(benchmark::State& state) {
+        RunScript(state,
+            "local bytes = memory.read(" + hex(kText) + ", " + std::to_string(kEntries * 8) + ")\n"
+            "local targets = {}\n"
+            "for i = 0, " + std::to_string(kEntries - 1) + " do local o = i * 8 local v = 0\n"
+            "  for b = 8, 1, -1 do v = (v << 8) | bytes[o + b] end targets[i + 1] = v end\n"
+            "assert(#targets == " + std::to_string(kEntries) + ")",
+            kEntries * 8, kEntries);
+    }
+    BENCHMARK(BM_LuaPointerTable)->Unit(benchmark::kMicrosecond);
+
+    static const std::string kRecordBuffer =
+        "local buf = memory.read_buffer(" + hex(kText) + ", " + std::to_string(kEntries * 16) + ")\n";
+
+    static void BM_StructRecords(benchmark::State& state) {
+        RunScript(state, kRecordBuffer +
+            "local rec = struct.compile(\"u32 rva; u16 kind; u16 flags; u64 target\")\n"
+            "local rows = rec:decode_many(buf)\n"
+            "local n = 0 for i = 1, #rows, 97 do n = n + rows[i].kind end",
+            kEntries * 16, kEntries);
+    }
+    BENCHMARK(BM_StructRecords)->Unit(benchmark::kMicrosecond);
+
+    // string.unpack per record, the best plain Lua does
+    static void BM_UnpackRecords(benchmark::State& state) {
+        RunScript(state, kRecordBuffer +
+            "local s, unpack = buf:tostring(), string.unpack\n"
+            "local rows = {}\n"
+            "for i = 1, " + std::to_string(kEntries) + " do local rva, kind, flags, target = unpack(\"<I4I2I2i8\", s, i * 16 - 15)\n"
+            "  rows[i] = { rva = rva, kind = kind, flags = flags, target = target } end\n"
+            "local n = 0 for i = 1, #rows, 97 do n = n + rows[i].kind end",
+            kEntries * 16, kEntries);
+    }
+    BENCHMARK(BM_UnpackRecords)->Unit(benchmark::kMicrosecond);
+
+} // namespace bench
@@ -0,0 +1,170 @@
+#include "Allocator.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace LUDA
+{
+	// Keeps the first block of every chunk 16-byte aligned
+	static constexpr size_t kChunkHeader = 16;
+
+	Allocator::~Allocator()
+	{
+		while (m_chunks != nullptr) {
+			Chunk* next = m_chunks->next;
+			free(m_chunks);
+			m_chunks = next;
+		}
+	}
+
+	double Allocator::fragmentation() const
+	{
+		if (m_stats.small_reserved == 0) {
+			return 0.0;
+		}
+		return 1.0 - (double)m_stats.small_in_use / (double)m_stats.small_reserved;
+	}
+
+	bool Allocator::refill(size_t cls)
+	{
+		Chunk* chunk = (Chunk*)malloc(kChunkSize);
+		if (chunk == nullptr) {
+			return false;
+		}
+		chunk->next = m_chunks;
+		m_chunks = chunk;
+		m_stats.small_reserved += kChunkSize;
+
+		/* Thread the chunk onto the free list back to front so blocks come out in address order */
+		size_t size = class_size(cls);
+		size_t count = (kChunkSize - kChunkHeader) / size;
+		char* first = (char*)chunk + kChunkHeader;
+		FreeBlock* head = m_free[cls];
+		for (size_t i = count; i > 0; i--) {
+			FreeBlock* block = (FreeBlock*)(first + (i - 1) * size);
+			block->next = head;
+			head = block;
+		}
+		m_free[cls] = head;
+		return true;
+	}
+
+	bool Allocator::over_limit(size_t grow)
+	{
+		if (m_limit != 0 && m_stats.in_use + grow > m_limit) {
+			m_limit_hit = true;
+			return true;
+		}
+		return false;
+	}
+
+	void* Allocator::allocate(size_t size)
+	{
+		void* ptr;
+		if (size > kMaxSmall) {
+			ptr = malloc(size);
+			if (ptr == nullptr) return nullptr;
+			m_stats.large_in_use += size;
+		}
+		else {
+			size_t cls = class_of(size);
+			if (m_free[cls] == nullptr && !refill(cls)) {
+				return nullptr;
+			}
+			FreeBlock* block = m_free[cls];
+			m_free[cls] = block->next;
+			m_stats.small_in_use += class_size(cls);
+			m_stats.class_live[cls]++;
+			ptr = block;
+		}
+
+		m_stats.allocations++;
+		m_stats.in_use += size;
+		if (m_stats.in_use > m_stats.peak) {
+			m_stats.peak = m_stats.in_use;
+		}
+		return ptr;
+	}
+
+	void Allocator::release(void* ptr, size_t size)
+	{
+		if (size > kMaxSmall) {
+			free(ptr);
+			m_stats.large_in_use -= size;
+		}
+		else {
+			size_t cls = class_of(size);
+			FreeBlock* block = (FreeBlock*)ptr;
+			block->next = m_free[cls];
+			m_free[cls] = block;
+			m_stats.small_in_use -= class_size(cls);
+			m_stats.class_live[cls]--;
+		}
+
+		m_stats.frees++;
+		m_stats.in_use -= size;
+	}
+
+	void* Allocator::reallocate(void* ptr, size_t osize, size_t nsize)
+	{
+		bool old_small = osize <= kMaxSmall;
+		bool new_small = nsize <= kMaxSmall;
+
+		/* Same size class: nothing moves */
+		if (old_small && new_small && class_of(osize) == class_of(nsize)) {
+			m_stats.in_use = m_stats.in_use - osize + nsize;
+			if (m_stats.in_use > m_stats.peak) {
+				m_stats.peak = m_stats.in_use;
+			}
+			return ptr;
+		}
+
+		/* Large to large: let the system allocator grow in place if it can */
+		if (!old_small && !new_small) {
+			void* grown = realloc(ptr, nsize);
+			if (grown == nullptr) {
+				return nullptr;
+			}
+			m_stats.large_in_use = m_stats.large_in_use - osize + nsize;
+			m_stats.in_use = m_stats.in_use - osize + nsize;
+			if (m_stats.in_use > m_stats.peak) {
+				m_stats.peak = m_stats.in_use;
+			}
+			return grown;
+		}
+
+		/* Moving into another class or between pool and system allocator. If that fails,
+		   even for a shrink, report it: Lua collects and retries, then raises a memory
+		   error. Handing back the old block would later free it into the wrong class. */
+		void* moved = allocate(nsize);
+		if (moved == nullptr) {
+			return nullptr;
+		}
+		memcpy(moved, ptr, osize < nsize ? osize : nsize);
+		release(ptr, osize);
+		return moved;
+	}
+
+	void* Allocator::alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+	{
+		Allocator* self = (Allocator*)ud;
+
+		if (nsize == 0) {
+			if (ptr != nullptr) {
+				self->release(ptr, osize);
+			}
+			return nullptr;
+		}
+
+		/* When ptr is NULL, osize carries the object type rather than a size */
+		size_t grow = ptr == nullptr ? nsize : (nsize > osize ? nsize - osize : 0);
+		if (grow != 0 && self->over_limit(grow)) {
+			return nullptr;
+		}
+
+		if (ptr == nullptr) {
+			return self->allocate(nsize);
+		}
+		return self->reallocate(ptr, osize, nsize);
+	}
+}
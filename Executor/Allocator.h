@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace LUDA
+{
+	/*
+		Size-class pool allocator for a single lua_State (installed through
+		lua_newstate). Lua always tells the allocator the old block size, so
+		small blocks carry no header: they are carved out of 64 KB chunks and
+		recycled through one free list per 16-byte size class. Anything above
+		kMaxSmall goes straight to the system allocator.
+
+		Not thread safe; a Lua state is only ever touched by one thread at a time.
+	*/
+	class Allocator
+	{
+	public:
+		static constexpr size_t kGranularity = 16;
+		static constexpr size_t kMaxSmall = 512;
+		static constexpr size_t kClasses = kMaxSmall / kGranularity;
+		static constexpr size_t kChunkSize = 64 * 1024;
+
+		struct Stats {
+			size_t in_use = 0;          // bytes Lua currently holds (requested sizes)
+			size_t peak = 0;            // high-water mark of in_use
+			uint64_t allocations = 0;   // blocks handed out, including moves on realloc
+			uint64_t frees = 0;
+			size_t small_in_use = 0;    // bytes of pooled blocks in use, rounded to class size
+			size_t small_reserved = 0;  // bytes of chunks obtained for pools
+			size_t large_in_use = 0;    // bytes served by the system allocator
+			uint64_t class_live[kClasses] = {};
+		};
+
+		Allocator() = default;
+		~Allocator();
+
+		Allocator(const Allocator&) = delete;
+		Allocator& operator=(const Allocator&) = delete;
+
+		// lua_Alloc entry point, `ud` is the Allocator
+		static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+		const Stats& stats() const { return m_stats; }
+
+		// Share of pooled memory that is reserved but not handed out (0..1)
+		double fragmentation() const;
+
+		// Refuse to grow past `bytes` in use (0 = unlimited). Lua runs an
+		// emergency collection and then raises a memory error.
+		void set_limit(size_t bytes) { m_limit = bytes; m_limit_hit = false; }
+		size_t limit() const { return m_limit; }
+		bool limit_hit() const { return m_limit_hit; }
+
+		// Restart the high-water mark from what is in use right now
+		void reset_peak() { m_stats.peak = m_stats.in_use; }
+
+	private:
+		struct FreeBlock { FreeBlock* next; };
+		struct Chunk { Chunk* next; };
+
+		static size_t class_of(size_t size) { return (size + kGranularity - 1) / kGranularity - 1; }
+		static size_t class_size(size_t cls) { return (cls + 1) * kGranularity; }
+
+		void* allocate(size_t size);
+		void release(void* ptr, size_t size);
+		void* reallocate(void* ptr, size_t osize, size_t nsize);
+		bool refill(size_t cls);
+		bool over_limit(size_t grow);
+
+		FreeBlock* m_free[kClasses] = {};
+		Chunk* m_chunks = nullptr;
+		Stats m_stats;
+		size_t m_limit = 0;
+		bool m_limit_hit = false;
+	};
+}
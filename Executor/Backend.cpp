@@ -0,0 +1,27 @@
+#include "Backend.h"
+
+#ifdef LUDA_HEADLESS
+#include "MemoryBackend.h"
+#else
+#include "IdaBackend.h"
+#endif
+
+namespace LUDA
+{
+#ifdef LUDA_HEADLESS
+	static MemoryBackend default_backend;
+#else
+	static IdaBackend default_backend;
+#endif
+	static Backend* active_backend = &default_backend;
+
+	Backend& backend()
+	{
+		return *active_backend;
+	}
+
+	void set_backend(Backend* backend)
+	{
+		active_backend = backend != nullptr ? backend : &default_backend;
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifdef LUDA_HEADLESS
+#include "Headless.h"
+#else
+#define __EA64__
+#include <pro.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace LUDA
+{
+	// Function bounds, [start, end)
+	struct FunctionRange {
+		ea_t start = BADADDR;
+		ea_t end = BADADDR;
+	};
+
+	struct Segment {
+		ea_t start = BADADDR;
+		ea_t end = BADADDR;
+		std::string name;
+	};
+
+	enum class XrefKind { code, data };
+
+	// `size` bytes from `data` to write at ea
+	struct Patch {
+		ea_t ea = BADADDR;
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
+	/*
+		Everything the libraries read from (or patch into) the database.
+
+		The IDA build talks to the SDK (IdaBackend); headless builds run against a
+		MemoryBackend loaded from a raw image and a metadata file, so the bindings
+		can be tested and benchmarked without IDA. Calls come from the job thread only.
+	*/
+	class Backend
+	{
+	public:
+		using StringVisitor = std::function<bool(ea_t ea, const std::string& contents)>;
+
+		virtual ~Backend() = default;
+
+		// Bytes that aren't loaded read as 0
+		virtual uint8_t read_byte(ea_t ea) = 0;
+		virtual bool read_bytes(ea_t ea, void* out, size_t size) = 0; // false if the read was cancelled
+		virtual void patch_byte(ea_t ea, uint8_t value) = 0;
+		// All of `patches` as one change; IDA undoes them together as the action `label`
+		virtual void patch_bytes(const Patch* patches, size_t count, const char* label) = 0;
+
+		virtual ea_t image_base() = 0;
+		virtual ea_t min_ea() = 0;
+		virtual ea_t max_ea() = 0;  // one past the last address
+
+		// Function containing ea
+		virtual bool function_at(ea_t ea, FunctionRange& out) = 0;
+
+		virtual ea_t name_ea(const char* name) = 0; // BADADDR if there's no such name
+		virtual bool name_at(ea_t ea, std::string& out) = 0;
+
+		// Sources of the references to ea, appended to `out`
+		virtual void xrefs_to(ea_t ea, XrefKind kind, std::vector<ea_t>& out) = 0;
+
+		// C string literals in address order; return false from `visit` to stop
+		virtual void for_each_string(const StringVisitor& visit) = 0;
+
+		virtual void segments(std::vector<Segment>& out) = 0;
+	};
+
+	// The database the bindings work on
+	Backend& backend();
+
+	// Switch to another backend (not owned), nullptr for the default one: the SDK in the
+	// IDA build, an empty database in headless builds
+	void set_backend(Backend* backend);
+}
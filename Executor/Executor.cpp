@@ -1,12 +1,30 @@
 #include "Executor.h"
+#include "Snapshot.h"
+#include "Sandbox.h"
+
+#include <cstdio>
+#include <charconv>
 
 #include "Libraries/print.hpp"
+#ifndef LUDA_HEADLESS
 #include "Libraries/hexrays.hpp"
+#endif
 #include "Libraries/functions.hpp"
 #include "Libraries/xrefs.hpp"
 #include "Libraries/strings.hpp"
 #include "Libraries/patching.hpp"
+#ifdef LUDA_WITH_KEYSTONE
 #include "Libraries/assembler.hpp"
+#endif
+#include "Libraries/gc.hpp"
+#include "Libraries/buffer.hpp"
+#include "Libraries/format.hpp"
+#include "Libraries/arrays.hpp"
+#include "Libraries/records.hpp"
+#include "Libraries/structs.hpp"
+#include "Libraries/eamap.hpp"
+#include "Libraries/rangeset.hpp"
+#include "Libraries/channel.hpp"
 
 Executor::Executor()
 {
@@ -15,7 +33,24 @@ Executor::Executor()
 
 Executor::~Executor()
 {
-	lua_close(this->L);
+	if (this->L != nullptr) {
+		lua_close(this->L);
+	}
+}
+
+static int on_panic(lua_State* L)
+{
+	const char* error_msg = lua_tostring(L, -1);
+	msg("[PANIC] %s\n", error_msg ? error_msg : "unprotected error in Lua");
+	return 0;
+}
+
+static void on_warning(void*, const char* message, int tocont)
+{
+	if (!tocont && message[0] == '@') {
+		return; // control message ("@on"/"@off")
+	}
+	msg("%s%s", message, tocont ? "" : "\n");
 }
 
 #define lua_register_alias(L, g, ng) lua_getglobal(L, g); \
@@ -33,71 +68,319 @@ Executor::~Executor()
     lua_setfield(L, -2, name); \
     lua_pop(L, 1)
 
-bool Executor::run_script(const std::string& script)
+// Functions wrapped by Libraries/binding.hpp, which pushes them with their field names
+#define LUA_REGISTER_BINDING(L, name, fn) \
+    LUDA::Library::push_binding<&fn>(L); \
+    lua_setglobal(L, name)
+
+#define LUA_REGISTER_TABLE_BINDING(L, table, name, fn) \
+    lua_getglobal(L, table); \
+    if (lua_isnil(L, -1)) { \
+        lua_pop(L, 1); \
+        lua_newtable(L); \
+        lua_setglobal(L, table); \
+        lua_getglobal(L, table); \
+    } \
+    LUDA::Library::push_binding<&fn>(L); \
+    lua_setfield(L, -2, name); \
+    lua_pop(L, 1)
+
+#define LUA_REGISTER_SUBTABLE_FUNCS(L, table, sub, funcs) \
+    lua_pushglobaltable(L); \
+    luaL_getsubtable(L, -1, table); \
+    luaL_getsubtable(L, -1, sub); \
+    luaL_setfuncs(L, funcs, 0); \
+    lua_pop(L, 3)
+
+// Scripts can carry options in their leading comment lines, e.g. "--@gc batch"
+static std::string script_option(const std::string& script, const std::string& key)
+{
+	const std::string tag = "--@" + key;
+	size_t pos = 0;
+	while (pos < script.size()) {
+		size_t end = script.find('\n', pos);
+		if (end == std::string::npos) end = script.size();
+		std::string line = script.substr(pos, end - pos);
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+
+		if (line.compare(0, 2, "--") != 0 && line.find_first_not_of(" \t") != std::string::npos) {
+			break; // first line of code, options end here
+		}
+		if (line.compare(0, tag.size(), tag) == 0 && line.size() > tag.size() && (line[tag.size()] == ' ' || line[tag.size()] == '\t')) {
+			size_t first = line.find_first_not_of(" \t", tag.size());
+			size_t last = line.find_last_not_of(" \t");
+			return first == std::string::npos ? "" : line.substr(first, last - first + 1);
+		}
+		pos = end + 1;
+	}
+	return "";
+}
+
+void Executor::begin_run(size_t limit)
+{
+	this->run_allocations = this->allocator.stats().allocations;
+	this->run_gc_cycles = this->gc_cycles;
+	this->run_heap_limit = limit;
+	this->allocator.reset_peak();
+	this->allocator.set_limit(limit ? this->allocator.stats().in_use + limit : 0);
+}
+
+luda::RunStats Executor::end_run()
+{
+	this->allocator.set_limit(0);
+
+	// GC settings are per job; also undo a luda.gc.pause() the script never resumed
+	LUDA::Library::apply_gc_profile(L, "default");
+	lua_gc(L, LUA_GCRESTART);
+
+	luda::RunStats stats;
+	stats.peak_bytes = this->allocator.stats().peak;
+	stats.allocations = this->allocator.stats().allocations - this->run_allocations;
+	stats.gc_cycles = this->gc_cycles - this->run_gc_cycles;
+	stats.heap_limit = this->run_heap_limit;
+	return stats;
+}
+
+// Job options win over the script's own "--@key" lines
+static std::string run_option(const luda::JobOptions& options, const std::string& script, const std::string& key)
+{
+	auto it = options.find(key);
+	return it != options.end() ? it->second : script_option(script, key);
+}
+
+bool Executor::run_job(const luda::Job& job)
+{
+	for (const std::string& script : job.scripts) {
+		if (!run_script(script, job.options)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Executor::run_script(const std::string& script, const luda::JobOptions& options)
 {
 	//luda::SendOutput("Received script (" + std::to_string(script.length()) + " chars)");
+	size_t limit = this->heap_limit;
+	std::string limit_mb = run_option(options, script, "heap_limit_mb");
+	if (!limit_mb.empty()) {
+		unsigned long long mb = 0;
+		auto parsed = std::from_chars(limit_mb.data(), limit_mb.data() + limit_mb.size(), mb);
+		if (parsed.ec == std::errc() && parsed.ptr == limit_mb.data() + limit_mb.size()) {
+			limit = (size_t)mb * 1024 * 1024;
+		}
+		else {
+			msg("[Executor] Ignoring heap_limit_mb '%s'\n", limit_mb.c_str());
+		}
+	}
+	begin_run(limit);
+
+	std::string gc_profile = run_option(options, script, "gc");
+	if (!gc_profile.empty() && !LUDA::Library::apply_gc_profile(L, gc_profile.c_str())) {
+		msg("[Executor] Unknown GC profile '%s', using default\n", gc_profile.c_str());
+	}
+
+	// The base environment is frozen on the first run, after the prelude had its turn
+	if (!LUDA::Sandbox::is_frozen(L)) {
+		LUDA::Sandbox::freeze(L);
+	}
+
 	int result = luaL_loadbuffer(L, script.c_str(), script.size(), "script");
+	if (result == 0) {
+		// Fresh globals for every run, everything else is shared read-only
+		LUDA::Sandbox::push_environment(L);
+		lua_setupvalue(L, -2, 1);
+		result = lua_pcall(L, 0, 0, 0);
+	}
+
 	if (result != 0) {
-		const char* error_msg = lua_tostring(L, -1);
-		msg("[ERROR] %s\n", error_msg);
-		luda::SendError(error_msg);
+		std::string error_msg = lua_isstring(L, -1) ? lua_tostring(L, -1) : "(error object is not a string)";
+		if (result == LUA_ERRMEM && this->allocator.limit_hit()) {
+			error_msg = "memory limit exceeded: run may use at most " +
+				std::to_string(this->run_heap_limit / (1024 * 1024)) + " MB of Lua heap";
+		}
 		lua_pop(L, 1);  // Pop the error message
+
+		msg("[%s] %s\n", result == LUA_ERRSYNTAX ? "ERROR" : "RUNTIME ERROR", error_msg.c_str());
+		luda::SendError(error_msg, end_run());
 		return false;
 	}
-	int pres = lua_pcall(L, 0, 0, 0);
-	if (pres != 0) {
-		const char* error_msg = lua_tostring(L, -1);
-		msg("[RUNTIME ERROR] %s\n", error_msg);
-		luda::SendError(error_msg);
-		lua_pop(L, 1);  // Pop the error message
+	luda::SendSuccess("Script executed successfully.", end_run());
+	//msg("Executed script successfully!\n");
+	return true;
+}
+
+static int gc_sentinel(lua_State* L)
+{
+	uint64_t* counter = (uint64_t*)lua_touserdata(L, lua_upvalueindex(1));
+	(*counter)++;
+
+	/* Re-arm: a fresh unreferenced sentinel dies in the next collection */
+	lua_getmetatable(L, 1);
+	lua_newuserdatauv(L, 0, 0);
+	lua_insert(L, -2);
+	lua_setmetatable(L, -2);
+	return 0;
+}
+
+void Executor::install_gc_counter()
+{
+	lua_createtable(L, 0, 1);
+	lua_pushlightuserdata(L, &this->gc_cycles);
+	lua_pushcclosure(L, gc_sentinel, 1);
+	lua_setfield(L, -2, "__gc");
+
+	lua_newuserdatauv(L, 0, 0);
+	lua_insert(L, -2);
+	lua_setmetatable(L, -2);
+	lua_pop(L, 1);
+}
+
+static bool read_file(const std::string& path, std::string& out)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == nullptr) {
 		return false;
 	}
-	luda::SendSuccess();
-	//msg("Executed script successfully!\n");
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	out.resize(size > 0 ? (size_t)size : 0);
+	bool ok = size >= 0 && fread(out.data(), 1, out.size(), f) == out.size();
+	fclose(f);
+	return ok;
+}
+
+static bool write_file(const std::string& path, const std::string& data)
+{
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	fclose(f);
+	return ok;
+}
+
+bool Executor::load_prelude(const std::string& prelude_path, const std::string& snapshot_path)
+{
+	std::string source;
+	if (!read_file(prelude_path, source)) {
+		return false; // No prelude, nothing to warm up
+	}
+	uint64_t source_hash = LUDA::Snapshot::hash(source);
+
+	std::string blob, error;
+	if (read_file(snapshot_path, blob)) {
+		if (LUDA::Snapshot::restore(L, blob, source_hash, error)) {
+			msg("[Executor] Prelude restored from snapshot (%zu bytes)\n", blob.size());
+			return true;
+		}
+		msg("[Executor] Ignoring snapshot: %s\n", error.c_str());
+	}
+
+	if (luaL_loadbuffer(L, source.c_str(), source.size(), "@prelude") != 0 || lua_pcall(L, 0, 0, 0) != 0) {
+		msg("[ERROR] prelude: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return false;
+	}
+
+	if (!LUDA::Snapshot::save(L, source_hash, blob, error)) {
+		msg("[Executor] Prelude can't be snapshotted: %s\n", error.c_str());
+	}
+	else if (!write_file(snapshot_path, blob)) {
+		msg("[Executor] Failed to write snapshot %s\n", snapshot_path.c_str());
+	}
 	return true;
 }
+
 bool Executor::initialize()
 {
-	L = luaL_newstate(); // Create new Lua state
+	// Same as luaL_newstate, but on our pooled allocator
+	L = lua_newstate(LUDA::Allocator::alloc, &this->allocator, luaL_makeseed(nullptr));
 	msg("[Executor] Lua state created: %p\n", L);
 
 	if (L == nullptr) {
 		return false; // Failed to create Lua state
 	}
 
+	lua_atpanic(L, on_panic);
+	lua_setwarnf(L, on_warning, nullptr);
+
 	luaL_openlibs(L); // Load standard Lua libraries
+	install_gc_counter();
+	LUDA::Library::capture_gc_defaults(L);
+	LUDA::Library::register_buffer_type(L);
+	LUDA::Library::register_array_type(L);
+	LUDA::Library::register_records_type(L);
+	LUDA::Library::register_struct_type(L);
+	LUDA::Library::register_eamap_type(L);
+	LUDA::Library::register_rangeset_type(L);
+#ifdef LUDA_WITH_KEYSTONE
+	LUDA::Library::register_assembler_type(L);
+#endif
 
 	/* Register custom environment */
 
 	// UI related / output
 	lua_register(this->L, "print", (lua_CFunction)LUDA::Library::c_print);
 
-	// pseudocode/disassembly related
-	LUA_REGISTER_TABLE_FUNC(this->L, "hexrays", "decompile", (lua_CFunction)LUDA::Library::c_decompile);
-	LUA_REGISTER_TABLE_FUNC(this->L, "hexrays", "disassemble", (lua_CFunction)LUDA::Library::c_disassemble);
+	// pseudocode/disassembly related, the in-memory backend has no decoder
+#ifndef LUDA_HEADLESS
+	LUA_REGISTER_TABLE_BINDING(this->L, "hexrays", "decompile", LUDA::Library::decompile);
+	LUA_REGISTER_TABLE_BINDING(this->L, "hexrays", "disassemble", LUDA::Library::disassemble);
+#endif
 
 	// functions
-	lua_register(this->L, "get_function", (lua_CFunction)LUDA::Library::c_get_func);
+	LUA_REGISTER_BINDING(this->L, "get_function", LUDA::Library::get_function);
 
 	// xrefs
-	LUA_REGISTER_TABLE_FUNC(this->L, "xrefs", "get", (lua_CFunction)LUDA::Library::c_get_xrefs);
+	LUA_REGISTER_TABLE_BINDING(this->L, "xrefs", "get", LUDA::Library::get_xrefs);
 
 	// strings
-	LUA_REGISTER_TABLE_FUNC(this->L, "strings", "search", (lua_CFunction)LUDA::Library::c_search_strings);
+	LUA_REGISTER_TABLE_BINDING(this->L, "strings", "search", LUDA::Library::search_strings);
 
+	// formatting
 	lua_register(this->L, "hex", (lua_CFunction)LUDA::Library::c_to_hex);
+	lua_register(this->L, "hexdump", (lua_CFunction)LUDA::Library::c_hexdump);
 
 	// patching
-	LUA_REGISTER_TABLE_FUNC(this->L, "memory", "write", (lua_CFunction)LUDA::Library::c_patch_bytes);
+	LUA_REGISTER_TABLE_FUNC(this->L, "memory", "write", (lua_CFunction)LUDA::Library::c_write_bytes);
 	LUA_REGISTER_TABLE_FUNC(this->L, "memory", "read", (lua_CFunction)LUDA::Library::c_get_bytes);
+	LUA_REGISTER_TABLE_FUNC(this->L, "memory", "read_buffer", (lua_CFunction)LUDA::Library::c_read_buffer);
 
-	// other shit
-	LUA_REGISTER_TABLE_FUNC(this->L, "image", "base", (lua_CFunction)LUDA::Library::c_get_imagebase);
-	LUA_REGISTER_TABLE_FUNC(this->L, "image", "first", (lua_CFunction)LUDA::Library::c_get_first_address);
-	LUA_REGISTER_TABLE_FUNC(this->L, "image", "last", (lua_CFunction)LUDA::Library::c_get_last_address);
+	// byte buffers, binary layouts, and the binary channel back to the UI
+	LUA_REGISTER_TABLE_FUNC(this->L, "buffer", "new", (lua_CFunction)LUDA::Library::c_buffer_new);
+	LUA_REGISTER_TABLE_FUNC(this->L, "buffer", "from", (lua_CFunction)LUDA::Library::c_buffer_from);
+	LUA_REGISTER_TABLE_FUNC(this->L, "struct", "compile", (lua_CFunction)LUDA::Library::c_struct_compile);
+	LUA_REGISTER_TABLE_FUNC(this->L, "luda", "send", (lua_CFunction)LUDA::Library::c_send);
+	LUA_REGISTER_TABLE_FUNC(this->L, "luda", "emit", (lua_CFunction)LUDA::Library::c_emit);
 
+	// address-keyed containers
+	LUA_REGISTER_TABLE_FUNC(this->L, "luda", "eamap", (lua_CFunction)LUDA::Library::c_eamap_new);
+	LUA_REGISTER_TABLE_FUNC(this->L, "luda", "rangeset", (lua_CFunction)LUDA::Library::c_rangeset_new);
 
+	// typed integer arrays
+	LUA_REGISTER_TABLE_FUNC(this->L, "luda", "u64array", (lua_CFunction)LUDA::Library::c_u64array_new);
+	LUA_REGISTER_TABLE_FUNC(this->L, "luda", "u32array", (lua_CFunction)LUDA::Library::c_u32array_new);
+	LUA_REGISTER_TABLE_FUNC(this->L, "luda", "u8array", (lua_CFunction)LUDA::Library::c_u8array_new);
+
+	// other shit
+	LUA_REGISTER_TABLE_BINDING(this->L, "image", "base", LUDA::Library::get_imagebase);
+	LUA_REGISTER_TABLE_BINDING(this->L, "image", "first", LUDA::Library::get_first_address);
+	LUA_REGISTER_TABLE_BINDING(this->L, "image", "last", LUDA::Library::get_last_address);
+
+#ifdef LUDA_WITH_KEYSTONE
 	lua_register(this->L, "assemble", (lua_CFunction)LUDA::Library::c_assemble);
+	lua_register(this->L, "assemble_many", (lua_CFunction)LUDA::Library::c_assemble_many);
+	LUA_REGISTER_TABLE_FUNC(this->L, "patch", "asm_at", (lua_CFunction)LUDA::Library::c_patch_asm_at);
+#endif
+
+	// garbage collector control
+	LUA_REGISTER_SUBTABLE_FUNCS(this->L, "luda", "gc", LUDA::Library::gc_functions);
+
+	// Everything registered so far is native; snapshots only carry what comes after
+	LUDA::Snapshot::capture_baseline(this->L);
 
 	return true;
 }
@@ -1,11 +1,15 @@
 #pragma once
 #define __EA64__
 #include <string>
+#ifndef LUDA_HEADLESS
 #include <ida.hpp>
 #include <kernwin.hpp>
 #include <funcs.hpp>
 #include <hexrays.hpp>
+#endif
 #include "../LudaSocket/ludasocket.h"
+#include "Allocator.h"
+#include "Backend.h"
 
 extern "C" {
 #include <Lua/lua.h>
@@ -19,8 +23,33 @@ public:
 	Executor();
 	~Executor();
 	bool initialize(); // Create luaState and load standard libraries
-	bool run_script(const std::string& script);
+	bool run_script(const std::string& script, const luda::JobOptions& options = {});
+
+	// Run a job's scripts in order, stopping at the first one that fails
+	bool run_job(const luda::Job& job);
+
+	// Run the user prelude once, or restore it from a snapshot saved by an
+	// earlier session if the prelude source has not changed since.
+	bool load_prelude(const std::string& prelude_path, const std::string& snapshot_path);
+
+	// Allocation counters of the Lua heap
+	const LUDA::Allocator& memory() const { return allocator; }
+
+	// Cap on how much a single run may grow the Lua heap, 0 = unlimited
+	void set_heap_limit(size_t bytes) { heap_limit = bytes; }
+	static constexpr size_t default_heap_limit = 1024ull * 1024 * 1024;
 private:
-	lua_State* L;
+	void begin_run(size_t limit);
+	luda::RunStats end_run();
+	void install_gc_counter();
+
+	lua_State* L = nullptr;
+	LUDA::Allocator allocator; // must outlive L
+
+	size_t heap_limit = default_heap_limit;
+	size_t run_heap_limit = 0; // limit of the run in progress, may be overridden per job
+	uint64_t gc_cycles = 0; // bumped by a finalizer sentinel once per collection
+	uint64_t run_allocations = 0;
+	uint64_t run_gc_cycles = 0;
 };
 
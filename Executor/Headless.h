@@ -0,0 +1,21 @@
+#pragma once
+// The few IDA SDK names the executor and its libraries use outside of the backend,
+// for builds without the SDK (LUDA_HEADLESS). Output goes to stdout.
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+
+typedef uint64_t ea_t;
+constexpr ea_t BADADDR = ea_t(-1);
+
+inline int msg(const char* format, ...)
+{
+	va_list va;
+	va_start(va, format);
+	int n = vprintf(format, va);
+	va_end(va);
+	fflush(stdout);
+	return n;
+}
+
+#define qsnprintf snprintf
@@ -0,0 +1,124 @@
+#include "IdaBackend.h"
+
+#include <ida.hpp>
+#include <bytes.hpp>
+#include <funcs.hpp>
+#include <name.hpp>
+#include <nalt.hpp>
+#include <xref.hpp>
+#include <segment.hpp>
+#include <undo.hpp>
+
+#include <cstring>
+
+namespace LUDA
+{
+	uint8_t IdaBackend::read_byte(ea_t ea)
+	{
+		return (uint8_t)get_byte(ea);
+	}
+
+	bool IdaBackend::read_bytes(ea_t ea, void* out, size_t size)
+	{
+		return get_bytes(out, (ssize_t)size, ea, GMB_READALL) >= 0;
+	}
+
+	void IdaBackend::patch_byte(ea_t ea, uint8_t value)
+	{
+		::patch_byte(ea, value);
+	}
+
+	void IdaBackend::patch_bytes(const Patch* patches, size_t count, const char* label)
+	{
+		create_undo_point((const uchar*)label, strlen(label));
+		for (size_t i = 0; i < count; i++) {
+			::patch_bytes(patches[i].ea, patches[i].data, patches[i].size);
+		}
+	}
+
+	ea_t IdaBackend::image_base()
+	{
+		return get_imagebase();
+	}
+
+	ea_t IdaBackend::min_ea()
+	{
+		return inf_get_min_ea();
+	}
+
+	ea_t IdaBackend::max_ea()
+	{
+		return inf_get_max_ea();
+	}
+
+	bool IdaBackend::function_at(ea_t ea, FunctionRange& out)
+	{
+		func_t* func = get_func(ea);
+		if (func == nullptr) {
+			return false;
+		}
+		out.start = func->start_ea;
+		out.end = func->end_ea;
+		return true;
+	}
+
+	ea_t IdaBackend::name_ea(const char* name)
+	{
+		return get_name_ea(BADADDR, name);
+	}
+
+	bool IdaBackend::name_at(ea_t ea, std::string& out)
+	{
+		qstring name;
+		if (get_name(&name, ea) <= 0) {
+			return false;
+		}
+		out.assign(name.c_str(), name.length());
+		return true;
+	}
+
+	void IdaBackend::xrefs_to(ea_t ea, XrefKind kind, std::vector<ea_t>& out)
+	{
+		if (kind == XrefKind::code) {
+			for (ea_t from = get_first_cref_to(ea); from != BADADDR; from = get_next_cref_to(ea, from)) {
+				out.push_back(from);
+			}
+		}
+		else {
+			for (ea_t from = get_first_dref_to(ea); from != BADADDR; from = get_next_dref_to(ea, from)) {
+				out.push_back(from);
+			}
+		}
+	}
+
+	void IdaBackend::for_each_string(const StringVisitor& visit)
+	{
+		std::string contents;
+		for (ea_t ea = inf_get_min_ea(); ea != BADADDR; ea = next_head(ea, BADADDR)) {
+			if (get_str_type(ea) != STRTYPE_C) {
+				continue;
+			}
+			qstring literal;
+			if (get_strlit_contents(&literal, ea, get_item_size(ea), STRTYPE_C, nullptr, STRCONV_ESCAPE) == -1) {
+				continue;
+			}
+			contents.assign(literal.c_str(), literal.length());
+			if (!visit(ea, contents)) {
+				return;
+			}
+		}
+	}
+
+	void IdaBackend::segments(std::vector<Segment>& out)
+	{
+		for (segment_t* seg = get_first_seg(); seg != nullptr; seg = get_next_seg(seg->start_ea)) {
+			Segment segment;
+			segment.start = seg->start_ea;
+			segment.end = seg->end_ea;
+			qstring name;
+			get_segm_name(&name, seg);
+			segment.name.assign(name.c_str(), name.length());
+			out.push_back(std::move(segment));
+		}
+	}
+}
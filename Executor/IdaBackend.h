@@ -0,0 +1,28 @@
+#pragma once
+#include "Backend.h"
+
+namespace LUDA
+{
+	// The open IDB, through the SDK
+	class IdaBackend : public Backend
+	{
+	public:
+		uint8_t read_byte(ea_t ea) override;
+		bool read_bytes(ea_t ea, void* out, size_t size) override;
+		void patch_byte(ea_t ea, uint8_t value) override;
+		void patch_bytes(const Patch* patches, size_t count, const char* label) override;
+
+		ea_t image_base() override;
+		ea_t min_ea() override;
+		ea_t max_ea() override;
+
+		bool function_at(ea_t ea, FunctionRange& out) override;
+
+		ea_t name_ea(const char* name) override;
+		bool name_at(ea_t ea, std::string& out) override;
+
+		void xrefs_to(ea_t ea, XrefKind kind, std::vector<ea_t>& out) override;
+		void for_each_string(const StringVisitor& visit) override;
+		void segments(std::vector<Segment>& out) override;
+	};
+}
@@ -0,0 +1,662 @@
+#pragma once
+#include "../Executor.h"
+#include "binding.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace LUDA::Library
+{
+    /* Flat arrays of unsigned integers (u8, u32 or u64 elements) in a single userdata, for the
+       address lists and masks that scripts sort, intersect and filter as a whole:
+
+            local callers = xrefs.get(ea):sort():unique()
+            local both = callers:intersect(other)
+            local near = both:filter(both:mask(">=", lo) & both:mask("<", hi))
+
+       Every operation is one native loop over the elements; the compare and mask loops are
+       kept branch-free so the compiler vectorizes them. Set operations want sorted input and
+       check for it. Elements reach Lua as integers, so u64 values at or above 2^63 read as
+       negative like any other address, while sorting and comparisons treat them as unsigned. */
+    static constexpr const char* array_type = "LUDA.array";
+
+    enum class ArrayKind : uint8_t { u8, u32, u64 };
+
+    static const char* const array_kind_names[] = { "u8", "u32", "u64" };
+
+    struct TypedArray {
+        size_t count;
+        ArrayKind kind;
+        bool sorted;                 // known to be in ascending order; writes clear it
+        alignas(16) uint8_t data[1]; // count elements follow
+    };
+
+    // Arrays of T returned by a binding, pushed as a typed array instead of a table
+    template <typename T>
+    struct Array : std::vector<T> {
+        using std::vector<T>::vector;
+    };
+
+    template <typename T>
+    static constexpr ArrayKind array_kind_of()
+    {
+        static_assert(std::is_integral_v<T> && std::is_unsigned_v<T> && (sizeof(T) == 1 || sizeof(T) == 4 || sizeof(T) == 8),
+            "typed arrays hold u8, u32 or u64 elements");
+        return sizeof(T) == 1 ? ArrayKind::u8 : sizeof(T) == 4 ? ArrayKind::u32 : ArrayKind::u64;
+    }
+
+    static size_t array_width(ArrayKind kind)
+    {
+        return kind == ArrayKind::u8 ? 1 : kind == ArrayKind::u32 ? 4 : 8;
+    }
+
+    // New array of `count` uninitialized elements on top of the stack
+    static TypedArray* push_array(lua_State* L, ArrayKind kind, size_t count)
+    {
+        size_t width = array_width(kind);
+        if (count > ((size_t)-1 - offsetof(TypedArray, data)) / width) {
+            luaL_error(L, "array too large");
+        }
+        TypedArray* array = (TypedArray*)lua_newuserdatauv(L, offsetof(TypedArray, data) + (count ? count * width : 1), 0);
+        array->count = count;
+        array->kind = kind;
+        array->sorted = count <= 1;
+        luaL_setmetatable(L, array_type);
+        return array;
+    }
+
+    static TypedArray* test_array(lua_State* L, int idx)
+    {
+        return (TypedArray*)luaL_testudata(L, idx, array_type);
+    }
+
+    static TypedArray* check_array(lua_State* L, int idx)
+    {
+        return (TypedArray*)luaL_checkudata(L, idx, array_type);
+    }
+
+    // Calls f with the array's elements as a pointer of the matching type
+    template <typename F>
+    static decltype(auto) with_elements(TypedArray* array, F&& f)
+    {
+        switch (array->kind) {
+        case ArrayKind::u8:
+            return f((uint8_t*)array->data);
+        case ArrayKind::u32:
+            return f((uint32_t*)array->data);
+        default:
+            return f((uint64_t*)array->data);
+        }
+    }
+
+    template <typename T>
+    struct lua_value<Array<T>> : no_keys {
+        static int push(lua_State* L, const Array<T>& values, int)
+        {
+            TypedArray* array = push_array(L, array_kind_of<T>(), values.size());
+            if (!values.empty()) {
+                memcpy(array->data, values.data(), values.size() * sizeof(T));
+            }
+            return 1;
+        }
+    };
+
+    // An array argument of the same element type as `array`
+    static TypedArray* check_same_kind(lua_State* L, int idx, const TypedArray* array)
+    {
+        TypedArray* other = check_array(L, idx);
+        if (other->kind != array->kind) {
+            luaL_argerror(L, idx, lua_pushfstring(L, "%s array expected, got %s array",
+                array_kind_names[(int)array->kind], array_kind_names[(int)other->kind]));
+        }
+        return other;
+    }
+
+    // Checked once, then remembered until the next write
+    static bool is_sorted_array(TypedArray* array)
+    {
+        if (!array->sorted) {
+            array->sorted = with_elements(array, [&](auto* values) { return std::is_sorted(values, values + array->count); });
+        }
+        return array->sorted;
+    }
+
+    // Set operations and isin() rely on this
+    static void check_sorted(lua_State* L, int idx, TypedArray* array)
+    {
+        if (!is_sorted_array(array)) {
+            luaL_argerror(L, idx, "array is not sorted (call :sort() first)");
+        }
+    }
+
+    // Moves the first `count` elements of the array at the top of the stack into an exact-size one,
+    // so results of set operations and filters don't hold on to their worst-case allocation
+    static TypedArray* shrink_array(lua_State* L, TypedArray* array, size_t count)
+    {
+        if (count == array->count) {
+            return array;
+        }
+        TypedArray* exact = push_array(L, array->kind, count);
+        memcpy(exact->data, array->data, count * array_width(array->kind));
+        exact->sorted = array->sorted;
+        lua_replace(L, -2);
+        return exact;
+    }
+
+    // LSD radix sort, one pass per byte; bytes that are the same in every key (the high bytes
+    // of addresses in one image, usually) are skipped. Scratch space is a temporary userdata.
+    template <typename T>
+    static void radix_sort(lua_State* L, T* keys, size_t n)
+    {
+        if (n < 256) {
+            std::sort(keys, keys + n);
+            return;
+        }
+        if constexpr (sizeof(T) == 1) {
+            size_t counts[256] = {};
+            for (size_t i = 0; i < n; i++) counts[keys[i]]++;
+            for (size_t b = 0, i = 0; b < 256; b++) {
+                memset(keys + i, (int)b, counts[b]);
+                i += counts[b];
+            }
+        }
+        else {
+            constexpr int digits = (int)sizeof(T);
+            size_t counts[digits][256] = {};
+            for (size_t i = 0; i < n; i++) {
+                T key = keys[i];
+                for (int d = 0; d < digits; d++) counts[d][(key >> (8 * d)) & 0xFF]++;
+            }
+
+            T* from = keys;
+            T* to = (T*)lua_newuserdatauv(L, n * sizeof(T), 0);
+            for (int d = 0; d < digits; d++) {
+                size_t* offsets = counts[d];
+                if (offsets[(from[0] >> (8 * d)) & 0xFF] == n) continue;
+                for (size_t b = 0, offset = 0; b < 256; b++) {
+                    size_t count = offsets[b];
+                    offsets[b] = offset;
+                    offset += count;
+                }
+                for (size_t i = 0; i < n; i++) {
+                    T key = from[i];
+                    to[offsets[(key >> (8 * d)) & 0xFF]++] = key;
+                }
+                std::swap(from, to);
+            }
+            if (from != keys) {
+                memcpy(keys, from, n * sizeof(T));
+            }
+            lua_pop(L, 1);
+        }
+    }
+
+    // Element `i` (0-based) of a table argument as an integer
+    static lua_Integer check_element(lua_State* L, int idx, lua_Integer i)
+    {
+        int ok;
+        lua_rawgeti(L, idx, i + 1);
+        lua_Integer value = lua_tointegerx(L, -1, &ok);
+        if (!ok) {
+            luaL_error(L, "bad element #%I (integer expected, got %s)", i + 1, luaL_typename(L, -1));
+        }
+        lua_pop(L, 1);
+        return value;
+    }
+
+    // luda.u64array(n | table | array), luda.u32array(...), luda.u8array(...) -> array
+    // n zeroed elements, a copy of a table's sequence, or another array's elements converted.
+    // Values that don't fit the element type are truncated, like buffer bytes.
+    static int new_array(lua_State* L, ArrayKind kind)
+    {
+        if (TypedArray* source = test_array(L, 1)) {
+            TypedArray* array = push_array(L, kind, source->count);
+            with_elements(array, [&](auto* to) {
+                with_elements(source, [&](auto* from) {
+                    using T = std::remove_pointer_t<decltype(to)>;
+                    for (size_t i = 0; i < source->count; i++) to[i] = (T)from[i];
+                });
+            });
+            return 1;
+        }
+        if (lua_type(L, 1) == LUA_TTABLE) {
+            size_t count = (size_t)lua_rawlen(L, 1);
+            TypedArray* array = push_array(L, kind, count);
+            with_elements(array, [&](auto* to) {
+                using T = std::remove_pointer_t<decltype(to)>;
+                for (size_t i = 0; i < count; i++) to[i] = (T)check_element(L, 1, (lua_Integer)i);
+            });
+            return 1;
+        }
+        lua_Integer count = luaL_checkinteger(L, 1);
+        luaL_argcheck(L, count >= 0, 1, "size must not be negative");
+        TypedArray* array = push_array(L, kind, (size_t)count);
+        memset(array->data, 0, (size_t)count * array_width(kind));
+        return 1;
+    }
+
+    static int c_u64array_new(lua_State* L) { return new_array(L, ArrayKind::u64); }
+    static int c_u32array_new(lua_State* L) { return new_array(L, ArrayKind::u32); }
+    static int c_u8array_new(lua_State* L) { return new_array(L, ArrayKind::u8); }
+
+    // a:sort() -> a, sorted in place (ascending, unsigned)
+    static int c_array_sort(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        if (!is_sorted_array(array)) {
+            with_elements(array, [&](auto* values) { radix_sort(L, values, array->count); });
+            array->sorted = true;
+        }
+        lua_settop(L, 1);
+        return 1;
+    }
+
+    // a:unique() -> a, sorted and without repeated elements, in place
+    static int c_array_unique(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        with_elements(array, [&](auto* values) {
+            if (!is_sorted_array(array)) {
+                radix_sort(L, values, array->count);
+                array->sorted = true;
+            }
+            array->count = (size_t)(std::unique(values, values + array->count) - values);
+        });
+        lua_settop(L, 1);
+        return 1;
+    }
+
+    enum class SetOp { union_, intersect, difference };
+
+    // Sorted merge of two sorted arrays into a new one
+    template <SetOp op>
+    static int array_set_op(lua_State* L)
+    {
+        TypedArray* a = check_array(L, 1);
+        TypedArray* b = check_same_kind(L, 2, a);
+        check_sorted(L, 1, a);
+        check_sorted(L, 2, b);
+
+        size_t capacity = op == SetOp::union_ ? a->count + b->count
+                        : op == SetOp::intersect ? std::min(a->count, b->count)
+                        : a->count;
+        TypedArray* out = push_array(L, a->kind, capacity);
+        out->sorted = true;
+        size_t count = with_elements(a, [&](auto* x) {
+            using T = std::remove_pointer_t<decltype(x)>;
+            const T* y = (const T*)b->data;
+            T* to = (T*)out->data;
+            T* end = op == SetOp::union_ ? std::set_union(x, x + a->count, y, y + b->count, to)
+                   : op == SetOp::intersect ? std::set_intersection(x, x + a->count, y, y + b->count, to)
+                   : std::set_difference(x, x + a->count, y, y + b->count, to);
+            return (size_t)(end - to);
+        });
+        shrink_array(L, out, count);
+        return 1;
+    }
+
+    // a:union(b), a:intersect(b), a:difference(b) -> new sorted array; a and b must be sorted
+    static int c_array_union(lua_State* L) { return array_set_op<SetOp::union_>(L); }
+    static int c_array_intersect(lua_State* L) { return array_set_op<SetOp::intersect>(L); }
+    static int c_array_difference(lua_State* L) { return array_set_op<SetOp::difference>(L); }
+
+    static const char* const array_sides[] = { "left", "right", nullptr };
+
+    // Values past the element type's range go after everything rather than wrapping
+    template <typename T>
+    static size_t search_sorted(const T* values, size_t count, uint64_t wide, bool right)
+    {
+        if (wide > (T)-1) {
+            return count + 1;
+        }
+        T value = (T)wide;
+        const T* at = right ? std::upper_bound(values, values + count, value) : std::lower_bound(values, values + count, value);
+        return (size_t)(at - values) + 1;
+    }
+
+    // a:searchsorted(value | values [, "left" | "right"]) -> position (1-based), or a u64 array of them
+    // Where value would be inserted into sorted `a` to keep it sorted: before equal elements
+    // ("left", the default) or after them. #a + 1 when it goes after everything.
+    static int c_array_searchsorted(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        bool right = luaL_checkoption(L, 3, "left", array_sides) == 1;
+        if (TypedArray* queries = test_array(L, 2)) {
+            TypedArray* out = push_array(L, ArrayKind::u64, queries->count);
+            uint64_t* positions = (uint64_t*)out->data;
+            with_elements(array, [&](auto* values) {
+                with_elements(queries, [&](auto* q) {
+                    for (size_t i = 0; i < queries->count; i++) {
+                        positions[i] = search_sorted(values, array->count, (uint64_t)q[i], right);
+                    }
+                });
+            });
+            return 1;
+        }
+        lua_Integer value = luaL_checkinteger(L, 2);
+        size_t at = with_elements(array, [&](auto* values) {
+            return search_sorted(values, array->count, (uint64_t)value, right);
+        });
+        lua_pushinteger(L, (lua_Integer)at);
+        return 1;
+    }
+
+    enum class MaskOp { eq, ne, lt, le, gt, ge, in };
+
+    static const char* const mask_ops[] = { "==", "~=", "<", "<=", ">", ">=", "in", nullptr };
+
+    // Compares in U: T itself when the operands fit it, so the loop stays as narrow as the
+    // elements, and u64 otherwise. For "in", `hi` is the width of the range.
+    template <MaskOp op, typename T, typename U>
+    static void mask_loop(const T* values, size_t count, U lo, U hi, uint8_t* out)
+    {
+        for (size_t i = 0; i < count; i++) {
+            U v = values[i];
+            if constexpr (op == MaskOp::eq) out[i] = v == lo;
+            if constexpr (op == MaskOp::ne) out[i] = v != lo;
+            if constexpr (op == MaskOp::lt) out[i] = v < lo;
+            if constexpr (op == MaskOp::le) out[i] = v <= lo;
+            if constexpr (op == MaskOp::gt) out[i] = v > lo;
+            if constexpr (op == MaskOp::ge) out[i] = v >= lo;
+            if constexpr (op == MaskOp::in) out[i] = (U)(v - lo) < hi;
+        }
+    }
+
+    template <typename T, typename U>
+    static void mask_elements(MaskOp op, const T* values, size_t n, U lo, U hi, uint8_t* mask)
+    {
+        switch (op) {
+        case MaskOp::eq: mask_loop<MaskOp::eq>(values, n, lo, hi, mask); break;
+        case MaskOp::ne: mask_loop<MaskOp::ne>(values, n, lo, hi, mask); break;
+        case MaskOp::lt: mask_loop<MaskOp::lt>(values, n, lo, hi, mask); break;
+        case MaskOp::le: mask_loop<MaskOp::le>(values, n, lo, hi, mask); break;
+        case MaskOp::gt: mask_loop<MaskOp::gt>(values, n, lo, hi, mask); break;
+        case MaskOp::ge: mask_loop<MaskOp::ge>(values, n, lo, hi, mask); break;
+        case MaskOp::in: mask_loop<MaskOp::in>(values, n, lo, hi, mask); break;
+        }
+    }
+
+    // a:mask(op, value [, hi]) -> u8 array with 1 where `element op value` holds, 0 elsewhere
+    // op is one of == ~= < <= > >= (unsigned), or "in" for value <= element < hi.
+    static int c_array_mask(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        MaskOp op = (MaskOp)luaL_checkoption(L, 2, nullptr, mask_ops);
+        uint64_t lo = (uint64_t)luaL_checkinteger(L, 3);
+        uint64_t hi = lo;
+        if (op == MaskOp::in) {
+            uint64_t end = (uint64_t)luaL_checkinteger(L, 4);
+            hi = end > lo ? end - lo : 0;
+        }
+
+        TypedArray* out = push_array(L, ArrayKind::u8, array->count);
+        with_elements(array, [&](auto* values) {
+            using T = std::remove_pointer_t<decltype(values)>;
+            // For "in" the end of the range must fit too, or v - lo wraps values below lo into it
+            if (lo <= (T)-1 && (op != MaskOp::in || hi <= (T)-1 - lo)) {
+                mask_elements(op, values, array->count, (T)lo, (T)hi, out->data);
+            }
+            else {
+                mask_elements(op, values, array->count, lo, hi, out->data);
+            }
+        });
+        return 1;
+    }
+
+    // a:isin(set) -> u8 array with 1 where the element is in sorted array `set`
+    // One merge pass when `a` is sorted too, a binary search per element otherwise.
+    static int c_array_isin(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        TypedArray* set = check_same_kind(L, 2, array);
+        check_sorted(L, 2, set);
+
+        TypedArray* out = push_array(L, ArrayKind::u8, array->count);
+        with_elements(array, [&](auto* values) {
+            using T = std::remove_pointer_t<decltype(values)>;
+            const T* members = (const T*)set->data;
+            size_t n = array->count, m = set->count;
+            uint8_t* mask = out->data;
+            if (is_sorted_array(array)) {
+                size_t i = 0, j = 0;
+                while (i < n && j < m) {
+                    if (values[i] < members[j]) {
+                        mask[i++] = 0;
+                    }
+                    else if (members[j] < values[i]) {
+                        j++;
+                    }
+                    else {
+                        mask[i++] = 1;
+                    }
+                }
+                memset(mask + i, 0, n - i);
+                return;
+            }
+            for (size_t i = 0; i < n; i++) {
+                mask[i] = std::binary_search(members, members + m, values[i]);
+            }
+        });
+        return 1;
+    }
+
+    // a:filter(mask) -> new array of the elements where mask (any array of #a elements) is non-zero
+    static int c_array_filter(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        TypedArray* mask = check_array(L, 2);
+        luaL_argcheck(L, mask->count == array->count, 2, "mask length differs from the array's");
+
+        size_t kept = with_elements(mask, [&](auto* m) {
+            size_t n = 0;
+            for (size_t i = 0; i < mask->count; i++) n += m[i] != 0;
+            return n;
+        });
+        TypedArray* out = push_array(L, array->kind, kept);
+        out->sorted = array->sorted;
+        with_elements(array, [&](auto* values) {
+            using T = std::remove_pointer_t<decltype(values)>;
+            T* to = (T*)out->data;
+            with_elements(mask, [&](auto* m) {
+                for (size_t i = 0, j = 0; i < array->count; i++) {
+                    if (m[i] != 0) to[j++] = values[i];
+                }
+            });
+        });
+        return 1;
+    }
+
+    // a:gather(positions) -> new array of a[p] for each 1-based position in array `positions`
+    static int c_array_gather(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        TypedArray* positions = check_array(L, 2);
+
+        TypedArray* out = push_array(L, array->kind, positions->count);
+        with_elements(array, [&](auto* values) {
+            using T = std::remove_pointer_t<decltype(values)>;
+            T* to = (T*)out->data;
+            with_elements(positions, [&](auto* p) {
+                for (size_t i = 0; i < positions->count; i++) {
+                    uint64_t at = (uint64_t)p[i] - 1;
+                    if (at >= array->count) {
+                        luaL_error(L, "bad position #%I (%I out of range 1..%I)",
+                            (lua_Integer)i + 1, (lua_Integer)p[i], (lua_Integer)array->count);
+                    }
+                    to[i] = values[at];
+                }
+            });
+        });
+        return 1;
+    }
+
+    // a:copy() -> new array with the same elements
+    static int c_array_copy(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        TypedArray* out = push_array(L, array->kind, array->count);
+        memcpy(out->data, array->data, array->count * array_width(array->kind));
+        out->sorted = array->sorted;
+        return 1;
+    }
+
+    // a:totable() -> { elements }
+    static int c_array_totable(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        lua_createtable(L, (int)std::min<size_t>(array->count, INT_MAX), 0);
+        with_elements(array, [&](auto* values) {
+            for (size_t i = 0; i < array->count; i++) {
+                lua_pushinteger(L, (lua_Integer)values[i]);
+                lua_rawseti(L, -2, (lua_Integer)i + 1);
+            }
+        });
+        return 1;
+    }
+
+    static const luaL_Reg array_methods[] = {
+        { "sort",         c_array_sort },
+        { "unique",       c_array_unique },
+        { "union",        c_array_union },
+        { "intersect",    c_array_intersect },
+        { "difference",   c_array_difference },
+        { "searchsorted", c_array_searchsorted },
+        { "mask",         c_array_mask },
+        { "isin",         c_array_isin },
+        { "filter",       c_array_filter },
+        { "gather",       c_array_gather },
+        { "copy",         c_array_copy },
+        { "totable",      c_array_totable },
+        { NULL, NULL }
+    };
+
+    // a[i] -> element i (1-based), or a method. Metamethods can't be reached from Lua
+    // (__metatable), so the first argument is always an array.
+    static int array_index(lua_State* L)
+    {
+        TypedArray* array = (TypedArray*)lua_touserdata(L, 1);
+        if (lua_type(L, 2) == LUA_TNUMBER) {
+            lua_Integer i = lua_tointeger(L, 2);
+            if (i >= 1 && (lua_Unsigned)i <= array->count) {
+                lua_pushinteger(L, with_elements(array, [&](auto* values) { return (lua_Integer)values[i - 1]; }));
+            }
+            else {
+                lua_pushnil(L);
+            }
+            return 1;
+        }
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    // a[i] = value, truncated to the element type
+    static int array_newindex(lua_State* L)
+    {
+        TypedArray* array = (TypedArray*)lua_touserdata(L, 1);
+        lua_Integer i = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, i >= 1 && (lua_Unsigned)i <= array->count, 2, "index out of range");
+        lua_Integer value = luaL_checkinteger(L, 3);
+        with_elements(array, [&](auto* values) {
+            values[i - 1] = (std::remove_pointer_t<decltype(values)>)value;
+        });
+        array->sorted = array->count <= 1;
+        return 0;
+    }
+
+    static int array_len(lua_State* L)
+    {
+        lua_pushinteger(L, (lua_Integer)((TypedArray*)lua_touserdata(L, 1))->count);
+        return 1;
+    }
+
+    static int array_tostring(lua_State* L)
+    {
+        TypedArray* array = (TypedArray*)lua_touserdata(L, 1);
+        lua_pushfstring(L, "%sarray: %I elements", array_kind_names[(int)array->kind], (lua_Integer)array->count);
+        return 1;
+    }
+
+    enum class BitOp { and_, or_, xor_ };
+
+    // a & b, a | b, a ~ b -> new array, element by element; either side may be an integer.
+    // Combines masks: a:mask(">=", lo) & a:mask("<", hi)
+    template <BitOp op>
+    static int array_bitop(lua_State* L)
+    {
+        int idx = test_array(L, 1) ? 1 : 2;
+        TypedArray* array = check_array(L, idx);
+        int other_idx = 3 - idx;
+        TypedArray* other = test_array(L, other_idx);
+        lua_Integer scalar = 0;
+        if (other != nullptr) {
+            check_same_kind(L, other_idx, array);
+            luaL_argcheck(L, other->count == array->count, other_idx, "array lengths differ");
+        }
+        else {
+            scalar = luaL_checkinteger(L, other_idx);
+        }
+
+        TypedArray* out = push_array(L, array->kind, array->count);
+        with_elements(array, [&](auto* x) {
+            using T = std::remove_pointer_t<decltype(x)>;
+            T* to = (T*)out->data;
+            const T* y = other ? (const T*)other->data : nullptr;
+            T s = (T)scalar;
+            for (size_t i = 0; i < array->count; i++) {
+                T v = y ? y[i] : s;
+                if constexpr (op == BitOp::and_) to[i] = x[i] & v;
+                if constexpr (op == BitOp::or_) to[i] = x[i] | v;
+                if constexpr (op == BitOp::xor_) to[i] = x[i] ^ v;
+            }
+        });
+        return 1;
+    }
+
+    // ~mask -> new array with 1 where mask is 0 and 0 elsewhere (a logical not, for masks)
+    static int array_bnot(lua_State* L)
+    {
+        TypedArray* array = check_array(L, 1);
+        TypedArray* out = push_array(L, array->kind, array->count);
+        with_elements(array, [&](auto* x) {
+            using T = std::remove_pointer_t<decltype(x)>;
+            T* to = (T*)out->data;
+            for (size_t i = 0; i < array->count; i++) to[i] = x[i] == 0;
+        });
+        return 1;
+    }
+
+    // Create the array metatable; must run before any array is made
+    static void register_array_type(lua_State* L)
+    {
+        luaL_newmetatable(L, array_type);
+
+        lua_newtable(L);
+        luaL_setfuncs(L, array_methods, 0);
+        lua_pushcclosure(L, array_index, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, array_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushcfunction(L, array_len);
+        lua_setfield(L, -2, "__len");
+        lua_pushcfunction(L, array_tostring);
+        lua_setfield(L, -2, "__tostring");
+        lua_pushcfunction(L, array_bitop<BitOp::and_>);
+        lua_setfield(L, -2, "__band");
+        lua_pushcfunction(L, array_bitop<BitOp::or_>);
+        lua_setfield(L, -2, "__bor");
+        lua_pushcfunction(L, array_bitop<BitOp::xor_>);
+        lua_setfield(L, -2, "__bxor");
+        lua_pushcfunction(L, array_bnot);
+        lua_setfield(L, -2, "__bnot");
+        lua_pushliteral(L, "array");
+        lua_setfield(L, -2, "__metatable");
+
+        lua_pop(L, 1);
+    }
+}
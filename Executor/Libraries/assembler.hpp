@@ -1,38 +1,319 @@
 #include "../Executor.h"
+#include "arrays.hpp"
+#include "buffer.hpp"
 #include <keystone/keystone.h>
 
+#include <algorithm>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 namespace LUDA::Library
 {
-    int c_assemble(lua_State* L) {
-        const char* code = luaL_checkstring(L, 1);
+    /* One Keystone engine per Lua state, opened on first use and closed with the state.
+       Encodings depend on the address (RIP-relative operands, relative branches), so recent
+       ones are cached by (text, address); patch scripts tend to assemble the same stub at
+       the same sites again on every run. Symbols Keystone can't resolve itself are looked up
+       among the database's names; encodings that used one aren't cached, names can move. */
+    static constexpr const char* assembler_type = "LUDA.assembler";
+    static constexpr size_t assembler_cache_entries = 4096;
 
-        ks_engine* ks;
-        if (ks_open(KS_ARCH_X86, KS_MODE_64, &ks) != KS_ERR_OK) {
-            lua_pushnil(L);
-            lua_pushstring(L, "Failed to initialize Keystone");
-            return 2;
+    struct Assembler {
+        struct Entry {
+            std::string key;      // text, then the 8 address bytes
+            std::string encoding;
+        };
+
+        ks_engine* ks = nullptr;
+        std::list<Entry> recent;  // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;  // keys live in `recent`
+        std::string key;          // scratch key of the lookup in progress
+        std::string uncached;     // last encoding that used a database name
+
+        ~Assembler()
+        {
+            if (ks != nullptr) {
+                ks_close(ks);
+            }
+        }
+    };
+
+    // Set when the resolver is asked for a name during the ks_asm call in progress
+    static thread_local bool assembler_used_names = false;
+
+    static bool resolve_name(const char* symbol, uint64_t* value)
+    {
+        assembler_used_names = true;
+        ea_t ea = backend().name_ea(symbol);
+        if (ea == BADADDR) {
+            return false;
+        }
+        *value = ea;
+        return true;
+    }
+
+    static Assembler* get_assembler(lua_State* L)
+    {
+        lua_getfield(L, LUA_REGISTRYINDEX, assembler_type);
+        Assembler* as = (Assembler*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        return as;
+    }
+
+    // Bytes of `code` assembled at `ea`; nullptr and a message if it doesn't assemble
+    static const std::string* assemble_at(Assembler* as, const char* code, size_t length, ea_t ea, const char** error)
+    {
+        as->key.assign(code, length);
+        as->key.append((const char*)&ea, sizeof(ea));
+
+        auto it = as->index.find(as->key);
+        if (it != as->index.end()) {
+            as->recent.splice(as->recent.begin(), as->recent, it->second);
+            return &it->second->encoding;
+        }
+
+        if (as->ks == nullptr) {
+            if (ks_open(KS_ARCH_X86, KS_MODE_64, &as->ks) != KS_ERR_OK) {
+                as->ks = nullptr;
+                *error = "Failed to initialize Keystone";
+                return nullptr;
+            }
+            ks_option(as->ks, KS_OPT_SYM_RESOLVER, (size_t)resolve_name);
         }
 
         unsigned char* encoded;
         size_t size;
         size_t count;
+        assembler_used_names = false;
+        if (ks_asm(as->ks, code, ea, &encoded, &size, &count) != KS_ERR_OK) {
+            *error = ks_strerror(ks_errno(as->ks));
+            return nullptr;
+        }
+        if (assembler_used_names) {
+            as->uncached.assign((const char*)encoded, size);
+            ks_free(encoded);
+            return &as->uncached;
+        }
+
+        if (as->recent.size() >= assembler_cache_entries) {
+            as->index.erase(as->recent.back().key);
+            as->recent.pop_back();
+        }
+        as->recent.push_front({ as->key, std::string((const char*)encoded, size) });
+        as->index.emplace(as->recent.front().key, as->recent.begin());
+        ks_free(encoded);
+        return &as->recent.front().encoding;
+    }
+
+    // assemble(code [, ea]) -> { byte, ... } | nil, message
+    // `ea` is where the code will live (default 0); branches and RIP-relative operands depend on it
+    static int c_assemble(lua_State* L)
+    {
+        size_t length;
+        const char* code = luaL_checklstring(L, 1, &length);
+        ea_t ea = (ea_t)luaL_optinteger(L, 2, 0);
 
-        if (ks_asm(ks, code, 0, &encoded, &size, &count) != KS_ERR_OK) {
+        const char* error;
+        const std::string* bytes = assemble_at(get_assembler(L), code, length, ea, &error);
+        if (bytes == nullptr) {
             lua_pushnil(L);
-            lua_pushfstring(L, "Assembly failed: %s", ks_strerror(ks_errno(ks)));
-            ks_close(ks);
+            lua_pushfstring(L, "Assembly failed: %s", error);
             return 2;
         }
 
-        lua_newtable(L);
-        for (size_t i = 0; i < size; i++) {
-            lua_pushinteger(L, encoded[i]);
-            lua_rawseti(L, -2, i + 1);
+        lua_createtable(L, (int)bytes->size(), 0);
+        for (size_t i = 0; i < bytes->size(); i++) {
+            lua_pushinteger(L, (uint8_t)(*bytes)[i]);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
         }
+        return 1;
+    }
 
-        ks_free(encoded);
-        ks_close(ks);
+    // assemble_many({ code, ... } [, ea | { ea, ... } | u64array]) -> { buffer, ... } | nil, message
+    // One address for every snippet, or one per snippet
+    static int c_assemble_many(lua_State* L)
+    {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        lua_Integer count = (lua_Integer)lua_rawlen(L, 1);
+
+        ea_t ea = 0;
+        TypedArray* eas = nullptr;
+        bool ea_table = false;
+        if (lua_type(L, 2) == LUA_TTABLE) {
+            luaL_argcheck(L, (lua_Integer)lua_rawlen(L, 2) == count, 2, "one address per snippet expected");
+            ea_table = true;
+        }
+        else if ((eas = test_array(L, 2)) != nullptr) {
+            luaL_argcheck(L, (lua_Integer)eas->count == count, 2, "one address per snippet expected");
+        }
+        else {
+            ea = (ea_t)luaL_optinteger(L, 2, 0);
+        }
+
+        Assembler* as = get_assembler(L);
+        lua_createtable(L, (int)count, 0);
+        for (lua_Integer i = 1; i <= count; i++) {
+            if (lua_rawgeti(L, 1, i) != LUA_TSTRING) {
+                return luaL_error(L, "bad argument #1 (string expected at [%I], got %s)", i, luaL_typename(L, -1));
+            }
+            size_t length;
+            const char* code = lua_tolstring(L, -1, &length);
+
+            if (ea_table) {
+                lua_rawgeti(L, 2, i);
+                int ok;
+                ea = (ea_t)lua_tointegerx(L, -1, &ok);
+                if (!ok) {
+                    return luaL_error(L, "bad argument #2 (integer expected at [%I], got %s)", i, luaL_typename(L, -1));
+                }
+                lua_pop(L, 1);
+            }
+            else if (eas != nullptr) {
+                ea = (ea_t)with_elements(eas, [&](auto* data) { return (uint64_t)data[i - 1]; });
+            }
+
+            const char* error;
+            const std::string* bytes = assemble_at(as, code, length, ea, &error);
+            if (bytes == nullptr) {
+                lua_pushnil(L);
+                lua_pushfstring(L, "Assembly of snippet %I failed: %s", i, error);
+                return 2;
+            }
+            lua_pop(L, 1);
+
+            Buffer* buffer = push_buffer(L, bytes->size());
+            memcpy(buffer->data, bytes->data(), bytes->size());
+            lua_rawseti(L, -2, i);
+        }
+        return 1;
+    }
+
+    // patch.asm_at(sites, template [, opts]) -> u32array of patch sizes | nil, message
+    // Assembles `template` (text, or function(ea, i) -> text) at every site, u64array or
+    // { ea, ... }, and writes all of it as one undo point. Nothing is written if a site
+    // doesn't assemble or two patches overlap. opts: dry_run (assemble and check only)
+    static int c_patch_asm_at(lua_State* L)
+    {
+        if (test_array(L, 1) == nullptr) {
+            luaL_argexpected(L, lua_type(L, 1) == LUA_TTABLE, 1, "table or array");
+            lua_pushcfunction(L, c_u64array_new);
+            lua_pushvalue(L, 1);
+            lua_call(L, 1, 1);
+            lua_replace(L, 1);
+        }
+        TypedArray* sites = test_array(L, 1);
+        size_t count = sites->count;
+        auto site = [&](size_t i) { return (ea_t)with_elements(sites, [&](auto* eas) { return (uint64_t)eas[i]; }); };
+
+        int type = lua_type(L, 2);
+        luaL_argexpected(L, type == LUA_TSTRING || type == LUA_TFUNCTION, 2, "string or function");
+        bool dry_run = false;
+        if (!lua_isnoneornil(L, 3)) {
+            luaL_checktype(L, 3, LUA_TTABLE);
+            lua_getfield(L, 3, "dry_run");
+            dry_run = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+        }
+        lua_settop(L, 3);
+
+        // Every site's text up front (slot 4), the template may fail; after this nothing raises
+        if (type == LUA_TFUNCTION) {
+            lua_createtable(L, (int)count, 0);
+            for (size_t i = 0; i < count; i++) {
+                lua_pushvalue(L, 2);
+                lua_pushinteger(L, (lua_Integer)site(i));
+                lua_pushinteger(L, (lua_Integer)i + 1);
+                lua_call(L, 2, 1);
+                if (lua_type(L, -1) != LUA_TSTRING) {
+                    return luaL_error(L, "template returned %s for site %d, string expected", luaL_typename(L, -1), (int)i + 1);
+                }
+                lua_rawseti(L, 4, (lua_Integer)i + 1);
+            }
+        }
+        else {
+            lua_pushvalue(L, 2);
+        }
+        TypedArray* sizes = push_array(L, ArrayKind::u32, count);
+        uint32_t* size_of = (uint32_t*)sizes->data;
+
+        char error[256] = "";
+        {
+            Assembler* as = get_assembler(L);
+            std::string bytes;
+            std::vector<Patch> patches(count);
+            for (size_t i = 0; i < count && !error[0]; i++) {
+                if (type == LUA_TFUNCTION) {
+                    lua_rawgeti(L, 4, (lua_Integer)i + 1);
+                }
+                else {
+                    lua_pushvalue(L, 4);
+                }
+                size_t length;
+                const char* code = lua_tolstring(L, -1, &length);
+                const char* message;
+                const std::string* encoding = assemble_at(as, code, length, site(i), &message);
+                lua_pop(L, 1);
+
+                if (encoding == nullptr) {
+                    qsnprintf(error, sizeof(error), "Assembly at site %d (0x%llX) failed: %s", (int)i + 1, (unsigned long long)site(i), message);
+                    break;
+                }
+                patches[i] = { site(i), nullptr, encoding->size() };
+                size_of[i] = (uint32_t)encoding->size();
+                bytes += *encoding;
+            }
+
+            // Sorted by address, each patch has to end before the next one starts
+            std::vector<size_t> order;
+            order.reserve(count);
+            size_t offset = 0;
+            for (size_t i = 0; i < count && !error[0]; i++) {
+                patches[i].data = (const uint8_t*)bytes.data() + offset;
+                offset += patches[i].size;
+                if (patches[i].size > 0) {
+                    order.push_back(i);
+                }
+            }
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return patches[a].ea < patches[b].ea; });
+            for (size_t k = 1; k < order.size() && !error[0]; k++) {
+                const Patch& prev = patches[order[k - 1]];
+                const Patch& next = patches[order[k]];
+                if (next.ea - prev.ea < prev.size) {
+                    qsnprintf(error, sizeof(error), "Patches at site %d (0x%llX-0x%llX) and site %d (0x%llX) overlap",
+                        (int)order[k - 1] + 1, (unsigned long long)prev.ea, (unsigned long long)(prev.ea + prev.size),
+                        (int)order[k] + 1, (unsigned long long)next.ea);
+                }
+            }
+
+            if (!error[0] && !dry_run) {
+                backend().patch_bytes(patches.data(), patches.size(), "patch.asm_at");
+            }
+        }
 
+        if (error[0]) {
+            lua_pushnil(L);
+            lua_pushstring(L, error);
+            return 2;
+        }
         return 1;
     }
-}
\ No newline at end of file
+
+    static int assembler_gc(lua_State* L)
+    {
+        ((Assembler*)lua_touserdata(L, 1))->~Assembler();
+        return 0;
+    }
+
+    // Create this state's assembler; Keystone itself is opened by the first assemble()
+    static void register_assembler_type(lua_State* L)
+    {
+        new (lua_newuserdatauv(L, sizeof(Assembler), 0)) Assembler();
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, assembler_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_setmetatable(L, -2);
+        lua_setfield(L, LUA_REGISTRYINDEX, assembler_type);
+    }
+}
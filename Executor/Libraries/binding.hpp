@@ -0,0 +1,513 @@
+#pragma once
+#include "../Executor.h"
+
+#include <array>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace LUDA::Library
+{
+    /*
+        Lua bindings generated from plain C++ functions. bind<&fn> checks fn's arguments
+        by their C++ types and pushes whatever it returns, so a binding is one line:
+
+            static ea_t image_base() { return backend().image_base(); }
+            LUA_REGISTER_TABLE_BINDING(L, "image", "base", LUDA::Library::image_base);
+
+        Arguments: integers (ea_t included), floating point, bool, const char*,
+        std::string(_view), std::optional<T> (nil or none for nullopt), std::vector<T>
+        from a sequence, std::variant<...> picked by Lua type. A leading lua_State* is
+        passed through and takes no stack slot.
+
+        Results: the same plus std::span<const T>, records, std::tuple<...> for several
+        values and Result<T> for value-or-(nil, message). The IDA build adds qstring
+        and func_t*.
+
+        Records are structs with a record_fields specialization. Their field names are
+        interned once, as upvalues of the binding's closure (push_binding), so filling a
+        row is lua_pushvalue + lua_rawset per field, into a table created at its final size.
+
+        Lua errors longjmp past C++ destructors, so nothing that owns memory may be alive
+        when one can be raised. All arguments are checked before any is converted, and the
+        arguments are destroyed before the results are pushed. A result that owns memory is
+        kept in a box in the closure's last upvalue while it is pushed. If a push fails,
+        the box is emptied by the next call or when the state is closed.
+    */
+
+    // A value, or nil and an error message
+    template <typename T>
+    struct Result {
+        std::optional<T> value;
+        std::string error;
+
+        Result(T v) : value(std::move(v)) {}
+
+        static Result fail(std::string message)
+        {
+            Result result;
+            result.error = std::move(message);
+            return result;
+        }
+
+    private:
+        Result() = default;
+    };
+
+    template <typename Record, typename Member>
+    struct Field {
+        using member_type = Member;
+        const char* name;
+        Member Record::* member;
+    };
+
+    template <typename Record, typename Member>
+    constexpr Field<Record, Member> field(const char* name, Member Record::* member)
+    {
+        return { name, member };
+    }
+
+    // Specialize with: static constexpr auto fields = std::make_tuple(field("name", &T::member), ...);
+    template <typename T>
+    struct record_fields;
+
+    template <>
+    struct record_fields<FunctionRange> {
+        static constexpr auto fields = std::make_tuple(
+            field("start", &FunctionRange::start),
+            field("end", &FunctionRange::end));
+    };
+
+    template <>
+    struct record_fields<Segment> {
+        static constexpr auto fields = std::make_tuple(
+            field("name", &Segment::name),
+            field("start", &Segment::start),
+            field("end", &Segment::end));
+    };
+
+    /*
+        lua_value<T>:
+            slots                     stack slots the argument takes
+            check(L, idx)             Lua error unless the argument at idx is a T
+            get(L, idx)               the checked argument at idx; never raises
+            matches(L, idx)           value at idx is a T (variants, list elements)
+            push(L, value, key)       number of values pushed; `key` is the upvalue of its first field name
+            keys / push_keys(L)       field names T needs as upvalues
+    */
+    template <typename T, typename = void>
+    struct lua_value;
+
+    struct no_keys {
+        static constexpr int slots = 1;
+        static constexpr int keys = 0;
+        static void push_keys(lua_State*) {}
+    };
+
+    template <typename T>
+    struct lua_value<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> : no_keys {
+        static constexpr const char* expected = "number";
+        static bool matches(lua_State* L, int idx) { return lua_type(L, idx) == LUA_TNUMBER; }
+        static void check(lua_State* L, int idx) { luaL_checkinteger(L, idx); }
+        static T get(lua_State* L, int idx) { return (T)lua_tointeger(L, idx); }
+        static int push(lua_State* L, T value, int) { lua_pushinteger(L, (lua_Integer)value); return 1; }
+    };
+
+    template <typename T>
+    struct lua_value<T, std::enable_if_t<std::is_floating_point_v<T>>> : no_keys {
+        static constexpr const char* expected = "number";
+        static bool matches(lua_State* L, int idx) { return lua_type(L, idx) == LUA_TNUMBER; }
+        static void check(lua_State* L, int idx) { luaL_checknumber(L, idx); }
+        static T get(lua_State* L, int idx) { return (T)lua_tonumber(L, idx); }
+        static int push(lua_State* L, T value, int) { lua_pushnumber(L, (lua_Number)value); return 1; }
+    };
+
+    // Any value is a boolean, like in a Lua condition
+    template <>
+    struct lua_value<bool> : no_keys {
+        static constexpr const char* expected = "boolean";
+        static bool matches(lua_State*, int) { return true; }
+        static void check(lua_State*, int) {}
+        static bool get(lua_State* L, int idx) { return lua_toboolean(L, idx) != 0; }
+        static int push(lua_State* L, bool value, int) { lua_pushboolean(L, value); return 1; }
+    };
+
+    template <>
+    struct lua_value<const char*> : no_keys {
+        static constexpr const char* expected = "string";
+        static bool matches(lua_State* L, int idx) { return lua_type(L, idx) == LUA_TSTRING; }
+        static void check(lua_State* L, int idx) { luaL_checkstring(L, idx); }
+        static const char* get(lua_State* L, int idx) { return lua_tostring(L, idx); }
+        static int push(lua_State* L, const char* value, int) { lua_pushstring(L, value); return 1; }
+    };
+
+    // Views into the argument string, valid for the call
+    template <>
+    struct lua_value<std::string_view> : no_keys {
+        static constexpr const char* expected = "string";
+        static bool matches(lua_State* L, int idx) { return lua_type(L, idx) == LUA_TSTRING; }
+        static void check(lua_State* L, int idx) { luaL_checkstring(L, idx); }
+        static std::string_view get(lua_State* L, int idx)
+        {
+            size_t len;
+            const char* s = lua_tolstring(L, idx, &len);
+            return { s, len };
+        }
+        static int push(lua_State* L, std::string_view value, int) { lua_pushlstring(L, value.data(), value.size()); return 1; }
+    };
+
+    template <>
+    struct lua_value<std::string> : no_keys {
+        static constexpr const char* expected = "string";
+        static bool matches(lua_State* L, int idx) { return lua_type(L, idx) == LUA_TSTRING; }
+        static void check(lua_State* L, int idx) { luaL_checkstring(L, idx); }
+        static std::string get(lua_State* L, int idx) { return std::string(lua_value<std::string_view>::get(L, idx)); }
+        static int push(lua_State* L, const std::string& value, int) { lua_pushlstring(L, value.data(), value.size()); return 1; }
+    };
+
+    // The calling state, handed to the function as is
+    template <>
+    struct lua_value<lua_State*> : no_keys {
+        static constexpr int slots = 0;
+        static void check(lua_State*, int) {}
+        static lua_State* get(lua_State* L, int) { return L; }
+    };
+
+    template <typename T>
+    struct lua_value<std::optional<T>> {
+        static constexpr int slots = 1;
+        static constexpr int keys = lua_value<T>::keys;
+        static void push_keys(lua_State* L) { lua_value<T>::push_keys(L); }
+
+        static void check(lua_State* L, int idx)
+        {
+            if (!lua_isnoneornil(L, idx)) {
+                lua_value<T>::check(L, idx);
+            }
+        }
+
+        static std::optional<T> get(lua_State* L, int idx)
+        {
+            if (lua_isnoneornil(L, idx)) {
+                return std::nullopt;
+            }
+            return lua_value<T>::get(L, idx);
+        }
+
+        static int push(lua_State* L, const std::optional<T>& value, int key)
+        {
+            if (!value) {
+                lua_pushnil(L);
+                return 1;
+            }
+            return lua_value<T>::push(L, *value, key);
+        }
+    };
+
+    // Sequences: pushed as a table of the exact size
+    template <typename T>
+    static int push_sequence(lua_State* L, const T* items, size_t count, int key)
+    {
+        lua_createtable(L, (int)count, 0);
+        for (size_t i = 0; i < count; i++) {
+            lua_value<std::remove_cv_t<T>>::push(L, items[i], key);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        return 1;
+    }
+
+    template <typename T>
+    struct lua_value<std::span<T>> {
+        static constexpr int slots = 1;
+        static constexpr int keys = lua_value<std::remove_cv_t<T>>::keys;
+        static void push_keys(lua_State* L) { lua_value<std::remove_cv_t<T>>::push_keys(L); }
+        static int push(lua_State* L, std::span<T> value, int key) { return push_sequence(L, value.data(), value.size(), key); }
+    };
+
+    template <typename T>
+    struct lua_value<std::vector<T>> {
+        static constexpr int slots = 1;
+        static constexpr int keys = lua_value<T>::keys;
+        static void push_keys(lua_State* L) { lua_value<T>::push_keys(L); }
+        static int push(lua_State* L, const std::vector<T>& value, int key) { return push_sequence(L, value.data(), value.size(), key); }
+
+        static void check(lua_State* L, int idx)
+        {
+            luaL_checktype(L, idx, LUA_TTABLE);
+            size_t count = (size_t)lua_rawlen(L, idx);
+            for (size_t i = 1; i <= count; i++) {
+                lua_rawgeti(L, idx, (lua_Integer)i);
+                if (!lua_value<T>::matches(L, -1)) {
+                    luaL_error(L, "bad argument #%d (%s expected at [%d], got %s)",
+                        idx, lua_value<T>::expected, (int)i, luaL_typename(L, -1));
+                }
+                lua_value<T>::check(L, lua_gettop(L));
+                lua_pop(L, 1);
+            }
+        }
+
+        static std::vector<T> get(lua_State* L, int idx)
+        {
+            size_t count = (size_t)lua_rawlen(L, idx);
+            std::vector<T> items;
+            items.reserve(count);
+            for (size_t i = 1; i <= count; i++) {
+                lua_rawgeti(L, idx, (lua_Integer)i);
+                items.push_back(lua_value<T>::get(L, lua_gettop(L)));
+                lua_pop(L, 1);
+            }
+            return items;
+        }
+    };
+
+    // First alternative whose Lua type matches
+    template <typename... T>
+    struct lua_value<std::variant<T...>> : no_keys {
+        static void check(lua_State* L, int idx)
+        {
+            bool picked = false;
+            ((!picked && lua_value<T>::matches(L, idx) ? (void)(picked = true, lua_value<T>::check(L, idx)) : (void)0), ...);
+            if (!picked) {
+                static const std::string expected = [] {
+                    std::string names;
+                    ((names += names.empty() ? "" : " or ", names += lua_value<T>::expected), ...);
+                    return names;
+                }();
+                luaL_typeerror(L, idx, expected.c_str());
+            }
+        }
+
+        static std::variant<T...> get(lua_State* L, int idx)
+        {
+            std::optional<std::variant<T...>> picked;
+            ((!picked && lua_value<T>::matches(L, idx) ? (void)(picked = lua_value<T>::get(L, idx)) : (void)0), ...);
+            return *picked;
+        }
+    };
+
+    template <typename T>
+    struct lua_value<Result<T>> {
+        static constexpr int keys = lua_value<T>::keys;
+        static void push_keys(lua_State* L) { lua_value<T>::push_keys(L); }
+
+        static int push(lua_State* L, const Result<T>& result, int key)
+        {
+            if (result.value) {
+                return lua_value<T>::push(L, *result.value, key);
+            }
+            lua_pushnil(L);
+            lua_pushlstring(L, result.error.data(), result.error.size());
+            return 2;
+        }
+    };
+
+    // Several results; each one's field names follow the previous one's
+    template <typename... T>
+    struct lua_value<std::tuple<T...>> {
+        static constexpr int keys = (0 + ... + lua_value<T>::keys);
+        static void push_keys(lua_State* L) { (lua_value<T>::push_keys(L), ...); }
+
+        static int push(lua_State* L, const std::tuple<T...>& values, int key)
+        {
+            int pushed = 0;
+            std::apply([&](const T&... value) {
+                ((pushed += lua_value<T>::push(L, value, key), key += lua_value<T>::keys), ...);
+            }, values);
+            return pushed;
+        }
+    };
+
+    template <typename T, typename = void>
+    struct is_record : std::false_type {};
+
+    template <typename T>
+    struct is_record<T, std::void_t<decltype(record_fields<T>::fields)>> : std::true_type {};
+
+    // Table with one entry per field. Field names sit in upvalues key .. key + count - 1,
+    // followed by those of fields that are records themselves.
+    template <typename T>
+    struct lua_value<T, std::enable_if_t<is_record<T>::value>> {
+        static constexpr int slots = 1;
+        static constexpr int count = (int)std::tuple_size_v<std::remove_cv_t<decltype(record_fields<T>::fields)>>;
+        static constexpr int keys = count + std::apply([](const auto&... f) {
+            return (0 + ... + lua_value<typename std::remove_cvref_t<decltype(f)>::member_type>::keys);
+        }, record_fields<T>::fields);
+
+        static void push_keys(lua_State* L)
+        {
+            std::apply([&](const auto&... f) { (lua_pushstring(L, f.name), ...); }, record_fields<T>::fields);
+            std::apply([&](const auto&... f) {
+                (lua_value<typename std::remove_cvref_t<decltype(f)>::member_type>::push_keys(L), ...);
+            }, record_fields<T>::fields);
+        }
+
+        static int push(lua_State* L, const T& value, int key)
+        {
+            lua_createtable(L, 0, count);
+            int name = key;
+            int nested = key + count;
+            std::apply([&](const auto&... f) {
+                ((lua_pushvalue(L, lua_upvalueindex(name++)),
+                  push_field(L, value.*(f.member), nested),
+                  lua_rawset(L, -3)), ...);
+            }, record_fields<T>::fields);
+            return 1;
+        }
+
+    private:
+        template <typename M>
+        static void push_field(lua_State* L, const M& member, int& nested)
+        {
+            lua_value<M>::push(L, member, nested);
+            nested += lua_value<M>::keys;
+        }
+    };
+
+#ifndef LUDA_HEADLESS
+    template <>
+    struct lua_value<qstring> : no_keys {
+        static constexpr const char* expected = "string";
+        static bool matches(lua_State* L, int idx) { return lua_type(L, idx) == LUA_TSTRING; }
+        static void check(lua_State* L, int idx) { luaL_checkstring(L, idx); }
+        static qstring get(lua_State* L, int idx)
+        {
+            size_t len;
+            const char* s = lua_tolstring(L, idx, &len);
+            return qstring(s, len);
+        }
+        static int push(lua_State* L, const qstring& value, int) { lua_pushlstring(L, value.c_str(), value.length()); return 1; }
+    };
+
+    // Taken as the address of any byte in the function (nullptr if there is none),
+    // given back as {start, end}
+    template <>
+    struct lua_value<func_t*> {
+        static constexpr int slots = 1;
+        static constexpr int keys = lua_value<FunctionRange>::keys;
+        static void push_keys(lua_State* L) { lua_value<FunctionRange>::push_keys(L); }
+
+        static void check(lua_State* L, int idx) { luaL_checkinteger(L, idx); }
+        static func_t* get(lua_State* L, int idx) { return get_func((ea_t)lua_tointeger(L, idx)); }
+
+        static int push(lua_State* L, const func_t* func, int key)
+        {
+            if (func == nullptr) {
+                lua_pushnil(L);
+                return 1;
+            }
+            FunctionRange range;
+            range.start = func->start_ea;
+            range.end = func->end_ea;
+            return lua_value<FunctionRange>::push(L, range, key);
+        }
+    };
+#endif
+
+    // A result that owns memory, parked while it is pushed (see the top of the file)
+    template <typename R>
+    struct result_box {
+        std::optional<R> value;
+    };
+
+    template <typename R>
+    static int result_box_gc(lua_State* L)
+    {
+        ((result_box<R>*)lua_touserdata(L, 1))->~result_box<R>();
+        return 0;
+    }
+
+    template <auto Fn, typename F = decltype(Fn)>
+    struct trampoline;
+
+    template <auto Fn, typename R, typename... A>
+    struct trampoline<Fn, R (*)(A...)> {
+        using result = std::remove_cvref_t<R>;
+
+        // Results that own memory go through a result_box
+        static constexpr bool boxed = !std::is_void_v<R> && !std::is_trivially_destructible_v<result>;
+
+        static constexpr std::array<int, sizeof...(A)> stack_indices()
+        {
+            std::array<int, sizeof...(A)> index{};
+            [[maybe_unused]] int next = 1;
+            [[maybe_unused]] size_t i = 0;
+            ((index[i++] = next, next += lua_value<std::remove_cvref_t<A>>::slots), ...);
+            return index;
+        }
+
+        // Converts the checked arguments and calls Fn; the arguments are gone when this returns
+        template <size_t... I>
+        static std::conditional_t<std::is_void_v<R>, void, result> apply([[maybe_unused]] lua_State* L, std::index_sequence<I...>)
+        {
+            [[maybe_unused]] constexpr auto index = stack_indices();
+            // Braced initialization converts the arguments left to right
+            std::tuple<std::remove_cvref_t<A>...> args{ lua_value<std::remove_cvref_t<A>>::get(L, index[I])... };
+            return std::apply(Fn, std::move(args));
+        }
+
+        template <size_t... I>
+        static int invoke(lua_State* L, std::index_sequence<I...> sequence)
+        {
+            [[maybe_unused]] constexpr auto index = stack_indices();
+            (lua_value<std::remove_cvref_t<A>>::check(L, index[I]), ...);
+
+            if constexpr (std::is_void_v<R>) {
+                apply(L, sequence);
+                return 0;
+            }
+            else if constexpr (!boxed) {
+                return lua_value<result>::push(L, apply(L, sequence), 1);
+            }
+            else {
+                auto* box = (result_box<result>*)lua_touserdata(L, lua_upvalueindex(lua_value<result>::keys + 1));
+                box->value.reset();  // left over if the last push failed
+                box->value.emplace(apply(L, sequence));
+                int pushed = lua_value<result>::push(L, *box->value, 1);
+                box->value.reset();
+                return pushed;
+            }
+        }
+
+        static int call(lua_State* L)
+        {
+            return invoke(L, std::index_sequence_for<A...>{});
+        }
+    };
+
+    template <auto Fn>
+    static int bind(lua_State* L)
+    {
+        return trampoline<Fn>::call(L);
+    }
+
+    // Push bind<Fn> as a closure over the field names its results use
+    template <auto Fn>
+    static void push_binding(lua_State* L)
+    {
+        using R = typename trampoline<Fn>::result;
+        if constexpr (std::is_void_v<R>) {
+            lua_pushcfunction(L, bind<Fn>);
+        }
+        else if constexpr (!trampoline<Fn>::boxed) {
+            static_assert(lua_value<R>::keys <= 255, "too many field names for one closure");
+            lua_value<R>::push_keys(L);
+            lua_pushcclosure(L, bind<Fn>, lua_value<R>::keys);
+        }
+        else {
+            static_assert(lua_value<R>::keys + 1 <= 255, "too many field names for one closure");
+            lua_value<R>::push_keys(L);
+            new (lua_newuserdatauv(L, sizeof(result_box<R>), 0)) result_box<R>();
+            lua_createtable(L, 0, 1);
+            lua_pushcfunction(L, result_box_gc<R>);
+            lua_setfield(L, -2, "__gc");
+            lua_setmetatable(L, -2);
+            lua_pushcclosure(L, bind<Fn>, lua_value<R>::keys + 1);
+        }
+    }
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include "../Executor.h"
+
+#include <cstring>
+
+namespace LUDA::Library
+{
+    /* Fixed-size byte array living in a single userdata, so it counts against the Lua heap
+       and can be handed to the socket without converting it to a string or table first. */
+    static constexpr const char* buffer_type = "LUDA.buffer";
+
+    struct Buffer {
+        size_t size;
+        alignas(16) uint8_t data[1]; // `size` bytes follow
+    };
+
+    // New zeroed buffer on top of the stack
+    static Buffer* push_buffer(lua_State* L, size_t size)
+    {
+        if (size > (size_t)-1 - offsetof(Buffer, data)) {
+            luaL_error(L, "buffer too large");
+        }
+        // Zeroed as the whole block, a memset of `size` bytes from `data[1]` looks like an overflow
+        size_t bytes = offsetof(Buffer, data) + (size ? size : 1);
+        Buffer* buffer = (Buffer*)memset(lua_newuserdatauv(L, bytes, 0), 0, bytes);
+        buffer->size = size;
+        luaL_setmetatable(L, buffer_type);
+        return buffer;
+    }
+
+    static Buffer* check_buffer(lua_State* L, int idx)
+    {
+        return (Buffer*)luaL_checkudata(L, idx, buffer_type);
+    }
+
+    // Bytes of a buffer or string argument, without copying; nullptr for anything else
+    static const uint8_t* to_bytes(lua_State* L, int idx, size_t* size)
+    {
+        if (Buffer* buffer = (Buffer*)luaL_testudata(L, idx, buffer_type)) {
+            *size = buffer->size;
+            return buffer->data;
+        }
+        if (lua_type(L, idx) == LUA_TSTRING) {
+            return (const uint8_t*)lua_tolstring(L, idx, size);
+        }
+        return nullptr;
+    }
+
+    // Lua-style i..j (1-based, negative from the end) clamped to [0, size)
+    static bool buffer_range(lua_State* L, int idx, size_t size, size_t* from, size_t* to)
+    {
+        lua_Integer i = luaL_optinteger(L, idx, 1);
+        lua_Integer j = luaL_optinteger(L, idx + 1, -1);
+        lua_Integer n = (lua_Integer)size;
+        if (i < 0) i = n + i + 1;
+        if (j < 0) j = n + j + 1;
+        if (i < 1) i = 1;
+        if (j > n) j = n;
+        if (i > j) {
+            return false;
+        }
+        *from = (size_t)(i - 1);
+        *to = (size_t)j;
+        return true;
+    }
+
+    // buffer.new(size) -> zeroed buffer
+    static int c_buffer_new(lua_State* L)
+    {
+        lua_Integer size = luaL_checkinteger(L, 1);
+        luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+        push_buffer(L, (size_t)size);
+        return 1;
+    }
+
+    // buffer.from(string) -> buffer with a copy of the string's bytes
+    static int c_buffer_from(lua_State* L)
+    {
+        size_t size;
+        const char* bytes = luaL_checklstring(L, 1, &size);
+        Buffer* buffer = push_buffer(L, size);
+        memcpy(buffer->data, bytes, size);
+        return 1;
+    }
+
+    // buf:sub(i [, j]) -> new buffer with bytes i..j
+    static int c_buffer_sub(lua_State* L)
+    {
+        Buffer* buffer = check_buffer(L, 1);
+        size_t from, to;
+        if (!buffer_range(L, 2, buffer->size, &from, &to)) {
+            push_buffer(L, 0);
+            return 1;
+        }
+        Buffer* slice = push_buffer(L, to - from);
+        memcpy(slice->data, buffer->data + from, to - from);
+        return 1;
+    }
+
+    // buf:tostring([i [, j]]) -> bytes i..j as a Lua string
+    static int c_buffer_tostring(lua_State* L)
+    {
+        Buffer* buffer = check_buffer(L, 1);
+        size_t from, to;
+        if (!buffer_range(L, 2, buffer->size, &from, &to)) {
+            lua_pushliteral(L, "");
+            return 1;
+        }
+        lua_pushlstring(L, (const char*)buffer->data + from, to - from);
+        return 1;
+    }
+
+    static const luaL_Reg buffer_methods[] = {
+        { "sub",      c_buffer_sub },
+        { "tostring", c_buffer_tostring },
+        { NULL, NULL }
+    };
+
+    // buf[i] -> byte at i (1-based), or a method
+    static int buffer_index(lua_State* L)
+    {
+        Buffer* buffer = check_buffer(L, 1);
+        if (lua_type(L, 2) == LUA_TNUMBER) {
+            lua_Integer i = lua_tointeger(L, 2);
+            if (i >= 1 && (lua_Unsigned)i <= buffer->size) {
+                lua_pushinteger(L, buffer->data[i - 1]);
+            }
+            else {
+                lua_pushnil(L);
+            }
+            return 1;
+        }
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    // buf[i] = byte
+    static int buffer_newindex(lua_State* L)
+    {
+        Buffer* buffer = check_buffer(L, 1);
+        lua_Integer i = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, i >= 1 && (lua_Unsigned)i <= buffer->size, 2, "index out of range");
+        buffer->data[i - 1] = (uint8_t)luaL_checkinteger(L, 3);
+        return 0;
+    }
+
+    static int buffer_len(lua_State* L)
+    {
+        lua_pushinteger(L, (lua_Integer)check_buffer(L, 1)->size);
+        return 1;
+    }
+
+    static int buffer_tostring_meta(lua_State* L)
+    {
+        lua_pushfstring(L, "buffer: %I bytes", (lua_Integer)check_buffer(L, 1)->size);
+        return 1;
+    }
+
+    // Create the buffer metatable; must run before any buffer is made
+    static void register_buffer_type(lua_State* L)
+    {
+        luaL_newmetatable(L, buffer_type);
+
+        lua_newtable(L);
+        luaL_setfuncs(L, buffer_methods, 0);
+        lua_pushcclosure(L, buffer_index, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, buffer_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushcfunction(L, buffer_len);
+        lua_setfield(L, -2, "__len");
+        lua_pushcfunction(L, buffer_tostring_meta);
+        lua_setfield(L, -2, "__tostring");
+        lua_pushliteral(L, "buffer");
+        lua_setfield(L, -2, "__metatable");
+
+        lua_pop(L, 1);
+    }
+}
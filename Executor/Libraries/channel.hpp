@@ -0,0 +1,58 @@
+#pragma once
+#include "../Executor.h"
+#include "buffer.hpp"
+#include "msgpack.hpp"
+
+namespace LUDA::Library
+{
+    static const char* const binary_kinds[] = { "data", "memory", "text", "records", NULL };
+    static const char* const binary_encodings[] = { "raw", "utf8", "msgpack", NULL };
+
+    // luda.send(buffer | string [, kind [, encoding [, address]]]) -> delivered
+    // Sends a binary message to the client that submitted this script. The bytes go
+    // from the buffer/string straight to the socket.
+    static int c_send(lua_State* L)
+    {
+        size_t size;
+        const uint8_t* bytes = to_bytes(L, 1, &size);
+        luaL_argexpected(L, bytes != nullptr, 1, "buffer or string");
+
+        int kind = luaL_checkoption(L, 2, "data", binary_kinds);
+        int encoding = luaL_checkoption(L, 3, "raw", binary_encodings);
+        uint64_t address = (uint64_t)luaL_optinteger(L, 4, 0);
+
+        lua_pushboolean(L, luda::SendBinary((luda::BinaryKind)kind, (luda::BinaryEncoding)encoding, bytes, size, address));
+        return 1;
+    }
+
+    // Encoder output, reused between calls (one job runs at a time)
+    static std::vector<uint8_t>& emit_buffer()
+    {
+        static std::vector<uint8_t> out;
+        return out;
+    }
+
+    // luda.emit(value [, kind]) -> delivered, size
+    // Encodes a Lua value tree (tables, numbers, strings, booleans, buffers) as MessagePack
+    // and sends it to the client that submitted this script as one binary frame.
+    static int c_emit(lua_State* L)
+    {
+        luaL_checkany(L, 1);
+        int kind = luaL_checkoption(L, 2, "data", binary_kinds);
+        lua_settop(L, 1);
+
+        std::vector<uint8_t>& out = emit_buffer();
+        out.clear();
+        msgpack_encode(L, 1, out, 0);
+
+        bool delivered = luda::SendBinary((luda::BinaryKind)kind, luda::BinaryEncoding::MessagePack, out.data(), out.size());
+        lua_pushboolean(L, delivered);
+        lua_pushinteger(L, (lua_Integer)out.size());
+
+        // Don't hold on to the peak of one huge result
+        if (out.capacity() > 16 * 1024 * 1024) {
+            std::vector<uint8_t>().swap(out);
+        }
+        return 2;
+    }
+}
@@ -0,0 +1,687 @@
+#pragma once
+#include "../Executor.h"
+#include "heap.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace LUDA::Library
+{
+    /*
+        luda.eamap(): map from addresses to any Lua value, kept in address order.
+
+            m[ea] = v, m[ea], m[ea] = nil     like a table with integer keys
+            m:lower_bound(ea), m:upper_bound(ea), m:floor(ea), m:first(), m:last()
+                                              -> ea, value of the first entry >= / > ea,
+                                                 the last <= ea, ...; nil if there is none
+            for ea, v in m:range(a, b)        entries with a <= ea < b, in order
+            for ea, v in pairs(m)             all entries, in order
+            #m, m:clear()
+
+        Addresses compare unsigned. The keys live in a B+tree of native nodes (leaves linked
+        both ways for iteration); a leaf holds the value's slot in a Lua table that is the
+        map's user value, so values stay visible to the collector. Freed slots are chained
+        through that table and reused. Iterators continue from the last key they returned,
+        so changing the map while iterating is safe; unchanged, they step along the leaves.
+    */
+    static constexpr const char* eamap_type = "LUDA.eamap";
+    static constexpr int eamap_order = 32;     // keys per node
+    static constexpr int eamap_max_height = 24;
+
+    struct EaMapNode {
+        int count;                             // keys in use
+    };
+
+    struct EaMapLeaf : EaMapNode {
+        EaMapLeaf* prev;
+        EaMapLeaf* next;
+        ea_t keys[eamap_order];
+        uint32_t slots[eamap_order];           // index into the values table
+    };
+
+    struct EaMapInner : EaMapNode {
+        ea_t keys[eamap_order];                // keys[i] <= every key under children[i + 1]
+        EaMapNode* children[eamap_order + 1];
+    };
+
+    struct EaMap {
+        LuaHeap heap;
+        EaMapNode* root;                       // nullptr while empty
+        int height;                            // inner levels above the leaves
+        size_t count;
+        EaMapLeaf* first;
+        EaMapLeaf* last;
+        uint64_t version;                      // bumped whenever nodes change, see eamap_next
+        uint32_t next_slot;                    // first slot never used
+        uint32_t free_slot;                    // head of the free slot chain, 0 if none
+        // Nodes allocated ahead of an insert, so a split can't fail half way
+        EaMapLeaf* spare_leaves;               // chained through next
+        EaMapInner* spare_inners;              // chained through children[0]
+        int spare_leaf_count;
+        int spare_inner_count;
+    };
+
+    // An entry: leaf and index, leaf == nullptr past the end
+    struct EaMapPosition {
+        EaMapLeaf* leaf;
+        int i;
+    };
+
+    static EaMap* check_eamap(lua_State* L, int idx)
+    {
+        return (EaMap*)luaL_checkudata(L, idx, eamap_type);
+    }
+
+    // Make sure a split of every level plus a new root can be served from the spares
+    static void eamap_reserve(lua_State* L, EaMap* map)
+    {
+        if (map->height >= eamap_max_height - 1) {
+            luaL_error(L, "eamap is too deep");
+        }
+        while (map->spare_leaf_count < 1) {
+            EaMapLeaf* leaf = (EaMapLeaf*)map->heap.allocate(L, sizeof(EaMapLeaf));
+            leaf->next = map->spare_leaves;
+            map->spare_leaves = leaf;
+            map->spare_leaf_count++;
+        }
+        while (map->spare_inner_count < map->height + 1) {
+            EaMapInner* inner = (EaMapInner*)map->heap.allocate(L, sizeof(EaMapInner));
+            inner->children[0] = map->spare_inners;
+            map->spare_inners = inner;
+            map->spare_inner_count++;
+        }
+    }
+
+    static EaMapLeaf* eamap_take_leaf(EaMap* map)
+    {
+        EaMapLeaf* leaf = map->spare_leaves;
+        map->spare_leaves = leaf->next;
+        map->spare_leaf_count--;
+        leaf->count = 0;
+        leaf->prev = leaf->next = nullptr;
+        return leaf;
+    }
+
+    static EaMapInner* eamap_take_inner(EaMap* map)
+    {
+        EaMapInner* inner = map->spare_inners;
+        map->spare_inners = (EaMapInner*)inner->children[0];
+        map->spare_inner_count--;
+        inner->count = 0;
+        return inner;
+    }
+
+    // Leaf that would hold `key`, with the inner nodes and child indices on the way down
+    static EaMapLeaf* eamap_find_leaf(const EaMap* map, ea_t key, EaMapInner** path = nullptr, int* index = nullptr)
+    {
+        EaMapNode* node = map->root;
+        for (int level = 0; level < map->height; level++) {
+            EaMapInner* inner = (EaMapInner*)node;
+            int i = (int)(std::upper_bound(inner->keys, inner->keys + inner->count, key) - inner->keys);
+            if (path) {
+                path[level] = inner;
+                index[level] = i;
+            }
+            node = inner->children[i];
+        }
+        return (EaMapLeaf*)node;
+    }
+
+    // Step to the next entry, across leaves
+    static EaMapPosition eamap_normalize(EaMapPosition at)
+    {
+        if (at.leaf != nullptr && at.i >= at.leaf->count) {
+            return { at.leaf->next, 0 };
+        }
+        return at;
+    }
+
+    // First entry with a key >= ea (upper: > ea)
+    static EaMapPosition eamap_lower_bound(const EaMap* map, ea_t ea, bool upper = false)
+    {
+        if (map->root == nullptr) {
+            return { nullptr, 0 };
+        }
+        EaMapLeaf* leaf = eamap_find_leaf(map, ea);
+        ea_t* end = leaf->keys + leaf->count;
+        int i = (int)((upper ? std::upper_bound(leaf->keys, end, ea) : std::lower_bound(leaf->keys, end, ea)) - leaf->keys);
+        return eamap_normalize({ leaf, i });
+    }
+
+    // Last entry with a key <= ea
+    static EaMapPosition eamap_floor(const EaMap* map, ea_t ea)
+    {
+        if (map->root == nullptr) {
+            return { nullptr, 0 };
+        }
+        EaMapLeaf* leaf = eamap_find_leaf(map, ea);
+        int i = (int)(std::upper_bound(leaf->keys, leaf->keys + leaf->count, ea) - leaf->keys) - 1;
+        if (i < 0) {
+            leaf = leaf->prev;
+            i = leaf ? leaf->count - 1 : 0;
+        }
+        return { leaf, i };
+    }
+
+    // Slot of ea's entry, 0 if there is none
+    static uint32_t eamap_find(const EaMap* map, ea_t ea)
+    {
+        EaMapPosition at = eamap_lower_bound(map, ea);
+        return at.leaf != nullptr && at.leaf->keys[at.i] == ea ? at.leaf->slots[at.i] : 0;
+    }
+
+    // Add ea -> slot at position i of the leaf eamap_find_leaf found along path/index
+    // (nullptr in an empty map). ea must not be in the map and eamap_reserve must have run.
+    static void eamap_insert(EaMap* map, EaMapInner** path, const int* index, EaMapLeaf* leaf, int i, ea_t ea, uint32_t slot)
+    {
+        map->count++;
+        map->version++;
+        if (leaf == nullptr) {
+            leaf = eamap_take_leaf(map);
+            leaf->keys[0] = ea;
+            leaf->slots[0] = slot;
+            leaf->count = 1;
+            map->root = leaf;
+            map->first = map->last = leaf;
+            return;
+        }
+
+        if (leaf->count == eamap_order) {
+            // Move the upper half to a new leaf on the right
+            EaMapLeaf* right = eamap_take_leaf(map);
+            int half = eamap_order / 2;
+            right->count = eamap_order - half;
+            memcpy(right->keys, leaf->keys + half, right->count * sizeof(ea_t));
+            memcpy(right->slots, leaf->slots + half, right->count * sizeof(uint32_t));
+            leaf->count = half;
+
+            right->prev = leaf;
+            right->next = leaf->next;
+            if (right->next) right->next->prev = right;
+            else map->last = right;
+            leaf->next = right;
+
+            if (i > half) {
+                leaf = right;
+                i -= half;
+            }
+
+            // Hand the separator up, splitting full inner nodes on the way
+            ea_t separator = right->keys[0];
+            EaMapNode* child = right;
+            int level = map->height - 1;
+            for (; level >= 0; level--) {
+                EaMapInner* inner = path[level];
+                int at = index[level];
+                if (inner->count < eamap_order) {
+                    memmove(inner->keys + at + 1, inner->keys + at, (inner->count - at) * sizeof(ea_t));
+                    memmove(inner->children + at + 2, inner->children + at + 1, (inner->count - at) * sizeof(EaMapNode*));
+                    inner->keys[at] = separator;
+                    inner->children[at + 1] = child;
+                    inner->count++;
+                    break;
+                }
+
+                ea_t keys[eamap_order + 1];
+                EaMapNode* children[eamap_order + 2];
+                memcpy(keys, inner->keys, at * sizeof(ea_t));
+                keys[at] = separator;
+                memcpy(keys + at + 1, inner->keys + at, (eamap_order - at) * sizeof(ea_t));
+                memcpy(children, inner->children, (at + 1) * sizeof(EaMapNode*));
+                children[at + 1] = child;
+                memcpy(children + at + 2, inner->children + at + 1, (eamap_order - at) * sizeof(EaMapNode*));
+
+                // Left keeps keys[0 .. mid), keys[mid] moves up, right gets the rest
+                EaMapInner* sibling = eamap_take_inner(map);
+                int mid = (eamap_order + 1) / 2;
+                inner->count = mid;
+                memcpy(inner->keys, keys, mid * sizeof(ea_t));
+                memcpy(inner->children, children, (mid + 1) * sizeof(EaMapNode*));
+                sibling->count = eamap_order - mid;
+                memcpy(sibling->keys, keys + mid + 1, sibling->count * sizeof(ea_t));
+                memcpy(sibling->children, children + mid + 1, (sibling->count + 1) * sizeof(EaMapNode*));
+
+                separator = keys[mid];
+                child = sibling;
+            }
+            if (level < 0) {
+                EaMapInner* root = eamap_take_inner(map);
+                root->count = 1;
+                root->keys[0] = separator;
+                root->children[0] = map->root;
+                root->children[1] = child;
+                map->root = root;
+                map->height++;
+            }
+        }
+
+        memmove(leaf->keys + i + 1, leaf->keys + i, (leaf->count - i) * sizeof(ea_t));
+        memmove(leaf->slots + i + 1, leaf->slots + i, (leaf->count - i) * sizeof(uint32_t));
+        leaf->keys[i] = ea;
+        leaf->slots[i] = slot;
+        leaf->count++;
+    }
+
+    // Drop ea's entry and return its slot, 0 if there is none. Nodes are not rebalanced,
+    // only freed once empty.
+    static uint32_t eamap_erase(EaMap* map, ea_t ea)
+    {
+        if (map->root == nullptr) {
+            return 0;
+        }
+        EaMapInner* path[eamap_max_height];
+        int index[eamap_max_height];
+        EaMapLeaf* leaf = eamap_find_leaf(map, ea, path, index);
+        int i = (int)(std::lower_bound(leaf->keys, leaf->keys + leaf->count, ea) - leaf->keys);
+        if (i == leaf->count || leaf->keys[i] != ea) {
+            return 0;
+        }
+        uint32_t slot = leaf->slots[i];
+        map->version++;
+        memmove(leaf->keys + i, leaf->keys + i + 1, (leaf->count - i - 1) * sizeof(ea_t));
+        memmove(leaf->slots + i, leaf->slots + i + 1, (leaf->count - i - 1) * sizeof(uint32_t));
+        leaf->count--;
+        map->count--;
+        if (leaf->count > 0) {
+            return slot;
+        }
+
+        if (leaf->prev) leaf->prev->next = leaf->next;
+        else map->first = leaf->next;
+        if (leaf->next) leaf->next->prev = leaf->prev;
+        else map->last = leaf->prev;
+        map->heap.release(leaf, sizeof(EaMapLeaf));
+
+        // Unhook the empty node from its parent, and the parent too if that was its last child
+        int level = map->height - 1;
+        for (; level >= 0; level--) {
+            EaMapInner* inner = path[level];
+            int at = index[level];
+            if (inner->count == 0) {
+                map->heap.release(inner, sizeof(EaMapInner));
+                continue;
+            }
+            int key = at > 0 ? at - 1 : 0;
+            memmove(inner->keys + key, inner->keys + key + 1, (inner->count - key - 1) * sizeof(ea_t));
+            memmove(inner->children + at, inner->children + at + 1, (inner->count - at) * sizeof(EaMapNode*));
+            inner->count--;
+            break;
+        }
+        if (level < 0) {
+            map->root = nullptr;
+            map->height = 0;
+            return slot;
+        }
+
+        // A root with a single child is one level too many
+        while (map->height > 0 && map->root->count == 0) {
+            EaMapInner* root = (EaMapInner*)map->root;
+            map->root = root->children[0];
+            map->heap.release(root, sizeof(EaMapInner));
+            map->height--;
+        }
+        return slot;
+    }
+
+    static void eamap_free_node(EaMap* map, EaMapNode* node, int level)
+    {
+        if (level == 0) {
+            map->heap.release(node, sizeof(EaMapLeaf));
+            return;
+        }
+        EaMapInner* inner = (EaMapInner*)node;
+        for (int i = 0; i <= inner->count; i++) {
+            eamap_free_node(map, inner->children[i], level - 1);
+        }
+        map->heap.release(inner, sizeof(EaMapInner));
+    }
+
+    static void eamap_free_nodes(EaMap* map)
+    {
+        if (map->root != nullptr) {
+            eamap_free_node(map, map->root, map->height);
+        }
+        map->root = nullptr;
+        map->height = 0;
+        map->count = 0;
+        map->first = map->last = nullptr;
+        map->version++;
+    }
+
+    // New empty values table as user value 1 of the map at idx
+    static void eamap_reset_values(lua_State* L, int idx, EaMap* map)
+    {
+        lua_newtable(L);
+        lua_setiuservalue(L, idx, 1);
+        map->next_slot = 1;
+        map->free_slot = 0;
+    }
+
+    // Push key and value of the entry at `at`, or nil past the end
+    static int eamap_push_entry(lua_State* L, int idx, EaMapPosition at)
+    {
+        if (at.leaf == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+        lua_pushinteger(L, (lua_Integer)at.leaf->keys[at.i]);
+        lua_getiuservalue(L, idx, 1);
+        lua_rawgeti(L, -1, at.leaf->slots[at.i]);
+        lua_remove(L, -2);
+        return 2;
+    }
+
+    static void eamap_get(lua_State* L, int idx, EaMap* map, ea_t ea)
+    {
+        uint32_t slot = eamap_find(map, ea);
+        if (slot == 0) {
+            lua_pushnil(L);
+            return;
+        }
+        lua_getiuservalue(L, idx, 1);
+        lua_rawgeti(L, -1, slot);
+        lua_remove(L, -2);
+    }
+
+    // m[ea] = value at value_idx; nil removes the entry
+    static void eamap_set(lua_State* L, int idx, EaMap* map, ea_t ea, int value_idx)
+    {
+        value_idx = lua_absindex(L, value_idx);
+        lua_getiuservalue(L, idx, 1);
+        int values = lua_gettop(L);
+
+        if (lua_isnil(L, value_idx)) {
+            uint32_t slot = eamap_erase(map, ea);
+            if (slot != 0) {
+                lua_pushinteger(L, map->free_slot);
+                lua_rawseti(L, values, slot);
+                map->free_slot = slot;
+            }
+            lua_pop(L, 1);
+            return;
+        }
+
+        // Everything that can raise comes before the tree changes
+        eamap_reserve(L, map);
+        EaMapInner* path[eamap_max_height];
+        int index[eamap_max_height];
+        EaMapLeaf* leaf = nullptr;
+        int i = 0;
+        if (map->root != nullptr) {
+            leaf = eamap_find_leaf(map, ea, path, index);
+            i = (int)(std::lower_bound(leaf->keys, leaf->keys + leaf->count, ea) - leaf->keys);
+            if (i < leaf->count && leaf->keys[i] == ea) {
+                lua_pushvalue(L, value_idx);
+                lua_rawseti(L, values, leaf->slots[i]);
+                lua_pop(L, 1);
+                return;
+            }
+        }
+
+        uint32_t slot;
+        if (map->free_slot != 0) {
+            slot = map->free_slot;
+            lua_rawgeti(L, values, slot);
+            uint32_t next = (uint32_t)lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            lua_pushvalue(L, value_idx);
+            lua_rawseti(L, values, slot);
+            map->free_slot = next;
+        }
+        else {
+            if (map->next_slot == UINT32_MAX) {
+                luaL_error(L, "eamap is full");
+            }
+            slot = map->next_slot;
+            lua_pushvalue(L, value_idx);
+            lua_rawseti(L, values, slot);
+            map->next_slot++;
+        }
+        eamap_insert(map, path, index, leaf, i, ea, slot);
+        lua_pop(L, 1);
+    }
+
+    // luda.eamap() -> empty map
+    static int c_eamap_new(lua_State* L)
+    {
+        EaMap* map = (EaMap*)lua_newuserdatauv(L, sizeof(EaMap), 1);
+        memset(map, 0, sizeof(EaMap));
+        map->heap.init(L);
+        luaL_setmetatable(L, eamap_type);
+        eamap_reset_values(L, lua_gettop(L), map);
+        return 1;
+    }
+
+    // m:get(ea) -> value or nil
+    static int c_eamap_get(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        eamap_get(L, 1, map, (ea_t)luaL_checkinteger(L, 2));
+        return 1;
+    }
+
+    // m:set(ea, value)
+    static int c_eamap_set(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        ea_t ea = (ea_t)luaL_checkinteger(L, 2);
+        lua_settop(L, 3);
+        eamap_set(L, 1, map, ea, 3);
+        return 0;
+    }
+
+    // m:remove(ea) -> the value it had
+    static int c_eamap_remove(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        ea_t ea = (ea_t)luaL_checkinteger(L, 2);
+        eamap_get(L, 1, map, ea);
+        lua_pushnil(L);
+        eamap_set(L, 1, map, ea, -1);
+        lua_pop(L, 1);
+        return 1;
+    }
+
+    static int c_eamap_lower_bound(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        return eamap_push_entry(L, 1, eamap_lower_bound(map, (ea_t)luaL_checkinteger(L, 2)));
+    }
+
+    static int c_eamap_upper_bound(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        return eamap_push_entry(L, 1, eamap_lower_bound(map, (ea_t)luaL_checkinteger(L, 2), true));
+    }
+
+    static int c_eamap_floor(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        return eamap_push_entry(L, 1, eamap_floor(map, (ea_t)luaL_checkinteger(L, 2)));
+    }
+
+    static int c_eamap_first(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        return eamap_push_entry(L, 1, { map->first, 0 });
+    }
+
+    static int c_eamap_last(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        return eamap_push_entry(L, 1, { map->last, map->last ? map->last->count - 1 : 0 });
+    }
+
+    // Where an iterator over `map` stopped, valid while the map's version is unchanged
+    struct EaMapCursor {
+        const EaMap* map;
+        uint64_t version;
+        EaMapPosition at;
+    };
+
+    // Iterator step: the entry after `ea` (the first one for nil), while below the
+    // upvalue bound if there is one. Upvalue 1 is where an unstarted range begins, upvalue 3
+    // the cursor, which saves a descent per step as long as the map isn't changed.
+    static int eamap_next(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        EaMapCursor* cursor = (EaMapCursor*)lua_touserdata(L, lua_upvalueindex(3));
+        EaMapPosition at;
+        if (lua_isnil(L, 2)) {
+            at = lua_isnil(L, lua_upvalueindex(1))
+                ? EaMapPosition{ map->first, 0 }
+                : eamap_lower_bound(map, (ea_t)lua_tointeger(L, lua_upvalueindex(1)));
+        }
+        else {
+            ea_t ea = (ea_t)luaL_checkinteger(L, 2);
+            if (cursor->map == map && cursor->version == map->version && cursor->at.leaf != nullptr &&
+                cursor->at.leaf->keys[cursor->at.i] == ea) {
+                at = eamap_normalize({ cursor->at.leaf, cursor->at.i + 1 });
+            }
+            else {
+                at = eamap_lower_bound(map, ea, true);
+            }
+        }
+        if (cursor->map == map) {
+            cursor->version = map->version;
+            cursor->at = at;
+        }
+        if (at.leaf == nullptr) {
+            return 0;
+        }
+        if (!lua_isnil(L, lua_upvalueindex(2)) && at.leaf->keys[at.i] >= (ea_t)lua_tointeger(L, lua_upvalueindex(2))) {
+            return 0;
+        }
+        return eamap_push_entry(L, 1, at);
+    }
+
+    // Iterator over [upvalue start, upvalue end) with a fresh cursor, then the map and nil
+    static int eamap_push_iterator(lua_State* L)
+    {
+        // The cursor holds on to its map, so no other map can take its address
+        EaMapCursor* cursor = (EaMapCursor*)lua_newuserdatauv(L, sizeof(EaMapCursor), 1);
+        memset(cursor, 0, sizeof(EaMapCursor));
+        cursor->map = (const EaMap*)lua_touserdata(L, 1);
+        lua_pushvalue(L, 1);
+        lua_setiuservalue(L, -2, 1);
+        lua_pushcclosure(L, eamap_next, 3);
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        return 3;
+    }
+
+    // for ea, v in m:range([a [, b]]) -> entries with a <= ea < b
+    static int c_eamap_range(lua_State* L)
+    {
+        check_eamap(L, 1);
+        if (!lua_isnoneornil(L, 2)) luaL_checkinteger(L, 2);
+        if (!lua_isnoneornil(L, 3)) luaL_checkinteger(L, 3);
+        lua_settop(L, 3);
+        return eamap_push_iterator(L);
+    }
+
+    static int c_eamap_clear(lua_State* L)
+    {
+        EaMap* map = check_eamap(L, 1);
+        eamap_free_nodes(map);
+        eamap_reset_values(L, 1, map);
+        return 0;
+    }
+
+    static const luaL_Reg eamap_methods[] = {
+        { "get",         c_eamap_get },
+        { "set",         c_eamap_set },
+        { "remove",      c_eamap_remove },
+        { "lower_bound", c_eamap_lower_bound },
+        { "upper_bound", c_eamap_upper_bound },
+        { "floor",       c_eamap_floor },
+        { "first",       c_eamap_first },
+        { "last",        c_eamap_last },
+        { "range",       c_eamap_range },
+        { "clear",       c_eamap_clear },
+        { NULL, NULL }
+    };
+
+    // m[ea] -> value, m.name -> method. Metamethods can't be reached from Lua
+    // (__metatable), so the first argument is always a map.
+    static int eamap_index(lua_State* L)
+    {
+        EaMap* map = (EaMap*)lua_touserdata(L, 1);
+        int is_integer;
+        lua_Integer ea = lua_tointegerx(L, 2, &is_integer);
+        if (is_integer) {
+            eamap_get(L, 1, map, (ea_t)ea);
+            return 1;
+        }
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    static int eamap_newindex(lua_State* L)
+    {
+        EaMap* map = (EaMap*)lua_touserdata(L, 1);
+        eamap_set(L, 1, map, (ea_t)luaL_checkinteger(L, 2), 3);
+        return 0;
+    }
+
+    static int eamap_len(lua_State* L)
+    {
+        lua_pushinteger(L, (lua_Integer)check_eamap(L, 1)->count);
+        return 1;
+    }
+
+    static int eamap_pairs(lua_State* L)
+    {
+        check_eamap(L, 1);
+        lua_settop(L, 1);
+        lua_pushnil(L);
+        lua_pushnil(L);
+        return eamap_push_iterator(L);
+    }
+
+    static int eamap_tostring(lua_State* L)
+    {
+        lua_pushfstring(L, "eamap: %I entries", (lua_Integer)check_eamap(L, 1)->count);
+        return 1;
+    }
+
+    static int eamap_gc(lua_State* L)
+    {
+        EaMap* map = (EaMap*)lua_touserdata(L, 1);
+        eamap_free_nodes(map);
+        while (map->spare_leaf_count > 0) {
+            map->heap.release(eamap_take_leaf(map), sizeof(EaMapLeaf));
+        }
+        while (map->spare_inner_count > 0) {
+            map->heap.release(eamap_take_inner(map), sizeof(EaMapInner));
+        }
+        return 0;
+    }
+
+    // Create the eamap metatable; must run before any map is made
+    static void register_eamap_type(lua_State* L)
+    {
+        luaL_newmetatable(L, eamap_type);
+
+        lua_newtable(L);
+        luaL_setfuncs(L, eamap_methods, 0);
+        lua_pushcclosure(L, eamap_index, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, eamap_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushcfunction(L, eamap_len);
+        lua_setfield(L, -2, "__len");
+        lua_pushcfunction(L, eamap_pairs);
+        lua_setfield(L, -2, "__pairs");
+        lua_pushcfunction(L, eamap_tostring);
+        lua_setfield(L, -2, "__tostring");
+        lua_pushcfunction(L, eamap_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushliteral(L, "eamap");
+        lua_setfield(L, -2, "__metatable");
+
+        lua_pop(L, 1);
+    }
+}
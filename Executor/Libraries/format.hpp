@@ -0,0 +1,188 @@
+#pragma once
+#include "../Executor.h"
+#include "buffer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <string>
+
+namespace LUDA::Library
+{
+    /* Native number and byte formatting for hex(), hexdump() and print(). Hex digits come
+       from a table of all 256 byte values, so each lookup writes two digits. Long output is
+       built in one std::string that stays allocated between calls. */
+    struct HexPairs {
+        char text[512];
+
+        constexpr HexPairs() : text()
+        {
+            const char* digits = "0123456789ABCDEF";
+            for (int i = 0; i < 256; i++) {
+                text[2 * i] = digits[i >> 4];
+                text[2 * i + 1] = digits[i & 15];
+            }
+        }
+    };
+
+    static constexpr HexPairs hex_pairs{};
+
+    // Upper-case hex digits of value, at least min_digits of them (zero-padded); returns the count.
+    // `out` needs room for max(16, min_digits) characters.
+    static size_t format_hex(char* out, uint64_t value, size_t min_digits)
+    {
+        size_t digits = std::max<size_t>({ ((size_t)std::bit_width(value) + 3) / 4, min_digits, 1 });
+        char* at = out + digits;
+        while (at - out >= 2) {
+            at -= 2;
+            memcpy(at, &hex_pairs.text[(value & 0xFF) * 2], 2);
+            value >>= 8;
+        }
+        if (at > out) {
+            *--at = hex_pairs.text[(value & 0xF) * 2 + 1];
+        }
+        return digits;
+    }
+
+    static void append_decimal(std::string& out, lua_Integer value)
+    {
+        char text[24];
+        char* end = std::to_chars(text, text + sizeof(text), (long long)value).ptr;
+        out.append(text, (size_t)(end - text));
+    }
+
+    // Output of print() and hexdump(), reused between calls; neither runs Lua code while
+    // filling it, so calls can't interleave
+    static std::string& format_buffer()
+    {
+        static std::string out;
+        return out;
+    }
+
+    // Don't hold on to the peak of one huge dump
+    static void trim_format_buffer()
+    {
+        std::string& out = format_buffer();
+        if (out.capacity() > 1024 * 1024) {
+            std::string().swap(out);
+        }
+    }
+
+    // hex(value [, digits]) -> upper-case hex without a prefix, zero-padded to `digits`
+    // Negative values print as their 64-bit two's complement, like string.format("%X").
+    static int c_to_hex(lua_State* L)
+    {
+        lua_Integer value = luaL_checkinteger(L, 1);
+        lua_Integer digits = luaL_optinteger(L, 2, 1);
+        luaL_argcheck(L, digits >= 1 && digits <= 64, 2, "digit count out of range (1-64)");
+
+        char text[64];
+        size_t length = format_hex(text, (uint64_t)value, (size_t)digits);
+        lua_pushlstring(L, text, length);
+        return 1;
+    }
+
+    // Bytes `data` shown as hexdump lines from address `base`:
+    //   0000000140001000  48 8B C4 48 89 58 08 48  89 68 10 48 89 70 18 57  |H..H.X.H.h.H.p.W|
+    static void format_hexdump(std::string& out, const uint8_t* data, size_t size, uint64_t base, size_t width, bool ascii)
+    {
+        uint64_t last = size ? base + (size - 1) : base;
+        size_t address_digits = (last >> 32) == 0 && last >= base ? 8 : 16;
+        size_t groups = (width - 1) / 8;
+        size_t hex_width = width * 3 - 1 + groups;
+        size_t line_size = address_digits + 2 + hex_width + (ascii ? width + 4 : 0) + 1;
+        size_t lines = (size + width - 1) / width;
+
+        out.resize(lines * line_size);
+        char* at = out.data();
+        for (size_t line = 0; line < lines; line++) {
+            size_t offset = line * width;
+            size_t count = std::min(width, size - offset);
+            const uint8_t* bytes = data + offset;
+
+            at += format_hex(at, base + offset, address_digits);
+            *at++ = ' ';
+            *at++ = ' ';
+            char* hex = at;
+            memset(hex, ' ', hex_width);
+            for (size_t i = 0; i < count; i++) {
+                char* cell = hex + i * 3 + i / 8;
+                memcpy(cell, &hex_pairs.text[bytes[i] * 2], 2);
+            }
+            if (ascii) {
+                at += hex_width;
+                *at++ = ' ';
+                *at++ = ' ';
+                *at++ = '|';
+                for (size_t i = 0; i < count; i++) {
+                    uint8_t c = bytes[i];
+                    *at++ = c >= 0x20 && c < 0x7F ? (char)c : '.';
+                }
+                *at++ = '|';
+            }
+            else {
+                at += count * 3 - 1 + (count - 1) / 8;  // a short last line has no padding to trim
+            }
+            *at++ = '\n';
+        }
+        out.resize(at - out.data() - (lines ? 1 : 0));  // no newline after the last line
+    }
+
+    // hexdump(buffer | string [, opts]) -> text
+    // hexdump(address, size [, opts]) -> text of database bytes
+    // opts: address (shown for the first byte; default 0, or the address read),
+    //       width (bytes per line, default 16), ascii (column of printable bytes, default true)
+    static int c_hexdump(lua_State* L)
+    {
+        size_t size;
+        const uint8_t* data;
+        uint64_t base = 0;
+        int opts = 2;
+        if (lua_type(L, 1) == LUA_TNUMBER) {
+            lua_settop(L, 3);
+            ea_t addr = (ea_t)luaL_checkinteger(L, 1);
+            lua_Integer len = luaL_checkinteger(L, 2);
+            luaL_argcheck(L, len >= 0, 2, "size must not be negative");
+            Buffer* buffer = push_buffer(L, (size_t)len);
+            if (len > 0 && !backend().read_bytes(addr, buffer->data, (size_t)len)) {
+                char where[32];
+                qsnprintf(where, sizeof(where), "0x%llX", (unsigned long long)addr);
+                return luaL_error(L, "read of %I bytes at %s was cancelled", len, where);
+            }
+            data = buffer->data;
+            size = buffer->size;
+            base = addr;
+            opts = 3;
+        }
+        else {
+            data = to_bytes(L, 1, &size);
+            if (data == nullptr) {
+                return luaL_typeerror(L, 1, "buffer, string or address");
+            }
+        }
+
+        lua_Integer width = 16;
+        bool ascii = true;
+        if (!lua_isnoneornil(L, opts)) {
+            luaL_checktype(L, opts, LUA_TTABLE);
+            if (lua_getfield(L, opts, "address") != LUA_TNIL) {
+                base = (uint64_t)luaL_checkinteger(L, -1);
+            }
+            if (lua_getfield(L, opts, "width") != LUA_TNIL) {
+                width = luaL_checkinteger(L, -1);
+                luaL_argcheck(L, width >= 1 && width <= 256, opts, "width out of range (1-256)");
+            }
+            if (lua_getfield(L, opts, "ascii") != LUA_TNIL) {
+                ascii = lua_toboolean(L, -1);
+            }
+            lua_pop(L, 3);
+        }
+
+        std::string& out = format_buffer();
+        format_hexdump(out, data, size, base, (size_t)width, ascii);
+        lua_pushlstring(L, out.data(), out.size());
+        trim_format_buffer();
+        return 1;
+    }
+}
@@ -1,43 +1,22 @@
 #include "../Executor.h"
+#include "binding.hpp"
 
 namespace LUDA::Library
 {
-    static int c_get_func(lua_State* L)
+    // get_function(address | name) -> start of the function containing it, or nil
+    static std::optional<ea_t> get_function(std::variant<ea_t, const char*> where)
     {
-        if (lua_type(L, 1) == LUA_TNUMBER) /* If address */
-        {
-            lua_Integer addr = lua_tointeger(L, 1);  // Use lua_tointeger instead
-            func_t* func = get_func(addr);
-
-            if (func == NULL) {
-                lua_pushnil(L);
-                return 1;
-            }
-
-            /* push the function addr to lua stack and return */
-            lua_pushinteger(L, func->start_ea);
-            return 1;
+        ea_t ea = std::holds_alternative<ea_t>(where)
+            ? std::get<ea_t>(where)
+            : backend().name_ea(std::get<const char*>(where));
+        if (ea == BADADDR) {
+            return std::nullopt;
         }
-        else if (lua_type(L, 1) == LUA_TSTRING) /* If name */
-        {
-            const char* func_name = lua_tostring(L, 1);
-            ea_t ea = get_name_ea(BADADDR, func_name);
-
-            if (ea == BADADDR) {
-                lua_pushnil(L);
-                return 1;
-            }
-
-            func_t* func = get_func(ea);
-            if (func == NULL) {
-                lua_pushnil(L);
-                return 1;
-            }
 
-            lua_pushinteger(L, func->start_ea);
-            return 1;
+        FunctionRange func;
+        if (!backend().function_at(ea, func)) {
+            return std::nullopt;
         }
-        lua_pushnil(L);
-        return 1;
+        return func.start;
     }
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "../Executor.h"
+
+#include <cstring>
+
+namespace LUDA::Library
+{
+    /* Names accepted by luda.gc.tune, in LUA_GCP* order */
+    static const char* const gc_param_names[LUA_GCPN] = {
+        "minormul", "majorminor", "minormajor", "pause", "stepmul", "stepsize"
+    };
+
+    struct GcProfile {
+        const char* name;
+        int mode;               // LUA_GCINC or LUA_GCGEN
+        int params[LUA_GCPN];   // -1 keeps the value captured at startup
+    };
+
+    static const GcProfile gc_profiles[] = {
+        /*                              minormul majorminor minormajor pause stepmul stepsize */
+        { "default",      LUA_GCINC, {  -1,      -1,        -1,        -1,   -1,     -1 } },
+        { "generational", LUA_GCGEN, {  -1,      -1,        -1,        -1,   -1,     -1 } },
+        // millions of short-lived tables: fewer, larger minor collections
+        { "batch",        LUA_GCGEN, {  100,     -1,        -1,        -1,   -1,     -1 } },
+        // let the heap grow further between cycles, then collect aggressively
+        { "throughput",   LUA_GCINC, {  -1,      -1,        -1,        400,  400,    -1 } },
+        { "lowmemory",    LUA_GCINC, {  -1,      -1,        -1,        120,  300,    -1 } },
+    };
+
+    static constexpr const char* gc_defaults_key = "LUDA.gc.defaults";
+
+    static int gc_param_index(const char* name)
+    {
+        for (int i = 0; i < LUA_GCPN; i++) {
+            if (strcmp(gc_param_names[i], name) == 0) return i;
+        }
+        return -1;
+    }
+
+    // Remember the collector parameters the state started with
+    static void capture_gc_defaults(lua_State* L)
+    {
+        lua_createtable(L, LUA_GCPN, 0);
+        for (int i = 0; i < LUA_GCPN; i++) {
+            lua_pushinteger(L, lua_gc(L, LUA_GCPARAM, i, -1));
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_setfield(L, LUA_REGISTRYINDEX, gc_defaults_key);
+    }
+
+    // Switch mode and parameters to a named profile; false if there is no such profile
+    static bool apply_gc_profile(lua_State* L, const char* name)
+    {
+        for (const GcProfile& profile : gc_profiles) {
+            if (strcmp(profile.name, name) != 0) continue;
+
+            lua_getfield(L, LUA_REGISTRYINDEX, gc_defaults_key);
+            for (int i = 0; i < LUA_GCPN; i++) {
+                int value = profile.params[i];
+                if (value < 0) {
+                    lua_rawgeti(L, -1, i + 1);
+                    value = (int)lua_tointeger(L, -1);
+                    lua_pop(L, 1);
+                }
+                lua_gc(L, LUA_GCPARAM, i, value);
+            }
+            lua_pop(L, 1);
+
+            lua_gc(L, profile.mode); // no-op when already in that mode
+            return true;
+        }
+        return false;
+    }
+
+    // luda.gc.mode("incremental" | "generational") -> previous mode
+    static int c_gc_mode(lua_State* L)
+    {
+        static const char* const modes[] = { "incremental", "generational", NULL };
+        int mode = luaL_checkoption(L, 1, NULL, modes);
+        int previous = lua_gc(L, mode == 0 ? LUA_GCINC : LUA_GCGEN);
+        lua_pushstring(L, previous == LUA_GCGEN ? "generational" : "incremental");
+        return 1;
+    }
+
+    // luda.gc.tune({ pause = 300, stepmul = 400, ... }) -> table of previous values
+    static int c_gc_tune(lua_State* L)
+    {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        lua_createtable(L, 0, LUA_GCPN);
+
+        lua_pushnil(L);
+        while (lua_next(L, 1) != 0) {
+            const char* name = lua_type(L, -2) == LUA_TSTRING ? lua_tostring(L, -2) : "";
+            int param = gc_param_index(name);
+            if (param < 0) {
+                return luaL_error(L, "unknown GC parameter '%s'", name);
+            }
+            lua_Integer value = luaL_checkinteger(L, -1);
+            luaL_argcheck(L, value >= 0 && value <= 100000, 1, "GC parameter out of range");
+
+            lua_pushinteger(L, lua_gc(L, LUA_GCPARAM, param, (int)value));
+            lua_setfield(L, -4, name);
+            lua_pop(L, 1);
+        }
+        return 1;
+    }
+
+    // luda.gc.profile(name): apply one of the predefined profiles
+    static int c_gc_profile(lua_State* L)
+    {
+        const char* name = luaL_checkstring(L, 1);
+        if (!apply_gc_profile(L, name)) {
+            return luaL_error(L, "unknown GC profile '%s'", name);
+        }
+        return 0;
+    }
+
+    static int c_gc_pause(lua_State* L)
+    {
+        lua_gc(L, LUA_GCSTOP);
+        return 0;
+    }
+
+    static int c_gc_resume(lua_State* L)
+    {
+        lua_gc(L, LUA_GCRESTART);
+        return 0;
+    }
+
+    // luda.gc.batch(fn, ...): run fn with the collector paused, resume even if it errors
+    static int c_gc_batch(lua_State* L)
+    {
+        luaL_checktype(L, 1, LUA_TFUNCTION);
+        int was_running = lua_gc(L, LUA_GCISRUNNING);
+
+        lua_gc(L, LUA_GCSTOP);
+        int status = lua_pcall(L, lua_gettop(L) - 1, LUA_MULTRET, 0);
+        if (was_running) {
+            lua_gc(L, LUA_GCRESTART);
+        }
+
+        if (status != LUA_OK) {
+            return lua_error(L);
+        }
+        return lua_gettop(L);
+    }
+
+    // luda.gc.stats() -> { kbytes = n, running = bool }
+    static int c_gc_stats(lua_State* L)
+    {
+        lua_createtable(L, 0, 2);
+        lua_pushnumber(L, lua_gc(L, LUA_GCCOUNT) + lua_gc(L, LUA_GCCOUNTB) / 1024.0);
+        lua_setfield(L, -2, "kbytes");
+        lua_pushboolean(L, lua_gc(L, LUA_GCISRUNNING));
+        lua_setfield(L, -2, "running");
+        return 1;
+    }
+
+    static const luaL_Reg gc_functions[] = {
+        { "mode", c_gc_mode },
+        { "tune", c_gc_tune },
+        { "profile", c_gc_profile },
+        { "pause", c_gc_pause },
+        { "resume", c_gc_resume },
+        { "batch", c_gc_batch },
+        { "stats", c_gc_stats },
+        { NULL, NULL }
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "../Executor.h"
+
+namespace LUDA::Library
+{
+    /* Memory for native containers (eamap, rangeset, ...) that live behind a userdata.
+       It comes from the state's own allocator, so it is pooled like Lua objects and counts
+       toward the run's heap limit, but the collector doesn't see it: __gc gives it back. */
+    struct LuaHeap {
+        lua_Alloc alloc;
+        void* ud;
+
+        void init(lua_State* L)
+        {
+            alloc = lua_getallocf(L, &ud);
+        }
+
+        // Raises a Lua error when out of memory, after one emergency collection
+        void* allocate(lua_State* L, size_t size)
+        {
+            return reallocate(L, nullptr, 0, size);
+        }
+
+        void* reallocate(lua_State* L, void* ptr, size_t osize, size_t nsize)
+        {
+            void* moved = alloc(ud, ptr, osize, nsize);
+            if (moved == nullptr) {
+                lua_gc(L, LUA_GCCOLLECT);
+                moved = alloc(ud, ptr, osize, nsize);
+                if (moved == nullptr) {
+                    luaL_error(L, "not enough memory");
+                }
+            }
+            return moved;
+        }
+
+        void release(void* ptr, size_t size)
+        {
+            if (ptr != nullptr) {
+                alloc(ud, ptr, size, 0);
+            }
+        }
+    };
+}
@@ -1,4 +1,5 @@
 #include "../Executor.h"
+#include "records.hpp"
 
 bool decompile_function(ea_t func_addr, std::string& out_pseudocode)
 {
@@ -35,46 +36,87 @@ bool decompile_function(ea_t func_addr, std::string& out_pseudocode)
 
 namespace LUDA::Library
 {
-    static int c_decompile(lua_State* L)
+    // hexrays.decompile(address) -> pseudocode, or nil and why not
+    static Result<std::string> decompile(func_t* func)
     {
-        ea_t addr = (ea_t)lua_tointeger(L, 1);
-
         // Check if address is in a function
-        if (!get_func(addr)) {
-            lua_pushnil(L);
-            lua_pushstring(L, "Address is not in a function");
-            return 2;
+        if (func == nullptr) {
+            return Result<std::string>::fail("Address is not in a function");
         }
 
-        std::string pseudocode = "no pseudo";
-        if (decompile_function(addr, pseudocode)) {
-            lua_pushstring(L, pseudocode.c_str());
-            return 1;
-        }
-        else {
-            lua_pushnil(L);
-            lua_pushstring(L, "Decompilation failed");
-            return 2;
+        std::string pseudocode;
+        if (!decompile_function(func->start_ea, pseudocode)) {
+            return Result<std::string>::fail("Decompilation failed");
         }
+        return pseudocode;
     }
 
-    static int c_disassemble(lua_State* L) {
-        ea_t func_addr = lua_tointeger(L, 1);
-        //msg("Looking for function at: 0x%X\n", func_addr);
+    struct Operand {
+        int type;
+        const char* type_name;
+        std::optional<std::string> reg_name; // register operands only
+        ea_t value;
+        ea_t addr;
+    };
+
+    struct InstructionFlags {
+        bool is_jump;
+        bool is_call;
+        bool is_ret;
+    };
+
+    struct Instruction {
+        std::string disasm;
+        std::string op;
+        ea_t ea;
+        int size;
+        std::vector<Operand> operands;
+        std::vector<std::string> regs;
+        InstructionFlags flags;
+    };
+
+    template <>
+    struct record_fields<Operand> {
+        static constexpr auto fields = std::make_tuple(
+            field("type", &Operand::type),
+            field("type_name", &Operand::type_name),
+            field("reg_name", &Operand::reg_name),
+            field("value", &Operand::value),
+            field("addr", &Operand::addr));
+    };
+
+    template <>
+    struct record_fields<InstructionFlags> {
+        static constexpr auto fields = std::make_tuple(
+            field("is_jump", &InstructionFlags::is_jump),
+            field("is_call", &InstructionFlags::is_call),
+            field("is_ret", &InstructionFlags::is_ret));
+    };
+
+    template <>
+    struct record_fields<Instruction> {
+        static constexpr auto fields = std::make_tuple(
+            field("disasm", &Instruction::disasm),
+            field("op", &Instruction::op),
+            field("ea", &Instruction::ea),
+            field("size", &Instruction::size),
+            field("operands", &Instruction::operands),
+            field("regs", &Instruction::regs),
+            field("flags", &Instruction::flags));
+    };
+
+    // hexrays.disassemble(address) -> records {disasm, op, ea, size, operands, regs, flags}
+    // of every instruction of the function, or nil
+    static std::optional<Records<Instruction>> disassemble(ea_t func_addr)
+    {
         func_t* func = get_func(func_addr);
         if (!func) {
-            //msg("ERROR: get_func returned NULL\n");
-            lua_pushnil(L);
-            return 1;
+            return std::nullopt;
         }
-        //msg("Function found: start=0x%X, end=0x%X\n", func->start_ea, func->end_ea);
         if (func->end_ea == 0 || func->end_ea <= func->start_ea) {
-            //msg("ERROR: Invalid function bounds\n");
-            lua_pushnil(L);
-            return 1;
+            return std::nullopt;
         }
-        lua_newtable(L);
-        int table_idx = 1;
+        Records<Instruction> insns;
         for (ea_t addr = func->start_ea; addr < func->end_ea; ) {
             insn_t insn;
             int size = decode_insn(&insn, addr);
@@ -83,37 +125,22 @@ namespace LUDA::Library
                 addr++;
                 continue;
             }
-            /* Create instruction table */
-            lua_newtable(L);
+            Instruction& row = insns.emplace_back();
             qstring qstr;
             qstring buf;
             generate_disasm_line(&qstr, addr);
             tag_remove(&buf, qstr);
-            lua_pushstring(L, buf.c_str());
-            lua_setfield(L, -2, "disasm");
+            row.disasm = buf.c_str();
             char mnem[64] = { 0 };
             sscanf(buf.c_str(), "%63s", mnem);
-            lua_pushstring(L, mnem);
-            lua_setfield(L, -2, "op");
-            lua_pushinteger(L, insn.ea);
-            lua_setfield(L, -2, "ea");
-            lua_pushinteger(L, insn.size);
-            lua_setfield(L, -2, "size");
-
-            /* Operands table */
-            lua_newtable(L);
-            int op_idx = 1;
+            row.op = mnem;
+            row.ea = insn.ea;
+            row.size = insn.size;
+
             for (int i = 0; i < UA_MAXOP; i++) {
                 op_t& op = insn.ops[i];
                 if (op.type == o_void) break;
 
-                lua_newtable(L);
-
-                /* Operand type */
-                lua_pushinteger(L, op.type);
-                lua_setfield(L, -2, "type");
-
-                /* Type name */
                 const char* type_name = "unknown";
                 switch (op.type) {
                 case o_reg:     type_name = "reg"; break;
@@ -124,69 +151,28 @@ namespace LUDA::Library
                 case o_far:     type_name = "far"; break;
                 case o_near:    type_name = "near"; break;
                 }
-                lua_pushstring(L, type_name);
-                lua_setfield(L, -2, "type_name");
-
-                /* Register name (if register operand) */
-                if (op.type == o_reg) {
-                    qstring reg_buf;
-                    size_t width = op.dtype ? get_dtype_size(op.dtype) : 8;
-                    get_reg_name(&reg_buf, op.reg, width);
-                    lua_pushstring(L, reg_buf.c_str());
-                    lua_setfield(L, -2, "reg_name");
-                }
-
-                /* Value */
-                lua_pushinteger(L, op.value);
-                lua_setfield(L, -2, "value");
-
-                /* Offset/displacement */
-                lua_pushinteger(L, op.addr);
-                lua_setfield(L, -2, "addr");
-
-                lua_rawseti(L, -2, op_idx);
-                op_idx++;
-            }
-            lua_setfield(L, -2, "operands");
-
-            /* Registers used table */
-            lua_newtable(L);
-            int reg_idx = 1;
-            for (int i = 0; i < UA_MAXOP; i++) {
-                op_t& op = insn.ops[i];
-                if (op.type == o_void) break;
 
+                Operand& operand = row.operands.emplace_back();
+                operand.type = op.type;
+                operand.type_name = type_name;
                 if (op.type == o_reg) {
                     qstring reg_buf;
                     size_t width = op.dtype ? get_dtype_size(op.dtype) : 8;
                     get_reg_name(&reg_buf, op.reg, width);
-                    lua_pushstring(L, reg_buf.c_str());
-                    lua_rawseti(L, -2, reg_idx);
-                    reg_idx++;
+                    operand.reg_name = reg_buf.c_str();
+                    row.regs.push_back(reg_buf.c_str());
                 }
+                operand.value = op.value;
+                operand.addr = op.addr;
             }
-            lua_setfield(L, -2, "regs");
 
             /* Features/flags - check mnemonic */
-            lua_newtable(L);
-
-            bool is_jump = strstr(mnem, "j") != NULL && strcmp(mnem, "mov") != 0;
-            bool is_call = strcmp(mnem, "call") == 0;
-            bool is_ret = strcmp(mnem, "ret") == 0 || strcmp(mnem, "retn") == 0;
+            row.flags.is_jump = strstr(mnem, "j") != NULL && strcmp(mnem, "mov") != 0;
+            row.flags.is_call = strcmp(mnem, "call") == 0;
+            row.flags.is_ret = strcmp(mnem, "ret") == 0 || strcmp(mnem, "retn") == 0;
 
-            lua_pushboolean(L, is_jump);
-            lua_setfield(L, -2, "is_jump");
-            lua_pushboolean(L, is_call);
-            lua_setfield(L, -2, "is_call");
-            lua_pushboolean(L, is_ret);
-            lua_setfield(L, -2, "is_ret");
-
-            lua_setfield(L, -2, "flags");
-
-            lua_rawseti(L, -2, table_idx);
-            table_idx++;
             addr += insn.size;
         }
-        return 1;
+        return insns;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,230 @@
+#pragma once
+#include "../Executor.h"
+#include "buffer.hpp"
+#include "arrays.hpp"
+#include "records.hpp"
+
+#include <vector>
+#include <cstring>
+
+namespace LUDA::Library
+{
+    /* MessagePack encoder that walks a Lua value on the stack and appends to a byte vector.
+       Tables with keys 1..n only become arrays, anything else a map; buffers become bin,
+       typed arrays arrays of integers and record blocks arrays of maps (fields without a
+       value left out). */
+    static constexpr int msgpack_max_depth = 64;
+
+    static void mp_put(std::vector<uint8_t>& out, uint8_t tag)
+    {
+        out.push_back(tag);
+    }
+
+    // tag followed by a big-endian integer of `width` bytes
+    static void mp_put(std::vector<uint8_t>& out, uint8_t tag, uint64_t value, int width)
+    {
+        size_t at = out.size();
+        out.resize(at + 1 + width);
+        uint8_t* p = out.data() + at;
+        *p++ = tag;
+        for (int i = width - 1; i >= 0; i--) {
+            *p++ = (uint8_t)(value >> (i * 8));
+        }
+    }
+
+    static void mp_put_integer(std::vector<uint8_t>& out, lua_Integer value)
+    {
+        if (value >= 0) {
+            uint64_t u = (uint64_t)value;
+            if (u < 0x80)             mp_put(out, (uint8_t)u);
+            else if (u <= 0xFF)       mp_put(out, 0xCC, u, 1);
+            else if (u <= 0xFFFF)     mp_put(out, 0xCD, u, 2);
+            else if (u <= 0xFFFFFFFF) mp_put(out, 0xCE, u, 4);
+            else                      mp_put(out, 0xCF, u, 8);
+        }
+        else {
+            if (value >= -32)              mp_put(out, (uint8_t)(int8_t)value);
+            else if (value >= INT8_MIN)    mp_put(out, 0xD0, (uint64_t)value, 1);
+            else if (value >= INT16_MIN)   mp_put(out, 0xD1, (uint64_t)value, 2);
+            else if (value >= INT32_MIN)   mp_put(out, 0xD2, (uint64_t)value, 4);
+            else                           mp_put(out, 0xD3, (uint64_t)value, 8);
+        }
+    }
+
+    static void mp_put_float(std::vector<uint8_t>& out, lua_Number value)
+    {
+        double d = (double)value;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        mp_put(out, 0xCB, bits, 8);
+    }
+
+    // str or bin header, then the bytes
+    static void mp_put_bytes(std::vector<uint8_t>& out, const void* data, size_t size, bool binary)
+    {
+        if (binary) {
+            if (size <= 0xFF)            mp_put(out, 0xC4, size, 1);
+            else if (size <= 0xFFFF)     mp_put(out, 0xC5, size, 2);
+            else                         mp_put(out, 0xC6, size, 4);
+        }
+        else {
+            if (size < 32)               mp_put(out, (uint8_t)(0xA0 | size));
+            else if (size <= 0xFF)       mp_put(out, 0xD9, size, 1);
+            else if (size <= 0xFFFF)     mp_put(out, 0xDA, size, 2);
+            else                         mp_put(out, 0xDB, size, 4);
+        }
+        out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+    }
+
+    static void mp_put_container(std::vector<uint8_t>& out, size_t count, bool map)
+    {
+        if (count < 16)             mp_put(out, (uint8_t)((map ? 0x80 : 0x90) | count));
+        else if (count <= 0xFFFF)   mp_put(out, map ? 0xDE : 0xDC, count, 2);
+        else                        mp_put(out, map ? 0xDF : 0xDD, count, 4);
+    }
+
+    // Encode the value at `idx`. Raises a Lua error on values that have no encoding,
+    // so callers must not keep anything on the C++ stack that needs destroying.
+    static void msgpack_encode(lua_State* L, int idx, std::vector<uint8_t>& out, int depth)
+    {
+        switch (lua_type(L, idx)) {
+        case LUA_TNIL:
+            mp_put(out, 0xC0);
+            return;
+        case LUA_TBOOLEAN:
+            mp_put(out, lua_toboolean(L, idx) ? 0xC3 : 0xC2);
+            return;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, idx)) {
+                mp_put_integer(out, lua_tointeger(L, idx));
+            }
+            else {
+                mp_put_float(out, lua_tonumber(L, idx));
+            }
+            return;
+        case LUA_TSTRING: {
+            size_t size;
+            const char* s = lua_tolstring(L, idx, &size);
+            mp_put_bytes(out, s, size, false);
+            return;
+        }
+        case LUA_TUSERDATA: {
+            if (Buffer* buffer = (Buffer*)luaL_testudata(L, idx, buffer_type)) {
+                mp_put_bytes(out, buffer->data, buffer->size, true);
+                return;
+            }
+            if (TypedArray* array = test_array(L, idx)) {
+                mp_put_container(out, array->count, false);
+                with_elements(array, [&](auto* values) {
+                    for (size_t i = 0; i < array->count; i++) mp_put_integer(out, (lua_Integer)values[i]);
+                });
+                return;
+            }
+            if (depth >= msgpack_max_depth) {
+                luaL_error(L, "cannot encode: tables nested more than %d deep (cycle?)", msgpack_max_depth);
+                return;
+            }
+            luaL_checkstack(L, 3, "cannot encode: nesting too deep");
+            idx = lua_absindex(L, idx);
+            if (const RecordBlock* block = test_records(L, idx)) {
+                mp_put_container(out, block->count, false);
+                for (size_t i = 0; i < block->count; i++) {
+                    push_row(L, idx, block->first + i);
+                    msgpack_encode(L, -1, out, depth + 1);
+                    lua_pop(L, 1);
+                }
+                return;
+            }
+            if (const RecordRow* record = test_record_row(L, idx)) {
+                const RecordSchema* schema = record->block->schema;
+                size_t count = 0;
+                for (size_t c = 0; c < schema->columns.size(); c++) {
+                    count += cell_present(record->block, c, record->row);
+                }
+                mp_put_container(out, count, true);
+                lua_getiuservalue(L, idx, 1);
+                for (size_t c = 0; c < schema->columns.size(); c++) {
+                    if (!cell_present(record->block, c, record->row)) continue;
+                    const char* name = schema->columns[c].name;
+                    mp_put_bytes(out, name, strlen(name), false);
+                    push_cell(L, -1, record->block, c, record->row);
+                    msgpack_encode(L, -1, out, depth + 1);
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+                return;
+            }
+            break;
+        }
+        case LUA_TTABLE: {
+            if (depth >= msgpack_max_depth) {
+                luaL_error(L, "cannot encode: tables nested more than %d deep (cycle?)", msgpack_max_depth);
+                return;
+            }
+            luaL_checkstack(L, 3, "cannot encode: nesting too deep");
+            idx = lua_absindex(L, idx);
+
+            size_t length = lua_rawlen(L, idx);
+            if (length == 0) {
+                // Record-like table: encode in one traversal, then fix up the entry count
+                size_t header = out.size();
+                mp_put(out, 0x80);
+                size_t count = 0;
+                lua_pushnil(L);
+                while (lua_next(L, idx) != 0) {
+                    msgpack_encode(L, -2, out, depth + 1);
+                    msgpack_encode(L, -1, out, depth + 1);
+                    lua_pop(L, 1);
+                    count++;
+                }
+                if (count == 0) {
+                    out[header] = 0x90; // empty table: empty array
+                }
+                else if (count < 16) {
+                    out[header] = (uint8_t)(0x80 | count);
+                }
+                else {
+                    // map16/map32: widen the one-byte header in place
+                    int width = count <= 0xFFFF ? 2 : 4;
+                    out.insert(out.begin() + header + 1, width, 0);
+                    out[header] = width == 2 ? 0xDE : 0xDF;
+                    for (int i = 0; i < width; i++) {
+                        out[header + 1 + i] = (uint8_t)(count >> ((width - 1 - i) * 8));
+                    }
+                }
+                return;
+            }
+
+            size_t count = 0;
+            lua_pushnil(L);
+            while (lua_next(L, idx) != 0) {
+                count++;
+                lua_pop(L, 1);
+            }
+
+            if (count == length) {
+                // 1..n sequence: array
+                mp_put_container(out, count, false);
+                for (size_t i = 1; i <= length; i++) {
+                    lua_rawgeti(L, idx, (lua_Integer)i);
+                    msgpack_encode(L, -1, out, depth + 1);
+                    lua_pop(L, 1);
+                }
+                return;
+            }
+
+            mp_put_container(out, count, true);
+            lua_pushnil(L);
+            while (lua_next(L, idx) != 0) {
+                msgpack_encode(L, -2, out, depth + 1);
+                msgpack_encode(L, -1, out, depth + 1);
+                lua_pop(L, 1);
+            }
+            return;
+        }
+        default:
+            break;
+        }
+        luaL_error(L, "cannot encode a %s value", luaL_typename(L, idx));
+    }
+}
@@ -1,85 +1,101 @@
 #include "../Executor.h"
+#include "buffer.hpp"
+#include "binding.hpp"
+
+#include <algorithm>
+#include <climits>
 
 namespace LUDA::Library
 {
+    // memory.read(address, size) -> { byte, ... }
     static int c_get_bytes(lua_State* L)
     {
-        if (lua_type(L, 1) == LUA_TNUMBER && lua_type(L, 2) == LUA_TNUMBER)
-        {
-            ea_t addr = (ea_t)lua_tointeger(L, 1);
-            size_t len = (size_t)lua_tointeger(L, 2);
-
-            // Create a new table to hold the bytes
-            lua_newtable(L);
-
-            // Read each byte and add to table
-            for (size_t i = 0; i < len; i++)
-            {
-                uint8_t byte = get_byte(addr + i);  // IDA's get_byte function
-
-                lua_pushinteger(L, byte);
-                lua_rawseti(L, -2, i + 1);  // table[i+1] = byte (Lua is 1-indexed)
+        ea_t addr = (ea_t)luaL_checkinteger(L, 1);
+        lua_Integer len = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, len >= 0 && len <= INT_MAX, 2, "size out of range");
+
+        lua_createtable(L, (int)len, 0);
+
+        // Bulk reads through a small window instead of one backend call per byte
+        uint8_t chunk[4096];
+        for (lua_Integer done = 0; done < len; ) {
+            size_t n = (size_t)std::min<lua_Integer>(len - done, sizeof(chunk));
+            if (!backend().read_bytes(addr + done, chunk, n)) {
+                char where[32];
+                qsnprintf(where, sizeof(where), "0x%llX", (unsigned long long)(addr + done));
+                return luaL_error(L, "read at %s was cancelled", where);
             }
-
-            return 1;  // Return the table
+            for (size_t i = 0; i < n; i++) {
+                lua_pushinteger(L, chunk[i]);
+                lua_rawseti(L, -2, done + (lua_Integer)i + 1);  // Lua is 1-indexed
+            }
+            done += (lua_Integer)n;
         }
 
-        lua_pushnil(L);  // Return nil on invalid args
         return 1;
     }
 
-    static int c_patch_bytes(lua_State* L)
+    // memory.read_buffer(address, size) -> buffer
+    // One bulk read into a buffer; bytes that aren't loaded read as 0
+    static int c_read_buffer(lua_State* L)
     {
-        if (lua_type(L, 1) == LUA_TNUMBER && lua_type(L, 2) == LUA_TTABLE)
-        {
-            ea_t addr = (ea_t)lua_tointeger(L, 1);
-
-            // Get the table length
-            size_t len = lua_objlen(L, 2);
-
-            // Iterate through the table and patch each byte
-            for (size_t i = 1; i <= len; i++)
-            {
-                lua_rawgeti(L, 2, i);  // Push table[i] onto stack
+        ea_t addr = (ea_t)luaL_checkinteger(L, 1);
+        lua_Integer len = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, len >= 0, 2, "size must not be negative");
+
+        Buffer* buffer = push_buffer(L, (size_t)len);
+        if (len > 0 && !backend().read_bytes(addr, buffer->data, (size_t)len)) {
+            char where[32];
+            qsnprintf(where, sizeof(where), "0x%llX", (unsigned long long)addr);
+            return luaL_error(L, "read of %I bytes at %s was cancelled", len, where);
+        }
+        return 1;
+    }
 
-                if (lua_type(L, -1) == LUA_TNUMBER)
-                {
-                    uint8_t byte = (uint8_t)lua_tointeger(L, -1);
-                    patch_byte(addr + (i - 1), byte);  // IDA's patch function
+    // memory.write(address, { byte, ... } | buffer | string) -> true
+    // Written as one patch, which IDA undoes as a whole
+    static int c_write_bytes(lua_State* L)
+    {
+        ea_t addr = (ea_t)luaL_checkinteger(L, 1);
+        size_t size;
+        const uint8_t* data = to_bytes(L, 2, &size);
+        if (data == nullptr) {
+            luaL_argexpected(L, lua_type(L, 2) == LUA_TTABLE, 2, "table, buffer or string");
+            size = (size_t)lua_rawlen(L, 2);
+            Buffer* bytes = push_buffer(L, size);
+            for (size_t i = 0; i < size; i++) {
+                lua_rawgeti(L, 2, (lua_Integer)i + 1);
+                int ok;
+                bytes->data[i] = (uint8_t)lua_tointegerx(L, -1, &ok);
+                if (!ok) {
+                    return luaL_error(L, "bad argument #2 (number expected at [%d], got %s)", (int)i + 1, luaL_typename(L, -1));
                 }
-
-                lua_pop(L, 1);  // Pop the value from stack
+                lua_pop(L, 1);
             }
-
-            lua_pushboolean(L, 1);  // Return true on success
-            return 1;
+            data = bytes->data;
         }
 
-        lua_pushboolean(L, 0);  // Return false on invalid args
+        Patch patch{ addr, data, size };
+        backend().patch_bytes(&patch, 1, "memory.write");
+        lua_pushboolean(L, 1);
         return 1;
     }
 
     // Get the image base (preferred load address)
-    static int c_get_imagebase(lua_State* L)
+    static ea_t get_imagebase()
     {
-        ea_t base = get_imagebase();
-        lua_pushinteger(L, (lua_Number)base);
-        return 1;
+        return backend().image_base();
     }
 
     // Get the first address of the loaded binary (min EA)
-    static int c_get_first_address(lua_State* L)
+    static ea_t get_first_address()
     {
-        ea_t first = inf_get_min_ea();
-        lua_pushinteger(L, (lua_Integer)first);
-        return 1;
+        return backend().min_ea();
     }
 
     // Get the last address of the loaded binary (max EA)
-    static int c_get_last_address(lua_State* L)
+    static ea_t get_last_address()
     {
-        ea_t last = inf_get_max_ea();
-        lua_pushinteger(L, (lua_Integer)last);
-        return 1;
+        return backend().max_ea();
     }
 }
\ No newline at end of file
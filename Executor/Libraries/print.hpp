@@ -1,43 +1,58 @@
 #include "../Executor.h"
+#include "format.hpp"
 
 namespace LUDA::Library
 {
-    lua_CFunction c_print(lua_State* L)
+    // print(...) -> nothing
+    // Values are shown as tostring() would (integers in decimal, __tostring respected),
+    // tab-separated on one line.
+    static int c_print(lua_State* L)
     {
         int nargs = lua_gettop(L);
-        std::string result;
 
+        // Convert anything that needs tostring first: __tostring is Lua code and may print too
         for (int i = 1; i <= nargs; i++) {
-            if (i > 1) result += "\t";
-
-            if (lua_isstring(L, i)) {
-                result += lua_tostring(L, i);
+            int type = lua_type(L, i);
+            if (type != LUA_TSTRING && type != LUA_TNUMBER && type != LUA_TBOOLEAN && type != LUA_TNIL) {
+                luaL_tolstring(L, i, nullptr);
+                lua_replace(L, i);
             }
-            else if (lua_isboolean(L, i)) {
+        }
+
+        std::string& result = format_buffer();
+        result.clear();
+        for (int i = 1; i <= nargs; i++) {
+            if (i > 1) result += '\t';
+
+            switch (lua_type(L, i)) {
+            case LUA_TNUMBER:
+                if (lua_isinteger(L, i)) {
+                    append_decimal(result, lua_tointeger(L, i));
+                    break;
+                }
+                [[fallthrough]];
+            case LUA_TSTRING: {
+                size_t length;
+                const char* text = lua_tolstring(L, i, &length);
+                result.append(text, length);
+                break;
+            }
+            case LUA_TBOOLEAN:
                 result += lua_toboolean(L, i) ? "true" : "false";
-            }
-            else if (lua_isnil(L, i)) {
+                break;
+            default:
                 result += "nil";
+                break;
             }
-            else if (lua_isnumber(L, i)) {
-                result += "0x" + std::to_string((ea_t)lua_tointeger(L, i));
-            }
-            else if (lua_istable(L, i)) {
-                result += "table";
-            }
-            else if (lua_isfunction(L, i)) {
-                result += "function";
-            }
-            else if (lua_isuserdata(L, i)) {
-                result += "userdata";
-            }
-            else {
-                result += lua_typename(L, lua_type(L, i));
-            }
         }
-        // Right now we don't send to UI through websocket
-		//luda::SendPrint(result);
-        msg("%s\n", result.c_str());
+        // Scripts from a client print to that client (batched by the socket), anything else to IDA
+        if (luda::CurrentJob() != nullptr) {
+            luda::SendPrint(result);
+        }
+        else {
+            msg("%s\n", result.c_str());
+        }
+        trim_format_buffer();
         return 0;
     }
-}
\ No newline at end of file
+}
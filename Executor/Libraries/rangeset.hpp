@@ -0,0 +1,402 @@
+#pragma once
+#include "../Executor.h"
+#include "heap.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace LUDA::Library
+{
+    /*
+        luda.rangeset([{ {start, end}, ... }]): set of addresses as half-open ranges
+        [start, end), the semantics of the SDK's rangeset_t (range.hpp): ranges are kept
+        sorted, and overlapping or touching ones merge; empty ranges are ignored.
+
+            s:add(start, end), s:remove(start, end)    change s in place, return s
+            s:contains(ea), s:find(ea) -> start, end, s:overlaps(start, end)
+            s:union(o), s:intersect(o), s:subtract(o)  new sets; also s | o, s & o, s - o
+            for start, end_ in s:ranges()              in address order
+            #s (number of ranges), s:size() (addresses covered), s:clear()
+
+        Implemented natively so it works without the SDK (headless builds too); the
+        ranges are one sorted array from the Lua allocator. Set operations are linear merges.
+    */
+    static constexpr const char* rangeset_type = "LUDA.rangeset";
+
+    struct EaRange {
+        ea_t start;
+        ea_t end;
+    };
+
+    struct RangeSet {
+        LuaHeap heap;
+        EaRange* ranges;
+        size_t count;
+        size_t capacity;
+    };
+
+    static RangeSet* check_rangeset(lua_State* L, int idx)
+    {
+        return (RangeSet*)luaL_checkudata(L, idx, rangeset_type);
+    }
+
+    // Room for `count` ranges
+    static void rangeset_reserve(lua_State* L, RangeSet* set, size_t count)
+    {
+        if (count <= set->capacity) {
+            return;
+        }
+        size_t capacity = std::max(count, std::max<size_t>(set->capacity * 2, 8));
+        set->ranges = (EaRange*)set->heap.reallocate(L, set->ranges,
+            set->capacity * sizeof(EaRange), capacity * sizeof(EaRange));
+        set->capacity = capacity;
+    }
+
+    // New empty set with room for `capacity` ranges on top of the stack
+    static RangeSet* push_rangeset(lua_State* L, size_t capacity)
+    {
+        RangeSet* set = (RangeSet*)lua_newuserdatauv(L, sizeof(RangeSet), 0);
+        memset(set, 0, sizeof(RangeSet));
+        set->heap.init(L);
+        luaL_setmetatable(L, rangeset_type);
+        rangeset_reserve(L, set, capacity);
+        return set;
+    }
+
+    // First range with end >= ea when touching ranges count, end > ea otherwise
+    static size_t rangeset_first_ending(const RangeSet* set, ea_t ea, bool touching)
+    {
+        EaRange* end = set->ranges + set->count;
+        return (size_t)(std::partition_point(set->ranges, end, [&](const EaRange& r) {
+            return touching ? r.end < ea : r.end <= ea;
+        }) - set->ranges);
+    }
+
+    // First range with start > ea when touching ranges count, start >= ea otherwise
+    static size_t rangeset_first_starting_after(const RangeSet* set, ea_t ea, bool touching)
+    {
+        EaRange* end = set->ranges + set->count;
+        return (size_t)(std::partition_point(set->ranges, end, [&](const EaRange& r) {
+            return touching ? r.start <= ea : r.start < ea;
+        }) - set->ranges);
+    }
+
+    // Replace ranges [from, to) by `pieces`; room must have been reserved
+    static void rangeset_splice(RangeSet* set, size_t from, size_t to, const EaRange* pieces, size_t count)
+    {
+        memmove(set->ranges + from + count, set->ranges + to, (set->count - to) * sizeof(EaRange));
+        memcpy(set->ranges + from, pieces, count * sizeof(EaRange));
+        set->count = set->count - (to - from) + count;
+    }
+
+    static void rangeset_add(lua_State* L, RangeSet* set, ea_t start, ea_t end)
+    {
+        if (start >= end) {
+            return;
+        }
+        rangeset_reserve(L, set, set->count + 1);
+        size_t from = rangeset_first_ending(set, start, true);
+        size_t to = rangeset_first_starting_after(set, end, true);
+        EaRange merged = { start, end };
+        if (from < to) {
+            merged.start = std::min(start, set->ranges[from].start);
+            merged.end = std::max(end, set->ranges[to - 1].end);
+        }
+        rangeset_splice(set, from, to, &merged, 1);
+    }
+
+    static void rangeset_remove(lua_State* L, RangeSet* set, ea_t start, ea_t end)
+    {
+        if (start >= end) {
+            return;
+        }
+        rangeset_reserve(L, set, set->count + 1);
+        size_t from = rangeset_first_ending(set, start, false);
+        size_t to = rangeset_first_starting_after(set, end, false);
+        if (from >= to) {
+            return;
+        }
+        EaRange pieces[2];
+        size_t count = 0;
+        if (set->ranges[from].start < start) {
+            pieces[count++] = { set->ranges[from].start, start };
+        }
+        if (set->ranges[to - 1].end > end) {
+            pieces[count++] = { end, set->ranges[to - 1].end };
+        }
+        rangeset_splice(set, from, to, pieces, count);
+    }
+
+    // Index of the range holding ea, or count
+    static size_t rangeset_find(const RangeSet* set, ea_t ea)
+    {
+        size_t i = rangeset_first_ending(set, ea, false);
+        return i < set->count && set->ranges[i].start <= ea ? i : set->count;
+    }
+
+    // Append to a set being built in order, merging with the last range if they touch
+    static void rangeset_append(RangeSet* set, EaRange range)
+    {
+        if (set->count > 0 && set->ranges[set->count - 1].end >= range.start) {
+            EaRange& last = set->ranges[set->count - 1];
+            last.end = std::max(last.end, range.end);
+            return;
+        }
+        set->ranges[set->count++] = range;
+    }
+
+    // luda.rangeset([ranges | set]) -> set of the given {start, end} pairs, or a copy
+    static int c_rangeset_new(lua_State* L)
+    {
+        if (lua_isnoneornil(L, 1)) {
+            push_rangeset(L, 0);
+            return 1;
+        }
+        if (RangeSet* other = (RangeSet*)luaL_testudata(L, 1, rangeset_type)) {
+            RangeSet* set = push_rangeset(L, other->count);
+            memcpy(set->ranges, other->ranges, other->count * sizeof(EaRange));
+            set->count = other->count;
+            return 1;
+        }
+        luaL_checktype(L, 1, LUA_TTABLE);
+        size_t count = (size_t)lua_rawlen(L, 1);
+        RangeSet* set = push_rangeset(L, count);
+        for (size_t i = 1; i <= count; i++) {
+            if (lua_rawgeti(L, 1, (lua_Integer)i) != LUA_TTABLE) {
+                return luaL_error(L, "bad argument #1 (range expected at [%d], got %s)", (int)i, luaL_typename(L, -1));
+            }
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            int start_ok, end_ok;
+            ea_t start = (ea_t)lua_tointegerx(L, -2, &start_ok);
+            ea_t end = (ea_t)lua_tointegerx(L, -1, &end_ok);
+            if (!start_ok || !end_ok) {
+                return luaL_error(L, "bad argument #1 ({start, end} expected at [%d])", (int)i);
+            }
+            lua_pop(L, 3);
+            if (start < end) {
+                set->ranges[set->count++] = { start, end };
+            }
+        }
+
+        // Sort, then merge in place
+        std::sort(set->ranges, set->ranges + set->count, [](const EaRange& a, const EaRange& b) {
+            return a.start < b.start;
+        });
+        size_t ranges = set->count;
+        set->count = 0;
+        for (size_t i = 0; i < ranges; i++) {
+            rangeset_append(set, set->ranges[i]);
+        }
+        return 1;
+    }
+
+    // s:add(start, end) -> s
+    static int c_rangeset_add(lua_State* L)
+    {
+        RangeSet* set = check_rangeset(L, 1);
+        rangeset_add(L, set, (ea_t)luaL_checkinteger(L, 2), (ea_t)luaL_checkinteger(L, 3));
+        lua_settop(L, 1);
+        return 1;
+    }
+
+    // s:remove(start, end) -> s
+    static int c_rangeset_remove(lua_State* L)
+    {
+        RangeSet* set = check_rangeset(L, 1);
+        rangeset_remove(L, set, (ea_t)luaL_checkinteger(L, 2), (ea_t)luaL_checkinteger(L, 3));
+        lua_settop(L, 1);
+        return 1;
+    }
+
+    static int c_rangeset_contains(lua_State* L)
+    {
+        RangeSet* set = check_rangeset(L, 1);
+        lua_pushboolean(L, rangeset_find(set, (ea_t)luaL_checkinteger(L, 2)) < set->count);
+        return 1;
+    }
+
+    // s:find(ea) -> start, end of the range holding ea, or nil
+    static int c_rangeset_find(lua_State* L)
+    {
+        RangeSet* set = check_rangeset(L, 1);
+        size_t i = rangeset_find(set, (ea_t)luaL_checkinteger(L, 2));
+        if (i == set->count) {
+            lua_pushnil(L);
+            return 1;
+        }
+        lua_pushinteger(L, (lua_Integer)set->ranges[i].start);
+        lua_pushinteger(L, (lua_Integer)set->ranges[i].end);
+        return 2;
+    }
+
+    // s:overlaps(start, end) -> any address of [start, end) is in s
+    static int c_rangeset_overlaps(lua_State* L)
+    {
+        RangeSet* set = check_rangeset(L, 1);
+        ea_t start = (ea_t)luaL_checkinteger(L, 2);
+        ea_t end = (ea_t)luaL_checkinteger(L, 3);
+        size_t i = rangeset_first_ending(set, start, false);
+        lua_pushboolean(L, start < end && i < set->count && set->ranges[i].start < end);
+        return 1;
+    }
+
+    // s:size() -> number of addresses covered
+    static int c_rangeset_size(lua_State* L)
+    {
+        RangeSet* set = check_rangeset(L, 1);
+        ea_t size = 0;
+        for (size_t i = 0; i < set->count; i++) {
+            size += set->ranges[i].end - set->ranges[i].start;
+        }
+        lua_pushinteger(L, (lua_Integer)size);
+        return 1;
+    }
+
+    static int c_rangeset_union(lua_State* L)
+    {
+        RangeSet* a = check_rangeset(L, 1);
+        RangeSet* b = check_rangeset(L, 2);
+        RangeSet* set = push_rangeset(L, a->count + b->count);
+        size_t i = 0, j = 0;
+        while (i < a->count || j < b->count) {
+            bool take_a = j == b->count || (i < a->count && a->ranges[i].start <= b->ranges[j].start);
+            rangeset_append(set, take_a ? a->ranges[i++] : b->ranges[j++]);
+        }
+        return 1;
+    }
+
+    static int c_rangeset_intersect(lua_State* L)
+    {
+        RangeSet* a = check_rangeset(L, 1);
+        RangeSet* b = check_rangeset(L, 2);
+        RangeSet* set = push_rangeset(L, a->count + b->count);
+        size_t i = 0, j = 0;
+        while (i < a->count && j < b->count) {
+            ea_t start = std::max(a->ranges[i].start, b->ranges[j].start);
+            ea_t end = std::min(a->ranges[i].end, b->ranges[j].end);
+            if (start < end) {
+                set->ranges[set->count++] = { start, end };
+            }
+            if (a->ranges[i].end < b->ranges[j].end) i++;
+            else j++;
+        }
+        return 1;
+    }
+
+    static int c_rangeset_subtract(lua_State* L)
+    {
+        RangeSet* a = check_rangeset(L, 1);
+        RangeSet* b = check_rangeset(L, 2);
+        RangeSet* set = push_rangeset(L, a->count + b->count);
+        size_t j = 0;
+        for (size_t i = 0; i < a->count; i++) {
+            ea_t start = a->ranges[i].start;
+            ea_t end = a->ranges[i].end;
+            while (j < b->count && b->ranges[j].end <= start) j++;
+            // Cut out every range of b that overlaps [start, end)
+            for (size_t k = j; k < b->count && b->ranges[k].start < end; k++) {
+                if (b->ranges[k].start > start) {
+                    set->ranges[set->count++] = { start, b->ranges[k].start };
+                }
+                start = std::max(start, b->ranges[k].end);
+            }
+            if (start < end) {
+                set->ranges[set->count++] = { start, end };
+            }
+        }
+        return 1;
+    }
+
+    // Iterator step: the range after the one starting at `start` (the first for nil)
+    static int rangeset_next(lua_State* L)
+    {
+        RangeSet* set = check_rangeset(L, 1);
+        size_t i = lua_isnil(L, 2) ? 0 : rangeset_first_starting_after(set, (ea_t)luaL_checkinteger(L, 2), true);
+        if (i >= set->count) {
+            return 0;
+        }
+        lua_pushinteger(L, (lua_Integer)set->ranges[i].start);
+        lua_pushinteger(L, (lua_Integer)set->ranges[i].end);
+        return 2;
+    }
+
+    // for start, end_ in s:ranges()
+    static int c_rangeset_ranges(lua_State* L)
+    {
+        check_rangeset(L, 1);
+        lua_pushcfunction(L, rangeset_next);
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        return 3;
+    }
+
+    static int c_rangeset_clear(lua_State* L)
+    {
+        check_rangeset(L, 1)->count = 0;
+        return 0;
+    }
+
+    static const luaL_Reg rangeset_methods[] = {
+        { "add",       c_rangeset_add },
+        { "remove",    c_rangeset_remove },
+        { "contains",  c_rangeset_contains },
+        { "find",      c_rangeset_find },
+        { "overlaps",  c_rangeset_overlaps },
+        { "size",      c_rangeset_size },
+        { "union",     c_rangeset_union },
+        { "intersect", c_rangeset_intersect },
+        { "subtract",  c_rangeset_subtract },
+        { "ranges",    c_rangeset_ranges },
+        { "clear",     c_rangeset_clear },
+        { NULL, NULL }
+    };
+
+    static int rangeset_len(lua_State* L)
+    {
+        lua_pushinteger(L, (lua_Integer)check_rangeset(L, 1)->count);
+        return 1;
+    }
+
+    static int rangeset_tostring(lua_State* L)
+    {
+        lua_pushfstring(L, "rangeset: %I ranges", (lua_Integer)check_rangeset(L, 1)->count);
+        return 1;
+    }
+
+    static int rangeset_gc(lua_State* L)
+    {
+        RangeSet* set = (RangeSet*)lua_touserdata(L, 1);
+        set->heap.release(set->ranges, set->capacity * sizeof(EaRange));
+        set->ranges = nullptr;
+        set->count = set->capacity = 0;
+        return 0;
+    }
+
+    // Create the rangeset metatable; must run before any set is made
+    static void register_rangeset_type(lua_State* L)
+    {
+        luaL_newmetatable(L, rangeset_type);
+
+        lua_newtable(L);
+        luaL_setfuncs(L, rangeset_methods, 0);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, c_rangeset_union);
+        lua_setfield(L, -2, "__bor");
+        lua_pushcfunction(L, c_rangeset_intersect);
+        lua_setfield(L, -2, "__band");
+        lua_pushcfunction(L, c_rangeset_subtract);
+        lua_setfield(L, -2, "__sub");
+        lua_pushcfunction(L, rangeset_len);
+        lua_setfield(L, -2, "__len");
+        lua_pushcfunction(L, rangeset_tostring);
+        lua_setfield(L, -2, "__tostring");
+        lua_pushcfunction(L, rangeset_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushliteral(L, "rangeset");
+        lua_setfield(L, -2, "__metatable");
+
+        lua_pop(L, 1);
+    }
+}
@@ -0,0 +1,675 @@
+#pragma once
+#include "../Executor.h"
+#include "binding.hpp"
+#include "arrays.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LUDA::Library
+{
+    /*
+        Columnar result sets. A binding that returns Records<T> hands Lua one block with a
+        column per field of T (record_fields<T>) instead of a table per row:
+
+            results[i]          row i, a small userdata pointing into the block
+            results[i].ea       read from the `ea` column through a slot index
+            #results, ipairs, pairs
+            results:column(name), results:totable()
+
+        A block of n rows costs one allocation per column, however large n is. Strings of a
+        column share one character array; vector fields become a list column (offsets into a
+        child block of all their elements, itself columnar) and record fields a child block
+        with one row per parent row. std::optional fields read as nil where they are empty.
+
+        The schema of T is derived once; every row of every block of T shares its metatable,
+        whose __index maps a field name to its column with one lookup in a table of interned
+        names. Blocks and rows are read-only.
+    */
+    static constexpr const char* records_type = "LUDA.records";
+
+    // Result rows pushed as a columnar block
+    template <typename T>
+    struct Records : std::vector<T> {
+        using std::vector<T>::vector;
+    };
+
+    enum class ColumnKind { integer, number, boolean, string, record, list };
+
+    struct RecordSchema;
+
+    struct RecordColumn {
+        const char* name;
+        ColumnKind kind;
+        bool optional;              // rows may have no value (nil)
+        const RecordSchema* child;  // record and list columns: the schema of their child block
+    };
+
+    struct RecordSchema {
+        std::vector<RecordColumn> columns;
+        bool scalar;                // one unnamed column: rows are plain values (lists of numbers, strings)
+    };
+
+    struct ColumnData {
+        const void* values;         // lua_Integer, lua_Number or uint8_t per row; string and list
+                                    // columns: size_t offsets[rows + 1] into chars / the child block
+        const char* chars;
+        const uint8_t* present;     // optional columns: 0 where a row has no value
+    };
+
+    /* Column c keeps its storage in user value 2c+1 and its child block in 2c+2; the last
+       user value holds whatever owns a schema made at run time (a compiled struct layout).
+       List elements are handed out as views: a block sharing another block's columns
+       (and user values) that covers rows first .. first + count - 1 of them. */
+    struct RecordBlock {
+        const RecordSchema* schema;
+        size_t first;
+        size_t count;
+        ColumnData columns[1];      // one per schema column
+    };
+
+    // Row `row` of its block's columns; user value 1 is the block
+    struct RecordRow {
+        const RecordBlock* block;
+        size_t row;
+    };
+
+    template <typename M>
+    struct column_value {
+        using type = M;
+        static constexpr bool optional = false;
+        static bool has(const M&) { return true; }
+        static const M& get(const M& value) { return value; }
+    };
+
+    template <typename M>
+    struct column_value<std::optional<M>> {
+        using type = M;
+        static constexpr bool optional = true;
+        static bool has(const std::optional<M>& value) { return value.has_value(); }
+        static const M& get(const std::optional<M>& value) { return *value; }
+    };
+
+    template <typename T>
+    struct is_vector : std::false_type {};
+
+    template <typename T>
+    struct is_vector<std::vector<T>> : std::true_type {};
+
+    // Text of a string-like field
+    inline std::string_view column_text(const std::string& s) { return s; }
+    inline std::string_view column_text(std::string_view s) { return s; }
+    inline std::string_view column_text(const char* s) { return s ? std::string_view(s) : std::string_view(); }
+#ifndef LUDA_HEADLESS
+    inline std::string_view column_text(const qstring& s) { return { s.c_str(), s.length() }; }
+#endif
+
+    template <typename T>
+    static const RecordSchema& schema_of();
+
+    // How a field of type M is stored
+    template <typename M>
+    static RecordColumn column_of(const char* name)
+    {
+        using V = typename column_value<M>::type;
+        RecordColumn column{ name, ColumnKind::integer, column_value<M>::optional, nullptr };
+        if constexpr (std::is_same_v<V, bool>) {
+            column.kind = ColumnKind::boolean;
+        }
+        else if constexpr (std::is_integral_v<V>) {
+            column.kind = ColumnKind::integer;
+        }
+        else if constexpr (std::is_floating_point_v<V>) {
+            column.kind = ColumnKind::number;
+        }
+        else if constexpr (is_vector<V>::value) {
+            static_assert(!column_value<M>::optional, "list fields can't be optional, use an empty vector");
+            column.kind = ColumnKind::list;
+            column.child = &schema_of<typename V::value_type>();
+        }
+        else if constexpr (is_record<V>::value) {
+            static_assert(!column_value<M>::optional, "record fields can't be optional");
+            column.kind = ColumnKind::record;
+            column.child = &schema_of<V>();
+        }
+        else {
+            static_assert(std::is_same_v<decltype(column_text(std::declval<const V&>())), std::string_view>,
+                "fields must be numbers, booleans, strings, records or vectors");
+            column.kind = ColumnKind::string;
+        }
+        return column;
+    }
+
+    // Columns of a record type, or the one unnamed column of a list of plain values
+    template <typename T>
+    static const RecordSchema& schema_of()
+    {
+        static const RecordSchema schema = [] {
+            RecordSchema s;
+            if constexpr (is_record<T>::value) {
+                std::apply([&](const auto&... f) {
+                    (s.columns.push_back(column_of<typename std::remove_cvref_t<decltype(f)>::member_type>(f.name)), ...);
+                }, record_fields<T>::fields);
+                s.scalar = false;
+            }
+            else {
+                s.columns.push_back(column_of<T>(nullptr));
+                s.scalar = true;
+            }
+            return s;
+        }();
+        return schema;
+    }
+
+    // Storage userdata of `size` bytes, kept alive as user value `slot` of the block at block_idx
+    static uint8_t* column_storage(lua_State* L, int block_idx, int slot, size_t size)
+    {
+        uint8_t* storage = (uint8_t*)lua_newuserdatauv(L, size ? size : 1, 0);
+        lua_setiuservalue(L, block_idx, slot);
+        return storage;
+    }
+
+    template <typename T, typename Each>
+    static RecordBlock* push_block(lua_State* L, size_t count, const Each& each);
+
+    // Fill column `c` of the block at block_idx from `each(visit)`, which calls visit(const M&)
+    // once per row, in order
+    template <typename M, typename Each>
+    static void fill_column(lua_State* L, int block_idx, RecordBlock* block, size_t c, size_t count, const Each& each)
+    {
+        using U = column_value<M>;
+        using V = typename U::type;
+        const RecordColumn& column = block->schema->columns[c];
+        ColumnData& data = block->columns[c];
+        int slot = (int)(2 * c + 1);
+
+        switch (column.kind) {
+        case ColumnKind::integer:
+        case ColumnKind::number:
+        case ColumnKind::boolean:
+            if constexpr (std::is_arithmetic_v<V>) {
+                using S = std::conditional_t<std::is_same_v<V, bool>, uint8_t,
+                          std::conditional_t<std::is_floating_point_v<V>, lua_Number, lua_Integer>>;
+                uint8_t* storage = column_storage(L, block_idx, slot, count * sizeof(S) + (U::optional ? count : 0));
+                S* values = (S*)storage;
+                uint8_t* present = storage + count * sizeof(S);
+                size_t i = 0;
+                each([&](const M& value) {
+                    bool has = U::has(value);
+                    values[i] = has ? (S)U::get(value) : S();
+                    if (U::optional) present[i] = has;
+                    i++;
+                });
+                data.values = values;
+                data.present = U::optional ? present : nullptr;
+            }
+            break;
+        case ColumnKind::string:
+            if constexpr (!std::is_arithmetic_v<V> && !is_vector<V>::value && !is_record<V>::value) {
+                size_t chars = 0;
+                each([&](const M& value) {
+                    if (U::has(value)) chars += column_text(U::get(value)).size();
+                });
+                size_t header = (count + 1) * sizeof(size_t) + (U::optional ? count : 0);
+                uint8_t* storage = column_storage(L, block_idx, slot, header + chars);
+                size_t* offsets = (size_t*)storage;
+                uint8_t* present = storage + (count + 1) * sizeof(size_t);
+                char* text = (char*)storage + header;
+                size_t i = 0, at = 0;
+                offsets[0] = 0;
+                each([&](const M& value) {
+                    bool has = U::has(value);
+                    if (has) {
+                        std::string_view s = column_text(U::get(value));
+                        memcpy(text + at, s.data(), s.size());
+                        at += s.size();
+                    }
+                    if (U::optional) present[i] = has;
+                    offsets[++i] = at;
+                });
+                data.values = offsets;
+                data.chars = text;
+                data.present = U::optional ? present : nullptr;
+            }
+            break;
+        case ColumnKind::record:
+            if constexpr (is_record<V>::value) {
+                push_block<V>(L, count, each);
+                lua_setiuservalue(L, block_idx, slot + 1);
+            }
+            break;
+        case ColumnKind::list:
+            if constexpr (is_vector<V>::value) {
+                using E = typename V::value_type;
+                size_t* offsets = (size_t*)column_storage(L, block_idx, slot, (count + 1) * sizeof(size_t));
+                size_t i = 0, total = 0;
+                offsets[0] = 0;
+                each([&](const M& list) {
+                    total += list.size();
+                    offsets[++i] = total;
+                });
+                data.values = offsets;
+                push_block<E>(L, total, [&](const auto& visit) {
+                    each([&](const M& list) {
+                        for (const E& element : list) visit(element);
+                    });
+                });
+                lua_setiuservalue(L, block_idx, slot + 1);
+            }
+            break;
+        }
+    }
+
+    // New block of `count` rows with no column storage yet on top of the stack. `schema` must
+    // outlive it: either it is static, or the value at owner_idx owns it and the block keeps
+    // that alive (its row metatable, which the registry keeps, is then the owner's to remove).
+    static RecordBlock* push_empty_block(lua_State* L, const RecordSchema* schema, size_t count, int owner_idx = 0)
+    {
+        size_t columns = schema->columns.size();
+        owner_idx = owner_idx != 0 ? lua_absindex(L, owner_idx) : 0;
+        RecordBlock* block = (RecordBlock*)lua_newuserdatauv(L,
+            offsetof(RecordBlock, columns) + columns * sizeof(ColumnData), (int)(2 * columns + 1));
+        if (owner_idx != 0) {
+            lua_pushvalue(L, owner_idx);
+            lua_setiuservalue(L, -2, (int)(2 * columns + 1));
+        }
+        block->schema = schema;
+        block->first = 0;
+        block->count = count;
+        memset(block->columns, 0, columns * sizeof(ColumnData));
+        luaL_setmetatable(L, records_type);
+        return block;
+    }
+
+    // New block of `count` rows of T on top of the stack
+    template <typename T, typename Each>
+    static RecordBlock* push_block(lua_State* L, size_t count, const Each& each)
+    {
+        RecordBlock* block = push_empty_block(L, &schema_of<T>(), count);
+        int block_idx = lua_gettop(L);
+
+        if constexpr (is_record<T>::value) {
+            size_t c = 0;
+            std::apply([&](const auto&... f) {
+                ((fill_column<typename std::remove_cvref_t<decltype(f)>::member_type>(L, block_idx, block, c++, count,
+                    [&](const auto& visit) {
+                        each([&](const T& row) { visit(row.*(f.member)); });
+                    })), ...);
+            }, record_fields<T>::fields);
+        }
+        else {
+            fill_column<T>(L, block_idx, block, 0, count, each);
+        }
+        return block;
+    }
+
+    template <typename T>
+    struct lua_value<Records<T>> : no_keys {
+        static int push(lua_State* L, const Records<T>& rows, int)
+        {
+            push_block<T>(L, rows.size(), [&](const auto& visit) {
+                for (const T& row : rows) visit(row);
+            });
+            return 1;
+        }
+    };
+
+    static const RecordBlock* test_records(lua_State* L, int idx)
+    {
+        return (const RecordBlock*)luaL_testudata(L, idx, records_type);
+    }
+
+    // Rows carry their schema's metatable, tagged with records_type as a light userdata key
+    static const RecordRow* test_record_row(lua_State* L, int idx)
+    {
+        if (lua_type(L, idx) != LUA_TUSERDATA || !lua_getmetatable(L, idx)) {
+            return nullptr;
+        }
+        bool row = lua_rawgetp(L, -1, records_type) != LUA_TNIL;
+        lua_pop(L, 2);
+        return row ? (const RecordRow*)lua_touserdata(L, idx) : nullptr;
+    }
+
+    static bool cell_present(const RecordBlock* block, size_t c, size_t row)
+    {
+        return !block->schema->columns[c].optional || block->columns[c].present[row];
+    }
+
+    static void push_row(lua_State* L, int block_idx, size_t row);
+    static void push_view(lua_State* L, int block_idx, size_t first, size_t count);
+
+    // Push column c of `row` of the block at block_idx
+    static void push_cell(lua_State* L, int block_idx, const RecordBlock* block, size_t c, size_t row)
+    {
+        const ColumnData& data = block->columns[c];
+        if (!cell_present(block, c, row)) {
+            lua_pushnil(L);
+            return;
+        }
+        switch (block->schema->columns[c].kind) {
+        case ColumnKind::integer:
+            lua_pushinteger(L, ((const lua_Integer*)data.values)[row]);
+            return;
+        case ColumnKind::number:
+            lua_pushnumber(L, ((const lua_Number*)data.values)[row]);
+            return;
+        case ColumnKind::boolean:
+            lua_pushboolean(L, ((const uint8_t*)data.values)[row]);
+            return;
+        case ColumnKind::string: {
+            const size_t* offsets = (const size_t*)data.values;
+            lua_pushlstring(L, data.chars + offsets[row], offsets[row + 1] - offsets[row]);
+            return;
+        }
+        case ColumnKind::record:
+            block_idx = lua_absindex(L, block_idx);
+            lua_getiuservalue(L, block_idx, (int)(2 * c + 2));
+            push_row(L, -1, row);
+            lua_remove(L, -2);
+            return;
+        case ColumnKind::list: {
+            const size_t* offsets = (const size_t*)data.values;
+            block_idx = lua_absindex(L, block_idx);
+            lua_getiuservalue(L, block_idx, (int)(2 * c + 2));
+            push_view(L, -1, offsets[row], offsets[row + 1] - offsets[row]);
+            lua_remove(L, -2);
+            return;
+        }
+        }
+    }
+
+    static void push_row_metatable(lua_State* L, const RecordSchema* schema);
+
+    // Row `row` (counted over the whole storage, not from the view's first) of the block at block_idx;
+    // lists of plain values give the value itself
+    static void push_row(lua_State* L, int block_idx, size_t row)
+    {
+        block_idx = lua_absindex(L, block_idx);
+        const RecordBlock* block = (const RecordBlock*)lua_touserdata(L, block_idx);
+        if (block->schema->scalar) {
+            push_cell(L, block_idx, block, 0, row);
+            return;
+        }
+        RecordRow* record = (RecordRow*)lua_newuserdatauv(L, sizeof(RecordRow), 1);
+        record->block = block;
+        record->row = row;
+        lua_pushvalue(L, block_idx);
+        lua_setiuservalue(L, -2, 1);
+        push_row_metatable(L, block->schema);
+        lua_setmetatable(L, -2);
+    }
+
+    // Rows first .. first + count - 1 of the block at block_idx, sharing its columns
+    static void push_view(lua_State* L, int block_idx, size_t first, size_t count)
+    {
+        block_idx = lua_absindex(L, block_idx);
+        const RecordBlock* block = (const RecordBlock*)lua_touserdata(L, block_idx);
+        size_t columns = block->schema->columns.size();
+        RecordBlock* view = (RecordBlock*)lua_newuserdatauv(L,
+            offsetof(RecordBlock, columns) + columns * sizeof(ColumnData), (int)(2 * columns + 1));
+        memcpy(view, block, offsetof(RecordBlock, columns) + columns * sizeof(ColumnData));
+        view->first = first;
+        view->count = count;
+        for (int slot = 1; slot <= (int)(2 * columns + 1); slot++) {
+            lua_getiuservalue(L, block_idx, slot);
+            lua_setiuservalue(L, -2, slot);
+        }
+        luaL_setmetatable(L, records_type);
+    }
+
+    // row.name -> the field's value, nil for names that aren't fields
+    static int record_index(lua_State* L)
+    {
+        const RecordRow* record = (const RecordRow*)lua_touserdata(L, 1);
+        lua_pushvalue(L, 2);
+        if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNUMBER) {
+            lua_pushnil(L);
+            return 1;
+        }
+        size_t c = (size_t)lua_tointeger(L, -1);
+        lua_getiuservalue(L, 1, 1);
+        push_cell(L, -1, record->block, c, record->row);
+        return 1;
+    }
+
+    static int record_newindex(lua_State* L)
+    {
+        return luaL_error(L, "records are read-only (results:totable() makes a copy)");
+    }
+
+    // pairs(row) step: the field after `name` that has a value
+    static int record_next(lua_State* L)
+    {
+        const RecordRow* record = (const RecordRow*)lua_touserdata(L, 1);
+        const RecordSchema* schema = record->block->schema;
+        size_t c = 0;
+        if (!lua_isnil(L, 2)) {
+            lua_pushvalue(L, 2);
+            lua_rawget(L, lua_upvalueindex(1));
+            c = (size_t)lua_tointeger(L, -1) + 1;
+            lua_pop(L, 1);
+        }
+        for (; c < schema->columns.size(); c++) {
+            if (cell_present(record->block, c, record->row)) {
+                lua_pushstring(L, schema->columns[c].name);
+                lua_getiuservalue(L, 1, 1);
+                push_cell(L, -1, record->block, c, record->row);
+                lua_remove(L, -2);
+                return 2;
+            }
+        }
+        return 0;
+    }
+
+    static int record_pairs(lua_State* L)
+    {
+        lua_pushvalue(L, lua_upvalueindex(1));
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        return 3;
+    }
+
+    static int record_tostring(lua_State* L)
+    {
+        const RecordRow* record = (const RecordRow*)lua_touserdata(L, 1);
+        lua_pushfstring(L, "record: row %I of %p", (lua_Integer)record->row + 1, (const void*)record->block);
+        return 1;
+    }
+
+    // Shared by every row of `schema`, made on first use and kept in the registry
+    static void push_row_metatable(lua_State* L, const RecordSchema* schema)
+    {
+        if (lua_rawgetp(L, LUA_REGISTRYINDEX, schema) == LUA_TTABLE) {
+            return;
+        }
+        lua_pop(L, 1);
+
+        lua_createtable(L, 0, 7);
+        int meta = lua_gettop(L);
+
+        // field name -> column
+        lua_createtable(L, 0, (int)schema->columns.size());
+        for (size_t c = 0; c < schema->columns.size(); c++) {
+            lua_pushinteger(L, (lua_Integer)c);
+            lua_setfield(L, -2, schema->columns[c].name);
+        }
+        int slots = lua_gettop(L);
+
+        lua_pushvalue(L, slots);
+        lua_pushcclosure(L, record_index, 1);
+        lua_setfield(L, meta, "__index");
+        lua_pushvalue(L, slots);
+        lua_pushcclosure(L, record_next, 1);
+        lua_pushcclosure(L, record_pairs, 1);
+        lua_setfield(L, meta, "__pairs");
+        lua_pop(L, 1);
+
+        lua_pushcfunction(L, record_newindex);
+        lua_setfield(L, meta, "__newindex");
+        lua_pushcfunction(L, record_tostring);
+        lua_setfield(L, meta, "__tostring");
+        lua_pushliteral(L, "record");
+        lua_setfield(L, meta, "__metatable");
+        lua_pushboolean(L, 1);
+        lua_rawsetp(L, meta, records_type);
+
+        lua_pushvalue(L, meta);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, schema);
+    }
+
+    // Copy of the value at idx with blocks and rows turned into plain tables
+    static void push_plain(lua_State* L, int idx)
+    {
+        idx = lua_absindex(L, idx);
+        luaL_checkstack(L, 4, "records nested too deep");
+        if (const RecordBlock* block = test_records(L, idx)) {
+            lua_createtable(L, (int)block->count, 0);
+            for (size_t i = 0; i < block->count; i++) {
+                push_row(L, idx, block->first + i);
+                push_plain(L, -1);
+                lua_rawseti(L, -3, (lua_Integer)i + 1);
+                lua_pop(L, 1);
+            }
+        }
+        else if (const RecordRow* record = test_record_row(L, idx)) {
+            const RecordSchema* schema = record->block->schema;
+            lua_createtable(L, 0, (int)schema->columns.size());
+            lua_getiuservalue(L, idx, 1);
+            for (size_t c = 0; c < schema->columns.size(); c++) {
+                if (!cell_present(record->block, c, record->row)) continue;
+                push_cell(L, -1, record->block, c, record->row);
+                push_plain(L, -1);
+                lua_setfield(L, -4, schema->columns[c].name);
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+        }
+        else {
+            lua_pushvalue(L, idx);
+        }
+    }
+
+    // results:column(name) -> { value of `name` in every row }
+    // Integer columns without nils come back as a u64 array, one copy of the column.
+    static int c_records_column(lua_State* L)
+    {
+        const RecordBlock* block = (const RecordBlock*)luaL_checkudata(L, 1, records_type);
+        const RecordSchema* schema = block->schema;
+        size_t c = 0;
+        if (!schema->scalar) {
+            const char* name = luaL_checkstring(L, 2);
+            while (c < schema->columns.size() && strcmp(schema->columns[c].name, name) != 0) c++;
+            if (c == schema->columns.size()) {
+                return luaL_argerror(L, 2, lua_pushfstring(L, "no field '%s'", name));
+            }
+        }
+        const RecordColumn& column = schema->columns[c];
+        if (column.kind == ColumnKind::integer && !column.optional) {
+            TypedArray* array = push_array(L, ArrayKind::u64, block->count);
+            memcpy(array->data, (const lua_Integer*)block->columns[c].values + block->first, block->count * sizeof(lua_Integer));
+            return 1;
+        }
+        lua_createtable(L, (int)block->count, 0);
+        for (size_t i = 0; i < block->count; i++) {
+            push_cell(L, 1, block, c, block->first + i);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        return 1;
+    }
+
+    // results:totable() -> the same rows as plain, writable tables
+    static int c_records_totable(lua_State* L)
+    {
+        luaL_checkudata(L, 1, records_type);
+        push_plain(L, 1);
+        return 1;
+    }
+
+    static const luaL_Reg records_methods[] = {
+        { "column",  c_records_column },
+        { "totable", c_records_totable },
+        { NULL, NULL }
+    };
+
+    // results[i] -> row i (1-based), or a method. Metamethods can't be reached from Lua
+    // (__metatable), so the first argument is always a block.
+    static int records_index(lua_State* L)
+    {
+        const RecordBlock* block = (const RecordBlock*)lua_touserdata(L, 1);
+        if (lua_type(L, 2) == LUA_TNUMBER) {
+            lua_Integer i = lua_tointeger(L, 2);
+            if (i >= 1 && (lua_Unsigned)i <= block->count) {
+                push_row(L, 1, block->first + (size_t)i - 1);
+            }
+            else {
+                lua_pushnil(L);
+            }
+            return 1;
+        }
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    static int records_len(lua_State* L)
+    {
+        lua_pushinteger(L, (lua_Integer)((const RecordBlock*)lua_touserdata(L, 1))->count);
+        return 1;
+    }
+
+    // pairs(results) step: i + 1, row i + 1
+    static int records_next(lua_State* L)
+    {
+        const RecordBlock* block = (const RecordBlock*)luaL_checkudata(L, 1, records_type);
+        lua_Integer i = luaL_optinteger(L, 2, 0) + 1;
+        if (i < 1 || (lua_Unsigned)i > block->count) {
+            return 0;
+        }
+        lua_pushinteger(L, i);
+        push_row(L, 1, block->first + (size_t)i - 1);
+        return 2;
+    }
+
+    static int records_pairs(lua_State* L)
+    {
+        luaL_checkudata(L, 1, records_type);
+        lua_pushcfunction(L, records_next);
+        lua_pushvalue(L, 1);
+        lua_pushinteger(L, 0);
+        return 3;
+    }
+
+    static int records_tostring(lua_State* L)
+    {
+        lua_pushfstring(L, "records: %I rows", (lua_Integer)((const RecordBlock*)luaL_checkudata(L, 1, records_type))->count);
+        return 1;
+    }
+
+    // Create the block metatable; must run before any block is made
+    static void register_records_type(lua_State* L)
+    {
+        luaL_newmetatable(L, records_type);
+
+        lua_newtable(L);
+        luaL_setfuncs(L, records_methods, 0);
+        lua_pushcclosure(L, records_index, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, record_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushcfunction(L, records_len);
+        lua_setfield(L, -2, "__len");
+        lua_pushcfunction(L, records_pairs);
+        lua_setfield(L, -2, "__pairs");
+        lua_pushcfunction(L, records_tostring);
+        lua_setfield(L, -2, "__tostring");
+        lua_pushliteral(L, "records");
+        lua_setfield(L, -2, "__metatable");
+
+        lua_pop(L, 1);
+    }
+}
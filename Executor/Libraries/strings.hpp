@@ -1,68 +1,38 @@
 #include "../Executor.h"
+#include "records.hpp"
 
 namespace LUDA::Library
 {
-    static int c_to_hex(lua_State* L)
-    {
-        lua_Integer num = lua_tointeger(L, 1);  // Use lua_tointeger
-
-        lua_getglobal(L, "string");
-        lua_getfield(L, -1, "format");
-
-        lua_pushstring(L, "%X");
-        lua_pushinteger(L, num);
-
-        lua_pcall(L, 2, 1, 0);
+    struct StringMatch {
+        std::string string;
+        ea_t address;
+    };
 
-        lua_remove(L, -2);
+    template <>
+    struct record_fields<StringMatch> {
+        static constexpr auto fields = std::make_tuple(
+            field("string", &StringMatch::string),
+            field("address", &StringMatch::address));
+    };
 
-        return 1;
-    }
-
-    static int c_search_strings(lua_State* L)
+    // strings.search(text [, exact]) -> records {string, address} of every C string
+    // containing text (or equal to it)
+    static Records<StringMatch> search_strings(const char* search_string, bool exact_match)
     {
-        const char* search_string = lua_tostring(L, 1);
-        bool exact_match = lua_toboolean(L, 2);
-    
-        lua_newtable(L);  // Create result table
-        int result_index = 0;
-    
-        // Iterate through all strings in the database
-        for (ea_t addr = get_segm_base(getseg(0)); addr != BADADDR; addr = next_head(addr, BADADDR)) {
-            int32 str_type = get_str_type(addr);
-            if (str_type == STRTYPE_C) {  // Only process C strings
-                size_t len = get_item_size(addr);
-                qstring str_content;
-            
-                // Get the string contents properly
-                ssize_t result = get_strlit_contents(&str_content, addr, len, str_type, nullptr, STRCONV_ESCAPE);
-                if (result == -1) continue;  // Failed to get string
-            
-                bool match = false;
-                if (exact_match) {
-                    match = (str_content == search_string);
-                } else {
-                    match = (str_content.find(search_string) != qstring::npos);
-                }
-            
-                if (match) {
-                    result_index += 1;
-                    lua_pushinteger(L, result_index);
-                
-                    // Create a sub-table with string content and address
-                    lua_newtable(L);
-                    lua_pushstring(L, "string");
-                    lua_pushstring(L, str_content.c_str());
-                    lua_settable(L, -3);
-                    lua_pushstring(L, "address");
-                    lua_pushinteger(L, addr);
-                    lua_settable(L, -3);
-                
-                    lua_settable(L, -3);
-                }
+        Records<StringMatch> matches;
+        backend().for_each_string([&](ea_t addr, const std::string& str_content) {
+            bool match = false;
+            if (exact_match) {
+                match = (str_content == search_string);
+            } else {
+                match = (str_content.find(search_string) != std::string::npos);
+            }
+
+            if (match) {
+                matches.push_back({ str_content, addr });
             }
-        }
-    
-        return 1;  // Return the table
+            return true;
+        });
+        return matches;
     }
 }
\ No newline at end of file
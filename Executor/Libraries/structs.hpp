@@ -0,0 +1,621 @@
+#pragma once
+#include "../Executor.h"
+#include "buffer.hpp"
+#include "records.hpp"
+
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LUDA::Library
+{
+    /* Binary layouts compiled once and decoded in C into record blocks:
+
+            local entry = struct.compile("u32 rva; u16 ordinal; u16 flags; char tag[4]")
+            local hdr = struct.compile("u32 magic; u16 count; u16 _; u64 ptrs[count]")
+
+            local h, after = hdr:decode(address)           -- one row, read from the database
+            local rows = entry:decode_many(buf, n, pos)    -- n rows of a buffer or string
+            local rvas = rows:column("rva")                -- u64array
+
+       Fields are `type name`, `type name[N]` or `type name[field]` (the count held by an
+       earlier integer field of the same row), separated by ';' or newlines; `--` starts a
+       comment. Types are u8..u64, i8..i64, f32, f64 and char (arrays of char are strings cut
+       at the first NUL), little-endian unless suffixed with `be`. Fields named `_` are
+       skipped. Rows are packed: no alignment padding is inserted. */
+    static constexpr const char* struct_type = "LUDA.struct";
+    static constexpr const char* struct_cache = "LUDA.struct.compiled";
+
+    enum class FieldType : uint8_t { u8, u16, u32, u64, i8, i16, i32, i64, f32, f64, chars };
+
+    static const char* const field_type_names[] = { "u8", "u16", "u32", "u64", "i8", "i16", "i32", "i64", "f32", "f64", "char" };
+    static const uint8_t field_type_widths[] = { 1, 2, 4, 8, 1, 2, 4, 8, 4, 8, 1 };
+
+    struct StructField {
+        std::string name;
+        FieldType type;
+        bool big_endian;
+        bool array;         // declared with [..]: a list column, or a string for char
+        size_t count;       // elements, when fixed
+        int count_field;    // earlier field holding the element count, or -1
+        size_t offset;      // from the row start, when no earlier field has a variable count
+        int column;         // in the schema, -1 for skipped fields
+    };
+
+    struct StructLayout {
+        std::vector<StructField> fields;
+        RecordSchema schema;
+        size_t min_size;    // bytes per row, with every variable count at 0
+        bool variable;      // some field has a variable count, so rows differ in size
+    };
+
+    // Where one field of one row starts and how many elements it has
+    struct FieldSpan {
+        size_t offset;
+        size_t count;
+    };
+
+    template <typename U>
+    static U swap_bytes(U value)
+    {
+        U swapped = 0;
+        for (size_t i = 0; i < sizeof(U); i++) {
+            swapped = (U)((swapped << 8) | (value & 0xFF));
+            value = (U)(value >> 8);
+        }
+        return swapped;
+    }
+
+    template <typename T>
+    static T load_field(const uint8_t* at, bool big_endian)
+    {
+        using U = std::conditional_t<sizeof(T) == 1, uint8_t, std::conditional_t<sizeof(T) == 2, uint16_t,
+                  std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+        U raw;
+        memcpy(&raw, at, sizeof(U));
+        if (big_endian) raw = swap_bytes(raw);
+        T value;
+        memcpy(&value, &raw, sizeof(T));
+        return value;
+    }
+
+    // Calls f with a value of the field type's C type, so element loops are compiled per type
+    template <typename F>
+    static void with_field_type(FieldType type, F&& f)
+    {
+        switch (type) {
+        case FieldType::u8: f(uint8_t()); break;
+        case FieldType::u16: f(uint16_t()); break;
+        case FieldType::u32: f(uint32_t()); break;
+        case FieldType::u64: f(uint64_t()); break;
+        case FieldType::i8: f(int8_t()); break;
+        case FieldType::i16: f(int16_t()); break;
+        case FieldType::i32: f(int32_t()); break;
+        case FieldType::i64: f(int64_t()); break;
+        case FieldType::f32: f(float()); break;
+        case FieldType::f64: f(double()); break;
+        case FieldType::chars: f(char()); break;
+        }
+    }
+
+    // Integer fields become lua_Integer (u64 keeps its bits), float fields lua_Number
+    template <typename T>
+    using field_value_t = std::conditional_t<std::is_floating_point_v<T>, lua_Number, lua_Integer>;
+
+    /* ---- compiling ---- */
+
+    struct LayoutParser {
+        lua_State* L;
+        const char* source;
+        size_t size;
+        size_t at;
+
+        // Raises the error; doesn't return
+        void fail(const char* message)
+        {
+            luaL_error(L, "struct.compile: %s at position %d", message, (int)at + 1);
+        }
+
+        void skip_space()
+        {
+            while (at < size) {
+                char c = source[at];
+                if (c == '-' && at + 1 < size && source[at + 1] == '-') {
+                    while (at < size && source[at] != '\n') at++;
+                }
+                else if (c == ' ' || c == '\t' || c == '\r') {
+                    at++;
+                }
+                else {
+                    return;
+                }
+            }
+        }
+
+        std::string_view word()
+        {
+            skip_space();
+            size_t start = at;
+            while (at < size && (isalnum((unsigned char)source[at]) || source[at] == '_')) at++;
+            return std::string_view(source + start, at - start);
+        }
+
+        bool accept(char c)
+        {
+            skip_space();
+            if (at < size && source[at] == c) {
+                at++;
+                return true;
+            }
+            return false;
+        }
+
+        // Field separators: ';' and line ends, any number of them
+        bool separator()
+        {
+            bool any = false;
+            while (accept(';') || accept('\n')) any = true;
+            return any;
+        }
+    };
+
+    static void parse_field(LayoutParser& p, StructLayout* layout)
+    {
+        size_t type_at = p.at;
+        std::string_view type_name = p.word();
+        bool big_endian = false;
+        if (type_name.size() > 2 && (type_name.substr(type_name.size() - 2) == "be" || type_name.substr(type_name.size() - 2) == "le")) {
+            big_endian = type_name.substr(type_name.size() - 2) == "be";
+            type_name.remove_suffix(2);
+        }
+        int type = -1;
+        for (int t = 0; t < (int)std::size(field_type_names); t++) {
+            if (type_name == field_type_names[t]) type = t;
+        }
+        if (type < 0) {
+            p.at = type_at;
+            p.fail("unknown type");
+        }
+
+        std::string_view name = p.word();
+        if (name.empty() || isdigit((unsigned char)name[0])) {
+            p.fail("field name expected");
+        }
+        if (name != "_") {
+            for (const StructField& field : layout->fields) {
+                if (field.name == name) p.fail("duplicate field name");
+            }
+        }
+
+        // Owned by the layout from here on, so an error below doesn't leak it
+        layout->fields.push_back({ std::string(name), (FieldType)type, big_endian, false, 1, -1, 0, -1 });
+        StructField& field = layout->fields.back();
+        if (p.accept('[')) {
+            field.array = true;
+            std::string_view count = p.word();
+            if (count.empty()) {
+                p.fail("element count expected");
+            }
+            if (isdigit((unsigned char)count[0])) {
+                size_t n = 0;
+                for (char c : count) {
+                    if (!isdigit((unsigned char)c)) p.fail("bad element count");
+                    n = n * 10 + (size_t)(c - '0');
+                    if (n > INT_MAX) p.fail("element count too large");
+                }
+                field.count = n;
+            }
+            else {
+                for (size_t f = 0; f + 1 < layout->fields.size(); f++) {
+                    const StructField& earlier = layout->fields[f];
+                    if (earlier.name == count && earlier.name != "_") field.count_field = (int)f;
+                }
+                if (field.count_field < 0) {
+                    p.fail("count must be a number or an earlier field");
+                }
+                const StructField& counter = layout->fields[field.count_field];
+                if (counter.array || counter.type == FieldType::f32 || counter.type == FieldType::f64 || counter.type == FieldType::chars) {
+                    p.fail("count field must be a single integer");
+                }
+                field.count = 0;
+            }
+            if (!p.accept(']')) {
+                p.fail("']' expected");
+            }
+        }
+    }
+
+    // Column per named field, once the field list (and the names the columns point into) is final
+    static void build_schema(StructLayout* layout)
+    {
+        size_t offset = 0;
+        bool variable = false;
+        layout->min_size = 0;
+        for (StructField& field : layout->fields) {
+            size_t width = field_type_widths[(int)field.type];
+            field.offset = variable ? 0 : offset;
+            if (field.count_field >= 0) {
+                variable = true;
+            }
+            else {
+                offset += field.count * width;
+                layout->min_size += field.count * width;
+            }
+            if (field.name == "_") continue;
+
+            RecordColumn column{ field.name.c_str(), ColumnKind::integer, false, nullptr };
+            bool number = field.type == FieldType::f32 || field.type == FieldType::f64;
+            if (field.type == FieldType::chars) {
+                column.kind = ColumnKind::string;
+            }
+            else if (field.array) {
+                column.kind = ColumnKind::list;
+                column.child = number ? &schema_of<lua_Number>() : &schema_of<lua_Integer>();
+            }
+            else if (number) {
+                column.kind = ColumnKind::number;
+            }
+            field.column = (int)layout->schema.columns.size();
+            layout->schema.columns.push_back(column);
+        }
+        layout->schema.scalar = false;
+        layout->variable = variable;
+    }
+
+    static int struct_gc(lua_State* L)
+    {
+        StructLayout* layout = (StructLayout*)luaL_checkudata(L, 1, struct_type);
+        // No block of it is left, so neither is a row needing its metatable; a layout
+        // compiled later at the same address must not pick it up
+        lua_pushnil(L);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &layout->schema);
+        layout->~StructLayout();
+        return 0;
+    }
+
+    // struct.compile(layout) -> struct
+    // Compiled layouts are shared by their text for as long as something holds them; record
+    // blocks point at their layout's schema, so each block keeps its layout alive.
+    static int c_struct_compile(lua_State* L)
+    {
+        size_t size;
+        const char* source = luaL_checklstring(L, 1, &size);
+
+        lua_getfield(L, LUA_REGISTRYINDEX, struct_cache);
+        lua_pushvalue(L, 1);
+        if (lua_rawget(L, 2) == LUA_TUSERDATA) {
+            return 1;
+        }
+        lua_pop(L, 1);
+
+        // Parse straight into the userdata: a syntax error unwinds with the layout already
+        // owned by something __gc will destroy
+        StructLayout* layout = new (lua_newuserdatauv(L, sizeof(StructLayout), 0)) StructLayout();
+        luaL_setmetatable(L, struct_type);
+
+        LayoutParser p{ L, source, size, 0 };
+        p.separator();
+        while (p.at < size) {
+            parse_field(p, layout);
+            if (!p.separator() && p.at < size) {
+                p.fail("';' expected");
+            }
+        }
+        build_schema(layout);
+        if (layout->schema.columns.empty()) {
+            return luaL_error(L, "struct.compile: layout has no named fields");
+        }
+
+        lua_pushvalue(L, 1);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, 2);
+        return 1;
+    }
+
+    /* ---- decoding ---- */
+
+    // Bytes being decoded: a buffer or string argument, or a window of database bytes that
+    // grows as rows need more of it
+    struct StructInput {
+        const uint8_t* data;
+        size_t size;
+        bool database;
+        ea_t address;
+        int window;         // stack slot of the database window
+    };
+
+    // Makes sure bytes [0, end) are available and returns the (possibly moved) data
+    static const uint8_t* struct_need(lua_State* L, StructInput& in, size_t end)
+    {
+        if (end <= in.size) {
+            return in.data;
+        }
+        if (!in.database) {
+            luaL_error(L, "struct runs past the end of the data (%I bytes needed, %I available)", (lua_Integer)end, (lua_Integer)in.size);
+        }
+        size_t size = std::max(end, in.size * 2);
+        uint8_t* window = (uint8_t*)lua_newuserdatauv(L, size, 0);
+        if (in.size != 0) {
+            memcpy(window, in.data, in.size);
+        }
+        if (!backend().read_bytes(in.address + in.size, window + in.size, size - in.size)) {
+            char where[32];
+            qsnprintf(where, sizeof(where), "0x%llX", (unsigned long long)(in.address + in.size));
+            luaL_error(L, "read at %s was cancelled", where);
+        }
+        lua_replace(L, in.window);
+        in.data = window;
+        in.size = size;
+        return window;
+    }
+
+    // Element count of a variable field, read from its count field in the same row
+    static size_t read_count(lua_State* L, const StructField& counter, const uint8_t* at)
+    {
+        lua_Integer count = 0;
+        with_field_type(counter.type, [&](auto tag) {
+            using T = decltype(tag);
+            if constexpr (std::is_integral_v<T> && !std::is_same_v<T, char>) {
+                count = (lua_Integer)load_field<T>(at, counter.big_endian);
+            }
+        });
+        if (count < 0 || (lua_Unsigned)count > (lua_Unsigned)INT_MAX) {
+            luaL_error(L, "field '%s' holds a bad element count (%I)", counter.name.c_str(), count);
+        }
+        return (size_t)count;
+    }
+
+    // Walks `rows` rows of a variable layout, recording every field's span; returns the bytes used
+    static size_t map_rows(lua_State* L, const StructLayout* layout, StructInput& in, size_t rows, FieldSpan* spans)
+    {
+        size_t fields = layout->fields.size();
+        size_t at = 0;
+        for (size_t r = 0; r < rows; r++) {
+            FieldSpan* row = spans + r * fields;
+            for (size_t f = 0; f < fields; f++) {
+                const StructField& field = layout->fields[f];
+                size_t count = field.count;
+                if (field.count_field >= 0) {
+                    const uint8_t* data = struct_need(L, in, row[field.count_field].offset + field_type_widths[(int)layout->fields[field.count_field].type]);
+                    count = read_count(L, layout->fields[field.count_field], data + row[field.count_field].offset);
+                }
+                row[f] = { at, count };
+                at += count * field_type_widths[(int)field.type];
+            }
+            struct_need(L, in, at);
+        }
+        return at;
+    }
+
+    // Column for field f of every row, into the block at block_idx
+    template <typename Span>
+    static void decode_column(lua_State* L, int block_idx, RecordBlock* block, const StructField& field,
+                              const uint8_t* data, size_t rows, const Span& span)
+    {
+        size_t c = (size_t)field.column;
+        ColumnData& column = block->columns[c];
+        int slot = (int)(2 * c + 1);
+        bool big = field.big_endian;
+
+        if (field.type == FieldType::chars) {
+            size_t chars = 0;
+            for (size_t r = 0; r < rows; r++) {
+                FieldSpan s = span(r);
+                chars += strnlen((const char*)data + s.offset, s.count);
+            }
+            uint8_t* storage = column_storage(L, block_idx, slot, (rows + 1) * sizeof(size_t) + chars);
+            size_t* offsets = (size_t*)storage;
+            char* text = (char*)(offsets + rows + 1);
+            offsets[0] = 0;
+            for (size_t r = 0, at = 0; r < rows; r++) {
+                FieldSpan s = span(r);
+                size_t length = strnlen((const char*)data + s.offset, s.count);
+                memcpy(text + at, data + s.offset, length);
+                at += length;
+                offsets[r + 1] = at;
+            }
+            column.values = offsets;
+            column.chars = text;
+            return;
+        }
+
+        with_field_type(field.type, [&](auto tag) {
+            using T = decltype(tag);
+            if constexpr (!std::is_same_v<T, char>) {
+                using V = field_value_t<T>;
+                if (!field.array) {
+                    V* values = (V*)column_storage(L, block_idx, slot, rows * sizeof(V));
+                    for (size_t r = 0; r < rows; r++) {
+                        values[r] = (V)load_field<T>(data + span(r).offset, big);
+                    }
+                    column.values = values;
+                    return;
+                }
+                size_t* offsets = (size_t*)column_storage(L, block_idx, slot, (rows + 1) * sizeof(size_t));
+                size_t total = 0;
+                offsets[0] = 0;
+                for (size_t r = 0; r < rows; r++) {
+                    total += span(r).count;
+                    offsets[r + 1] = total;
+                }
+                column.values = offsets;
+                push_block<V>(L, total, [&](const auto& visit) {
+                    for (size_t r = 0; r < rows; r++) {
+                        FieldSpan s = span(r);
+                        for (size_t i = 0; i < s.count; i++) {
+                            visit((V)load_field<T>(data + s.offset + i * sizeof(T), big));
+                        }
+                    }
+                });
+                lua_setiuservalue(L, block_idx, slot + 1);
+            }
+        });
+    }
+
+    // Decodes `rows` rows from the start of `in` into a block on top of the stack; returns the
+    // bytes used. The layout is at layout_idx.
+    static size_t decode_rows(lua_State* L, int layout_idx, const StructLayout* layout, StructInput& in, size_t rows)
+    {
+        size_t fields = layout->fields.size();
+        FieldSpan* spans = nullptr;
+        size_t used;
+        if (layout->variable) {
+            if (rows > SIZE_MAX / sizeof(FieldSpan) / fields) {
+                luaL_error(L, "too many rows");
+            }
+            spans = (FieldSpan*)lua_newuserdatauv(L, rows * fields * sizeof(FieldSpan) + 1, 0);
+            used = map_rows(L, layout, in, rows, spans);
+        }
+        else {
+            if (layout->min_size != 0 && rows > SIZE_MAX / layout->min_size) {
+                luaL_error(L, "too many rows");
+            }
+            used = rows * layout->min_size;
+            struct_need(L, in, used);
+        }
+
+        RecordBlock* block = push_empty_block(L, &layout->schema, rows, layout_idx);
+        int block_idx = lua_gettop(L);
+        for (size_t f = 0; f < fields; f++) {
+            const StructField& field = layout->fields[f];
+            if (field.column < 0) continue;
+            if (spans != nullptr) {
+                decode_column(L, block_idx, block, field, in.data, rows, [&](size_t r) { return spans[r * fields + f]; });
+            }
+            else {
+                size_t size = layout->min_size;
+                decode_column(L, block_idx, block, field, in.data, rows, [&](size_t r) { return FieldSpan{ r * size + field.offset, field.count }; });
+            }
+        }
+        if (spans != nullptr) {
+            lua_remove(L, -2);
+        }
+        return used;
+    }
+
+    // Source argument at idx: a buffer or string (with a 1-based position at pos_idx), or a database address
+    static StructInput struct_input(lua_State* L, int idx, int pos_idx, lua_Integer* start)
+    {
+        StructInput in{ nullptr, 0, false, 0, 0 };
+        if (lua_type(L, idx) == LUA_TNUMBER) {
+            in.database = true;
+            in.address = (ea_t)luaL_checkinteger(L, idx);
+            *start = (lua_Integer)in.address;
+            lua_pushnil(L);
+            in.window = lua_gettop(L);
+            return in;
+        }
+        size_t size;
+        const uint8_t* bytes = to_bytes(L, idx, &size);
+        if (bytes == nullptr) {
+            luaL_typeerror(L, idx, "buffer, string or address");
+        }
+        lua_Integer pos = luaL_optinteger(L, pos_idx, 1);
+        luaL_argcheck(L, pos >= 1 && (lua_Unsigned)pos <= size + 1, pos_idx, "position out of range");
+        in.data = bytes + pos - 1;
+        in.size = size - (size_t)(pos - 1);
+        *start = pos;
+        return in;
+    }
+
+    // s:decode(buffer | string [, pos]) -> row, next pos
+    // s:decode(address) -> row, next address
+    static int c_struct_decode(lua_State* L)
+    {
+        const StructLayout* layout = (const StructLayout*)luaL_checkudata(L, 1, struct_type);
+        lua_Integer start;
+        StructInput in = struct_input(L, 2, 3, &start);
+        size_t used = decode_rows(L, 1, layout, in, 1);
+        push_row(L, -1, 0);
+        lua_pushinteger(L, start + (lua_Integer)used);
+        return 2;
+    }
+
+    // s:decode_many(buffer | string, [count [, pos]]) -> records, next pos
+    // s:decode_many(address, count) -> records, next address
+    // Without a count, fixed-size layouts decode every whole row up to the end of the data.
+    static int c_struct_decode_many(lua_State* L)
+    {
+        const StructLayout* layout = (const StructLayout*)luaL_checkudata(L, 1, struct_type);
+        lua_Integer start;
+        StructInput in = struct_input(L, 2, 4, &start);
+        size_t rows;
+        if (lua_isnoneornil(L, 3)) {
+            luaL_argcheck(L, !in.database && !layout->variable && layout->min_size != 0, 3,
+                "count needed for database reads and variable-size layouts");
+            rows = in.size / layout->min_size;
+        }
+        else {
+            lua_Integer count = luaL_checkinteger(L, 3);
+            luaL_argcheck(L, count >= 0, 3, "count must not be negative");
+            rows = (size_t)count;
+        }
+        size_t used = decode_rows(L, 1, layout, in, rows);
+        lua_pushinteger(L, start + (lua_Integer)used);
+        return 2;
+    }
+
+    // s:size() -> bytes per row, or nil when rows vary in size
+    static int c_struct_size(lua_State* L)
+    {
+        const StructLayout* layout = (const StructLayout*)luaL_checkudata(L, 1, struct_type);
+        if (layout->variable) {
+            lua_pushnil(L);
+        }
+        else {
+            lua_pushinteger(L, (lua_Integer)layout->min_size);
+        }
+        return 1;
+    }
+
+    static int struct_tostring(lua_State* L)
+    {
+        const StructLayout* layout = (const StructLayout*)luaL_checkudata(L, 1, struct_type);
+        if (layout->variable) {
+            lua_pushfstring(L, "struct: %d fields, %I+ bytes", (int)layout->fields.size(), (lua_Integer)layout->min_size);
+        }
+        else {
+            lua_pushfstring(L, "struct: %d fields, %I bytes", (int)layout->fields.size(), (lua_Integer)layout->min_size);
+        }
+        return 1;
+    }
+
+    static const luaL_Reg struct_methods[] = {
+        { "decode",      c_struct_decode },
+        { "decode_many", c_struct_decode_many },
+        { "size",        c_struct_size },
+        { NULL, NULL }
+    };
+
+    // Create the struct metatable and the weak-valued cache of compiled layouts; must run
+    // before any layout is compiled
+    static void register_struct_type(lua_State* L)
+    {
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_setfield(L, LUA_REGISTRYINDEX, struct_cache);
+
+        luaL_newmetatable(L, struct_type);
+
+        lua_newtable(L);
+        luaL_setfuncs(L, struct_methods, 0);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, struct_tostring);
+        lua_setfield(L, -2, "__tostring");
+        lua_pushcfunction(L, struct_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushliteral(L, "struct");
+        lua_setfield(L, -2, "__metatable");
+
+        lua_pop(L, 1);
+    }
+}
@@ -0,0 +1,506 @@
+#include "MemoryBackend.h"
+#include "../LudaSocket/json.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace LUDA
+{
+	// Decimal or 0x-prefixed hex
+	static bool parse_ea(std::string_view text, ea_t& out)
+	{
+		int radix = 10;
+		if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+			text.remove_prefix(2);
+			radix = 16;
+		}
+		uint64_t value = 0;
+		auto parsed = std::from_chars(text.data(), text.data() + text.size(), value, radix);
+		if (text.empty() || parsed.ec != std::errc() || parsed.ptr != text.data() + text.size()) {
+			return false;
+		}
+		out = (ea_t)value;
+		return true;
+	}
+
+	static bool parse_kind(std::string_view text, XrefKind& out)
+	{
+		if (text.empty() || text == "code") {
+			out = XrefKind::code;
+			return true;
+		}
+		if (text == "data") {
+			out = XrefKind::data;
+			return true;
+		}
+		return false;
+	}
+
+	static bool read_file(const std::string& path, std::string& out)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+		if (f == nullptr) {
+			return false;
+		}
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		out.resize(size > 0 ? (size_t)size : 0);
+		bool ok = size >= 0 && fread(out.data(), 1, out.size(), f) == out.size();
+		fclose(f);
+		return ok;
+	}
+
+	/* JSON metadata, see MemoryBackend.h. Entries are objects two levels down, string addresses one. */
+	class MetadataReader : public luda::json::Handler
+	{
+	public:
+		explicit MetadataReader(MemoryBackend& db) : m_db(db) {}
+
+		bool has_base() const { return m_has_base; }
+		ea_t base() const { return m_base; }
+		const std::string& error() const { return m_error; }
+
+		bool StartObject() override {
+			if (m_depth == 2 && m_section != Section::other) {
+				m_entry = Entry();
+			}
+			m_depth++;
+			return true;
+		}
+
+		bool EndObject() override {
+			m_depth--;
+			if (m_depth == 2 && m_section != Section::other && m_section != Section::strings) {
+				return commit();
+			}
+			return true;
+		}
+
+		bool StartArray() override {
+			if (m_depth == 0) {
+				return fail("metadata must be a JSON object");
+			}
+			m_depth++;
+			return true;
+		}
+
+		bool EndArray() override {
+			m_depth--;
+			return true;
+		}
+
+		bool Key(std::string_view key) override {
+			if (m_depth == 1) {
+				m_section = key == "base" ? Section::base
+					: key == "segments" ? Section::segments
+					: key == "functions" ? Section::functions
+					: key == "names" ? Section::names
+					: key == "xrefs" ? Section::xrefs
+					: key == "strings" ? Section::strings
+					: Section::other;
+			}
+			else if (m_depth == 3) {
+				m_key.assign(key);
+			}
+			return true;
+		}
+
+		bool Number(std::string_view text) override { return value(text); }
+		bool String(std::string_view text) override { return value(text); }
+		bool Bool(bool) override { return value({}); }
+		bool Null() override { return value({}); }
+
+	private:
+		enum class Section { other, base, segments, functions, names, xrefs, strings };
+
+		struct Entry {
+			ea_t start = BADADDR;
+			ea_t end = BADADDR;
+			ea_t ea = BADADDR;
+			ea_t from = BADADDR;
+			ea_t to = BADADDR;
+			std::string name;
+			std::string type;
+		};
+
+		bool fail(std::string message) {
+			m_error = std::move(message);
+			return false;
+		}
+
+		bool address(std::string_view text, ea_t& out) {
+			return parse_ea(text, out) || fail("\"" + std::string(text) + "\" is not an address");
+		}
+
+		bool value(std::string_view text) {
+			if (m_depth == 0) {
+				return fail("metadata must be a JSON object");
+			}
+			if (m_section == Section::other) {
+				return true;
+			}
+			if (m_depth == 1) {
+				if (m_section != Section::base) {
+					return fail("expected a list");
+				}
+				m_has_base = true;
+				return address(text, m_base);
+			}
+			if (m_depth == 2) {
+				ea_t ea = BADADDR;
+				if (m_section != Section::strings) {
+					return fail("expected objects in this list");
+				}
+				if (!address(text, ea)) {
+					return false;
+				}
+				m_db.add_string(ea);
+				return true;
+			}
+			if (m_depth == 3) {
+				if (m_key == "start") return address(text, m_entry.start);
+				if (m_key == "end") return address(text, m_entry.end);
+				if (m_key == "ea") return address(text, m_entry.ea);
+				if (m_key == "from") return address(text, m_entry.from);
+				if (m_key == "to") return address(text, m_entry.to);
+				if (m_key == "name") m_entry.name.assign(text);
+				else if (m_key == "type") m_entry.type.assign(text);
+			}
+			return true;
+		}
+
+		bool commit() {
+			const Entry& e = m_entry;
+			switch (m_section) {
+			case Section::segments:
+				if (e.start == BADADDR || e.end == BADADDR) return fail("a segment needs \"start\" and \"end\"");
+				m_db.add_segment(e.start, e.end, e.name);
+				break;
+			case Section::functions:
+				if (e.start == BADADDR || e.end == BADADDR) return fail("a function needs \"start\" and \"end\"");
+				m_db.add_function(e.start, e.end, e.name);
+				break;
+			case Section::names:
+				if (e.ea == BADADDR || e.name.empty()) return fail("a name needs \"ea\" and \"name\"");
+				m_db.add_name(e.ea, e.name);
+				break;
+			case Section::xrefs: {
+				XrefKind kind;
+				if (e.from == BADADDR || e.to == BADADDR) return fail("an xref needs \"from\" and \"to\"");
+				if (!parse_kind(e.type, kind)) return fail("xref type must be \"code\" or \"data\"");
+				m_db.add_xref(e.from, e.to, kind);
+				break;
+			}
+			default:
+				break;
+			}
+			return true;
+		}
+
+		MemoryBackend& m_db;
+		int m_depth = 0;
+		Section m_section = Section::other;
+		std::string m_key;
+		Entry m_entry;
+		bool m_has_base = false;
+		ea_t m_base = 0;
+		std::string m_error;
+	};
+
+	/* The line format: a keyword and its whitespace-separated arguments */
+	static bool load_lines(MemoryBackend& db, std::string_view text, ea_t& base, std::string& error)
+	{
+		size_t line_number = 0;
+		while (!text.empty()) {
+			size_t end = text.find('\n');
+			std::string_view line = text.substr(0, end);
+			text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+			line_number++;
+
+			std::string_view words[5];
+			size_t count = 0;
+			while (count < 5) {
+				size_t first = line.find_first_not_of(" \t\r");
+				if (first == std::string_view::npos) break;
+				line.remove_prefix(first);
+				size_t last = line.find_first_of(" \t\r");
+				words[count++] = line.substr(0, last);
+				line.remove_prefix(last == std::string_view::npos ? line.size() : last);
+			}
+			if (count == 0 || words[0][0] == '#') {
+				continue;
+			}
+
+			std::string_view keyword = words[0];
+			ea_t a = BADADDR, b = BADADDR;
+			XrefKind kind = XrefKind::code;
+			bool ok;
+			if (keyword == "base") {
+				ok = count == 2 && parse_ea(words[1], base);
+			}
+			else if (keyword == "segment" || keyword == "function") {
+				ok = (count == 3 || count == 4) && parse_ea(words[1], a) && parse_ea(words[2], b);
+				if (ok && keyword == "segment") db.add_segment(a, b, std::string(words[3]));
+				else if (ok) db.add_function(a, b, std::string(words[3]));
+			}
+			else if (keyword == "name") {
+				ok = count == 3 && parse_ea(words[1], a);
+				if (ok) db.add_name(a, std::string(words[2]));
+			}
+			else if (keyword == "xref") {
+				ok = (count == 3 || count == 4) && parse_ea(words[1], a) && parse_ea(words[2], b) && parse_kind(words[3], kind);
+				if (ok) db.add_xref(a, b, kind);
+			}
+			else if (keyword == "string") {
+				ok = count == 2 && parse_ea(words[1], a);
+				if (ok) db.add_string(a);
+			}
+			else {
+				error = "line " + std::to_string(line_number) + ": unknown entry '" + std::string(keyword) + "'";
+				return false;
+			}
+			if (!ok) {
+				error = "line " + std::to_string(line_number) + ": malformed '" + std::string(keyword) + "' entry";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void MemoryBackend::set_image(std::vector<uint8_t> image, ea_t base)
+	{
+		m_image = std::move(image);
+		m_base = base;
+	}
+
+	void MemoryBackend::add_segment(ea_t start, ea_t end, std::string name)
+	{
+		m_segments.push_back({ start, end, std::move(name) });
+		m_sorted = false;
+	}
+
+	void MemoryBackend::add_function(ea_t start, ea_t end, std::string name)
+	{
+		m_functions.push_back({ start, end });
+		m_sorted = false;
+		if (!name.empty()) {
+			add_name(start, std::move(name));
+		}
+	}
+
+	void MemoryBackend::add_name(ea_t ea, std::string name)
+	{
+		// One name per address and one address per name, like the IDB
+		auto old_ea = m_name_eas.find(name);
+		if (old_ea != m_name_eas.end()) {
+			m_names.erase(old_ea->second);
+		}
+		auto old_name = m_names.find(ea);
+		if (old_name != m_names.end()) {
+			m_name_eas.erase(old_name->second);
+		}
+		m_name_eas[name] = ea;
+		m_names[ea] = std::move(name);
+	}
+
+	void MemoryBackend::add_xref(ea_t from, ea_t to, XrefKind kind)
+	{
+		m_xrefs.push_back({ to, kind, from });
+		m_sorted = false;
+	}
+
+	void MemoryBackend::add_string(ea_t ea)
+	{
+		m_strings.push_back(ea);
+		m_sorted = false;
+	}
+
+	void MemoryBackend::clear()
+	{
+		*this = MemoryBackend();
+	}
+
+	bool MemoryBackend::load_metadata(std::string_view text, std::string& error)
+	{
+		size_t first = text.find_first_not_of(" \t\r\n");
+		if (first == std::string_view::npos || text[first] != '{') {
+			return load_lines(*this, text, m_base, error);
+		}
+
+		MetadataReader reader(*this);
+		luda::json::ParseError parse_error;
+		if (!luda::json::Parse(text, reader, &parse_error)) {
+			error = !reader.error().empty() ? reader.error()
+				: std::string(parse_error.message) + " at offset " + std::to_string(parse_error.offset);
+			return false;
+		}
+		if (reader.has_base()) {
+			m_base = reader.base();
+		}
+		return true;
+	}
+
+	bool MemoryBackend::load(const std::string& image_path, const std::string& metadata_path, std::string& error)
+	{
+		std::string text;
+		if (!read_file(metadata_path, text)) {
+			error = "can't read " + metadata_path;
+			return false;
+		}
+		if (!load_metadata(text, error)) {
+			error = metadata_path + ": " + error;
+			return false;
+		}
+
+		std::string image;
+		if (!read_file(image_path, image)) {
+			error = "can't read " + image_path;
+			return false;
+		}
+		m_image.assign(image.begin(), image.end());
+		return true;
+	}
+
+	void MemoryBackend::sort()
+	{
+		if (m_sorted) {
+			return;
+		}
+		auto by_start = [](const auto& a, const auto& b) { return a.start < b.start; };
+		std::sort(m_segments.begin(), m_segments.end(), by_start);
+		std::sort(m_functions.begin(), m_functions.end(), by_start);
+		std::sort(m_xrefs.begin(), m_xrefs.end(), [](const Xref& a, const Xref& b) {
+			return a.to != b.to ? a.to < b.to : a.kind != b.kind ? a.kind < b.kind : a.from < b.from;
+		});
+		std::sort(m_strings.begin(), m_strings.end());
+		m_strings.erase(std::unique(m_strings.begin(), m_strings.end()), m_strings.end());
+		m_sorted = true;
+	}
+
+	uint8_t MemoryBackend::read_byte(ea_t ea)
+	{
+		return ea >= m_base && ea - m_base < m_image.size() ? m_image[ea - m_base] : 0;
+	}
+
+	bool MemoryBackend::read_bytes(ea_t ea, void* out, size_t size)
+	{
+		memset(out, 0, size);
+		ea_t end = ea + size < ea ? BADADDR : ea + size; // clamp on wrap-around
+		ea_t image_end = m_base + m_image.size();
+		ea_t first = std::max(ea, m_base);
+		ea_t last = std::min(end, image_end);
+		if (first < last) {
+			memcpy((uint8_t*)out + (first - ea), m_image.data() + (first - m_base), (size_t)(last - first));
+		}
+		return true;
+	}
+
+	void MemoryBackend::patch_byte(ea_t ea, uint8_t value)
+	{
+		if (ea >= m_base && ea - m_base < m_image.size()) {
+			m_image[ea - m_base] = value;
+		}
+	}
+
+	void MemoryBackend::patch_bytes(const Patch* patches, size_t count, const char*)
+	{
+		ea_t image_end = m_base + m_image.size();
+		for (size_t i = 0; i < count; i++) {
+			const Patch& patch = patches[i];
+			ea_t end = patch.ea + patch.size < patch.ea ? BADADDR : patch.ea + patch.size; // clamp on wrap-around
+			ea_t first = std::max(patch.ea, m_base);
+			ea_t last = std::min(end, image_end);
+			if (first < last) {
+				memcpy(m_image.data() + (first - m_base), patch.data + (first - patch.ea), (size_t)(last - first));
+			}
+		}
+	}
+
+	ea_t MemoryBackend::image_base()
+	{
+		return m_base;
+	}
+
+	ea_t MemoryBackend::min_ea()
+	{
+		sort();
+		return m_segments.empty() ? m_base : m_segments.front().start;
+	}
+
+	ea_t MemoryBackend::max_ea()
+	{
+		if (m_segments.empty()) {
+			return m_base + m_image.size();
+		}
+		ea_t last = 0;
+		for (const Segment& segment : m_segments) {
+			last = std::max(last, segment.end);
+		}
+		return last;
+	}
+
+	bool MemoryBackend::function_at(ea_t ea, FunctionRange& out)
+	{
+		sort();
+		auto next = std::upper_bound(m_functions.begin(), m_functions.end(), ea,
+			[](ea_t value, const FunctionRange& f) { return value < f.start; });
+		if (next == m_functions.begin() || ea >= std::prev(next)->end) {
+			return false;
+		}
+		out = *std::prev(next);
+		return true;
+	}
+
+	ea_t MemoryBackend::name_ea(const char* name)
+	{
+		auto it = m_name_eas.find(name);
+		return it != m_name_eas.end() ? it->second : BADADDR;
+	}
+
+	bool MemoryBackend::name_at(ea_t ea, std::string& out)
+	{
+		auto it = m_names.find(ea);
+		if (it == m_names.end()) {
+			return false;
+		}
+		out = it->second;
+		return true;
+	}
+
+	void MemoryBackend::xrefs_to(ea_t ea, XrefKind kind, std::vector<ea_t>& out)
+	{
+		sort();
+		auto first = std::lower_bound(m_xrefs.begin(), m_xrefs.end(), Xref{ ea, kind, 0 },
+			[](const Xref& a, const Xref& b) { return a.to != b.to ? a.to < b.to : a.kind < b.kind; });
+		for (auto it = first; it != m_xrefs.end() && it->to == ea && it->kind == kind; ++it) {
+			out.push_back(it->from);
+		}
+	}
+
+	void MemoryBackend::for_each_string(const StringVisitor& visit)
+	{
+		sort();
+		std::string contents;
+		for (ea_t ea : m_strings) {
+			if (ea < m_base || ea - m_base >= m_image.size()) {
+				continue;
+			}
+			const uint8_t* start = m_image.data() + (ea - m_base);
+			const uint8_t* end = m_image.data() + m_image.size();
+			const uint8_t* terminator = std::find(start, end, 0);
+			contents.assign((const char*)start, (size_t)(terminator - start));
+			if (!visit(ea, contents)) {
+				return;
+			}
+		}
+	}
+
+	void MemoryBackend::segments(std::vector<Segment>& out)
+	{
+		sort();
+		out.insert(out.end(), m_segments.begin(), m_segments.end());
+	}
+}
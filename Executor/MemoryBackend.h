@@ -0,0 +1,91 @@
+#pragma once
+#include "Backend.h"
+
+#include <map>
+#include <string_view>
+#include <unordered_map>
+
+namespace LUDA
+{
+	/*
+		A database held in memory: a raw image mapped at a base address plus
+		segments, functions, names, xrefs and string literals. Filled by hand or
+		loaded from an image file and a metadata file, either JSON
+
+			{
+				"base": "0x140000000",
+				"segments":  [{"name": ".text", "start": "0x140001000", "end": "0x140008000"}],
+				"functions": [{"start": "0x140001000", "end": "0x140001040", "name": "main"}],
+				"names":     [{"ea": "0x140009000", "name": "g_table"}],
+				"xrefs":     [{"from": "0x140001010", "to": "0x140009000", "type": "data"}],
+				"strings":   ["0x14000A000"]
+			}
+
+		or one entry per line, '#' lines being comments:
+
+			base 0x140000000
+			segment 0x140001000 0x140008000 .text
+			function 0x140001000 0x140001040 main
+			name 0x140009000 g_table
+			xref 0x140001010 0x140009000 data
+			string 0x14000A000
+
+		Addresses are decimal or 0x-prefixed hex, as JSON numbers or strings. Strings
+		are read from the image up to their terminating zero; xrefs default to code.
+	*/
+	class MemoryBackend : public Backend
+	{
+	public:
+		void set_image(std::vector<uint8_t> image, ea_t base);
+		void add_segment(ea_t start, ea_t end, std::string name);
+		void add_function(ea_t start, ea_t end, std::string name = {}); // a name is added too
+		void add_name(ea_t ea, std::string name);
+		void add_xref(ea_t from, ea_t to, XrefKind kind);
+		void add_string(ea_t ea);
+		void clear();
+
+		// Both files; the image is mapped at the metadata's base (0 if it has none)
+		bool load(const std::string& image_path, const std::string& metadata_path, std::string& error);
+		bool load_metadata(std::string_view text, std::string& error);
+
+		const std::vector<uint8_t>& image() const { return m_image; }
+
+		uint8_t read_byte(ea_t ea) override;
+		bool read_bytes(ea_t ea, void* out, size_t size) override;
+		void patch_byte(ea_t ea, uint8_t value) override;
+		void patch_bytes(const Patch* patches, size_t count, const char* label) override;
+
+		ea_t image_base() override;
+		ea_t min_ea() override;
+		ea_t max_ea() override;
+
+		bool function_at(ea_t ea, FunctionRange& out) override;
+
+		ea_t name_ea(const char* name) override;
+		bool name_at(ea_t ea, std::string& out) override;
+
+		void xrefs_to(ea_t ea, XrefKind kind, std::vector<ea_t>& out) override;
+		void for_each_string(const StringVisitor& visit) override;
+		void segments(std::vector<Segment>& out) override;
+
+	private:
+		struct Xref {
+			ea_t to;
+			XrefKind kind;
+			ea_t from;
+		};
+
+		// Lookups binary search; additions only append and mark the lists unsorted
+		void sort();
+
+		std::vector<uint8_t> m_image;
+		ea_t m_base = 0;
+		std::vector<Segment> m_segments;
+		std::vector<FunctionRange> m_functions;
+		std::unordered_map<std::string, ea_t> m_name_eas;
+		std::map<ea_t, std::string> m_names;
+		std::vector<Xref> m_xrefs;
+		std::vector<ea_t> m_strings;
+		bool m_sorted = true;
+	};
+}
@@ -0,0 +1,209 @@
+#include "Sandbox.h"
+
+extern "C" {
+#include <Lua/lauxlib.h>
+}
+
+namespace LUDA::Sandbox
+{
+	static constexpr const char* kEnvMetaKey = "LUDA.sandbox.env";
+	static constexpr int kMaxFreezeDepth = 3;
+
+	// Mutable by design (package.path, package.loaded); left shared as-is
+	static constexpr const char* kUnfrozen[] = { "package" };
+
+	static int readonly_newindex(lua_State* L)
+	{
+		return luaL_error(L, "attempt to modify read-only table '%s'", lua_tostring(L, lua_upvalueindex(1)));
+	}
+
+	static int readonly_len(lua_State* L)
+	{
+		lua_pushinteger(L, (lua_Integer)lua_rawlen(L, lua_upvalueindex(1)));
+		return 1;
+	}
+
+	static int readonly_next(lua_State* L)
+	{
+		lua_settop(L, 2);
+		if (lua_next(L, 1)) {
+			return 2;
+		}
+		lua_pushnil(L);
+		return 1;
+	}
+
+	static int readonly_pairs(lua_State* L)
+	{
+		lua_pushcfunction(L, readonly_next);
+		lua_pushvalue(L, lua_upvalueindex(1));
+		lua_pushnil(L);
+		return 3;
+	}
+
+	static int frozen_global(lua_State* L)
+	{
+		return luaL_error(L, "attempt to assign '%s' in the frozen base environment", luaL_tolstring(L, 2, nullptr));
+	}
+
+	/* Push a read-only proxy for the table at `real`. Nested tables are proxied too. */
+	static void push_readonly(lua_State* L, int real, const char* name, int seen, int depth)
+	{
+		lua_pushvalue(L, real);
+		if (lua_rawget(L, seen) == LUA_TTABLE) {
+			return;
+		}
+		lua_pop(L, 1);
+
+		if (!lua_checkstack(L, 8)) {
+			lua_pushvalue(L, real);
+			return;
+		}
+
+		/* proxy children first so the real table only ever hands out proxies */
+		if (depth < kMaxFreezeDepth) {
+			lua_pushnil(L);
+			while (lua_next(L, real) != 0) {
+				if (lua_type(L, -1) == LUA_TTABLE && lua_type(L, -2) == LUA_TSTRING) {
+					const char* child = lua_pushfstring(L, "%s.%s", name, lua_tostring(L, -2));
+					push_readonly(L, lua_gettop(L) - 1, child, seen, depth + 1);
+					lua_pushvalue(L, -4);
+					lua_insert(L, -2);
+					lua_rawset(L, real); // replacing an existing key is fine during lua_next
+					lua_pop(L, 1);
+				}
+				lua_pop(L, 1);
+			}
+		}
+
+		lua_newtable(L); // proxy
+		lua_createtable(L, 0, 5);
+
+		lua_pushvalue(L, real);
+		lua_setfield(L, -2, "__index");
+
+		lua_pushstring(L, name);
+		lua_pushcclosure(L, readonly_newindex, 1);
+		lua_setfield(L, -2, "__newindex");
+
+		lua_pushvalue(L, real);
+		lua_pushcclosure(L, readonly_len, 1);
+		lua_setfield(L, -2, "__len");
+
+		lua_pushvalue(L, real);
+		lua_pushcclosure(L, readonly_pairs, 1);
+		lua_setfield(L, -2, "__pairs");
+
+		lua_pushliteral(L, "read-only");
+		lua_setfield(L, -2, "__metatable");
+
+		lua_setmetatable(L, -2);
+
+		lua_pushvalue(L, real);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, seen);
+	}
+
+	void freeze(lua_State* L)
+	{
+		if (is_frozen(L)) {
+			return;
+		}
+		int top = lua_gettop(L);
+
+		lua_pushglobaltable(L);
+		int G = lua_gettop(L);
+		lua_newtable(L);
+		int seen = lua_gettop(L);
+
+		/* a proxy for _G would hide the per-run table, never wrap it */
+		lua_pushvalue(L, G);
+		lua_pushvalue(L, G);
+		lua_rawset(L, seen);
+		for (const char* name : kUnfrozen) {
+			if (lua_getfield(L, G, name) == LUA_TTABLE) {
+				lua_pushvalue(L, -1);
+				lua_rawset(L, seen);
+			}
+			else {
+				lua_pop(L, 1);
+			}
+		}
+
+		lua_pushnil(L);
+		while (lua_next(L, G) != 0) {
+			if (lua_type(L, -1) == LUA_TTABLE && lua_type(L, -2) == LUA_TSTRING) {
+				push_readonly(L, lua_gettop(L), lua_tostring(L, -2), seen, 1);
+				lua_pushvalue(L, -3);
+				lua_insert(L, -2);
+				lua_rawset(L, G);
+			}
+			lua_pop(L, 1);
+		}
+
+		/* string methods are looked up through the string metatable, not the global */
+		lua_pushliteral(L, "");
+		if (lua_getmetatable(L, -1)) {
+			if (lua_getfield(L, -1, "__index") == LUA_TTABLE && lua_rawget(L, seen) == LUA_TTABLE) {
+				lua_setfield(L, -2, "__index");
+			}
+			else {
+				lua_pop(L, 1);
+			}
+			lua_pushliteral(L, "read-only");
+			lua_setfield(L, -2, "__metatable");
+		}
+		lua_settop(L, seen);
+
+		/* require() hands out package.loaded entries; those have to be the proxies too */
+		if (lua_getfield(L, G, "package") == LUA_TTABLE && lua_getfield(L, -1, "loaded") == LUA_TTABLE) {
+			int loaded = lua_gettop(L);
+			lua_pushnil(L);
+			while (lua_next(L, loaded) != 0) {
+				if (lua_type(L, -1) == LUA_TTABLE && lua_rawget(L, seen) == LUA_TTABLE) {
+					lua_pushvalue(L, -2);
+					lua_insert(L, -2);
+					lua_rawset(L, loaded);
+				}
+				else {
+					lua_pop(L, 1);
+				}
+			}
+		}
+		lua_settop(L, seen);
+
+		/* the base itself only changes through rawset from here on */
+		lua_createtable(L, 0, 2);
+		lua_pushcfunction(L, frozen_global);
+		lua_setfield(L, -2, "__newindex");
+		lua_pushliteral(L, "read-only");
+		lua_setfield(L, -2, "__metatable");
+		lua_setmetatable(L, G);
+
+		/* shared metatable of every per-run environment; __metatable keeps the base out of reach */
+		lua_createtable(L, 0, 2);
+		lua_pushvalue(L, G);
+		lua_setfield(L, -2, "__index");
+		lua_pushliteral(L, "sandbox");
+		lua_setfield(L, -2, "__metatable");
+		lua_setfield(L, LUA_REGISTRYINDEX, kEnvMetaKey);
+
+		lua_settop(L, top);
+	}
+
+	bool is_frozen(lua_State* L)
+	{
+		bool frozen = lua_getfield(L, LUA_REGISTRYINDEX, kEnvMetaKey) == LUA_TTABLE;
+		lua_pop(L, 1);
+		return frozen;
+	}
+
+	void push_environment(lua_State* L)
+	{
+		lua_createtable(L, 0, 4);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -2, "_G");
+		lua_getfield(L, LUA_REGISTRYINDEX, kEnvMetaKey);
+		lua_setmetatable(L, -2);
+	}
+}
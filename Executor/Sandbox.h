@@ -0,0 +1,28 @@
+#pragma once
+
+extern "C" {
+#include <Lua/lua.h>
+}
+
+/*
+	Per-run global environments on top of a frozen base.
+
+	freeze() turns the current globals into the shared base: library tables
+	are swapped for read-only proxies and assigning new base globals is an
+	error. push_environment() then hands out a fresh _ENV for every run: an
+	empty table whose misses fall through to the base, so whatever a run
+	assigns stays in its own table and disappears with it. The string
+	metatable and package.loaded hand out the proxies too, and the
+	metatables of the base and of every environment are locked
+	(__metatable), so the base can't be reached through them.
+*/
+namespace LUDA::Sandbox
+{
+	// Freeze the current globals. Call after all bindings and the prelude are in place.
+	void freeze(lua_State* L);
+
+	bool is_frozen(lua_State* L);
+
+	// Push a new, empty environment that inherits from the frozen base
+	void push_environment(lua_State* L);
+}
@@ -0,0 +1,768 @@
+#include "Snapshot.h"
+
+#include <cstring>
+#include <unordered_map>
+
+extern "C" {
+#include <Lua/lauxlib.h>
+}
+
+/*
+	Blob layout (little endian, x86_64 only like the rest of LUDA):
+
+		header   "LUDASNAP", u32 format, u16 lua version, u8 sizeof(lua_Integer),
+		         u8 sizeof(lua_Number), u64 source hash, u32 #strings, u32 #objects,
+		         u64 pool size
+		pool     every distinct string once, as (varint length, bytes)
+		body     a list of ops terminated by OP_END
+
+	Tables and Lua functions get an object id the first time they are written;
+	later occurrences are written as references so sharing and cycles survive.
+	Upvalues shared between closures are re-joined on restore.
+*/
+
+namespace LUDA::Snapshot
+{
+	static constexpr char kMagic[8] = { 'L', 'U', 'D', 'A', 'S', 'N', 'A', 'P' };
+	static constexpr uint32_t kFormat = 1;
+	static constexpr const char* kRegistryKey = "LUDA.snapshot";
+	static constexpr int kMaxDepth = 200;
+
+	enum Op : uint8_t {
+		OP_END = 0,
+		OP_SET_GLOBAL = 1,
+		OP_SET_FIELD = 2,
+	};
+
+	enum Tag : uint8_t {
+		T_NIL = 0,
+		T_FALSE,
+		T_TRUE,
+		T_INT,
+		T_FLOAT,
+		T_STRING,   // index into the string pool
+		T_REF,      // table/function already written
+		T_NATIVE,   // baseline value, stored as a dotted path
+		T_GLOBALS,  // the global table itself
+		T_TABLE,
+		T_FUNCTION,
+	};
+
+	enum Upvalue : uint8_t {
+		U_VALUE = 0,
+		U_JOIN = 1,  // shares the cell of an upvalue already restored
+	};
+
+	uint64_t hash(const std::string& data)
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (unsigned char c : data) {
+			h ^= c;
+			h *= 0x100000001b3ull;
+		}
+		return h;
+	}
+
+	static void put_varint(std::string& out, uint64_t v)
+	{
+		while (v >= 0x80) {
+			out += (char)(v | 0x80);
+			v >>= 7;
+		}
+		out += (char)v;
+	}
+
+	template <typename T>
+	static void put_raw(std::string& out, T v)
+	{
+		out.append((const char*)&v, sizeof(v));
+	}
+
+	/* Baseline */
+
+	static bool is_reference_type(int type)
+	{
+		return type == LUA_TTABLE || type == LUA_TFUNCTION || type == LUA_TUSERDATA || type == LUA_TLIGHTUSERDATA;
+	}
+
+	static constexpr int kMaxPathDepth = 4;
+
+	/* paths[v] = "prefix.k" for every reference value under string keys of `tbl`, first path wins */
+	static void register_paths(lua_State* L, int paths, int tbl, const char* prefix, int depth)
+	{
+		if (!lua_checkstack(L, 8)) return;
+
+		lua_pushnil(L);
+		while (lua_next(L, tbl) != 0) {
+			if (lua_type(L, -2) != LUA_TSTRING || !is_reference_type(lua_type(L, -1))) {
+				lua_pop(L, 1);
+				continue;
+			}
+
+			lua_pushvalue(L, -1);
+			bool known = lua_rawget(L, paths) != LUA_TNIL;
+			lua_pop(L, 1);
+			if (known) {
+				lua_pop(L, 1);
+				continue;
+			}
+
+			if (prefix != nullptr) lua_pushfstring(L, "%s.%s", prefix, lua_tostring(L, -2));
+			else lua_pushvalue(L, -2);
+			int path = lua_gettop(L);
+
+			lua_pushvalue(L, -2);
+			lua_pushvalue(L, path);
+			lua_rawset(L, paths);
+
+			if (lua_type(L, path - 1) == LUA_TTABLE && depth < kMaxPathDepth) {
+				register_paths(L, paths, path - 1, lua_tostring(L, path), depth + 1);
+			}
+			lua_pop(L, 2);
+		}
+	}
+
+	void capture_baseline(lua_State* L)
+	{
+		int top = lua_gettop(L);
+
+		lua_createtable(L, 0, 3);
+		int base = lua_gettop(L);
+		lua_newtable(L);
+		int globals = lua_gettop(L);
+		lua_newtable(L);
+		int fields = lua_gettop(L);
+		lua_newtable(L);
+		int paths = lua_gettop(L);
+
+		lua_pushglobaltable(L);
+		int G = lua_gettop(L);
+
+		/* _G itself is written as T_GLOBALS, keep it out of the path map */
+		lua_pushvalue(L, G);
+		lua_pushliteral(L, "_G");
+		lua_rawset(L, paths);
+		register_paths(L, paths, G, nullptr, 1);
+		lua_pushvalue(L, G);
+		lua_pushnil(L);
+		lua_rawset(L, paths);
+
+		/* Shallow copies of the globals and of every global table, for diffing in save() */
+		lua_pushnil(L);
+		while (lua_next(L, G) != 0) {
+			lua_pushvalue(L, -2);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, globals);
+
+			if (lua_type(L, -1) == LUA_TTABLE && !lua_rawequal(L, -1, G)) {
+				int tbl = lua_gettop(L);
+				lua_newtable(L);
+				int copy = lua_gettop(L);
+
+				lua_pushnil(L);
+				while (lua_next(L, tbl) != 0) {
+					lua_pushvalue(L, -2);
+					lua_insert(L, -2);
+					lua_rawset(L, copy);
+				}
+
+				/* fields[tbl] = copy */
+				lua_pushvalue(L, tbl);
+				lua_insert(L, -2);
+				lua_rawset(L, fields);
+			}
+			lua_pop(L, 1);
+		}
+
+		lua_pushvalue(L, paths);
+		lua_setfield(L, base, "paths");
+		lua_pushvalue(L, fields);
+		lua_setfield(L, base, "fields");
+		lua_pushvalue(L, globals);
+		lua_setfield(L, base, "globals");
+		lua_settop(L, base);
+		lua_setfield(L, LUA_REGISTRYINDEX, kRegistryKey);
+
+		lua_settop(L, top);
+	}
+
+	/* Save */
+
+	struct Writer {
+		lua_State* L = nullptr;
+		std::string body;
+		std::string pool;
+		uint32_t nstrings = 0;
+		uint32_t nobjects = 0;
+		int G = 0;
+		int paths = 0;
+		int strings = 0;  // string -> pool index
+		int objects = 0;  // table/function -> object id
+		int depth = 0;
+		std::unordered_map<void*, std::pair<uint32_t, int>> upvalues;
+		std::string error;
+	};
+
+	static int dump_writer(lua_State*, const void* p, size_t sz, void* ud)
+	{
+		((std::string*)ud)->append((const char*)p, sz);
+		return 0;
+	}
+
+	static uint32_t intern(Writer& w, int idx)
+	{
+		lua_State* L = w.L;
+		lua_pushvalue(L, idx);
+		if (lua_rawget(L, w.strings) == LUA_TNUMBER) {
+			uint32_t n = (uint32_t)lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			return n;
+		}
+		lua_pop(L, 1);
+
+		size_t len;
+		const char* s = lua_tolstring(L, idx, &len);
+		put_varint(w.pool, len);
+		w.pool.append(s, len);
+
+		uint32_t n = w.nstrings++;
+		lua_pushvalue(L, idx);
+		lua_pushinteger(L, n);
+		lua_rawset(L, w.strings);
+		return n;
+	}
+
+	static bool write_value(Writer& w, int idx);
+
+	static bool write_function(Writer& w, int idx, uint32_t id)
+	{
+		lua_State* L = w.L;
+		if (lua_iscfunction(L, idx)) {
+			w.error = "cannot snapshot a C function that is not part of the baseline";
+			return false;
+		}
+
+		std::string code;
+		lua_pushvalue(L, idx);
+		int status = lua_dump(L, dump_writer, &code, 0);
+		lua_pop(L, 1);
+		if (status != 0) {
+			w.error = "lua_dump failed";
+			return false;
+		}
+
+		int nups = 0;
+		while (lua_getupvalue(L, idx, nups + 1) != nullptr) {
+			lua_pop(L, 1);
+			nups++;
+		}
+
+		w.body += (char)T_FUNCTION;
+		put_varint(w.body, code.size());
+		w.body += code;
+		put_varint(w.body, nups);
+
+		for (int n = 1; n <= nups; n++) {
+			void* uid = lua_upvalueid(L, idx, n);
+			auto it = w.upvalues.find(uid);
+			if (it != w.upvalues.end()) {
+				w.body += (char)U_JOIN;
+				put_varint(w.body, it->second.first);
+				put_varint(w.body, it->second.second);
+				continue;
+			}
+			w.upvalues.emplace(uid, std::make_pair(id, n));
+
+			w.body += (char)U_VALUE;
+			lua_getupvalue(L, idx, n);
+			bool ok = write_value(w, lua_gettop(L));
+			lua_pop(L, 1);
+			if (!ok) return false;
+		}
+		return true;
+	}
+
+	static bool write_table(Writer& w, int idx)
+	{
+		lua_State* L = w.L;
+
+		uint64_t count = 0;
+		lua_pushnil(L);
+		while (lua_next(L, idx) != 0) {
+			lua_pop(L, 1);
+			count++;
+		}
+
+		w.body += (char)T_TABLE;
+		put_varint(w.body, count);
+
+		lua_pushnil(L);
+		while (lua_next(L, idx) != 0) {
+			int top = lua_gettop(L);
+			if (!write_value(w, top - 1) || !write_value(w, top)) {
+				lua_pop(L, 2);
+				return false;
+			}
+			lua_pop(L, 1);
+		}
+
+		if (lua_getmetatable(L, idx)) {
+			w.body += (char)1;
+			bool ok = write_value(w, lua_gettop(L));
+			lua_pop(L, 1);
+			return ok;
+		}
+		w.body += (char)0;
+		return true;
+	}
+
+	static bool write_value(Writer& w, int idx)
+	{
+		lua_State* L = w.L;
+		if (!lua_checkstack(L, 8) || ++w.depth > kMaxDepth) {
+			w.error = "value nested too deeply";
+			return false;
+		}
+
+		bool ok = true;
+		int type = lua_type(L, idx);
+		switch (type) {
+		case LUA_TNIL:
+			w.body += (char)T_NIL;
+			break;
+		case LUA_TBOOLEAN:
+			w.body += (char)(lua_toboolean(L, idx) ? T_TRUE : T_FALSE);
+			break;
+		case LUA_TNUMBER:
+			if (lua_isinteger(L, idx)) {
+				w.body += (char)T_INT;
+				put_raw(w.body, (lua_Integer)lua_tointeger(L, idx));
+			}
+			else {
+				w.body += (char)T_FLOAT;
+				put_raw(w.body, (lua_Number)lua_tonumber(L, idx));
+			}
+			break;
+		case LUA_TSTRING:
+			w.body += (char)T_STRING;
+			put_varint(w.body, intern(w, idx));
+			break;
+		default: {
+			if (lua_rawequal(L, idx, w.G)) {
+				w.body += (char)T_GLOBALS;
+				break;
+			}
+
+			lua_pushvalue(L, idx);
+			if (lua_rawget(L, w.paths) == LUA_TSTRING) {
+				w.body += (char)T_NATIVE;
+				put_varint(w.body, intern(w, lua_gettop(L)));
+				lua_pop(L, 1);
+				break;
+			}
+			lua_pop(L, 1);
+
+			if (type != LUA_TTABLE && type != LUA_TFUNCTION) {
+				w.error = std::string("cannot snapshot a value of type ") + lua_typename(L, type);
+				ok = false;
+				break;
+			}
+
+			lua_pushvalue(L, idx);
+			if (lua_rawget(L, w.objects) == LUA_TNUMBER) {
+				w.body += (char)T_REF;
+				put_varint(w.body, (uint64_t)lua_tointeger(L, -1));
+				lua_pop(L, 1);
+				break;
+			}
+			lua_pop(L, 1);
+
+			uint32_t id = w.nobjects++;
+			lua_pushvalue(L, idx);
+			lua_pushinteger(L, id);
+			lua_rawset(L, w.objects);
+
+			ok = type == LUA_TTABLE ? write_table(w, idx) : write_function(w, idx, id);
+			break;
+		}
+		}
+
+		w.depth--;
+		return ok;
+	}
+
+	/* Writes `op target key value` for every entry of `live` that differs from `copy` */
+	static bool write_diff(Writer& w, Op op, int target, int live, int copy)
+	{
+		lua_State* L = w.L;
+
+		lua_pushnil(L);
+		while (lua_next(L, live) != 0) {
+			lua_pushvalue(L, -2);
+			lua_rawget(L, copy);
+			bool same = lua_rawequal(L, -1, -2);
+			lua_pop(L, 1);
+			if (!same) {
+				w.body += (char)op;
+				int top = lua_gettop(L);
+				if ((target && !write_value(w, target)) || !write_value(w, top - 1) || !write_value(w, top)) {
+					lua_pop(L, 2);
+					return false;
+				}
+			}
+			lua_pop(L, 1);
+		}
+
+		/* entries the prelude removed */
+		lua_pushnil(L);
+		while (lua_next(L, copy) != 0) {
+			lua_pop(L, 1);
+			lua_pushvalue(L, -1);
+			if (lua_rawget(L, live) == LUA_TNIL) {
+				w.body += (char)op;
+				if ((target && !write_value(w, target)) || !write_value(w, lua_gettop(L) - 1)) {
+					lua_pop(L, 2);
+					return false;
+				}
+				w.body += (char)T_NIL;
+			}
+			lua_pop(L, 1);
+		}
+		return true;
+	}
+
+	bool save(lua_State* L, uint64_t source_hash, std::string& out, std::string& error)
+	{
+		int top = lua_gettop(L);
+		if (lua_getfield(L, LUA_REGISTRYINDEX, kRegistryKey) != LUA_TTABLE) {
+			lua_settop(L, top);
+			error = "no baseline captured";
+			return false;
+		}
+		int base = lua_gettop(L);
+
+		Writer w;
+		w.L = L;
+		lua_pushglobaltable(L);
+		w.G = lua_gettop(L);
+		lua_getfield(L, base, "paths");
+		w.paths = lua_gettop(L);
+		lua_newtable(L);
+		w.strings = lua_gettop(L);
+		lua_newtable(L);
+		w.objects = lua_gettop(L);
+		lua_getfield(L, base, "globals");
+		int globals = lua_gettop(L);
+		lua_getfield(L, base, "fields");
+		int fields = lua_gettop(L);
+
+		bool ok = write_diff(w, OP_SET_GLOBAL, 0, w.G, globals);
+
+		lua_pushnil(L);
+		while (ok && lua_next(L, fields) != 0) {
+			int copy = lua_gettop(L);
+			ok = write_diff(w, OP_SET_FIELD, copy - 1, copy - 1, copy);
+			lua_pop(L, 1);
+		}
+		lua_settop(L, top);
+
+		if (!ok) {
+			error = w.error;
+			return false;
+		}
+		w.body += (char)OP_END;
+
+		out.clear();
+		out.reserve(48 + w.pool.size() + w.body.size());
+		out.append(kMagic, sizeof(kMagic));
+		put_raw(out, kFormat);
+		put_raw(out, (uint16_t)LUA_VERSION_NUM);
+		put_raw(out, (uint8_t)sizeof(lua_Integer));
+		put_raw(out, (uint8_t)sizeof(lua_Number));
+		put_raw(out, source_hash);
+		put_raw(out, w.nstrings);
+		put_raw(out, w.nobjects);
+		put_raw(out, (uint64_t)w.pool.size());
+		out += w.pool;
+		out += w.body;
+		return true;
+	}
+
+	/* Restore */
+
+	struct Reader {
+		lua_State* L = nullptr;
+		const uint8_t* p = nullptr;
+		const uint8_t* end = nullptr;
+		int pool = 0;     // array of interned strings
+		int objects = 0;  // array of restored tables/functions
+		uint32_t nobjects = 0;
+		int depth = 0;
+		std::string error;
+
+		bool fail(const char* why) {
+			if (error.empty()) error = why;
+			return false;
+		}
+
+		bool byte(uint8_t& v) {
+			if (p >= end) return fail("truncated snapshot");
+			v = *p++;
+			return true;
+		}
+
+		bool varint(uint64_t& v) {
+			v = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				uint8_t b;
+				if (!byte(b)) return false;
+				v |= (uint64_t)(b & 0x7F) << shift;
+				if (!(b & 0x80)) return true;
+			}
+			return fail("malformed varint");
+		}
+
+		template <typename T>
+		bool raw(T& v) {
+			if ((size_t)(end - p) < sizeof(T)) return fail("truncated snapshot");
+			memcpy(&v, p, sizeof(T));
+			p += sizeof(T);
+			return true;
+		}
+	};
+
+	static bool push_native(Reader& r, const char* path)
+	{
+		lua_State* L = r.L;
+		lua_pushglobaltable(L);
+		const char* part = path;
+		while (true) {
+			const char* dot = strchr(part, '.');
+			size_t len = dot ? (size_t)(dot - part) : strlen(part);
+			lua_pushlstring(L, part, len);
+			lua_rawget(L, -2);
+			lua_remove(L, -2);
+			if (lua_isnil(L, -1)) {
+				lua_pop(L, 1);
+				r.error = std::string("snapshot refers to missing native value '") + path + "'";
+				return false;
+			}
+			if (!dot) return true;
+			part = dot + 1;
+		}
+	}
+
+	static bool read_value(Reader& r);
+
+	static bool read_function(Reader& r)
+	{
+		lua_State* L = r.L;
+		uint64_t len;
+		if (!r.varint(len)) return false;
+		if ((uint64_t)(r.end - r.p) < len) return r.fail("truncated snapshot");
+
+		if (luaL_loadbufferx(L, (const char*)r.p, (size_t)len, "=snapshot", "b") != LUA_OK) {
+			r.error = lua_tostring(L, -1);
+			lua_pop(L, 1);
+			return false;
+		}
+		r.p += len;
+		int fidx = lua_gettop(L);
+
+		lua_pushvalue(L, fidx);
+		lua_rawseti(L, r.objects, ++r.nobjects);
+
+		uint64_t nups;
+		if (!r.varint(nups)) return false;
+		for (int n = 1; n <= (int)nups; n++) {
+			uint8_t kind;
+			if (!r.byte(kind)) return false;
+			if (kind == U_JOIN) {
+				uint64_t other, other_n;
+				if (!r.varint(other) || !r.varint(other_n)) return false;
+				if (other >= r.nobjects) return r.fail("bad upvalue reference");
+				lua_rawgeti(L, r.objects, (lua_Integer)other + 1);
+				lua_upvaluejoin(L, fidx, n, lua_gettop(L), (int)other_n);
+				lua_pop(L, 1);
+			}
+			else {
+				if (!read_value(r)) return false;
+				if (lua_setupvalue(L, fidx, n) == nullptr) {
+					lua_pop(L, 1);
+					return r.fail("upvalue count mismatch");
+				}
+			}
+		}
+		return true;
+	}
+
+	static bool read_table(Reader& r)
+	{
+		lua_State* L = r.L;
+		uint64_t count;
+		if (!r.varint(count)) return false;
+
+		lua_createtable(L, 0, count < 0x10000 ? (int)count : 0);
+		int tidx = lua_gettop(L);
+		lua_pushvalue(L, tidx);
+		lua_rawseti(L, r.objects, ++r.nobjects);
+
+		for (uint64_t i = 0; i < count; i++) {
+			if (!read_value(r) || !read_value(r)) return false;
+			if (lua_isnil(L, -2)) return r.fail("nil table key");
+			lua_rawset(L, tidx);
+		}
+
+		uint8_t has_meta;
+		if (!r.byte(has_meta)) return false;
+		if (has_meta) {
+			if (!read_value(r)) return false;
+			lua_setmetatable(L, tidx);
+		}
+		return true;
+	}
+
+	static bool read_value(Reader& r)
+	{
+		lua_State* L = r.L;
+		if (!lua_checkstack(L, 8) || ++r.depth > kMaxDepth) {
+			return r.fail("value nested too deeply");
+		}
+
+		uint8_t tag;
+		if (!r.byte(tag)) return false;
+
+		bool ok = true;
+		switch (tag) {
+		case T_NIL:   lua_pushnil(L); break;
+		case T_FALSE: lua_pushboolean(L, 0); break;
+		case T_TRUE:  lua_pushboolean(L, 1); break;
+		case T_INT: {
+			lua_Integer v;
+			if ((ok = r.raw(v))) lua_pushinteger(L, v);
+			break;
+		}
+		case T_FLOAT: {
+			lua_Number v;
+			if ((ok = r.raw(v))) lua_pushnumber(L, v);
+			break;
+		}
+		case T_STRING:
+		case T_NATIVE: {
+			uint64_t n;
+			if (!(ok = r.varint(n))) break;
+			if (lua_rawgeti(L, r.pool, (lua_Integer)n + 1) != LUA_TSTRING) {
+				lua_pop(L, 1);
+				ok = r.fail("bad string index");
+				break;
+			}
+			if (tag == T_NATIVE) {
+				const char* path = lua_tostring(L, -1);
+				ok = push_native(r, path);
+				if (ok) lua_remove(L, -2);
+				else lua_pop(L, 1);
+			}
+			break;
+		}
+		case T_REF: {
+			uint64_t id;
+			if (!(ok = r.varint(id))) break;
+			if (id >= r.nobjects) {
+				ok = r.fail("bad object reference");
+				break;
+			}
+			lua_rawgeti(L, r.objects, (lua_Integer)id + 1);
+			break;
+		}
+		case T_GLOBALS:
+			lua_pushglobaltable(L);
+			break;
+		case T_TABLE:
+			ok = read_table(r);
+			break;
+		case T_FUNCTION:
+			ok = read_function(r);
+			break;
+		default:
+			ok = r.fail("unknown value tag");
+			break;
+		}
+
+		r.depth--;
+		return ok;
+	}
+
+	bool restore(lua_State* L, const std::string& blob, uint64_t source_hash, std::string& error)
+	{
+		Reader r;
+		r.L = L;
+		r.p = (const uint8_t*)blob.data();
+		r.end = r.p + blob.size();
+
+		char magic[sizeof(kMagic)];
+		uint32_t format, nstrings, nobjects;
+		uint16_t version;
+		uint8_t int_size, num_size;
+		uint64_t hash_value, pool_size;
+		if (!r.raw(magic) || memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+			error = "not a LUDA snapshot";
+			return false;
+		}
+		if (!r.raw(format) || !r.raw(version) || !r.raw(int_size) || !r.raw(num_size) ||
+			!r.raw(hash_value) || !r.raw(nstrings) || !r.raw(nobjects) || !r.raw(pool_size)) {
+			error = r.error;
+			return false;
+		}
+		if (format != kFormat || version != LUA_VERSION_NUM ||
+			int_size != sizeof(lua_Integer) || num_size != sizeof(lua_Number)) {
+			error = "snapshot was written by an incompatible build";
+			return false;
+		}
+		if (hash_value != source_hash) {
+			error = "snapshot is stale";
+			return false;
+		}
+
+		int top = lua_gettop(L);
+		bool ok = true;
+
+		lua_createtable(L, nstrings < 0x100000 ? (int)nstrings : 0, 0);
+		r.pool = lua_gettop(L);
+		for (uint32_t i = 0; ok && i < nstrings; i++) {
+			uint64_t len;
+			ok = r.varint(len) && ((uint64_t)(r.end - r.p) >= len || r.fail("truncated snapshot"));
+			if (!ok) break;
+			lua_pushlstring(L, (const char*)r.p, (size_t)len);
+			lua_rawseti(L, r.pool, (lua_Integer)i + 1);
+			r.p += len;
+		}
+
+		lua_createtable(L, nobjects < 0x100000 ? (int)nobjects : 0, 0);
+		r.objects = lua_gettop(L);
+
+		while (ok) {
+			uint8_t op;
+			if (!(ok = r.byte(op)) || op == OP_END) break;
+
+			int mark = lua_gettop(L);
+			if (op == OP_SET_GLOBAL) {
+				lua_pushglobaltable(L);
+				ok = read_value(r) && read_value(r);
+			}
+			else if (op == OP_SET_FIELD) {
+				ok = read_value(r) && (lua_type(L, -1) == LUA_TTABLE || r.fail("field target is not a table"))
+					&& read_value(r) && read_value(r);
+			}
+			else {
+				ok = r.fail("unknown snapshot op");
+			}
+			if (ok && lua_isnil(L, -2)) ok = r.fail("nil key");
+			if (ok) lua_rawset(L, mark + 1);
+			lua_settop(L, mark);
+		}
+
+		lua_settop(L, top);
+		if (!ok) error = r.error;
+		return ok;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+extern "C" {
+#include <Lua/lua.h>
+}
+
+/*
+	Snapshot of a warmed-up global environment.
+
+	After initialize() the executor records a baseline of every global and
+	library table. Anything a prelude adds on top of that (functions, constant
+	tables, strings) can be serialized into one blob and rebuilt in a fresh
+	state with a single pass over memory. Values that belong to the baseline
+	(C functions, library tables) are stored by path, not by value.
+*/
+namespace LUDA::Snapshot
+{
+	// Remember the current globals as the native baseline. Call once the
+	// standard libraries and LUDA bindings are registered.
+	void capture_baseline(lua_State* L);
+
+	// Serialize everything added or changed since capture_baseline().
+	bool save(lua_State* L, uint64_t source_hash, std::string& out, std::string& error);
+
+	// Rebuild a saved environment. The state must have the same baseline and
+	// the blob must have been saved for the same source hash.
+	bool restore(lua_State* L, const std::string& blob, uint64_t source_hash, std::string& error);
+
+	// FNV-1a, used to tie a snapshot to the prelude source it came from
+	uint64_t hash(const std::string& data);
+}
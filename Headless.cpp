@@ -0,0 +1,62 @@
+// Runs scripts against an in-memory database, no IDA needed:
+//   luda_headless <image> <metadata> <script.lua>...
+// The image is mapped at the metadata's base, see Executor/MemoryBackend.h for the
+// metadata formats. Exits non-zero if a file can't be loaded or a script fails.
+#include <cstdio>
+#include <string>
+
+#include <Executor/Executor.h>
+#include <Executor/MemoryBackend.h>
+
+static bool read_script(const char* path, std::string& out)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        out.append(chunk, n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <image> <metadata> <script.lua>...\n", argv[0]);
+        return 2;
+    }
+
+    LUDA::MemoryBackend database;
+    std::string error;
+    if (!database.load(argv[1], argv[2], error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    LUDA::set_backend(&database);
+
+    Executor executor;
+    if (!executor.initialize()) {
+        fprintf(stderr, "failed to create the Lua state\n");
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 3; i < argc; i++) {
+        std::string script;
+        if (!read_script(argv[i], script)) {
+            fprintf(stderr, "can't read %s\n", argv[i]);
+            return 1;
+        }
+        if (!executor.run_script(script)) {
+            status = 1;
+        }
+    }
+
+    LUDA::set_backend(nullptr);
+    return status;
+}
@@ -0,0 +1,231 @@
+#include "deflate.h"
+
+#include <algorithm>
+
+#ifdef LUDA_WITH_DEFLATE
+#include <zlib.h>
+#endif
+
+namespace luda {
+
+    // Every message compressed with a sync flush ends in an empty stored block; it is
+    // dropped on the wire and added back before inflating (RFC 7692 7.2.1)
+    static const uint8_t kSyncTail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+    static std::string_view Trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    // "8".."15" (quotes allowed), 0 for anything else
+    static int ParseWindowBits(std::string_view value) {
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+            value = value.substr(1, value.size() - 2);
+        }
+        if (value.empty() || value.size() > 2) return 0;
+        int bits = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9') return 0;
+            bits = bits * 10 + (c - '0');
+        }
+        return bits >= 8 && bits <= 15 ? bits : 0;
+    }
+
+    // One offer: "permessage-deflate; param[=value]; ..."
+    static bool AcceptOffer(std::string_view offer, DeflateParams& params, std::string& response) {
+        size_t semicolon = offer.find(';');
+        if (Trim(offer.substr(0, semicolon)) != "permessage-deflate") {
+            return false;
+        }
+
+        DeflateParams accepted;
+        bool serverBits = false, clientBits = false;
+        bool serverNoTakeover = false, clientNoTakeover = false;
+        while (semicolon != std::string_view::npos) {
+            offer.remove_prefix(semicolon + 1);
+            semicolon = offer.find(';');
+            std::string_view param = Trim(offer.substr(0, semicolon));
+
+            size_t equals = param.find('=');
+            std::string_view name = Trim(param.substr(0, equals));
+            std::string_view value = equals == std::string_view::npos ? std::string_view() : Trim(param.substr(equals + 1));
+            bool hasValue = equals != std::string_view::npos;
+
+            if (name == "server_no_context_takeover" && !hasValue && !serverNoTakeover) {
+                serverNoTakeover = accepted.serverNoContextTakeover = true;
+            }
+            else if (name == "client_no_context_takeover" && !hasValue && !clientNoTakeover) {
+                clientNoTakeover = accepted.clientNoContextTakeover = true;
+            }
+            else if (name == "server_max_window_bits" && !serverBits) {
+                // zlib can't produce raw deflate with a 256-byte window
+                int bits = ParseWindowBits(value);
+                if (bits < 9) return false;
+                serverBits = true;
+                accepted.serverMaxWindowBits = bits;
+            }
+            else if (name == "client_max_window_bits" && !clientBits) {
+                // Any window the client picks inflates with ours, so it's never answered
+                if (hasValue && ParseWindowBits(value) == 0) return false;
+                clientBits = true;
+            }
+            else {
+                return false; // unknown or repeated parameter: decline this offer
+            }
+        }
+
+        params = accepted;
+        response = "permessage-deflate";
+        if (accepted.serverNoContextTakeover) response += "; server_no_context_takeover";
+        if (accepted.clientNoContextTakeover) response += "; client_no_context_takeover";
+        if (serverBits) response += "; server_max_window_bits=" + std::to_string(accepted.serverMaxWindowBits);
+        return true;
+    }
+
+    bool NegotiateDeflate(std::string_view offers, DeflateParams& params, std::string& response) {
+        if (!DeflateAvailable()) {
+            return false;
+        }
+        while (!offers.empty()) {
+            size_t comma = offers.find(',');
+            if (AcceptOffer(offers.substr(0, comma), params, response)) {
+                return true;
+            }
+            if (comma == std::string_view::npos) break;
+            offers.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+#ifdef LUDA_WITH_DEFLATE
+
+    bool DeflateAvailable() {
+        return true;
+    }
+
+    struct MessageDeflate::Streams {
+        z_stream deflater = {};
+        z_stream inflater = {};
+        bool deflaterReady = false;
+        bool inflaterReady = false;
+
+        ~Streams() {
+            if (deflaterReady) deflateEnd(&deflater);
+            if (inflaterReady) inflateEnd(&inflater);
+        }
+    };
+
+    MessageDeflate::MessageDeflate() : m_streams(std::make_unique<Streams>()) {}
+    MessageDeflate::~MessageDeflate() = default;
+
+    void MessageDeflate::Start(const DeflateParams& params, int level) {
+        m_params = params;
+        m_level = std::clamp(level, 1, 9);
+        m_enabled = true;
+    }
+
+    bool MessageDeflate::Compress(const uint8_t* data, size_t len, std::string& out) {
+        z_stream& z = m_streams->deflater;
+        if (!m_streams->deflaterReady) {
+            // Negative window bits: raw deflate, no zlib header or checksum
+            if (deflateInit2(&z, m_level, Z_DEFLATED, -m_params.serverMaxWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return false;
+            }
+            m_streams->deflaterReady = true;
+        }
+
+        out.resize(deflateBound(&z, static_cast<uLong>(len)) + 16);
+        z.next_in = const_cast<Bytef*>(data);
+        z.avail_in = static_cast<uInt>(len);
+        size_t produced = 0;
+        while (true) {
+            z.next_out = reinterpret_cast<Bytef*>(&out[produced]);
+            z.avail_out = static_cast<uInt>(out.size() - produced);
+            int status = deflate(&z, Z_SYNC_FLUSH);
+            produced = out.size() - z.avail_out;
+            if (status != Z_OK && status != Z_BUF_ERROR) {
+                return false;
+            }
+            if (z.avail_out != 0) break; // flushed completely
+            out.resize(out.size() * 2);
+        }
+
+        if (produced < sizeof(kSyncTail)) {
+            return false;
+        }
+        out.resize(produced - sizeof(kSyncTail));
+
+        if (m_params.serverNoContextTakeover) {
+            deflateReset(&z);
+        }
+        return true;
+    }
+
+    bool MessageDeflate::Decompress(const uint8_t* data, size_t len, size_t maxSize, std::vector<uint8_t>& out) {
+        z_stream& z = m_streams->inflater;
+        if (!m_streams->inflaterReady) {
+            if (inflateInit2(&z, -15) != Z_OK) {
+                return false;
+            }
+            m_streams->inflaterReady = true;
+        }
+
+        out.clear();
+        size_t produced = 0;
+        const uint8_t* inputs[2] = { data, kSyncTail };
+        size_t sizes[2] = { len, sizeof(kSyncTail) };
+        for (int part = 0; part < 2; ++part) {
+            z.next_in = const_cast<Bytef*>(inputs[part]);
+            z.avail_in = static_cast<uInt>(sizes[part]);
+            while (z.avail_in > 0) {
+                if (produced == out.size()) {
+                    if (out.size() >= maxSize) {
+                        return false;
+                    }
+                    out.resize(std::min(maxSize, std::max<size_t>(out.size() * 2, len * 4 + 256)));
+                }
+                z.next_out = out.data() + produced;
+                z.avail_out = static_cast<uInt>(out.size() - produced);
+                int status = inflate(&z, Z_SYNC_FLUSH);
+                produced = out.size() - z.avail_out;
+                if (status == Z_STREAM_END) {
+                    inflateReset(&z); // the client ended its stream with a final block
+                }
+                else if (status != Z_OK && status != Z_BUF_ERROR) {
+                    return false;
+                }
+            }
+        }
+        out.resize(produced);
+
+        if (m_params.clientNoContextTakeover) {
+            inflateReset(&z);
+        }
+        return true;
+    }
+
+#else
+
+    bool DeflateAvailable() {
+        return false;
+    }
+
+    struct MessageDeflate::Streams {};
+
+    MessageDeflate::MessageDeflate() = default;
+    MessageDeflate::~MessageDeflate() = default;
+
+    void MessageDeflate::Start(const DeflateParams&, int) {}
+
+    bool MessageDeflate::Compress(const uint8_t*, size_t, std::string&) {
+        return false;
+    }
+
+    bool MessageDeflate::Decompress(const uint8_t*, size_t, size_t, std::vector<uint8_t>&) {
+        return false;
+    }
+
+#endif
+
+} // namespace luda
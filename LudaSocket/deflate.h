@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace luda {
+
+    // permessage-deflate (RFC 7692) parameters agreed with one client
+    struct DeflateParams {
+        bool serverNoContextTakeover = false;
+        bool clientNoContextTakeover = false;
+        int serverMaxWindowBits = 15;
+    };
+
+    // True if this build can compress (zlib was found, LUDA_WITH_DEFLATE)
+    bool DeflateAvailable();
+
+    // Accept the first permessage-deflate offer in a Sec-WebSocket-Extensions value that we
+    // can honour. Fills `params` and the value to answer with; false to decline them all.
+    bool NegotiateDeflate(std::string_view offers, DeflateParams& params, std::string& response);
+
+    // Compression state of one connection, both directions. The zlib streams are created
+    // on first use, so clients that only exchange small messages don't pay for them.
+    // Compress and Decompress may run on different threads, each one on a single thread at a time.
+    class MessageDeflate {
+    public:
+        MessageDeflate();
+        ~MessageDeflate();
+
+        MessageDeflate(const MessageDeflate&) = delete;
+        MessageDeflate& operator=(const MessageDeflate&) = delete;
+
+        // Enable with the negotiated parameters and a zlib level (1-9)
+        void Start(const DeflateParams& params, int level);
+        bool Enabled() const { return m_enabled; }
+
+        // One message's payload as sent on the wire (sync flush, 00 00 FF FF tail removed)
+        bool Compress(const uint8_t* data, size_t len, std::string& out);
+
+        // Inflate one received message into `out`; false if it is corrupt or inflates past `maxSize`
+        bool Decompress(const uint8_t* data, size_t len, size_t maxSize, std::vector<uint8_t>& out);
+
+    private:
+        struct Streams;
+        std::unique_ptr<Streams> m_streams;
+        DeflateParams m_params;
+        int m_level = 0;
+        bool m_enabled = false;
+    };
+
+} // namespace luda
@@ -0,0 +1,201 @@
+#include "eventloop.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include <algorithm>
+
+namespace luda {
+
+#if defined(__linux__)
+
+    class EventLoop::Backend {
+    public:
+        bool Open() {
+            m_epoll = epoll_create1(EPOLL_CLOEXEC);
+            m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_epoll < 0 || m_wake < 0) {
+                Close();
+                return false;
+            }
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.fd = m_wake;
+            return epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &ev) == 0;
+        }
+
+        void Close() {
+            if (m_wake >= 0) close(m_wake);
+            if (m_epoll >= 0) close(m_epoll);
+            m_wake = m_epoll = -1;
+        }
+
+        bool Control(int op, SOCKET s, uint32_t interest) {
+            epoll_event ev = {};
+            ev.events = EPOLLRDHUP;
+            if (interest & IoReadable) ev.events |= EPOLLIN;
+            if (interest & IoWritable) ev.events |= EPOLLOUT;
+            ev.data.fd = s;
+            return epoll_ctl(m_epoll, op, s, &ev) == 0;
+        }
+
+        bool Add(SOCKET s, uint32_t interest) { return Control(EPOLL_CTL_ADD, s, interest); }
+        bool Modify(SOCKET s, uint32_t interest) { return Control(EPOLL_CTL_MOD, s, interest); }
+        void Remove(SOCKET s) { epoll_ctl(m_epoll, EPOLL_CTL_DEL, s, nullptr); }
+
+        int Wait(std::vector<IoReady>& ready, int timeoutMs) {
+            epoll_event events[64];
+            int n = epoll_wait(m_epoll, events, 64, timeoutMs);
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.fd == m_wake) {
+                    uint64_t drained;
+                    while (read(m_wake, &drained, sizeof(drained)) > 0) {}
+                    continue;
+                }
+                uint32_t flags = 0;
+                if (events[i].events & EPOLLIN) flags |= IoReadable;
+                if (events[i].events & EPOLLOUT) flags |= IoWritable;
+                if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) flags |= IoClosed;
+                ready.push_back({ events[i].data.fd, flags });
+            }
+            return (int)ready.size();
+        }
+
+        void Wakeup() {
+            uint64_t one = 1;
+            (void)!write(m_wake, &one, sizeof(one));
+        }
+
+    private:
+        int m_epoll = -1;
+        int m_wake = -1;
+    };
+
+#else
+
+    // Poll-style backend shared by Windows (WSAPoll) and other POSIX systems
+    class EventLoop::Backend {
+    public:
+        bool Open() {
+#ifdef _WIN32
+            // Winsock has no pipes: a UDP socket connected to itself on loopback
+            m_wakeRead = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            if (m_wakeRead == INVALID_SOCKET) return false;
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int len = sizeof(addr);
+            if (bind(m_wakeRead, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+                getsockname(m_wakeRead, (sockaddr*)&addr, &len) == SOCKET_ERROR ||
+                connect(m_wakeRead, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+                Close();
+                return false;
+            }
+            m_wakeWrite = m_wakeRead;
+#else
+            int fds[2];
+            if (pipe(fds) != 0) return false;
+            m_wakeRead = fds[0];
+            m_wakeWrite = fds[1];
+            net::SetNonBlocking(m_wakeWrite);
+#endif
+            net::SetNonBlocking(m_wakeRead);
+            m_fds.clear();
+            m_fds.push_back(MakeFd(m_wakeRead, IoReadable));
+            return true;
+        }
+
+        void Close() {
+            if (m_wakeRead != INVALID_SOCKET) closesocket(m_wakeRead);
+            if (m_wakeWrite != INVALID_SOCKET && m_wakeWrite != m_wakeRead) closesocket(m_wakeWrite);
+            m_wakeRead = m_wakeWrite = INVALID_SOCKET;
+            m_fds.clear();
+        }
+
+        bool Add(SOCKET s, uint32_t interest) {
+            m_fds.push_back(MakeFd(s, interest));
+            return true;
+        }
+
+        bool Modify(SOCKET s, uint32_t interest) {
+            for (net::PollFd& fd : m_fds) {
+                if (fd.fd == s) {
+                    fd = MakeFd(s, interest);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Remove(SOCKET s) {
+            m_fds.erase(std::remove_if(m_fds.begin() + 1, m_fds.end(),
+                [s](const net::PollFd& fd) { return fd.fd == s; }), m_fds.end());
+        }
+
+        int Wait(std::vector<IoReady>& ready, int timeoutMs) {
+            int n = net::PollSockets(m_fds.data(), m_fds.size(), timeoutMs);
+            if (n <= 0) return 0;
+
+            if (m_fds[0].revents & POLLIN) {
+                char drained[64];
+#ifdef _WIN32
+                while (net::Recv(m_wakeRead, drained, sizeof(drained)) > 0) {}
+#else
+                while (read(m_wakeRead, drained, sizeof(drained)) > 0) {}
+#endif
+            }
+            for (size_t i = 1; i < m_fds.size(); ++i) {
+                short revents = m_fds[i].revents;
+                if (revents == 0) continue;
+                uint32_t flags = 0;
+                if (revents & POLLIN) flags |= IoReadable;
+                if (revents & POLLOUT) flags |= IoWritable;
+                if (revents & (POLLERR | POLLHUP | POLLNVAL)) flags |= IoClosed;
+                ready.push_back({ (SOCKET)m_fds[i].fd, flags });
+            }
+            return (int)ready.size();
+        }
+
+        void Wakeup() {
+            char one = 1;
+#ifdef _WIN32
+            net::Send(m_wakeWrite, &one, 1);
+#else
+            (void)!write(m_wakeWrite, &one, 1);
+#endif
+        }
+
+    private:
+        static net::PollFd MakeFd(SOCKET s, uint32_t interest) {
+            net::PollFd fd = {};
+            fd.fd = s;
+            if (interest & IoReadable) fd.events |= POLLIN;
+            if (interest & IoWritable) fd.events |= POLLOUT;
+            return fd;
+        }
+
+        SOCKET m_wakeRead = INVALID_SOCKET;
+        SOCKET m_wakeWrite = INVALID_SOCKET;
+        std::vector<net::PollFd> m_fds;  // [0] is the wake socket
+    };
+
+#endif
+
+    EventLoop::EventLoop() : m_backend(std::make_unique<Backend>()) {}
+    EventLoop::~EventLoop() { m_backend->Close(); }
+
+    bool EventLoop::Open() { return m_backend->Open(); }
+    void EventLoop::Close() { m_backend->Close(); }
+    bool EventLoop::Add(SOCKET s, uint32_t interest) { return m_backend->Add(s, interest); }
+    bool EventLoop::Modify(SOCKET s, uint32_t interest) { return m_backend->Modify(s, interest); }
+    void EventLoop::Remove(SOCKET s) { m_backend->Remove(s); }
+    void EventLoop::Wakeup() { m_backend->Wakeup(); }
+
+    int EventLoop::Wait(std::vector<IoReady>& ready, int timeoutMs) {
+        ready.clear();
+        return m_backend->Wait(ready, timeoutMs);
+    }
+
+} // namespace luda
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "platform.h"
+
+#include <vector>
+#include <memory>
+
+namespace luda {
+
+    // Readiness flags reported by EventLoop::Wait
+    enum IoEvent : uint32_t {
+        IoReadable = 1 << 0,
+        IoWritable = 1 << 1,
+        IoClosed   = 1 << 2,  // hang-up or error, the socket should be dropped
+    };
+
+    struct IoReady {
+        SOCKET socket;
+        uint32_t events;
+    };
+
+    // Readiness-based event loop over a set of sockets.
+    //   Linux:   epoll, woken through an eventfd
+    //   Windows: WSAPoll, woken through a loopback UDP socket
+    //   other:   poll, woken through a pipe
+    // Add/Modify/Remove/Wait belong to the loop thread; Wakeup may be called from anywhere.
+    class EventLoop {
+    public:
+        EventLoop();
+        ~EventLoop();
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        bool Open();
+        void Close();
+
+        bool Add(SOCKET s, uint32_t interest);
+        bool Modify(SOCKET s, uint32_t interest);
+        void Remove(SOCKET s);
+
+        // Block until a socket is ready, Wakeup() is called or timeoutMs passes (-1 = forever).
+        // Returns the number of entries written to `ready`.
+        int Wait(std::vector<IoReady>& ready, int timeoutMs);
+
+        void Wakeup();
+
+    private:
+        class Backend;
+        std::unique_ptr<Backend> m_backend;
+    };
+
+} // namespace luda
@@ -0,0 +1,276 @@
+#include "http.h"
+
+#include <algorithm>
+
+namespace luda {
+
+    // Past this the receive buffer is released once it empties instead of kept
+    static constexpr size_t kRetainedBufferCapacity = 4 * 1024 * 1024;
+
+    static char ToLower(char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    static bool EqualsNoCase(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+            [](char x, char y) { return ToLower(x) == ToLower(y); });
+    }
+
+    static std::string_view Trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    // Comma-separated header value (Connection, Upgrade) containing `token`
+    static bool HasToken(std::string_view list, std::string_view token) {
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            if (EqualsNoCase(Trim(list.substr(0, comma)), token)) return true;
+            if (comma == std::string_view::npos) break;
+            list.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    // RFC 7230 tchar
+    static bool IsTokenChar(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            (c != 0 && std::string_view("!#$%&'*+-.^_`|~").find(c) != std::string_view::npos);
+    }
+
+    std::string HttpRequest::Header(std::string_view name) const {
+        std::string value;
+        for (const auto& [key, headerValue] : headers) {
+            if (key == name) {
+                if (!value.empty()) value += ", ";
+                value += headerValue;
+            }
+        }
+        return value;
+    }
+
+    std::string_view HttpRequest::Path() const {
+        std::string_view path = target;
+        return path.substr(0, path.find('?'));
+    }
+
+    bool HttpRequest::KeepAlive() const {
+        std::string connection = Header("connection");
+        if (minorVersion == 0) {
+            return HasToken(connection, "keep-alive");
+        }
+        return !HasToken(connection, "close");
+    }
+
+    bool HttpRequest::IsWebSocketUpgrade() const {
+        return method == "GET" && HasToken(Header("upgrade"), "websocket") && !Header("sec-websocket-key").empty();
+    }
+
+    HttpParser::HttpParser(size_t maxHeadSize, size_t maxBodySize)
+        : m_maxHeadSize(maxHeadSize), m_maxBodySize(maxBodySize) {}
+
+    void HttpParser::Reset() {
+        std::string().swap(m_buffer);
+        m_read = 0;
+        m_scanned = 0;
+        m_haveHead = false;
+        m_headSize = 0;
+        m_bodySize = 0;
+        m_continue = false;
+        m_request = HttpRequest();
+        m_status = 0;
+        m_error = nullptr;
+    }
+
+    HttpParser::Result HttpParser::Fail(int status, const char* error) {
+        m_status = status;
+        m_error = error;
+        return Result::Error;
+    }
+
+    std::string HttpParser::TakeBuffered() {
+        std::string rest;
+        rest.swap(m_buffer);
+        m_scanned = 0;
+        return rest;
+    }
+
+    bool HttpParser::TakeContinue() {
+        bool send = m_continue;
+        m_continue = false;
+        return send;
+    }
+
+    bool HttpParser::ParseHead(std::string_view head) {
+        // Request line: METHOD SP target SP HTTP/1.x
+        size_t lineEnd = head.find("\r\n");
+        std::string_view line = head.substr(0, lineEnd);
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+        if (sp2 == std::string_view::npos || sp1 == 0 || sp2 == sp1 + 1) {
+            Fail(400, "malformed request line");
+            return false;
+        }
+        std::string_view method = line.substr(0, sp1);
+        std::string_view version = line.substr(sp2 + 1);
+        if (!std::all_of(method.begin(), method.end(), IsTokenChar)) {
+            Fail(400, "malformed request line");
+            return false;
+        }
+        if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+            Fail(505, "only HTTP/1.0 and HTTP/1.1 are supported");
+            return false;
+        }
+        m_request.method.assign(method);
+        m_request.target.assign(line.substr(sp1 + 1, sp2 - sp1 - 1));
+        m_request.minorVersion = version.back() - '0';
+
+        // Header fields: name ":" OWS value OWS
+        bool haveLength = false;
+        m_bodySize = 0;
+        std::string_view rest = head.substr(lineEnd + 2);
+        while (!rest.empty()) {
+            size_t end = rest.find("\r\n");
+            std::string_view field = rest.substr(0, end);
+            rest.remove_prefix(end + 2);
+
+            size_t colon = field.find(':');
+            std::string_view name = field.substr(0, colon);
+            if (colon == std::string_view::npos || name.empty() ||
+                !std::all_of(name.begin(), name.end(), IsTokenChar)) {
+                Fail(400, "malformed header field"); // also catches obsolete line folding
+                return false;
+            }
+            std::string lowerName(name);
+            std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ToLower);
+            std::string_view value = Trim(field.substr(colon + 1));
+
+            if (lowerName == "content-length") {
+                if (value.empty() || value.size() > 19 || !std::all_of(value.begin(), value.end(),
+                    [](char c) { return c >= '0' && c <= '9'; })) {
+                    Fail(400, "invalid Content-Length");
+                    return false;
+                }
+                size_t length = 0;
+                for (char c : value) length = length * 10 + static_cast<size_t>(c - '0');
+                if (haveLength && length != m_bodySize) {
+                    Fail(400, "conflicting Content-Length");
+                    return false;
+                }
+                haveLength = true;
+                m_bodySize = length;
+            }
+            else if (lowerName == "transfer-encoding") {
+                Fail(411, "chunked bodies are not supported, send Content-Length");
+                return false;
+            }
+            m_request.headers.emplace_back(std::move(lowerName), std::string(value));
+        }
+
+        if (m_bodySize > m_maxBodySize) {
+            Fail(413, "request body too large");
+            return false;
+        }
+        return true;
+    }
+
+    HttpParser::Result HttpParser::Feed(const uint8_t* data, size_t len, const Handler& handler) {
+        if (m_error) {
+            return Result::Error;
+        }
+        m_buffer.append(reinterpret_cast<const char*>(data), len);
+        Result result = Parse(handler);
+
+        // Requests handed over leave the buffer together; erasing each one would move the
+        // rest of a pipelined batch once per request
+        m_buffer.erase(0, m_read);
+        m_read = 0;
+        if (m_buffer.empty() && m_buffer.capacity() > kRetainedBufferCapacity) {
+            std::string().swap(m_buffer);
+        }
+        return result;
+    }
+
+    HttpParser::Result HttpParser::Parse(const Handler& handler) {
+        while (true) {
+            if (!m_haveHead) {
+                std::string_view pending = std::string_view(m_buffer).substr(m_read);
+                // Resume the search a few bytes back, the terminator may straddle two reads
+                size_t end = pending.find("\r\n\r\n", m_scanned >= 3 ? m_scanned - 3 : 0);
+                if (end == std::string_view::npos) {
+                    m_scanned = pending.size();
+                    return pending.size() > m_maxHeadSize ? Fail(431, "request head too large") : Result::Ok;
+                }
+                if (end + 4 > m_maxHeadSize) {
+                    return Fail(431, "request head too large");
+                }
+                if (!ParseHead(pending.substr(0, end + 2))) {
+                    return Result::Error;
+                }
+                m_haveHead = true;
+                m_headSize = end + 4;
+                if (pending.size() < m_headSize + m_bodySize) {
+                    m_continue = m_bodySize > 0 && EqualsNoCase(m_request.Header("expect"), "100-continue");
+                    m_buffer.reserve(m_read + m_headSize + m_bodySize);
+                }
+            }
+
+            if (m_buffer.size() - m_read < m_headSize + m_bodySize) {
+                return Result::Ok;
+            }
+
+            m_request.body.assign(m_buffer, m_read + m_headSize, m_bodySize);
+            m_read += m_headSize + m_bodySize;
+            m_haveHead = false;
+            m_scanned = 0;
+            m_continue = false;
+
+            bool more = handler(m_request);
+            m_request = HttpRequest();
+            if (!more) {
+                return Result::Stopped;
+            }
+            if (m_read == m_buffer.size()) {
+                return Result::Ok;
+            }
+        }
+    }
+
+    static const char* ReasonPhrase(int status) {
+        switch (status) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 411: return "Length Required";
+        case 413: return "Content Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+        default:  return "Unknown";
+        }
+    }
+
+    std::string HttpResponse(int status, std::string_view body, bool keepAlive,
+        std::string_view contentType, std::string_view extraHeaders) {
+        std::string response;
+        response.reserve(160 + extraHeaders.size() + body.size());
+        response += "HTTP/1.1 ";
+        response += std::to_string(status);
+        response += ' ';
+        response += ReasonPhrase(status);
+        response += "\r\nContent-Type: ";
+        response += contentType;
+        response += "\r\nContent-Length: ";
+        response += std::to_string(body.size());
+        response += keepAlive ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n";
+        response += extraHeaders;
+        response += "\r\n";
+        response += body;
+        return response;
+    }
+
+} // namespace luda
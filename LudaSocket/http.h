@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace luda {
+
+    // One parsed HTTP/1.x request
+    struct HttpRequest {
+        std::string method;
+        std::string target;       // as sent, including any query
+        int minorVersion = 1;     // HTTP/1.0 or HTTP/1.1
+        std::vector<std::pair<std::string, std::string>> headers;  // names lower-cased
+        std::string body;
+
+        // Value of a header (lower-case name), repeated ones joined with ", "; empty if absent
+        std::string Header(std::string_view name) const;
+
+        // Target without the query string
+        std::string_view Path() const;
+
+        // HTTP/1.1 unless "Connection: close", HTTP/1.0 only with "Connection: keep-alive"
+        bool KeepAlive() const;
+
+        // GET with "Upgrade: websocket" and a Sec-WebSocket-Key
+        bool IsWebSocketUpgrade() const;
+    };
+
+    // Incremental parser for requests arriving on a connection.
+    // Bytes can be fed in chunks of any size; a request is handed over once its head and
+    // Content-Length body are complete, and pipelined requests behind it are parsed in turn.
+    class HttpParser {
+    public:
+        // Return false to stop parsing (e.g. the connection switched protocols)
+        using Handler = std::function<bool(HttpRequest&)>;
+
+        enum class Result {
+            Ok,         // all input consumed
+            Stopped,    // the handler returned false; TakeBuffered() has the bytes after that request
+            Error,      // malformed or too large, see Status()/Error()
+        };
+
+        explicit HttpParser(size_t maxHeadSize = 16 * 1024, size_t maxBodySize = 64 * 1024 * 1024);
+
+        Result Feed(const uint8_t* data, size_t len, const Handler& handler);
+
+        // Input not parsed yet, handed over when the connection stops speaking HTTP
+        std::string TakeBuffered();
+
+        // True once per request whose head asked for "Expect: 100-continue" while its body is still due
+        bool TakeContinue();
+
+        // Forget everything (new connection)
+        void Reset();
+
+        int Status() const { return m_status; }        // HTTP status to answer an error with
+        const char* Error() const { return m_error; }
+
+    private:
+        bool ParseHead(std::string_view head);
+        Result Parse(const Handler& handler);
+        Result Fail(int status, const char* error);
+
+        size_t m_maxHeadSize;
+        size_t m_maxBodySize;
+
+        std::string m_buffer;         // received; bytes before m_read are handed over already
+        size_t m_read = 0;            // start of the next request, dropped from m_buffer once per Feed
+        size_t m_scanned = 0;         // bytes from m_read already searched for the end of the head
+        bool m_haveHead = false;
+        size_t m_headSize = 0;
+        size_t m_bodySize = 0;
+        bool m_continue = false;
+        HttpRequest m_request;
+
+        int m_status = 0;
+        const char* m_error = nullptr;
+    };
+
+    // Status line, headers and body of a complete response
+    std::string HttpResponse(int status, std::string_view body, bool keepAlive,
+        std::string_view contentType = "application/json", std::string_view extraHeaders = {});
+
+} // namespace luda
@@ -0,0 +1,378 @@
+#include "json.h"
+
+#include <cstring>
+#include <charconv>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUDA_JSON_SSE2 1
+#endif
+
+namespace luda::json {
+
+    static constexpr int kMaxDepth = 128;
+
+    class Parser {
+    public:
+        Parser(std::string_view text, Handler& handler)
+            : m_begin(text.data()), m_p(text.data()), m_end(text.data() + text.size()), m_handler(handler) {}
+
+        bool Run(ParseError* error) {
+            bool ok = ParseValue(0);
+            if (ok) {
+                SkipWhitespace();
+                if (m_p != m_end) {
+                    ok = Fail("unexpected data after the document");
+                }
+            }
+            if (!ok && error) {
+                error->offset = static_cast<size_t>(m_p - m_begin);
+                error->message = m_error ? m_error : "rejected by handler";
+            }
+            return ok;
+        }
+
+    private:
+        bool Fail(const char* message) {
+            if (!m_error) m_error = message;
+            return false;
+        }
+
+        void SkipWhitespace() {
+            while (m_p < m_end && (*m_p == ' ' || *m_p == '\n' || *m_p == '\r' || *m_p == '\t')) {
+                ++m_p;
+            }
+        }
+
+        bool Literal(const char* word, size_t len) {
+            if (static_cast<size_t>(m_end - m_p) < len || memcmp(m_p, word, len) != 0) {
+                return Fail("invalid literal");
+            }
+            m_p += len;
+            return true;
+        }
+
+        bool ParseValue(int depth) {
+            SkipWhitespace();
+            if (m_p == m_end) {
+                return Fail("unexpected end of input");
+            }
+            switch (*m_p) {
+            case '{': return ParseObject(depth);
+            case '[': return ParseArray(depth);
+            case '"': {
+                std::string_view value;
+                return ParseString(value) && m_handler.String(value);
+            }
+            case 't': return Literal("true", 4) && m_handler.Bool(true);
+            case 'f': return Literal("false", 5) && m_handler.Bool(false);
+            case 'n': return Literal("null", 4) && m_handler.Null();
+            default:  return ParseNumber();
+            }
+        }
+
+        bool ParseObject(int depth) {
+            if (depth >= kMaxDepth) return Fail("nesting too deep");
+            ++m_p;
+            if (!m_handler.StartObject()) return false;
+
+            SkipWhitespace();
+            if (m_p < m_end && *m_p == '}') {
+                ++m_p;
+                return m_handler.EndObject();
+            }
+            while (true) {
+                SkipWhitespace();
+                if (m_p == m_end || *m_p != '"') return Fail("expected a key");
+                std::string_view key;
+                if (!ParseString(key) || !m_handler.Key(key)) return false;
+
+                SkipWhitespace();
+                if (m_p == m_end || *m_p != ':') return Fail("expected ':'");
+                ++m_p;
+                if (!ParseValue(depth + 1)) return false;
+
+                SkipWhitespace();
+                if (m_p == m_end) return Fail("unexpected end of input");
+                if (*m_p == ',') { ++m_p; continue; }
+                if (*m_p == '}') { ++m_p; return m_handler.EndObject(); }
+                return Fail("expected ',' or '}'");
+            }
+        }
+
+        bool ParseArray(int depth) {
+            if (depth >= kMaxDepth) return Fail("nesting too deep");
+            ++m_p;
+            if (!m_handler.StartArray()) return false;
+
+            SkipWhitespace();
+            if (m_p < m_end && *m_p == ']') {
+                ++m_p;
+                return m_handler.EndArray();
+            }
+            while (true) {
+                if (!ParseValue(depth + 1)) return false;
+
+                SkipWhitespace();
+                if (m_p == m_end) return Fail("unexpected end of input");
+                if (*m_p == ',') { ++m_p; continue; }
+                if (*m_p == ']') { ++m_p; return m_handler.EndArray(); }
+                return Fail("expected ',' or ']'");
+            }
+        }
+
+        bool ParseNumber() {
+            const char* start = m_p;
+            if (m_p < m_end && *m_p == '-') ++m_p;
+
+            auto digit = [this] { return m_p < m_end && *m_p >= '0' && *m_p <= '9'; };
+            if (!digit()) return Fail("invalid value");
+            if (*m_p == '0') {
+                ++m_p;
+            }
+            else {
+                while (digit()) ++m_p;
+            }
+            if (m_p < m_end && *m_p == '.') {
+                ++m_p;
+                if (!digit()) return Fail("invalid number");
+                while (digit()) ++m_p;
+            }
+            if (m_p < m_end && (*m_p == 'e' || *m_p == 'E')) {
+                ++m_p;
+                if (m_p < m_end && (*m_p == '+' || *m_p == '-')) ++m_p;
+                if (!digit()) return Fail("invalid number");
+                while (digit()) ++m_p;
+            }
+            return m_handler.Number(std::string_view(start, static_cast<size_t>(m_p - start)));
+        }
+
+        // Advance to the first '"', '\\' or control character
+        void ScanPlain() {
+#ifdef LUDA_JSON_SSE2
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control = _mm_set1_epi8(0x1F);
+            while (m_end - m_p >= 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_p));
+                // bytes <= 0x1F: unsigned min with 0x1F leaves them unchanged
+                __m128i special = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+                int mask = _mm_movemask_epi8(special);
+                if (mask != 0) {
+#if defined(_MSC_VER)
+                    unsigned long bit;
+                    _BitScanForward(&bit, static_cast<unsigned long>(mask));
+                    m_p += bit;
+#else
+                    m_p += __builtin_ctz(static_cast<unsigned>(mask));
+#endif
+                    return;
+                }
+                m_p += 16;
+            }
+#endif
+            while (m_p < m_end) {
+                unsigned char c = static_cast<unsigned char>(*m_p);
+                if (c == '"' || c == '\\' || c < 0x20) return;
+                ++m_p;
+            }
+        }
+
+        static int HexValue(char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        bool ReadHex4(uint32_t& value) {
+            if (m_end - m_p < 4) return Fail("truncated \\u escape");
+            value = 0;
+            for (int i = 0; i < 4; ++i) {
+                int digit = HexValue(m_p[i]);
+                if (digit < 0) return Fail("invalid \\u escape");
+                value = (value << 4) | static_cast<uint32_t>(digit);
+            }
+            m_p += 4;
+            return true;
+        }
+
+        static void AppendUtf8(std::string& out, uint32_t cp) {
+            if (cp < 0x80) {
+                out += static_cast<char>(cp);
+            }
+            else if (cp < 0x800) {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000) {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+
+        // m_p is on the opening quote. `value` views the input when there were no
+        // escapes, otherwise the decoded copy in m_scratch.
+        bool ParseString(std::string_view& value) {
+            const char* start = ++m_p;
+            ScanPlain();
+            if (m_p < m_end && *m_p == '"') {
+                value = std::string_view(start, static_cast<size_t>(m_p - start));
+                ++m_p;
+                return true;
+            }
+
+            m_scratch.assign(start, m_p);
+            while (true) {
+                if (m_p == m_end) return Fail("unterminated string");
+                char c = *m_p;
+                if (c == '"') {
+                    ++m_p;
+                    value = m_scratch;
+                    return true;
+                }
+                if (c != '\\') {
+                    return Fail("control character in string");
+                }
+                if (++m_p == m_end) return Fail("unterminated string");
+                char escape = *m_p++;
+                switch (escape) {
+                case '"':  m_scratch += '"';  break;
+                case '\\': m_scratch += '\\'; break;
+                case '/':  m_scratch += '/';  break;
+                case 'b':  m_scratch += '\b'; break;
+                case 'f':  m_scratch += '\f'; break;
+                case 'n':  m_scratch += '\n'; break;
+                case 'r':  m_scratch += '\r'; break;
+                case 't':  m_scratch += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!ReadHex4(cp)) return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        uint32_t low;
+                        if (m_end - m_p < 2 || m_p[0] != '\\' || m_p[1] != 'u') return Fail("unpaired surrogate");
+                        m_p += 2;
+                        if (!ReadHex4(low)) return false;
+                        if (low < 0xDC00 || low > 0xDFFF) return Fail("unpaired surrogate");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        return Fail("unpaired surrogate");
+                    }
+                    AppendUtf8(m_scratch, cp);
+                    break;
+                }
+                default:
+                    --m_p;
+                    return Fail("invalid escape");
+                }
+
+                const char* run = m_p;
+                ScanPlain();
+                m_scratch.append(run, m_p);
+            }
+        }
+
+        const char* m_begin;
+        const char* m_p;
+        const char* m_end;
+        Handler& m_handler;
+        std::string m_scratch;
+        const char* m_error = nullptr;
+    };
+
+    bool Parse(std::string_view text, Handler& handler, ParseError* error) {
+        Parser parser(text, handler);
+        return parser.Run(error);
+    }
+
+    bool ToInteger(std::string_view number, int64_t& value) {
+        auto result = std::from_chars(number.data(), number.data() + number.size(), value);
+        return result.ec == std::errc() && result.ptr == number.data() + number.size();
+    }
+
+    void AppendEscaped(std::string& out, std::string_view str) {
+        static const char hex[] = "0123456789abcdef";
+        size_t plain = 0;
+        for (size_t i = 0; i < str.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(str[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+            out.append(str.data() + plain, i - plain);
+            plain = i + 1;
+            switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b";  break;
+            case '\f': out += "\\f";  break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default: {
+                char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                out.append(u, sizeof(u));
+                break;
+            }
+            }
+        }
+        out.append(str.data() + plain, str.size() - plain);
+    }
+
+    std::string Escape(std::string_view str) {
+        std::string result;
+        result.reserve(str.size() + 16);
+        AppendEscaped(result, str);
+        return result;
+    }
+
+    std::string CreateMessage(std::string_view type, std::string_view data, const Job* job, const RunStats* stats) {
+        std::string message;
+        message.reserve(data.size() + type.size() + 64);
+        message += "{\"type\":\"";
+        AppendEscaped(message, type);
+        message += "\",\"data\":\"";
+        AppendEscaped(message, data);
+        message += '"';
+        if (job != nullptr && job->id != 0) {
+            message += ",\"job\":" + std::to_string(job->id);
+        }
+        if (job != nullptr && !job->request.empty()) {
+            message += ",\"request\":";
+            message += job->request;
+        }
+        if (stats != nullptr) {
+            message += ",\"stats\":{\"peak_bytes\":" + std::to_string(stats->peak_bytes) +
+                ",\"allocations\":" + std::to_string(stats->allocations) +
+                ",\"gc_cycles\":" + std::to_string(stats->gc_cycles) +
+                ",\"heap_limit\":" + std::to_string(stats->heap_limit) + "}";
+        }
+        message += '}';
+        return message;
+    }
+
+    std::string CreateEvent(std::string_view channel, std::string_view data, SessionId session, uint64_t job) {
+        std::string message = "{\"type\":\"event\",\"channel\":\"";
+        AppendEscaped(message, channel);
+        message += "\",\"data\":\"";
+        AppendEscaped(message, data);
+        message += '"';
+        if (session != 0) {
+            message += ",\"session\":" + std::to_string(session);
+        }
+        if (job != 0) {
+            message += ",\"job\":" + std::to_string(job);
+        }
+        message += '}';
+        return message;
+    }
+
+} // namespace luda::json
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ludasocket.h"
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+namespace luda::json {
+
+    // Receives parse events in document order (SAX style).
+    // Views point into the input, or into the parser's scratch buffer for strings that
+    // had escapes, and are only valid during the call. Returning false stops the parse.
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+
+        virtual bool Null() { return true; }
+        virtual bool Bool(bool) { return true; }
+        virtual bool Number(std::string_view) { return true; }  // validated RFC 8259 number text
+        virtual bool String(std::string_view) { return true; }
+        virtual bool Key(std::string_view) { return true; }
+        virtual bool StartObject() { return true; }
+        virtual bool EndObject() { return true; }
+        virtual bool StartArray() { return true; }
+        virtual bool EndArray() { return true; }
+    };
+
+    struct ParseError {
+        size_t offset = 0;
+        const char* message = nullptr;
+    };
+
+    // Single pass over `text`. Strings without escapes are never copied.
+    // Strict RFC 8259 apart from not validating UTF-8 inside strings.
+    bool Parse(std::string_view text, Handler& handler, ParseError* error = nullptr);
+
+    // Number text (as given to Handler::Number) to an integer; false if it has a
+    // fraction/exponent or doesn't fit
+    bool ToInteger(std::string_view number, int64_t& value);
+
+    // Writing
+    void AppendEscaped(std::string& out, std::string_view str);
+    std::string Escape(std::string_view str);
+
+    // {"type":...,"data":...} plus "job"/"request"/"stats" when the message belongs to a job
+    std::string CreateMessage(std::string_view type, std::string_view data, const Job* job = nullptr, const RunStats* stats = nullptr);
+    std::string CreateEvent(std::string_view channel, std::string_view data, SessionId session = 0, uint64_t job = 0);
+
+} // namespace luda::json
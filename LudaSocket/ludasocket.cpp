@@ -1,110 +1,254 @@
 #include "ludasocket.h"
-
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#include <WinSock2.h>
-#include <WS2tcpip.h>
-
-#pragma comment(lib, "ws2_32.lib")
-
+#include "platform.h"
+#include "eventloop.h"
+#include "wsframe.h"
+#include "json.h"
+#include "deflate.h"
+#include "http.h"
+
+#include <cstring>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <sstream>
+#include <algorithm>
+#include <chrono>
 
 namespace luda {
 
-    // Simple JSON helpers
-    namespace json {
-        std::string Escape(const std::string& str) {
-            std::string result;
-            result.reserve(str.size() + 16);
-            for (char c : str) {
-                switch (c) {
-                case '"':  result += "\\\""; break;
-                case '\\': result += "\\\\"; break;
-                case '\b': result += "\\b";  break;
-                case '\f': result += "\\f";  break;
-                case '\n': result += "\\n";  break;
-                case '\r': result += "\\r";  break;
-                case '\t': result += "\\t";  break;
-                default:   result += c;      break;
-                }
+    // A control message from a client:
+    //   {"type":"execute", "id":..., "script":"..." | "scripts":["...", ...], "options":{...}}
+    //   {"type":"subscribe" | "unsubscribe", "channel":"..."}
+    // "data" is accepted in place of "script"/"channel", as older UIs send it.
+    struct Request {
+        std::string type;
+        std::string channel;
+        Job job;
+    };
+
+    // Fills a Request straight from the parse events; unknown fields are skipped
+    class RequestReader : public json::Handler {
+    public:
+        explicit RequestReader(Request& request) : m_request(request) {}
+
+        bool StartObject() override {
+            if (m_depth == 1 && m_field == Field::Options) {
+                m_inOptions = true;
             }
-            return result;
+            return Open();
         }
 
-        std::string CreateMessage(const std::string& type, const std::string& data) {
-            return "{\"type\":\"" + type + "\",\"data\":\"" + Escape(data) + "\"}";
-        }
-
-        bool ParseMessage(const std::string& json, std::string& type, std::string& data) {
-            auto findValue = [&json](const std::string& key) -> std::string {
-                std::string searchKey = "\"" + key + "\":\"";
-                size_t pos = json.find(searchKey);
-                if (pos == std::string::npos) return "";
-
-                pos += searchKey.length();
-                std::string result;
-                bool escaped = false;
-
-                for (size_t i = pos; i < json.length(); ++i) {
-                    char c = json[i];
-                    if (escaped) {
-                        switch (c) {
-                        case 'n': result += '\n'; break;
-                        case 'r': result += '\r'; break;
-                        case 't': result += '\t'; break;
-                        case 'b': result += '\b'; break;
-                        case 'f': result += '\f'; break;
-                        default:  result += c;    break;
-                        }
-                        escaped = false;
-                    }
-                    else if (c == '\\') {
-                        escaped = true;
-                    }
-                    else if (c == '"') {
-                        break;
-                    }
-                    else {
-                        result += c;
-                    }
+        bool EndObject() override {
+            if (m_depth == 2) m_inOptions = false;
+            return Close();
+        }
+
+        bool StartArray() override {
+            if (m_depth == 0) return Reject();
+            return Open();
+        }
+
+        bool EndArray() override {
+            return Close();
+        }
+
+        bool Key(std::string_view key) override {
+            if (m_depth == 1) {
+                m_field = key == "type" ? Field::Type
+                    : key == "id" ? Field::Id
+                    : key == "script" || key == "data" ? Field::Script
+                    : key == "scripts" ? Field::Scripts
+                    : key == "options" ? Field::Options
+                    : key == "channel" ? Field::Channel
+                    : Field::Unknown;
+            }
+            else if (m_depth == 2 && m_inOptions) {
+                m_optionKey.assign(key);
+            }
+            return true;
+        }
+
+        bool String(std::string_view value) override {
+            if (m_depth == 1) {
+                switch (m_field) {
+                case Field::Type:    m_request.type.assign(value); break;
+                case Field::Id:      m_request.job.request = "\"" + json::Escape(value) + "\""; break;
+                case Field::Script:  m_request.job.scripts.emplace_back(value); break;
+                case Field::Channel: m_request.channel.assign(value); break;
+                default: break;
                 }
-                return result;
-                };
+            }
+            else if (m_depth == 2 && m_field == Field::Scripts && !m_inOptions) {
+                m_request.job.scripts.emplace_back(value);
+            }
+            else {
+                Option(value);
+            }
+            return m_depth > 0 || Reject();
+        }
 
-            type = findValue("type");
-            data = findValue("data");
-            if (data.empty()) {
-                data = findValue("script");
+        bool Number(std::string_view text) override {
+            if (m_depth == 1 && m_field == Field::Id) {
+                m_request.job.request.assign(text);
             }
-            return !type.empty();
+            Option(text);
+            return m_depth > 0 || Reject();
+        }
+
+        bool Bool(bool value) override {
+            Option(value ? "true" : "false");
+            return m_depth > 0 || Reject();
+        }
+
+        bool Null() override {
+            return m_depth > 0 || Reject();
+        }
+
+        // Set when the document parsed but isn't a request
+        const char* Error() const { return m_error; }
+
+    private:
+        enum class Field { Unknown, Type, Id, Script, Scripts, Options, Channel };
+
+        bool Reject() {
+            m_error = "request must be a JSON object";
+            return false;
+        }
+
+        bool Open() {
+            ++m_depth;
+            return true;
         }
-    }
 
-    // WebSocket frame opcodes
-    enum class WsOpcode : uint8_t {
-        Continuation = 0x0,
-        Text = 0x1,
-        Binary = 0x2,
-        Close = 0x8,
-        Ping = 0x9,
-        Pong = 0xA
+        bool Close() {
+            --m_depth;
+            return true;
+        }
+
+        void Option(std::string_view value) {
+            if (m_depth == 2 && m_inOptions) {
+                m_request.job.options[m_optionKey].assign(value);
+            }
+        }
+
+        Request& m_request;
+        int m_depth = 0;
+        Field m_field = Field::Unknown;
+        bool m_inOptions = false;
+        std::string m_optionKey;
+        const char* m_error = nullptr;
+    };
+
+    // Limits that keep one misbehaving client from taking the server down
+    static constexpr size_t kMaxSessions = 64;
+    static constexpr size_t kMaxQueuedJobs = 64;       // per session
+
+    // Print output of the running job is batched and sent as one message once it reaches
+    // this size or has waited this long, instead of one frame per line
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t kPrintFlushBytes = 64 * 1024;
+    static constexpr Clock::duration kPrintFlushInterval = std::chrono::milliseconds(16);
+
+    // Output waiting for a slow client: past this, senders other than the loop thread block
+    // until it drains, and give the client up if the socket makes no progress for the timeout
+    static constexpr size_t kMaxOutboxBytes = 4 * 1024 * 1024;
+    static constexpr Clock::duration kSendStallTimeout = std::chrono::seconds(5);
+
+    // Buffers past this are released after use instead of kept for the next message
+    static constexpr size_t kRetainedBufferSize = 4 * 1024 * 1024;
+
+    // Job being run by the calling thread, used to route output to its session
+    static thread_local const Job* t_currentJob = nullptr;
+
+    // Set on the I/O thread, which must never wait for a socket
+    static thread_local bool t_loopThread = false;
+
+    // Frame on its way to the socket: the header inline, the payload either shared with
+    // the message it came from or borrowed from a sender that waits until it is written
+    struct OutFrame {
+        uint8_t head[10 + BinaryHeaderSize];
+        size_t headLen = 0;
+        std::shared_ptr<const std::string> owned;
+        const uint8_t* borrowed = nullptr;
+        size_t payloadLen = 0;
+        size_t written = 0;  // of headLen + payloadLen
+        uint64_t seq = 0;
+
+        const uint8_t* Payload() const {
+            return owned ? reinterpret_cast<const uint8_t*>(owned->data()) : borrowed;
+        }
+        size_t Size() const { return headLen + payloadLen; }
+    };
+
+    // Response to a pipelined HTTP request, sent once it and all before it are ready
+    struct HttpReply {
+        bool ready = false;
+        bool close = false;  // close the connection after this one
+        std::string bytes;
     };
 
+    struct Session {
+        SessionId id = 0;
+        SOCKET socket = INVALID_SOCKET;  // written under sendMutex
+
+        // A plain HTTP client (POST /run, GET /status) rather than a WebSocket UI.
+        // Set before the session is registered, fixed afterwards.
+        bool plainHttp = false;
+
+        // Loop thread only
+        bool handshakeDone = false;
+        HttpParser http;                 // requests until the upgrade, all of them on plain HTTP
+        bool httpClosing = false;        // final reply queued, further requests are ignored
+        FrameDecoder decoder;
+        bool writeArmed = false;         // registered for IoWritable
+        std::vector<uint8_t> inflated;   // last compressed message received, inflated
+
+        // permessage-deflate, set up in the handshake. deflateMutex is held from compressing
+        // a message until it is queued, so messages reach the client in compression order.
+        MessageDeflate deflate;
+        std::mutex deflateMutex;
+
+        // Outgoing data, guarded by sendMutex. Frames are written in order straight from
+        // their buffers; whatever the socket doesn't take at once waits in the outbox.
+        std::mutex sendMutex;
+        std::condition_variable drained; // the outbox made progress or the session closed
+        std::deque<OutFrame> outbox;
+        size_t outboxBytes = 0;
+        uint64_t framesQueued = 0;
+        uint64_t framesSent = 0;
+        uint64_t bytesSent = 0;
+        bool broken = false;             // a write failed or stalled, the stream is unusable
+        bool closeWhenSent = false;      // half-close once the outbox drains
+
+        // Plain HTTP, guarded by sendMutex: replies in request order, and the messages
+        // of the running POST /run collected for its reply
+        std::deque<HttpReply> replies;
+        std::string runMessages;         // JSON objects separated by commas
+        bool runFailed = false;
+
+        // Guarded by Impl::m_sessionsMutex
+        std::unordered_set<std::string> channels;
+
+        // Guarded by Impl::m_jobMutex
+        std::deque<Job> jobs;
+    };
+
+    using SessionPtr = std::shared_ptr<Session>;
+
     class LudaSocket::Impl {
     public:
-        Impl() : m_listenSocket(INVALID_SOCKET), m_clientSocket(INVALID_SOCKET),
-            m_running(false), m_clientConnected(false) {
-            WSADATA wsaData;
-            WSAStartup(MAKEWORD(2, 2), &wsaData);
+        Impl() : m_listenSocket(INVALID_SOCKET), m_running(false) {
+            net::Startup();
         }
 
         ~Impl() {
             Stop();
-            WSACleanup();
+            net::Cleanup();
         }
 
         bool Start(uint16_t port) {
@@ -132,41 +276,49 @@ namespace luda {
                 return false;
             }
 
-            if (listen(m_listenSocket, 1) == SOCKET_ERROR) {
+            if (listen(m_listenSocket, SOMAXCONN) == SOCKET_ERROR || !net::SetNonBlocking(m_listenSocket) ||
+                !m_loop.Open() || !m_loop.Add(m_listenSocket, IoReadable)) {
                 closesocket(m_listenSocket);
                 m_listenSocket = INVALID_SOCKET;
+                m_loop.Close();
                 return false;
             }
 
             m_running = true;
-            m_acceptThread = std::thread(&Impl::AcceptLoop, this);
+            m_loopThread = std::thread(&Impl::RunLoop, this);
+            m_jobThread = std::thread(&Impl::RunJobs, this);
 
             return true;
         }
 
         void Stop() {
             m_running = false;
+            m_loop.Wakeup();
+            {
+                std::lock_guard<std::mutex> lock(m_jobMutex);
+                m_jobCv.notify_all();
+            }
 
-            if (m_clientSocket != INVALID_SOCKET) {
-                shutdown(m_clientSocket, SD_BOTH);
-                closesocket(m_clientSocket);
-                m_clientSocket = INVALID_SOCKET;
+            if (m_loopThread.joinable()) {
+                m_loopThread.join();
             }
 
-            if (m_listenSocket != INVALID_SOCKET) {
-                closesocket(m_listenSocket);
-                m_listenSocket = INVALID_SOCKET;
+            // Nothing drains the outboxes any more; closing releases a job waiting on one
+            while (!m_bySocket.empty()) {
+                CloseSession(m_bySocket.begin()->second, false);
             }
 
-            if (m_acceptThread.joinable()) {
-                m_acceptThread.join();
+            // Waits for the job in progress, queued ones were dropped with their sessions
+            if (m_jobThread.joinable()) {
+                m_jobThread.join();
             }
 
-            if (m_clientThread.joinable()) {
-                m_clientThread.join();
+            if (m_listenSocket != INVALID_SOCKET) {
+                closesocket(m_listenSocket);
+                m_listenSocket = INVALID_SOCKET;
             }
 
-            m_clientConnected = false;
+            m_loop.Close();
         }
 
         bool IsRunning() const {
@@ -174,7 +326,14 @@ namespace luda {
         }
 
         bool IsClientConnected() const {
-            return m_clientConnected;
+            return SessionCount() > 0;
+        }
+
+        // Connected UIs; plain HTTP clients don't count
+        size_t SessionCount() const {
+            std::lock_guard<std::mutex> lock(m_sessionsMutex);
+            return static_cast<size_t>(std::count_if(m_sessions.begin(), m_sessions.end(),
+                [](const auto& entry) { return !entry.second->plainHttp; }));
         }
 
         void SetScriptCallback(ScriptCallback callback) {
@@ -187,86 +346,781 @@ namespace luda {
             m_connectionCallback = callback;
         }
 
-        void SendMessage(const std::string& type, const std::string& data) {
-            if (!m_clientConnected) return;
+        void SetCompression(int level, size_t minSize) {
+            m_compressLevel = std::clamp(level, 0, 9);
+            m_compressMinSize = minSize;
+        }
+
+        const Job* CurrentJob() const {
+            return t_currentJob;
+        }
+
+        void SendMessage(const std::string& type, const std::string& data, const RunStats* stats = nullptr) {
+            const Job* job = t_currentJob;
+            if (job != nullptr) {
+                FlushPrints(); // keep earlier prints ahead of this message
+                if (SessionPtr session = FindSession(job->session)) {
+                    SendJobMessage(session, type, json::CreateMessage(type, data, job, stats));
+                }
+                return;
+            }
+
+            auto message = std::make_shared<const std::string>(json::CreateMessage(type, data, nullptr, stats));
+            for (const SessionPtr& session : ConnectedSessions()) {
+                SendText(session, message);
+            }
+        }
+
+        // Inside a job the line joins the batch, flushed from here when it is full or
+        // overdue (a slow client then holds the script back) or by the loop thread on time
+        void SendPrint(const std::string& message) {
+            if (t_currentJob == nullptr) {
+                SendMessage("print", message);
+                return;
+            }
+
+            bool wake = false;
+            bool flush;
+            {
+                std::lock_guard<std::mutex> lock(m_printMutex);
+                Clock::time_point now = Clock::now();
+                if (m_printText.empty()) {
+                    m_printDeadline = now + kPrintFlushInterval;
+                    wake = true; // the loop thread picks up the new deadline
+                }
+                else {
+                    m_printText += '\n';
+                }
+                m_printText += message;
+                flush = m_printText.size() >= kPrintFlushBytes || now >= m_printDeadline;
+            }
+
+            if (flush) {
+                FlushPrints();
+            }
+            else if (wake) {
+                m_loop.Wakeup();
+            }
+        }
+
+        bool SendBinary(BinaryKind kind, BinaryEncoding encoding, const void* data, size_t size, uint64_t address) {
+            const Job* job = t_currentJob;
+
+            uint8_t header[BinaryHeaderSize] = {};
+            header[0] = BinaryVersion;
+            header[1] = static_cast<uint8_t>(kind);
+            header[2] = static_cast<uint8_t>(encoding);
+            PutLE64(header + 8, job != nullptr ? job->id : 0);
+            PutLE64(header + 16, address);
+
+            std::vector<SessionPtr> targets;
+            if (job != nullptr) {
+                FlushPrints();
+                SessionPtr session = FindSession(job->session);
+                if (session && !session->plainHttp) { // HTTP replies are JSON only
+                    targets.push_back(std::move(session));
+                }
+            }
+            else {
+                targets = ConnectedSessions();
+            }
 
-            std::string message = json::CreateMessage(type, data);
-            std::vector<uint8_t> payload(message.begin(), message.end());
+            bool delivered = false;
+            for (const SessionPtr& session : targets) {
+                OutFrame frame;
+                frame.headLen = FrameHeader(frame.head, WsOpcode::Binary, sizeof(header) + size);
+                memcpy(frame.head + frame.headLen, header, sizeof(header));
+                frame.headLen += sizeof(header);
+                frame.borrowed = static_cast<const uint8_t*>(data);
+                frame.payloadLen = size;
+                delivered |= Enqueue(session, std::move(frame));
+            }
+            return delivered;
+        }
 
-            std::lock_guard<std::mutex> lock(m_sendMutex);
-            SendFrame(WsOpcode::Text, payload.data(), payload.size());
+        void Broadcast(const std::string& channel, const std::string& data, SessionId sessionId = 0, uint64_t jobId = 0) {
+            std::vector<SessionPtr> subscribers;
+            {
+                std::lock_guard<std::mutex> lock(m_sessionsMutex);
+                for (const auto& [id, session] : m_sessions) {
+                    if (session->channels.count(channel)) {
+                        subscribers.push_back(session);
+                    }
+                }
+            }
+            if (subscribers.empty()) return;
+
+            auto message = std::make_shared<const std::string>(json::CreateEvent(channel, data, sessionId, jobId));
+            for (const SessionPtr& session : subscribers) {
+                SendText(session, message);
+            }
         }
 
     private:
-        void AcceptLoop() {
+        SessionPtr FindSession(SessionId id) {
+            std::lock_guard<std::mutex> lock(m_sessionsMutex);
+            auto it = m_sessions.find(id);
+            return it == m_sessions.end() ? nullptr : it->second;
+        }
+
+        std::vector<SessionPtr> ConnectedSessions() {
+            std::lock_guard<std::mutex> lock(m_sessionsMutex);
+            std::vector<SessionPtr> sessions;
+            sessions.reserve(m_sessions.size());
+            for (const auto& [id, session] : m_sessions) {
+                if (!session->plainHttp) {
+                    sessions.push_back(session);
+                }
+            }
+            return sessions;
+        }
+
+        // Output of a job: a frame for WebSocket clients, part of the reply for POST /run
+        void SendJobMessage(const SessionPtr& session, std::string_view type, std::string message) {
+            if (!session->plainHttp) {
+                SendText(session, std::move(message));
+                return;
+            }
+            std::lock_guard<std::mutex> lock(session->sendMutex);
+            if (!session->runMessages.empty()) {
+                session->runMessages += ',';
+            }
+            session->runMessages += message;
+            session->runFailed |= type == "error";
+        }
+
+        bool SendText(const SessionPtr& session, std::string message) {
+            return SendText(session, std::make_shared<const std::string>(std::move(message)));
+        }
+
+        // The message is shared, not copied, when it goes to several sessions
+        bool SendText(const SessionPtr& session, std::shared_ptr<const std::string> message) {
+            return SendFrame(session, WsOpcode::Text, std::move(message));
+        }
+
+        bool SendFrame(const SessionPtr& session, WsOpcode opcode, std::shared_ptr<const std::string> payload) {
+            // Large text is compressed if the client agreed to it. The loop thread only sends
+            // short replies, and must not wait on deflateMutex behind a sender held up by a slow client.
+            if (opcode == WsOpcode::Text && !t_loopThread && session->deflate.Enabled() &&
+                payload->size() >= m_compressMinSize) {
+                std::lock_guard<std::mutex> order(session->deflateMutex);
+                std::string compressed;
+                if (session->deflate.Compress(reinterpret_cast<const uint8_t*>(payload->data()), payload->size(), compressed)) {
+                    OutFrame frame;
+                    frame.headLen = FrameHeader(frame.head, opcode, compressed.size(), true);
+                    frame.payloadLen = compressed.size();
+                    frame.owned = std::make_shared<const std::string>(std::move(compressed));
+                    return Enqueue(session, std::move(frame));
+                }
+            }
+
+            OutFrame frame;
+            frame.headLen = FrameHeader(frame.head, opcode, payload->size());
+            frame.payloadLen = payload->size();
+            frame.owned = std::move(payload);
+            return Enqueue(session, std::move(frame));
+        }
+
+        // Bytes that aren't a WebSocket frame (HTTP responses)
+        static OutFrame RawFrame(std::string data) {
+            OutFrame frame;
+            frame.payloadLen = data.size();
+            frame.owned = std::make_shared<const std::string>(std::move(data));
+            return frame;
+        }
+
+        bool SendRaw(const SessionPtr& session, std::string data) {
+            return Enqueue(session, RawFrame(std::move(data)));
+        }
+
+        // Write what the socket takes now and leave the rest to the loop thread. Returns
+        // once the frame is written if its payload is borrowed, or once the outbox is back
+        // under kMaxOutboxBytes; the loop thread itself never waits.
+        bool Enqueue(const SessionPtr& session, OutFrame&& frame) {
+            std::unique_lock<std::mutex> lock(session->sendMutex);
+            return EnqueueLocked(session, std::move(frame), lock);
+        }
+
+        // Same, with sendMutex already held through `lock`
+        bool EnqueueLocked(const SessionPtr& session, OutFrame&& frame, std::unique_lock<std::mutex>& lock) {
+            if (t_loopThread && frame.borrowed != nullptr) {
+                // Can't wait here for the sender's memory to be written
+                frame.owned = std::make_shared<const std::string>(reinterpret_cast<const char*>(frame.borrowed), frame.payloadLen);
+                frame.borrowed = nullptr;
+            }
+            bool borrowed = frame.borrowed != nullptr && frame.payloadLen > 0;
+
+            if (session->socket == INVALID_SOCKET || session->broken) {
+                return false;
+            }
+
+            uint64_t seq = frame.seq = ++session->framesQueued;
+            session->outboxBytes += frame.Size();
+            session->outbox.push_back(std::move(frame));
+            if (session->outbox.size() == 1) {
+                if (!WriteOutbox(*session)) {
+                    Abandon(*session);
+                    return false;
+                }
+                if (session->outbox.empty()) {
+                    return true;
+                }
+            }
+            if (session->outbox.size() == 1) {
+                RequestWrite(session); // the loop thread takes over from here
+            }
+            if (t_loopThread) {
+                return true;
+            }
+
+            uint64_t progress = session->bytesSent;
+            while (session->socket != INVALID_SOCKET && !session->broken &&
+                (borrowed ? session->framesSent < seq : session->outboxBytes > kMaxOutboxBytes)) {
+                if (session->drained.wait_for(lock, kSendStallTimeout) == std::cv_status::timeout) {
+                    if (session->bytesSent == progress) {
+                        Abandon(*session);
+                        return false;
+                    }
+                    progress = session->bytesSent;
+                }
+            }
+            return !borrowed || session->framesSent >= seq;
+        }
+
+        // Send as much of the outbox as the socket takes, several frames per call.
+        // False if the connection failed. Called with sendMutex held.
+        bool WriteOutbox(Session& session) {
+            while (!session.outbox.empty()) {
+                net::IoSlice slices[net::kMaxSlices];
+                size_t count = 0;
+                size_t total = 0;
+                for (const OutFrame& frame : session.outbox) {
+                    if (count + 2 > net::kMaxSlices) break;
+                    size_t offset = frame.written;
+                    if (offset < frame.headLen) {
+                        slices[count++] = { frame.head + offset, frame.headLen - offset };
+                        total += frame.headLen - offset;
+                        offset = frame.headLen;
+                    }
+                    size_t left = frame.Size() - offset;
+                    if (left > 0) {
+                        size_t len = std::min(left, net::kMaxSliceLen);
+                        slices[count++] = { frame.Payload() + (offset - frame.headLen), len };
+                        total += len;
+                        if (len < left) break;
+                    }
+                }
+
+                int64_t sent = net::SendV(session.socket, slices, count);
+                if (sent < 0) {
+                    return net::WouldBlock();
+                }
+
+                session.bytesSent += static_cast<uint64_t>(sent);
+                session.outboxBytes -= static_cast<size_t>(sent);
+                size_t remaining = static_cast<size_t>(sent);
+                while (remaining > 0) {
+                    OutFrame& frame = session.outbox.front();
+                    size_t take = std::min(remaining, frame.Size() - frame.written);
+                    frame.written += take;
+                    remaining -= take;
+                    if (frame.written == frame.Size()) {
+                        session.outbox.pop_front();
+                        session.framesSent++;
+                    }
+                }
+                session.drained.notify_all();
+
+                if (static_cast<size_t>(sent) < total) {
+                    return true; // socket buffer is full
+                }
+            }
+
+            if (session.closeWhenSent) {
+                // Last HTTP reply is out: the client sees EOF, and its close ends the session
+                shutdown(session.socket, SD_SEND);
+                session.closeWhenSent = false;
+                session.broken = true;
+            }
+            return true;
+        }
+
+        // Give up on a connection whose writes fail or stall: drop the output (it may point
+        // into a sender's memory) and let the loop thread see the hang-up and close it.
+        // Called with sendMutex held.
+        void Abandon(Session& session) {
+            session.broken = true;
+            session.outbox.clear();
+            session.outboxBytes = 0;
+            if (session.socket != INVALID_SOCKET) {
+                shutdown(session.socket, SD_BOTH);
+            }
+            session.drained.notify_all();
+        }
+
+        // Have the loop thread wait for the socket to become writable
+        void RequestWrite(const SessionPtr& session) {
+            if (t_loopThread) {
+                ArmWrite(*session, true);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_writeMutex);
+                m_writeRequests.push_back(session);
+            }
+            m_loop.Wakeup();
+        }
+
+        // Loop thread only
+        void ArmWrite(Session& session, bool armed) {
+            if (session.writeArmed == armed || session.socket == INVALID_SOCKET) return;
+            m_loop.Modify(session.socket, armed ? IoReadable | IoWritable : IoReadable);
+            session.writeArmed = armed;
+        }
+
+        // Send the batched prints as one "print" message, lines separated by '\n'.
+        // Called from the job thread and the loop thread; m_flushMutex keeps batches in order.
+        void FlushPrints() {
+            std::unique_lock<std::mutex> order(m_flushMutex, std::defer_lock);
+            if (!t_loopThread) {
+                order.lock();
+            }
+            else if (!order.try_lock()) {
+                return; // the job thread is flushing, and may be waiting for this thread to drain it
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_printMutex);
+                if (m_printText.empty()) return;
+                m_flushText.clear();
+                m_flushText.swap(m_printText); // both keep their capacity
+            }
+
+            // m_printJob stays valid: RunJobs waits for this flush before the job ends
+            if (SessionPtr session = FindSession(m_printJob->session)) {
+                SendJobMessage(session, "print", json::CreateMessage("print", m_flushText, m_printJob));
+            }
+        }
+
+        // Milliseconds until the pending prints are due, -1 if there are none
+        int PrintTimeout() {
+            std::lock_guard<std::mutex> lock(m_printMutex);
+            if (m_printText.empty()) return -1;
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(m_printDeadline - Clock::now());
+            return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+        }
+
+        // Single I/O thread: wakes on accept, client data and Stop(), never polls
+        void RunLoop() {
+            t_loopThread = true;
+            std::vector<IoReady> ready;
+            std::vector<SessionPtr> writeRequests;
             while (m_running) {
-                // Set socket to non-blocking for accept with timeout
-                fd_set readSet;
-                FD_ZERO(&readSet);
-                FD_SET(m_listenSocket, &readSet);
-
-                timeval timeout = { 0, 100000 }; // 100ms
-                int result = select(0, &readSet, nullptr, nullptr, &timeout);
-
-                if (result > 0 && FD_ISSET(m_listenSocket, &readSet)) {
-                    SOCKET clientSocket = accept(m_listenSocket, nullptr, nullptr);
-                    if (clientSocket != INVALID_SOCKET) {
-                        // Close existing client if any
-                        if (m_clientSocket != INVALID_SOCKET) {
-                            shutdown(m_clientSocket, SD_BOTH);
-                            closesocket(m_clientSocket);
-                            if (m_clientThread.joinable()) {
-                                m_clientThread.join();
-                            }
-                        }
-
-                        m_clientSocket = clientSocket;
-
-                        // Perform WebSocket handshake
-                        if (PerformHandshake()) {
-                            m_clientConnected = true;
-
-                            // Notify callback
-                            ConnectionCallback cb;
-                            {
-                                std::lock_guard<std::mutex> lock(m_callbackMutex);
-                                cb = m_connectionCallback;
-                            }
-                            if (cb) cb(true);
-
-                            // Start client receive thread
-                            m_clientThread = std::thread(&Impl::ClientReceiveLoop, this);
-                        }
-                        else {
-                            closesocket(m_clientSocket);
-                            m_clientSocket = INVALID_SOCKET;
-                        }
+                {
+                    std::lock_guard<std::mutex> lock(m_writeMutex);
+                    writeRequests.swap(m_writeRequests);
+                }
+                for (const SessionPtr& session : writeRequests) {
+                    std::lock_guard<std::mutex> lock(session->sendMutex);
+                    if (!session->outbox.empty()) {
+                        ArmWrite(*session, true);
                     }
                 }
+                writeRequests.clear();
+
+                m_loop.Wait(ready, PrintTimeout());
+                for (const IoReady& io : ready) {
+                    if (io.socket == m_listenSocket) {
+                        OnAccept();
+                        continue;
+                    }
+                    auto it = m_bySocket.find(io.socket);
+                    if (it != m_bySocket.end()) {
+                        OnClientEvent(it->second, io.events);
+                    }
+                }
+                if (PrintTimeout() == 0) {
+                    FlushPrints();
+                }
+            }
+        }
+
+        // Job thread: one job at a time (there is one Lua state), taking turns between
+        // sessions so a batch runner can't starve an interactive console
+        void RunJobs() {
+            while (true) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(m_jobMutex);
+                    m_jobCv.wait(lock, [this] { return !m_running || !m_readySessions.empty(); });
+                    if (!m_running) {
+                        return;
+                    }
+                    SessionPtr session = m_readySessions.front();
+                    m_readySessions.pop_front();
+                    job = std::move(session->jobs.front());
+                    session->jobs.pop_front();
+                    if (!session->jobs.empty()) {
+                        m_readySessions.push_back(session);
+                    }
+                }
+
+                ScriptCallback cb;
+                {
+                    std::lock_guard<std::mutex> lock(m_callbackMutex);
+                    cb = m_scriptCallback;
+                }
+
+                Broadcast("jobs", "started", job.session, job.id);
+                m_runningJob = job.id;
+                {
+                    std::lock_guard<std::mutex> lock(m_flushMutex);
+                    m_printJob = &job;
+                }
+                t_currentJob = &job;
+                if (cb) {
+                    cb(job);
+                }
+                t_currentJob = nullptr;
+                FlushPrints();
+                {
+                    std::lock_guard<std::mutex> lock(m_flushMutex);
+                    m_printJob = nullptr;
+                }
+                SessionPtr session = FindSession(job.session);
+                if (session && session->plainHttp) {
+                    CompleteRun(session, job);
+                }
+                m_runningJob = 0;
+                Broadcast("jobs", "finished", job.session, job.id);
+            }
+        }
+
+        void OnAccept() {
+            while (m_running) {
+                SOCKET clientSocket = accept(m_listenSocket, nullptr, nullptr);
+                if (clientSocket == INVALID_SOCKET) {
+                    return; // backlog drained
+                }
+
+                if (m_bySocket.size() >= kMaxSessions) {
+                    closesocket(clientSocket);
+                    continue;
+                }
+
+                net::SetNonBlocking(clientSocket);
+                net::SetNoDelay(clientSocket);
+                if (!m_loop.Add(clientSocket, IoReadable)) {
+                    closesocket(clientSocket);
+                    continue;
+                }
+
+                auto session = std::make_shared<Session>();
+                session->id = ++m_lastSessionId;
+                session->socket = clientSocket;
+                m_bySocket[clientSocket] = session;
             }
         }
 
-        bool PerformHandshake() {
-            char buffer[4096];
-            int received = recv(m_clientSocket, buffer, sizeof(buffer) - 1, 0);
-            if (received <= 0) return false;
-            buffer[received] = '\0';
+        void OnClientEvent(SessionPtr session, uint32_t events) {
+            if (events & IoWritable) {
+                bool ok;
+                {
+                    std::lock_guard<std::mutex> lock(session->sendMutex);
+                    ok = session->broken || WriteOutbox(*session);
+                    if (!ok) {
+                        Abandon(*session);
+                    }
+                    if (session->outbox.empty()) {
+                        ArmWrite(*session, false);
+                    }
+                }
+                if (!ok) {
+                    CloseSession(session, true);
+                    return;
+                }
+            }
 
-            std::string request(buffer);
+            uint8_t buffer[64 * 1024];
 
-            // Find Sec-WebSocket-Key
-            std::string keyHeader = "Sec-WebSocket-Key: ";
-            size_t keyPos = request.find(keyHeader);
-            if (keyPos == std::string::npos) return false;
+            // Drain everything available; a hang-up shows up as recv() == 0
+            while (true) {
+                int received = net::Recv(session->socket, buffer, sizeof(buffer));
+                if (received > 0) {
+                    if (!OnClientData(session, buffer, static_cast<size_t>(received))) {
+                        return;
+                    }
+                    continue;
+                }
+                if (received == SOCKET_ERROR && net::WouldBlock() && !(events & IoClosed)) {
+                    return;
+                }
+                // Client disconnected
+                CloseSession(session, true);
+                return;
+            }
+        }
 
-            keyPos += keyHeader.length();
-            size_t keyEnd = request.find("\r\n", keyPos);
-            std::string clientKey = request.substr(keyPos, keyEnd - keyPos);
+        // Returns false once the client is gone
+        bool OnClientData(const SessionPtr& session, const uint8_t* data, size_t len) {
+            if (session->handshakeDone) {
+                return DecodeFrames(session, data, len);
+            }
+            if (session->httpClosing) {
+                return true; // waiting for the last reply to go out
+            }
 
-            // Generate accept key (simplified - proper implementation would use SHA1)
-            // For a real implementation, you'd compute: base64(SHA1(clientKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"))
-            // Using a simplified version that works with most clients
+            auto result = session->http.Feed(data, len, [&](HttpRequest& request) {
+                return OnHttpRequest(session, request);
+            });
+            if (session->http.TakeContinue()) {
+                // Only when it can't overtake the reply to an earlier pipelined request
+                std::unique_lock<std::mutex> lock(session->sendMutex);
+                if (session->replies.empty()) {
+                    EnqueueLocked(session, RawFrame("HTTP/1.1 100 Continue\r\n\r\n"), lock);
+                }
+            }
+
+            switch (result) {
+            case HttpParser::Result::Ok:
+                return true;
+            case HttpParser::Result::Error:
+                session->httpClosing = true;
+                QueueReply(session, HttpError(session->http.Status(), session->http.Error(), false), false);
+                return true;
+            case HttpParser::Result::Stopped:
+            default:
+                break;
+            }
+
+            // Upgraded to a WebSocket: anything after the request is frames
+            if (!session->handshakeDone) {
+                return session->httpClosing; // closed unless only stopped after a final request
+            }
+            std::string rest = session->http.TakeBuffered();
+            session->http.Reset();
+            return rest.empty() || DecodeFrames(session, reinterpret_cast<const uint8_t*>(rest.data()), rest.size());
+        }
+
+        // One complete request; false stops parsing (switched to WebSocket, closed, or the
+        // client asked to close after this one)
+        bool OnHttpRequest(const SessionPtr& session, HttpRequest& request) {
+            if (request.IsWebSocketUpgrade() && !session->plainHttp) {
+                if (!PerformHandshake(session, request)) {
+                    CloseSession(session, false);
+                    return false;
+                }
+                session->handshakeDone = true;
+                {
+                    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+                    m_sessions[session->id] = session;
+                }
+
+                // Tell the client who it is, then notify callback
+                SendText(session, json::CreateMessage("session", std::to_string(session->id)));
+
+                ConnectionCallback cb;
+                {
+                    std::lock_guard<std::mutex> lock(m_callbackMutex);
+                    cb = m_connectionCallback;
+                }
+                if (cb) cb(session->id, true);
+                return false;
+            }
+
+            if (!session->plainHttp) {
+                session->plainHttp = true;
+                std::lock_guard<std::mutex> lock(m_sessionsMutex);
+                m_sessions[session->id] = session;
+            }
+
+            bool keepAlive = request.KeepAlive();
+            session->httpClosing = !keepAlive;
+            std::string_view path = request.Path();
+            if (path == "/status") {
+                if (request.method != "GET") {
+                    QueueReply(session, HttpError(405, "use GET", keepAlive, "Allow: GET\r\n"), keepAlive);
+                    return keepAlive;
+                }
+                QueueReply(session, HttpResponse(200, StatusJson(), keepAlive), keepAlive);
+            }
+            else if (path == "/run") {
+                if (request.method != "POST") {
+                    QueueReply(session, HttpError(405, "use POST", keepAlive, "Allow: POST\r\n"), keepAlive);
+                    return keepAlive;
+                }
+                RunRequest(session, request, keepAlive);
+            }
+            else {
+                QueueReply(session, HttpError(404, "not found", keepAlive), keepAlive);
+            }
+            return keepAlive;
+        }
+
+        // POST /run: the body is the script, or an execute request as JSON
+        // ({"script"/"scripts", "options", "id"}) with Content-Type: application/json.
+        // The reply is held back until the job has run.
+        void RunRequest(const SessionPtr& session, HttpRequest& request, bool keepAlive) {
+            Request parsed;
+            std::string contentType = request.Header("content-type");
+            if (contentType.compare(0, 16, "application/json") == 0) {
+                RequestReader reader(parsed);
+                json::ParseError error;
+                if (!json::Parse(request.body, reader, &error)) {
+                    std::string message = reader.Error()
+                        ? std::string("bad request: ") + reader.Error()
+                        : std::string("bad request: ") + error.message + " at offset " + std::to_string(error.offset);
+                    QueueReply(session, HttpError(400, message, keepAlive), keepAlive);
+                    return;
+                }
+            }
+            else {
+                parsed.job.scripts.push_back(std::move(request.body));
+            }
+
+            Job& job = parsed.job;
+            if (job.scripts.empty()) {
+                QueueReply(session, HttpError(400, "execute needs a \"script\" or \"scripts\"", keepAlive), keepAlive);
+                return;
+            }
+
+            // Reserve the reply's place before the job can finish
+            {
+                std::lock_guard<std::mutex> lock(session->sendMutex);
+                session->replies.emplace_back();
+                session->replies.back().close = !keepAlive;
+            }
+            if (QueueJob(session, std::move(job)) == 0) {
+                std::unique_lock<std::mutex> lock(session->sendMutex);
+                if (!session->replies.empty()) {
+                    HttpReply& reply = session->replies.back();
+                    reply.bytes = HttpError(503, "job queue full", keepAlive);
+                    reply.ready = true;
+                }
+                SendReadyReplies(session, lock);
+            }
+        }
+
+        // Fill the oldest pending POST /run reply with the messages the job produced
+        void CompleteRun(const SessionPtr& session, const Job& job) {
+            std::unique_lock<std::mutex> lock(session->sendMutex);
+            auto reply = std::find_if(session->replies.begin(), session->replies.end(),
+                [](const HttpReply& r) { return !r.ready; });
+            if (reply == session->replies.end()) return;
+
+            std::string body = "{\"job\":" + std::to_string(job.id);
+            if (!job.request.empty()) {
+                body += ",\"request\":" + job.request;
+            }
+            body += session->runFailed ? ",\"ok\":false" : ",\"ok\":true";
+            body += ",\"messages\":[" + session->runMessages + "]}";
+            session->runMessages.clear();
+            session->runFailed = false;
+
+            reply->bytes = HttpResponse(200, body, !reply->close);
+            reply->ready = true;
+            SendReadyReplies(session, lock);
+        }
+
+        // Replies for requests that don't wait on a job
+        void QueueReply(const SessionPtr& session, std::string response, bool keepAlive) {
+            std::unique_lock<std::mutex> lock(session->sendMutex);
+            HttpReply& reply = session->replies.emplace_back();
+            reply.bytes = std::move(response);
+            reply.close = !keepAlive;
+            reply.ready = true;
+            SendReadyReplies(session, lock);
+        }
+
+        // Send replies from the front while they are ready, keeping pipelined responses in
+        // request order. After one that closes the connection the rest are dropped.
+        void SendReadyReplies(const SessionPtr& session, std::unique_lock<std::mutex>& lock) {
+            while (!session->replies.empty() && session->replies.front().ready) {
+                HttpReply reply = std::move(session->replies.front());
+                session->replies.pop_front();
+                if (reply.close) {
+                    session->replies.clear();
+                    session->closeWhenSent = true;
+                }
+                if (!EnqueueLocked(session, RawFrame(std::move(reply.bytes)), lock)) {
+                    return;
+                }
+            }
+        }
+
+        static std::string HttpError(int status, std::string_view message, bool keepAlive, std::string_view extraHeaders = {}) {
+            return HttpResponse(status, "{\"error\":\"" + json::Escape(message) + "\"}", keepAlive, "application/json", extraHeaders);
+        }
+
+        std::string StatusJson() {
+            size_t queued = 0;
+            {
+                std::lock_guard<std::mutex> lock(m_jobMutex);
+                for (const SessionPtr& session : m_readySessions) {
+                    queued += session->jobs.size();
+                }
+            }
+            return "{\"sessions\":" + std::to_string(SessionCount()) +
+                ",\"queued\":" + std::to_string(queued) +
+                ",\"running\":" + std::to_string(m_runningJob.load()) + "}";
+        }
+
+        void CloseSession(SessionPtr session, bool notify) {
+            SOCKET clientSocket;
+            {
+                std::lock_guard<std::mutex> lock(session->sendMutex);
+                clientSocket = session->socket;
+                session->socket = INVALID_SOCKET;
+                session->outbox.clear();
+                session->outboxBytes = 0;
+                session->drained.notify_all();
+            }
+            if (clientSocket == INVALID_SOCKET) return;
+
+            m_bySocket.erase(clientSocket);
+            m_loop.Remove(clientSocket);
+            shutdown(clientSocket, SD_BOTH);
+            closesocket(clientSocket);
+
+            bool wasConnected;
+            {
+                std::lock_guard<std::mutex> lock(m_sessionsMutex);
+                wasConnected = m_sessions.erase(session->id) > 0;
+            }
+
+            // Nobody is left to read the output of its queued jobs
+            {
+                std::lock_guard<std::mutex> lock(m_jobMutex);
+                session->jobs.clear();
+                m_readySessions.erase(std::remove(m_readySessions.begin(), m_readySessions.end(), session), m_readySessions.end());
+            }
+
+            if (notify && wasConnected && !session->plainHttp) {
+                ConnectionCallback cb;
+                {
+                    std::lock_guard<std::mutex> lock(m_callbackMutex);
+                    cb = m_connectionCallback;
+                }
+                if (cb) cb(session->id, false);
+            }
+        }
+
+        bool PerformHandshake(const SessionPtr& session, const HttpRequest& request) {
+            std::string clientKey = request.Header("sec-websocket-key");
+
+            // base64(SHA1(clientKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"))
             std::string acceptKey = ComputeAcceptKey(clientKey);
+            session->decoder.RequireMasked(true);
+
+            // Compression offers, possibly spread over several header lines
+            std::string offers = request.Header("sec-websocket-extensions");
+            DeflateParams deflateParams;
+            std::string accepted;
+            int level = m_compressLevel;
+            bool compress = level > 0 && !offers.empty() && NegotiateDeflate(offers, deflateParams, accepted);
+            if (compress) {
+                session->deflate.Start(deflateParams, level);
+                session->decoder.AllowCompressed(true);
+            }
 
             // Send handshake response
             std::ostringstream response;
@@ -274,10 +1128,12 @@ namespace luda {
             response << "Upgrade: websocket\r\n";
             response << "Connection: Upgrade\r\n";
             response << "Sec-WebSocket-Accept: " << acceptKey << "\r\n";
+            if (compress) {
+                response << "Sec-WebSocket-Extensions: " << accepted << "\r\n";
+            }
             response << "\r\n";
 
-            std::string responseStr = response.str();
-            return send(m_clientSocket, responseStr.c_str(), (int)responseStr.length(), 0) != SOCKET_ERROR;
+            return SendRaw(session, response.str());
         }
 
         std::string ComputeAcceptKey(const std::string& clientKey) {
@@ -361,165 +1217,141 @@ namespace luda {
             return Base64Encode(hash, 20);
         }
 
-        void ClientReceiveLoop() {
-            std::vector<uint8_t> buffer(4096);
-            std::vector<uint8_t> messageBuffer;
-
-            while (m_running && m_clientConnected) {
-                fd_set readSet;
-                FD_ZERO(&readSet);
-                FD_SET(m_clientSocket, &readSet);
-
-                timeval timeout = { 0, 100000 }; // 100ms
-                int result = select(0, &readSet, nullptr, nullptr, &timeout);
-
-                if (result <= 0) continue;
-
-                int received = recv(m_clientSocket, (char*)buffer.data(), (int)buffer.size(), 0);
-
-                if (received <= 0) {
-                    // Client disconnected
-                    m_clientConnected = false;
-                    ConnectionCallback cb;
-                    {
-                        std::lock_guard<std::mutex> lock(m_callbackMutex);
-                        cb = m_connectionCallback;
+        bool DecodeFrames(const SessionPtr& session, const uint8_t* data, size_t len) {
+            auto result = session->decoder.Feed(data, len, [&](const WsMessage& message) {
+                switch (message.opcode) {
+                case WsOpcode::Text:
+                case WsOpcode::Binary:
+                    if (message.compressed) {
+                        return HandleCompressed(session, message);
                     }
-                    if (cb) cb(false);
-                    break;
+                    HandleMessage(session, std::string_view(reinterpret_cast<const char*>(message.data), message.size));
+                    return true;
+                case WsOpcode::Ping:
+                    SendFrame(session, WsOpcode::Pong,
+                        std::make_shared<const std::string>(reinterpret_cast<const char*>(message.data), message.size));
+                    return true;
+                case WsOpcode::Close:
+                    SendClose(session, WsCloseNormal);
+                    CloseSession(session, true);
+                    return false;
+                default:
+                    return true;
                 }
+            });
 
-                // Parse WebSocket frames
-                size_t offset = 0;
-                while (offset < static_cast<size_t>(received)) {
-                    if (offset + 2 > static_cast<size_t>(received)) break;
-
-                    uint8_t byte0 = buffer[offset];
-                    uint8_t byte1 = buffer[offset + 1];
-
-                    bool fin = (byte0 & 0x80) != 0;
-                    WsOpcode opcode = static_cast<WsOpcode>(byte0 & 0x0F);
-                    bool masked = (byte1 & 0x80) != 0;
-                    uint64_t payloadLen = byte1 & 0x7F;
+            if (result == FrameDecoder::Result::Error) {
+                SendClose(session, session->decoder.CloseCode());
+                CloseSession(session, true);
+            }
+            return result == FrameDecoder::Result::Ok;
+        }
 
-                    offset += 2;
+        bool HandleCompressed(const SessionPtr& session, const WsMessage& message) {
+            std::vector<uint8_t>& inflated = session->inflated;
+            size_t limit = session->decoder.MaxMessageSize();
+            if (!session->deflate.Decompress(message.data, message.size, limit, inflated)) {
+                SendClose(session, inflated.size() >= limit ? WsCloseTooBig : WsCloseInvalidData);
+                CloseSession(session, true);
+                return false;
+            }
+            HandleMessage(session, std::string_view(reinterpret_cast<const char*>(inflated.data()), inflated.size()));
+            if (inflated.capacity() > kRetainedBufferSize) {
+                std::vector<uint8_t>().swap(inflated);
+            }
+            return true;
+        }
 
-                    if (payloadLen == 126) {
-                        if (offset + 2 > static_cast<size_t>(received)) break;
-                        payloadLen = (buffer[offset] << 8) | buffer[offset + 1];
-                        offset += 2;
-                    }
-                    else if (payloadLen == 127) {
-                        if (offset + 8 > static_cast<size_t>(received)) break;
-                        payloadLen = 0;
-                        for (int i = 0; i < 8; ++i) {
-                            payloadLen = (payloadLen << 8) | buffer[offset + i];
-                        }
-                        offset += 8;
-                    }
+        // Best effort: the session is closed right after, dropping it if it had to wait
+        void SendClose(const SessionPtr& session, uint16_t code) {
+            char payload[2] = { static_cast<char>(code >> 8), static_cast<char>(code & 0xFF) };
+            SendFrame(session, WsOpcode::Close, std::make_shared<const std::string>(payload, sizeof(payload)));
+        }
 
-                    uint8_t mask[4] = { 0 };
-                    if (masked) {
-                        if (offset + 4 > static_cast<size_t>(received)) break;
-                        memcpy(mask, &buffer[offset], 4);
-                        offset += 4;
-                    }
+        void HandleMessage(const SessionPtr& session, std::string_view message) {
+            Request request;
+            RequestReader reader(request);
+            json::ParseError error;
+            if (!json::Parse(message, reader, &error)) {
+                SendText(session, json::CreateMessage("error", reader.Error()
+                    ? std::string("bad request: ") + reader.Error()
+                    : std::string("bad request: ") + error.message + " at offset " + std::to_string(error.offset)));
+                return;
+            }
 
-                    if (offset + payloadLen > static_cast<size_t>(received)) break;
+            if (request.type == "execute") {
+                Job& job = request.job;
+                if (job.scripts.empty()) {
+                    SendText(session, json::CreateMessage("error", "execute needs a \"script\" or \"scripts\"", &job));
+                    return;
+                }
 
-                    // Extract payload
-                    std::vector<uint8_t> payload(payloadLen);
-                    for (uint64_t i = 0; i < payloadLen; ++i) {
-                        payload[i] = buffer[offset + i];
-                        if (masked) {
-                            payload[i] ^= mask[i % 4];
-                        }
-                    }
-                    offset += payloadLen;
-
-                    // Handle frame
-                    switch (opcode) {
-                    case WsOpcode::Text:
-                    case WsOpcode::Binary:
-                        messageBuffer.insert(messageBuffer.end(), payload.begin(), payload.end());
-                        if (fin) {
-                            HandleMessage(std::string(messageBuffer.begin(), messageBuffer.end()));
-                            messageBuffer.clear();
-                        }
-                        break;
-                    case WsOpcode::Continuation:
-                        messageBuffer.insert(messageBuffer.end(), payload.begin(), payload.end());
-                        if (fin) {
-                            HandleMessage(std::string(messageBuffer.begin(), messageBuffer.end()));
-                            messageBuffer.clear();
-                        }
-                        break;
-                    case WsOpcode::Ping:
-                        SendFrame(WsOpcode::Pong, payload.data(), payload.size());
-                        break;
-                    case WsOpcode::Close:
-                        m_clientConnected = false;
-                        {
-                            ConnectionCallback cb;
-                            {
-                                std::lock_guard<std::mutex> lock(m_callbackMutex);
-                                cb = m_connectionCallback;
-                            }
-                            if (cb) cb(false);
-                        }
-                        return;
-                    default:
-                        break;
-                    }
+                // What the acknowledgement reports: the job id this request became
+                Job receipt;
+                receipt.request = job.request;
+                receipt.id = QueueJob(session, std::move(job));
+                SendText(session, receipt.id != 0
+                    ? json::CreateMessage("queued", "", &receipt)
+                    : json::CreateMessage("error", "job queue full", &receipt));
+            }
+            else if (request.type == "subscribe" || request.type == "unsubscribe") {
+                std::string& channel = request.channel.empty() && !request.job.scripts.empty()
+                    ? request.job.scripts.front() // sent as "data"
+                    : request.channel;
+                std::lock_guard<std::mutex> lock(m_sessionsMutex);
+                if (request.type == "subscribe") {
+                    session->channels.insert(channel);
+                }
+                else {
+                    session->channels.erase(channel);
                 }
             }
         }
 
-        void HandleMessage(const std::string& message) {
-            std::string type, data;
-            if (json::ParseMessage(message, type, data)) {
-                if (type == "execute") {
-                    ScriptCallback cb;
-                    {
-                        std::lock_guard<std::mutex> lock(m_callbackMutex);
-                        cb = m_scriptCallback;
-                    }
-                    if (cb) {
-                        cb(data);
-                    }
-                }
+        // Job id, or 0 if the session's queue is full
+        uint64_t QueueJob(const SessionPtr& session, Job&& job) {
+            std::lock_guard<std::mutex> lock(m_jobMutex);
+            if (session->jobs.size() >= kMaxQueuedJobs) {
+                return 0;
             }
+            job.session = session->id;
+            job.id = ++m_lastJobId;
+            if (session->jobs.empty()) {
+                m_readySessions.push_back(session);
+            }
+            session->jobs.push_back(std::move(job));
+            m_jobCv.notify_one();
+            return m_lastJobId;
         }
 
-        bool SendFrame(WsOpcode opcode, const uint8_t* payload, size_t payloadLen) {
-            if (m_clientSocket == INVALID_SOCKET) return false;
+        static void PutLE64(uint8_t* out, uint64_t value) {
+            for (int i = 0; i < 8; ++i) {
+                out[i] = static_cast<uint8_t>(value >> (i * 8));
+            }
+        }
 
-            std::vector<uint8_t> frame;
+        // Frame header for an unmasked (server to client) frame; returns its length, at most 10
+        static size_t FrameHeader(uint8_t* head, WsOpcode opcode, uint64_t payloadLen, bool compressed = false) {
+            size_t headLen = 0;
 
-            // First byte: FIN + opcode
-            frame.push_back(0x80 | static_cast<uint8_t>(opcode));
+            // First byte: FIN + RSV1 for permessage-deflate + opcode
+            head[headLen++] = 0x80 | (compressed ? 0x40 : 0) | static_cast<uint8_t>(opcode);
 
-            // Server doesn't mask frames
             if (payloadLen < 126) {
-                frame.push_back(static_cast<uint8_t>(payloadLen));
+                head[headLen++] = static_cast<uint8_t>(payloadLen);
             }
             else if (payloadLen <= 65535) {
-                frame.push_back(126);
-                frame.push_back(static_cast<uint8_t>((payloadLen >> 8) & 0xFF));
-                frame.push_back(static_cast<uint8_t>(payloadLen & 0xFF));
+                head[headLen++] = 126;
+                head[headLen++] = static_cast<uint8_t>((payloadLen >> 8) & 0xFF);
+                head[headLen++] = static_cast<uint8_t>(payloadLen & 0xFF);
             }
             else {
-                frame.push_back(127);
+                head[headLen++] = 127;
                 for (int i = 7; i >= 0; --i) {
-                    frame.push_back(static_cast<uint8_t>((payloadLen >> (i * 8)) & 0xFF));
+                    head[headLen++] = static_cast<uint8_t>((payloadLen >> (i * 8)) & 0xFF);
                 }
             }
-
-            // Unmasked payload (server to client)
-            frame.insert(frame.end(), payload, payload + payloadLen);
-
-            int sent = send(m_clientSocket, (const char*)frame.data(), (int)frame.size(), 0);
-            return sent != SOCKET_ERROR;
+            return headLen;
         }
 
         std::string Base64Encode(const uint8_t* data, size_t len) {
@@ -541,16 +1373,46 @@ namespace luda {
             return result;
         }
 
+
     private:
         SOCKET m_listenSocket;
-        SOCKET m_clientSocket;
         std::atomic<bool> m_running;
-        std::atomic<bool> m_clientConnected;
 
-        std::thread m_acceptThread;
-        std::thread m_clientThread;
+        // Loop thread only
+        std::unordered_map<SOCKET, SessionPtr> m_bySocket;  // including clients mid-handshake and plain HTTP
+        SessionId m_lastSessionId = 0;
+
+        // Sessions past the handshake
+        mutable std::mutex m_sessionsMutex;
+        std::unordered_map<SessionId, SessionPtr> m_sessions;
+
+        // Sessions with queued jobs, in the order they get their next turn
+        std::mutex m_jobMutex;
+        std::condition_variable m_jobCv;
+        std::deque<SessionPtr> m_readySessions;
+        uint64_t m_lastJobId = 0;
+        std::atomic<uint64_t> m_runningJob{ 0 };
+
+        EventLoop m_loop;
+        std::thread m_loopThread;
+        std::thread m_jobThread;
+
+        // Prints of the running job not sent yet. Lock order: m_flushMutex, then m_printMutex.
+        std::mutex m_printMutex;
+        std::string m_printText;           // lines joined by '\n'
+        Clock::time_point m_printDeadline; // when the oldest line in m_printText is due
+        std::mutex m_flushMutex;
+        std::string m_flushText;           // batch being sent, under m_flushMutex
+        const Job* m_printJob = nullptr;   // under m_flushMutex
+
+        // Sessions whose outbox the loop thread should start draining
+        std::mutex m_writeMutex;
+        std::vector<SessionPtr> m_writeRequests;
+
+        // permessage-deflate level for new sessions (0 = don't offer) and the smallest message compressed
+        std::atomic<int> m_compressLevel{ 1 };
+        std::atomic<size_t> m_compressMinSize{ 1024 };
 
-        std::mutex m_sendMutex;
         std::mutex m_callbackMutex;
 
         ScriptCallback m_scriptCallback;
@@ -577,6 +1439,10 @@ namespace luda {
         return m_impl->IsClientConnected();
     }
 
+    size_t LudaSocket::SessionCount() const {
+        return m_impl->SessionCount();
+    }
+
     void LudaSocket::SetScriptCallback(ScriptCallback callback) {
         m_impl->SetScriptCallback(callback);
     }
@@ -585,6 +1451,10 @@ namespace luda {
         m_impl->SetConnectionCallback(callback);
     }
 
+    void LudaSocket::SetCompression(int level, size_t minSize) {
+        m_impl->SetCompression(level, minSize);
+    }
+
     void LudaSocket::SendOutput(const std::string& message) {
         m_impl->SendMessage("output", message);
     }
@@ -598,7 +1468,27 @@ namespace luda {
     }
 
     void LudaSocket::SendPrint(const std::string& message) {
-        m_impl->SendMessage("print", message);
+        m_impl->SendPrint(message);
+    }
+
+    void LudaSocket::SendError(const std::string& message, const RunStats& stats) {
+        m_impl->SendMessage("error", message, &stats);
+    }
+
+    void LudaSocket::SendSuccess(const std::string& message, const RunStats& stats) {
+        m_impl->SendMessage("success", message, &stats);
+    }
+
+    bool LudaSocket::SendBinary(BinaryKind kind, BinaryEncoding encoding, const void* data, size_t size, uint64_t address) {
+        return m_impl->SendBinary(kind, encoding, data, size, address);
+    }
+
+    const Job* LudaSocket::CurrentJob() const {
+        return m_impl->CurrentJob();
+    }
+
+    void LudaSocket::Broadcast(const std::string& channel, const std::string& data) {
+        m_impl->Broadcast(channel, data);
     }
 
     // Global instance
@@ -630,6 +1520,10 @@ namespace luda {
         return GetInstance().IsClientConnected();
     }
 
+    size_t SessionCount() {
+        return GetInstance().SessionCount();
+    }
+
     void SetScriptCallback(ScriptCallback callback) {
         GetInstance().SetScriptCallback(callback);
     }
@@ -638,6 +1532,10 @@ namespace luda {
         GetInstance().SetConnectionCallback(callback);
     }
 
+    void SetCompression(int level, size_t minSize) {
+        GetInstance().SetCompression(level, minSize);
+    }
+
     void SendOutput(const std::string& message) {
         GetInstance().SendOutput(message);
     }
@@ -654,4 +1552,24 @@ namespace luda {
         GetInstance().SendPrint(message);
     }
 
+    void SendError(const std::string& message, const RunStats& stats) {
+        GetInstance().SendError(message, stats);
+    }
+
+    void SendSuccess(const std::string& message, const RunStats& stats) {
+        GetInstance().SendSuccess(message, stats);
+    }
+
+    bool SendBinary(BinaryKind kind, BinaryEncoding encoding, const void* data, size_t size, uint64_t address) {
+        return GetInstance().SendBinary(kind, encoding, data, size, address);
+    }
+
+    const Job* CurrentJob() {
+        return GetInstance().CurrentJob();
+    }
+
+    void Broadcast(const std::string& channel, const std::string& data) {
+        GetInstance().Broadcast(channel, data);
+    }
+
 } // namespace luda
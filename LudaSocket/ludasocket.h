@@ -1,8 +1,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <map>
 #include <functional>
 #include <memory>
+#include <cstdint>
 
 /*#ifdef LUDASOCKET_EXPORTS
 #define LUDA_API __declspec(dllexport)
@@ -12,11 +15,55 @@
 */
 namespace luda {
 
-    // Callback type for when a script is received for execution
-    using ScriptCallback = std::function<void(const std::string& script)>;
+    // Identifies one connected client, never reused while the server runs
+    using SessionId = uint64_t;
+
+    // Per-job settings from the request's "options" object, values as text
+    using JobOptions = std::map<std::string, std::string, std::less<>>;
+
+    // Scripts submitted by a client in one request. Jobs queue per session and run one at a time.
+    struct Job {
+        SessionId session = 0;
+        uint64_t id = 0;
+        std::string request;               // the request's "id" as a JSON literal, echoed back; empty if none
+        std::vector<std::string> scripts;  // run in order, stopping at the first failure
+        JobOptions options;
+    };
+
+    // Callback type for when a script is received for execution (runs on the job thread)
+    using ScriptCallback = std::function<void(const Job& job)>;
 
     // Callback for connection state changes
-    using ConnectionCallback = std::function<void(bool connected)>;
+    using ConnectionCallback = std::function<void(SessionId session, bool connected)>;
+
+    // Resource usage of a single script run, reported with success/error
+    struct RunStats {
+        uint64_t peak_bytes = 0;   // Lua heap high-water mark during the run
+        uint64_t allocations = 0;  // blocks allocated during the run
+        uint64_t gc_cycles = 0;    // collections finished during the run
+        uint64_t heap_limit = 0;   // cap the run was held to, 0 if none
+    };
+
+    // Binary (opcode 0x2) messages carry bulk results without JSON escaping.
+    // Every one starts with a fixed little-endian header, followed by the raw payload:
+    //   u8 version, u8 kind, u8 encoding, u8 reserved, u32 reserved, u64 job, u64 address
+    constexpr uint8_t BinaryVersion = 1;
+    constexpr size_t BinaryHeaderSize = 24;
+
+    // What the payload is, so the UI knows how to show it
+    enum class BinaryKind : uint8_t {
+        Data = 0,     // opaque, up to the script
+        Memory = 1,   // bytes read from the database, `address` is where they start
+        Text = 2,
+        Records = 3,  // structured rows
+    };
+
+    // How the payload is encoded
+    enum class BinaryEncoding : uint8_t {
+        Raw = 0,
+        Utf8 = 1,
+        MessagePack = 2,
+    };
 
     class LudaSocket {
     public:
@@ -36,8 +83,9 @@ namespace luda {
         // Check if server is running
         bool IsRunning() const;
 
-        // Check if a client (UI) is connected
+        // Check if any client (UI) is connected
         bool IsClientConnected() const;
+        size_t SessionCount() const;
 
         // Set callback for incoming script execution requests
         void SetScriptCallback(ScriptCallback callback);
@@ -45,12 +93,34 @@ namespace luda {
         // Set callback for connection state changes
         void SetConnectionCallback(ConnectionCallback callback);
 
-        // Send responses back to the UI
+        // permessage-deflate for clients that offer it: zlib level 1-9 (0 turns it off) and the
+        // smallest text message worth compressing. Applies to sessions connecting afterwards.
+        // Needs a build with zlib (LUDA_WITH_DEFLATE); defaults to level 1 above 1 KB.
+        void SetCompression(int level, size_t minSize = 1024);
+
+        // Send responses back to the UI. Called from inside a job they go to the session
+        // that submitted it, anywhere else to every connected client.
         void SendOutput(const std::string& message);
         void SendError(const std::string& message);
         void SendSuccess(const std::string& message = "Script executed successfully.");
+        // Prints from inside a job are batched and sent as one message per 64 KB or 16 ms
         void SendPrint(const std::string& message);
 
+        // Same as above, with the run's resource usage attached
+        void SendError(const std::string& message, const RunStats& stats);
+        void SendSuccess(const std::string& message, const RunStats& stats);
+
+        // Binary message, routed like the Send* functions above. The payload is written
+        // to the socket straight from `data`, so this returns once the client has taken it
+        // (a slow client makes the caller wait). False if no client received it.
+        bool SendBinary(BinaryKind kind, BinaryEncoding encoding, const void* data, size_t size, uint64_t address = 0);
+
+        // Job the calling thread is running, nullptr outside of one
+        const Job* CurrentJob() const;
+
+        // Global event, delivered to every session subscribed to `channel`
+        void Broadcast(const std::string& channel, const std::string& data);
+
     private:
         class Impl;
         std::unique_ptr<Impl> m_impl;
@@ -62,11 +132,18 @@ namespace luda {
     void Stop();
     bool IsRunning();
     bool IsClientConnected();
+    size_t SessionCount();
     void SetScriptCallback(ScriptCallback callback);
     void SetConnectionCallback(ConnectionCallback callback);
+    void SetCompression(int level, size_t minSize = 1024);
     void SendOutput(const std::string& message);
     void SendError(const std::string& message);
     void SendSuccess(const std::string& message = "Script executed successfully.");
     void SendPrint(const std::string& message);
+    void SendError(const std::string& message, const RunStats& stats);
+    void SendSuccess(const std::string& message, const RunStats& stats);
+    bool SendBinary(BinaryKind kind, BinaryEncoding encoding, const void* data, size_t size, uint64_t address = 0);
+    const Job* CurrentJob();
+    void Broadcast(const std::string& channel, const std::string& data);
 
 } // namespace luda
@@ -0,0 +1,143 @@
+#pragma once
+
+// Thin portability layer over Winsock and BSD sockets
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+constexpr int SD_BOTH = SHUT_RDWR;
+constexpr int SD_SEND = SHUT_WR;
+
+inline int closesocket(SOCKET s) { return close(s); }
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+namespace luda::net {
+
+#ifdef _WIN32
+    using PollFd = WSAPOLLFD;
+    inline int PollSockets(PollFd* fds, size_t count, int timeoutMs) { return WSAPoll(fds, (ULONG)count, timeoutMs); }
+#else
+    using PollFd = pollfd;
+    inline int PollSockets(PollFd* fds, size_t count, int timeoutMs) { return poll(fds, (nfds_t)count, timeoutMs); }
+#endif
+
+    inline bool Startup() {
+#ifdef _WIN32
+        WSADATA wsaData;
+        return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+        return true;
+#endif
+    }
+
+    inline void Cleanup() {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    inline bool SetNonBlocking(SOCKET s) {
+#ifdef _WIN32
+        u_long mode = 1;
+        return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+        int flags = fcntl(s, F_GETFL, 0);
+        return flags != -1 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+    }
+
+    // Small request/response messages: don't let Nagle hold them back
+    inline void SetNoDelay(SOCKET s) {
+        int opt = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&opt, sizeof(opt));
+    }
+
+    // True if the last socket call failed only because it would have blocked
+    inline bool WouldBlock() {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+    }
+
+    inline int Send(SOCKET s, const void* data, size_t len) {
+#ifdef _WIN32
+        return send(s, (const char*)data, (int)len, 0);
+#elif defined(MSG_NOSIGNAL)
+        return (int)send(s, data, len, MSG_NOSIGNAL);
+#else
+        return (int)send(s, data, len, 0);
+#endif
+    }
+
+    inline int Recv(SOCKET s, void* data, size_t len) {
+#ifdef _WIN32
+        return recv(s, (char*)data, (int)len, 0);
+#else
+        return (int)recv(s, data, len, 0);
+#endif
+    }
+
+    // One piece of a gathered write
+    struct IoSlice {
+        const uint8_t* data;
+        size_t len;
+    };
+
+    constexpr size_t kMaxSlices = 64;            // per SendV call
+    constexpr size_t kMaxSliceLen = 1u << 30;    // WSABUF lengths are 32-bit
+
+    // Gathered write (WSASend/sendmsg) of up to kMaxSlices slices in one call.
+    // Returns the number of bytes the socket took, or SOCKET_ERROR.
+    inline int64_t SendV(SOCKET s, const IoSlice* slices, size_t count) {
+#ifdef _WIN32
+        WSABUF bufs[kMaxSlices];
+        for (size_t i = 0; i < count; ++i) {
+            bufs[i].buf = (CHAR*)slices[i].data;
+            bufs[i].len = (ULONG)slices[i].len;
+        }
+        DWORD sent = 0;
+        if (WSASend(s, bufs, (DWORD)count, &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+            return SOCKET_ERROR;
+        }
+        return (int64_t)sent;
+#else
+        iovec iov[kMaxSlices];
+        for (size_t i = 0; i < count; ++i) {
+            iov[i].iov_base = (void*)slices[i].data;
+            iov[i].iov_len = slices[i].len;
+        }
+        msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+#ifdef MSG_NOSIGNAL
+        return (int64_t)sendmsg(s, &message, MSG_NOSIGNAL);
+#else
+        return (int64_t)sendmsg(s, &message, 0);
+#endif
+#endif
+    }
+
+} // namespace luda::net
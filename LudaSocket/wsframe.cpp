@@ -0,0 +1,222 @@
+#include "wsframe.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUDA_WS_SSE2 1
+#endif
+
+namespace luda {
+
+    // Past this the message buffer is released after delivery instead of kept for reuse
+    static constexpr size_t kRetainedMessageCapacity = 4 * 1024 * 1024;
+
+    static bool IsControl(WsOpcode opcode) {
+        return (static_cast<uint8_t>(opcode) & 0x8) != 0;
+    }
+
+    size_t UnmaskCopy(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t mask[4], size_t phase) {
+        phase &= 3;
+
+        // Mask rotated so byte 0 lines up with `phase`, repeated across a word
+        uint8_t rotated[16];
+        for (size_t i = 0; i < sizeof(rotated); ++i) {
+            rotated[i] = mask[(phase + i) & 3];
+        }
+
+        size_t i = 0;
+#ifdef LUDA_WS_SSE2
+        const __m128i mask128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rotated));
+        for (; i + 16 <= len; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(block, mask128));
+        }
+#endif
+        uint64_t mask64;
+        memcpy(&mask64, rotated, sizeof(mask64));
+        for (; i + 8 <= len; i += 8) {
+            uint64_t word;
+            memcpy(&word, src + i, sizeof(word));
+            word ^= mask64;
+            memcpy(dst + i, &word, sizeof(word));
+        }
+        for (; i < len; ++i) {
+            dst[i] = src[i] ^ rotated[i & 3];
+        }
+
+        return (phase + len) & 3;
+    }
+
+    FrameDecoder::FrameDecoder(size_t maxMessageSize) : m_maxMessageSize(maxMessageSize) {}
+
+    void FrameDecoder::Reset() {
+        m_state = State::Header;
+        m_headerLen = 0;
+        m_remaining = 0;
+        m_inMessage = false;
+        m_allowCompressed = false;
+        m_message.clear();
+        m_control.clear();
+        m_closeCode = 0;
+        m_error = nullptr;
+    }
+
+    FrameDecoder::Result FrameDecoder::Fail(uint16_t code, const char* error) {
+        m_closeCode = code;
+        m_error = error;
+        return Result::Error;
+    }
+
+    // Header bytes needed so far, given what has been read of it
+    static size_t HeaderSize(const uint8_t* header, size_t have) {
+        if (have < 2) return 2;
+        size_t size = 2;
+        uint8_t len7 = header[1] & 0x7F;
+        if (len7 == 126) size += 2;
+        else if (len7 == 127) size += 8;
+        if (header[1] & 0x80) size += 4;
+        return size;
+    }
+
+    void FrameDecoder::ParseHeader() {
+        const uint8_t* h = m_header;
+        m_fin = (h[0] & 0x80) != 0;
+        m_opcode = static_cast<WsOpcode>(h[0] & 0x0F);
+        m_masked = (h[1] & 0x80) != 0;
+
+        size_t offset = 2;
+        uint64_t payloadLen = h[1] & 0x7F;
+        if (payloadLen == 126) {
+            payloadLen = (uint64_t(h[2]) << 8) | h[3];
+            offset += 2;
+        }
+        else if (payloadLen == 127) {
+            payloadLen = 0;
+            for (int i = 0; i < 8; ++i) {
+                payloadLen = (payloadLen << 8) | h[2 + i];
+            }
+            offset += 8;
+        }
+        if (m_masked) {
+            memcpy(m_mask, h + offset, 4);
+        }
+        m_remaining = payloadLen;
+        m_phase = 0;
+    }
+
+    FrameDecoder::Result FrameDecoder::Feed(const uint8_t* data, size_t len, const Handler& handler) {
+        if (m_error) {
+            return Result::Error;
+        }
+
+        while (len > 0 || (m_state == State::Payload && m_remaining == 0)) {
+            if (m_state == State::Header) {
+                // Carry header bytes over chunk boundaries; at most 14 per frame
+                size_t need = HeaderSize(m_header, m_headerLen);
+                while (m_headerLen < need && len > 0) {
+                    m_header[m_headerLen++] = *data++;
+                    --len;
+                    need = HeaderSize(m_header, m_headerLen);
+                }
+                if (m_headerLen < need) {
+                    return Result::Ok;
+                }
+                m_headerLen = 0;
+                ParseHeader();
+                if (m_requireMasked && !m_masked) {
+                    return Fail(WsCloseProtocolError, "unmasked frame from a client");
+                }
+
+                // RSV1 marks a compressed message, on its first frame only; RSV2/RSV3 are never used
+                bool rsv1 = (m_header[0] & 0x40) != 0;
+                bool firstOfMessage = m_opcode == WsOpcode::Text || m_opcode == WsOpcode::Binary;
+                if ((m_header[0] & 0x30) || (rsv1 && !(m_allowCompressed && firstOfMessage))) {
+                    return Fail(WsCloseProtocolError, "reserved bits set without a negotiated extension");
+                }
+
+                if (IsControl(m_opcode)) {
+                    if (m_opcode != WsOpcode::Close && m_opcode != WsOpcode::Ping && m_opcode != WsOpcode::Pong) {
+                        return Fail(WsCloseProtocolError, "unknown opcode");
+                    }
+                    if (!m_fin || m_remaining > 125) {
+                        return Fail(WsCloseProtocolError, "fragmented or oversized control frame");
+                    }
+                    m_control.clear();
+                }
+                else if (m_opcode == WsOpcode::Continuation) {
+                    if (!m_inMessage) {
+                        return Fail(WsCloseProtocolError, "continuation frame without a message");
+                    }
+                }
+                else if (m_opcode == WsOpcode::Text || m_opcode == WsOpcode::Binary) {
+                    if (m_inMessage) {
+                        return Fail(WsCloseProtocolError, "new message before the previous one finished");
+                    }
+                    m_inMessage = true;
+                    m_messageOpcode = m_opcode;
+                    m_messageCompressed = rsv1;
+                    m_message.clear();
+                }
+                else {
+                    return Fail(WsCloseProtocolError, "unknown opcode");
+                }
+
+                if (!IsControl(m_opcode)) {
+                    if (m_remaining > m_maxMessageSize - m_message.size()) {
+                        return Fail(WsCloseTooBig, "message exceeds the size limit");
+                    }
+                    // Declared length is trusted up to the limit; grow geometrically across fragments
+                    size_t needed = m_message.size() + static_cast<size_t>(m_remaining);
+                    if (needed > m_message.capacity()) {
+                        m_message.reserve(std::max(needed, m_message.capacity() * 2));
+                    }
+                }
+                m_state = State::Payload;
+                continue;
+            }
+
+            // Payload: unmask straight into the message (or control) buffer
+            size_t take = static_cast<size_t>(std::min<uint64_t>(m_remaining, len));
+            if (take > 0) {
+                std::vector<uint8_t>& target = IsControl(m_opcode) ? m_control : m_message;
+                size_t at = target.size();
+                target.resize(at + take);
+                if (m_masked) {
+                    m_phase = UnmaskCopy(target.data() + at, data, take, m_mask, m_phase);
+                }
+                else {
+                    memcpy(target.data() + at, data, take);
+                }
+                data += take;
+                len -= take;
+                m_remaining -= take;
+            }
+            if (m_remaining > 0) {
+                return Result::Ok;
+            }
+
+            // Frame complete
+            m_state = State::Header;
+            if (IsControl(m_opcode)) {
+                if (!handler({ m_opcode, m_control.data(), m_control.size(), false })) {
+                    return Result::Stopped;
+                }
+            }
+            else if (m_fin) {
+                m_inMessage = false;
+                bool more = handler({ m_messageOpcode, m_message.data(), m_message.size(), m_messageCompressed });
+                m_message.clear();
+                if (m_message.capacity() > kRetainedMessageCapacity) {
+                    std::vector<uint8_t>().swap(m_message);
+                }
+                if (!more) {
+                    return Result::Stopped;
+                }
+            }
+        }
+        return Result::Ok;
+    }
+
+} // namespace luda
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace luda {
+
+    // WebSocket frame opcodes
+    enum class WsOpcode : uint8_t {
+        Continuation = 0x0,
+        Text = 0x1,
+        Binary = 0x2,
+        Close = 0x8,
+        Ping = 0x9,
+        Pong = 0xA
+    };
+
+    // A complete message (fragments already joined) or a single control frame.
+    // `data` stays valid only for the duration of the handler call.
+    struct WsMessage {
+        WsOpcode opcode;
+        const uint8_t* data;
+        size_t size;
+        bool compressed;  // RSV1 on its first frame: permessage-deflate data, not inflated yet
+    };
+
+    // Close status codes the server sends on a bad stream (RFC 6455 7.4.1)
+    enum WsCloseCode : uint16_t {
+        WsCloseNormal = 1000,
+        WsCloseProtocolError = 1002,
+        WsCloseInvalidData = 1007,
+        WsCloseTooBig = 1009,
+    };
+
+    // XOR `len` bytes of `src` into `dst` with the 4-byte client mask, starting `phase` bytes into it.
+    // Works 16 bytes at a time with SSE2 where available, 8 bytes at a time otherwise.
+    // Returns the phase to continue with.
+    size_t UnmaskCopy(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t mask[4], size_t phase);
+
+    // Incremental decoder for client-to-server frames.
+    // Bytes can be fed in chunks of any size; header fields and payloads that straddle
+    // chunk boundaries are carried over, and payload bytes are unmasked straight into
+    // the message being assembled, so nothing is scanned twice.
+    class FrameDecoder {
+    public:
+        // Return false to stop decoding (e.g. the connection was closed)
+        using Handler = std::function<bool(const WsMessage&)>;
+
+        enum class Result {
+            Ok,         // all input consumed
+            Stopped,    // the handler returned false
+            Error,      // protocol violation, see CloseCode()/Error()
+        };
+
+        explicit FrameDecoder(size_t maxMessageSize = 64 * 1024 * 1024);
+
+        Result Feed(const uint8_t* data, size_t len, const Handler& handler);
+
+        // Forget any partial frame/message (new connection)
+        void Reset();
+
+        // Accept RSV1 on data messages once permessage-deflate has been negotiated
+        void AllowCompressed(bool allow) { m_allowCompressed = allow; }
+
+        // Server side: fail unmasked frames with 1002, clients must mask every frame (RFC 6455 5.1)
+        void RequireMasked(bool require) { m_requireMasked = require; }
+
+        size_t MaxMessageSize() const { return m_maxMessageSize; }
+        uint16_t CloseCode() const { return m_closeCode; }
+        const char* Error() const { return m_error; }
+
+    private:
+        enum class State { Header, Payload };
+
+        void ParseHeader();
+        Result Fail(uint16_t code, const char* error);
+
+        size_t m_maxMessageSize;
+        bool m_allowCompressed = false;
+        bool m_requireMasked = false;
+
+        State m_state = State::Header;
+        uint8_t m_header[14] = {};  // 2 fixed + up to 8 length + 4 mask
+        size_t m_headerLen = 0;
+
+        // Frame being read
+        WsOpcode m_opcode = WsOpcode::Continuation;
+        bool m_fin = false;
+        bool m_masked = false;
+        uint8_t m_mask[4] = {};
+        size_t m_phase = 0;
+        uint64_t m_remaining = 0;
+
+        // Data message being reassembled, and the control frame interleaved with it
+        bool m_inMessage = false;
+        WsOpcode m_messageOpcode = WsOpcode::Text;
+        bool m_messageCompressed = false;
+        std::vector<uint8_t> m_message;
+        std::vector<uint8_t> m_control;
+
+        uint16_t m_closeCode = 0;
+        const char* m_error = nullptr;
+    };
+
+} // namespace luda
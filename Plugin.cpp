@@ -9,32 +9,40 @@
 #include <IdaSDK/idp.hpp>
 #include <IdaSDK/loader.hpp>
 #include <IdaSDK/hexrays.hpp>
+#include <IdaSDK/diskio.hpp>
 
 #include <Executor/Executor.h>
 
-Executor* executor;
+Executor* executor = nullptr;
 bool has_initiated = false;
 plugmod_t* idaapi init() {
     if (!has_initiated)
     {
-        executor = new Executor();
+        // The job thread runs scripts on this state as soon as the server is up, so the
+        // prelude has to be in place before Start
+        if (executor == nullptr) {
+            executor = new Executor();
+            executor->initialize();
+
+            std::string user_dir = get_user_idadir();
+            executor->load_prelude(user_dir + "/luda_prelude.lua", user_dir + "/luda_prelude.snapshot");
+        }
 
-        luda::SetScriptCallback([](const std::string& script) {
-            executor->run_script(script);
+        luda::SetScriptCallback([](const luda::Job& job) {
+            executor->run_job(job);
         });
 
-        luda::SetConnectionCallback([](bool connected) {
+        luda::SetConnectionCallback([](luda::SessionId session, bool connected) {
             if (connected) {
-                msg("[LUDA] UI connected\n");
+                msg("[LUDA] UI connected (session %llu, %zu open)\n", (unsigned long long)session, luda::SessionCount());
             }
             else {
-                msg("[LUDA] UI disconnected!\n");
+                msg("[LUDA] UI disconnected! (session %llu)\n", (unsigned long long)session);
             }
         });
 
         if (luda::Start(8080)) {
             msg("[LUDA] Server started on port 8080\n");
-            executor->initialize();
             has_initiated = true;
         }
         else {
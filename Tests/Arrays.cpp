@@ -0,0 +1,239 @@
+// Typed arrays against plain-table references: sorting (both sort paths, and unsigned
+// order above 2^63), set operations, searchsorted, masks, isin, filter and gather
+#include "Check.h"
+
+#include <Executor/Executor.h>
+
+#include <string>
+
+static Executor& executor() {
+    static Executor* instance = [] {
+        auto* created = new Executor();
+        created->initialize();
+        return created;
+    }();
+    return *instance;
+}
+
+// Helpers every script starts with: a seeded generator, unsigned table sorting, and
+// element-by-element comparison of an array with a table
+static const std::string kHelpers = R"(
+local seed = 12345
+local function rand(n)
+  seed = seed * 6364136223846793005 + 1442695040888963407
+  return (seed >> 33) % n
+end
+local function sorted(t)
+  local copy = table.move(t, 1, #t, 1, {})
+  table.sort(copy, math.ult)
+  return copy
+end
+local function same(a, t)
+  if #a ~= #t then return false end
+  for i = 1, #t do if a[i] ~= t[i] then return false end end
+  return true
+end
+local function unique(t)
+  local out = {}
+  for _, v in ipairs(sorted(t)) do if v ~= out[#out] then out[#out + 1] = v end end
+  return out
+end
+local function raises(pattern, f, ...)
+  local ok, err = pcall(f, ...)
+  return not ok and tostring(err):find(pattern, 1, true) ~= nil
+end
+)";
+
+static bool run(const std::string& script) {
+    return executor().run_script(kHelpers + script);
+}
+
+TEST_CASE(SortBothPaths) {
+    CHECK(run(
+        "for _, n in ipairs({ 0, 1, 100, 255, 256, 5000 }) do\n"
+        "  local t64, t32, t8 = {}, {}, {}\n"
+        "  for i = 1, n do\n"
+        "    t64[i] = (rand(1 << 30) << 34) ~ rand(1 << 30)\n"
+        "    t32[i] = rand(1 << 32)\n"
+        "    t8[i] = rand(256)\n"
+        "  end\n"
+        "  assert(same(luda.u64array(t64):sort(), sorted(t64)), 'u64 ' .. n)\n"
+        "  assert(same(luda.u32array(t32):sort(), sorted(t32)), 'u32 ' .. n)\n"
+        "  assert(same(luda.u8array(t8):sort(), sorted(t8)), 'u8 ' .. n)\n"
+        "end"));
+}
+
+// u64 elements read as negative integers past 2^63 but sort after every smaller one
+TEST_CASE(SortIsUnsigned) {
+    CHECK(run(
+        "local t = { -1, 0, math.mininteger, 5, math.maxinteger, -2, 0x8000000000000001 }\n"
+        "local expected = { 0, 5, math.maxinteger, math.mininteger, 0x8000000000000001, -2, -1 }\n"
+        "assert(same(luda.u64array(t):sort(), expected))\n"
+        "local big = {}\n"
+        "for i = 1, 1000 do big[i] = rand(4) == 0 and -rand(1 << 40) or rand(1 << 40) end\n"
+        "local a = luda.u64array(big):sort()\n"
+        "assert(same(a, sorted(big)))\n"
+        "for i = 2, #a do assert(not math.ult(a[i], a[i - 1])) end"));
+}
+
+TEST_CASE(UniqueAgainstReference) {
+    CHECK(run(
+        "for _, n in ipairs({ 0, 1, 50, 3000 }) do\n"
+        "  local t = {}\n"
+        "  for i = 1, n do t[i] = rand(n // 3 + 1) * 8 - (rand(8) == 0 and 1 << 63 or 0) end\n"
+        "  local a = luda.u64array(t)\n"
+        "  assert(a:unique() == a)\n"
+        "  assert(same(a, unique(t)))\n"
+        "end"));
+}
+
+TEST_CASE(SetOperationsAgainstReference) {
+    CHECK(run(
+        "for round = 1, 20 do\n"
+        "  local ta, tb = {}, {}\n"
+        "  for i = 1, rand(400) do ta[i] = rand(600) end\n"
+        "  for i = 1, rand(400) do tb[i] = rand(600) end\n"
+        "  local ua, ub = unique(ta), unique(tb)\n"
+        "  local ina, inb = {}, {}\n"
+        "  for _, v in ipairs(ua) do ina[v] = true end\n"
+        "  for _, v in ipairs(ub) do inb[v] = true end\n"
+        "  local both, only = {}, {}\n"
+        "  for _, v in ipairs(ua) do\n"
+        "    if inb[v] then both[#both + 1] = v else only[#only + 1] = v end\n"
+        "  end\n"
+        "  local either = unique(table.move(ub, 1, #ub, #ua + 1, table.move(ua, 1, #ua, 1, {})))\n"
+        "  for _, make in ipairs({ luda.u64array, luda.u32array }) do\n"
+        "    local a, b = make(ta):unique(), make(tb):unique()\n"
+        "    assert(same(a:union(b), either))\n"
+        "    assert(same(a:intersect(b), both))\n"
+        "    assert(same(a:difference(b), only))\n"
+        "  end\n"
+        "end\n"
+        "local a, b = luda.u64array({ 3, 1 }), luda.u64array({ 1, 2 })\n"
+        "assert(raises('array is not sorted', a.union, a, b))\n"
+        "assert(raises('array is not sorted', b.intersect, b, a))\n"
+        "assert(raises('u64 array expected, got u32 array', b.union, b, luda.u32array({ 1 })))"));
+}
+
+TEST_CASE(SearchSortedSides) {
+    CHECK(run(
+        "local a = luda.u8array({ 10, 20, 20, 30 })\n"
+        "assert(a:searchsorted(20) == 2 and a:searchsorted(20, 'left') == 2)\n"
+        "assert(a:searchsorted(20, 'right') == 4)\n"
+        "assert(a:searchsorted(5) == 1 and a:searchsorted(5, 'right') == 1)\n"
+        "assert(a:searchsorted(30, 'right') == 5 and a:searchsorted(35) == 5)\n"
+        "assert(a:searchsorted(300) == 5 and a:searchsorted(-1) == 5)\n"
+        "local at = a:searchsorted(luda.u64array({ 0, 10, 25, 1000 }), 'right')\n"
+        "assert(tostring(at):find('u64array') and same(at, { 1, 2, 4, 5 }))\n"
+        "local big = luda.u64array({ 1, math.maxinteger, -1 })\n"
+        "assert(big:searchsorted(math.mininteger) == 3 and big:searchsorted(-1, 'right') == 4)\n"
+        "assert(raises('invalid option', a.searchsorted, a, 1, 'middle'))"));
+}
+
+// Every op on every element type, thresholds on and past the edges of the type
+TEST_CASE(MaskOpsAgainstReference) {
+    CHECK(run(
+        "local compare = {\n"
+        "  ['=='] = function(v, x) return v == x end,\n"
+        "  ['~='] = function(v, x) return v ~= x end,\n"
+        "  ['<'] = function(v, x) return math.ult(v, x) end,\n"
+        "  ['<='] = function(v, x) return v == x or math.ult(v, x) end,\n"
+        "  ['>'] = function(v, x) return math.ult(x, v) end,\n"
+        "  ['>='] = function(v, x) return v == x or math.ult(x, v) end,\n"
+        "}\n"
+        "local kinds = {\n"
+        "  { luda.u8array, { 0, 1, 127, 128, 254, 255 } },\n"
+        "  { luda.u32array, { 0, 1, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFE, 0xFFFFFFFF } },\n"
+        "  { luda.u64array, { 0, 1, math.maxinteger, math.mininteger, -2, -1 } },\n"
+        "}\n"
+        "for _, kind in ipairs(kinds) do\n"
+        "  local make, values = kind[1], kind[2]\n"
+        "  local a = make(values)\n"
+        "  local thresholds = { 0, 1, 2, 200, 256, 0x100000000, math.mininteger, -1 }\n"
+        "  table.move(values, 1, #values, #thresholds + 1, thresholds)\n"
+        "  for _, x in ipairs(thresholds) do\n"
+        "    for op, f in pairs(compare) do\n"
+        "      local m = a:mask(op, x)\n"
+        "      assert(tostring(m):find('u8array') and #m == #a)\n"
+        "      for i = 1, #a do\n"
+        "        assert(m[i] == (f(a[i], x) and 1 or 0), op .. ' ' .. x .. ' at ' .. i)\n"
+        "      end\n"
+        "    end\n"
+        "    for _, y in ipairs(thresholds) do\n"
+        "      local m = a:mask('in', x, y)\n"
+        "      for i = 1, #a do\n"
+        "        local inside = not math.ult(a[i], x) and math.ult(a[i], y)\n"
+        "        assert(m[i] == (inside and 1 or 0), 'in ' .. x .. ', ' .. y .. ' at ' .. i)\n"
+        "      end\n"
+        "    end\n"
+        "  end\n"
+        "end\n"
+        "local a = luda.u8array({ 1 })\n"
+        "assert(raises('invalid option', a.mask, a, '=', 1))\n"
+        "assert(raises('number expected', a.mask, a, 'in', 1))"));
+}
+
+// A range whose end is past the element type's maximum must not wrap onto small values
+TEST_CASE(MaskRangeEndingPastTheType) {
+    CHECK(run(
+        "assert(same(luda.u8array({ 10, 150, 220, 250 }):mask('in', 200, 300), { 0, 0, 1, 1 }))\n"
+        "assert(same(luda.u8array({ 0, 100, 255 }):mask('in', 1, 256), { 0, 1, 1 }))\n"
+        "assert(same(luda.u8array({ 0, 100, 255 }):mask('in', 1, 255), { 0, 1, 0 }))\n"
+        "assert(same(luda.u32array({ 5, 0xFFFFFF00, 0xFFFFFFFF, 0x100 }):mask('in', 0xFFFFFF00, 0x100000100), { 0, 1, 1, 0 }))\n"
+        "assert(same(luda.u64array({ 5, -256, -1 }):mask('in', -256, -1), { 0, 1, 0 }))"));
+}
+
+TEST_CASE(IsInSortedAndUnsorted) {
+    CHECK(run(
+        "for round = 1, 20 do\n"
+        "  local tv, ts = {}, {}\n"
+        "  for i = 1, rand(300) do tv[i] = rand(500) - (rand(5) == 0 and 1 << 63 or 0) end\n"
+        "  for i = 1, rand(300) do ts[i] = rand(500) - (rand(5) == 0 and 1 << 63 or 0) end\n"
+        "  local member = {}\n"
+        "  for _, v in ipairs(ts) do member[v] = true end\n"
+        "  local set = luda.u64array(ts):unique()\n"
+        "  local expected = {}\n"
+        "  for i, v in ipairs(tv) do expected[i] = member[v] and 1 or 0 end\n"
+        "  assert(same(luda.u64array(tv):isin(set), expected))\n"
+        "  local ordered = sorted(tv)\n"
+        "  for i, v in ipairs(ordered) do expected[i] = member[v] and 1 or 0 end\n"
+        "  assert(same(luda.u64array(ordered):isin(set), expected))\n"
+        "end\n"
+        "local a = luda.u32array({ 1, 2 })\n"
+        "assert(raises('array is not sorted', a.isin, a, luda.u32array({ 2, 1 })))"));
+}
+
+TEST_CASE(FilterAndGather) {
+    CHECK(run(
+        "local a = luda.u64array({ 10, 20, 30, 40 })\n"
+        "assert(same(a:filter(luda.u8array({ 1, 0, 0, 1 })), { 10, 40 }))\n"
+        "assert(same(a:filter(luda.u64array({ 0, 7, 0, 0 })), { 20 }))\n"
+        "assert(#a:filter(luda.u8array(4)) == 0)\n"
+        "assert(raises('mask length differs', a.filter, a, luda.u8array({ 1, 1, 1 })))\n"
+        "assert(raises('mask length differs', a.filter, a, luda.u8array(5)))\n"
+        "assert(same(a:gather(luda.u32array({ 4, 1, 1, 3 })), { 40, 10, 10, 30 }))\n"
+        "assert(raises('bad position #2 (0 out of range 1..4)', a.gather, a, luda.u32array({ 1, 0 })))\n"
+        "assert(raises('bad position #1 (5 out of range 1..4)', a.gather, a, luda.u32array({ 5 })))\n"
+        "assert(raises('out of range', a.gather, a, luda.u64array({ -1 })))"));
+}
+
+// A write clears the sorted flag; the set operations then check the order again
+TEST_CASE(WritesClearSorted) {
+    CHECK(run(
+        "local a = luda.u64array({ 5, 1, 3 }):sort()\n"
+        "local b = luda.u64array({ 1, 3, 9 })\n"
+        "assert(same(a:intersect(b), { 1, 3 }))\n"
+        "a[1] = 7\n"
+        "assert(raises('array is not sorted', a.intersect, a, b))\n"
+        "assert(raises('array is not sorted', b.isin, b, a))\n"
+        "assert(same(a:sort(), { 3, 5, 7 }))\n"
+        "assert(same(a:intersect(b), { 3 }))\n"
+        "a[3] = 8\n"
+        "assert(same(a:union(b), { 1, 3, 5, 8, 9 }))\n"
+        "local copy = a:copy()\n"
+        "copy[1] = 100\n"
+        "assert(raises('array is not sorted', copy.union, copy, b))\n"
+        "assert(same(a:union(b), { 1, 3, 5, 8, 9 }))"));
+}
+
+RUN_TESTS()
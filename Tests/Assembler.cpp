@@ -0,0 +1,292 @@
+// assemble, assemble_many and patch.asm_at on a bare Lua state: encodings that depend on
+// the address, the (text, address) cache and its bound, the address forms assemble_many
+// takes, and the all-or-nothing writes of patch.asm_at.
+// Only built with Keystone (LUDA_WITH_KEYSTONE); without it there is nothing to run.
+#include "Check.h"
+
+#ifdef LUDA_WITH_KEYSTONE
+#include <Executor/Libraries/assembler.hpp>
+#include <Executor/Libraries/patching.hpp>
+#include <Executor/MemoryBackend.h>
+
+#include <string>
+
+constexpr ea_t kBase = 0x140000000;
+constexpr ea_t kTarget = kBase + 0x8000;  // out of short-branch reach of every site used
+constexpr size_t kImageSize = 0x10000;
+
+static LUDA::MemoryBackend& database() {
+    static LUDA::MemoryBackend db;
+    return db;
+}
+
+// Stores the value on top of the stack as global table.name
+static void set_field(lua_State* L, const char* table, const char* name) {
+    if (lua_getglobal(L, table) == LUA_TNIL) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setglobal(L, table);
+    }
+    lua_insert(L, -2);
+    lua_setfield(L, -2, name);
+    lua_pop(L, 1);
+}
+
+static void set_field(lua_State* L, const char* table, const char* name, lua_CFunction fn) {
+    lua_pushcfunction(L, fn);
+    set_field(L, table, name);
+}
+
+// A bare state with the assembler, memory access and the types they take and return,
+// registered as the executor does, over an image of 0xCC bytes
+static lua_State* state() {
+    static lua_State* L = [] {
+        database().set_image(std::vector<uint8_t>(kImageSize, 0xCC), kBase);
+        database().add_segment(kBase, kBase + kImageSize, ".text");
+        LUDA::set_backend(&database());
+
+        lua_State* created = luaL_newstate();
+        luaL_openlibs(created);
+        LUDA::Library::register_buffer_type(created);
+        LUDA::Library::register_array_type(created);
+        LUDA::Library::register_assembler_type(created);
+        set_field(created, "buffer", "new", LUDA::Library::c_buffer_new);
+        set_field(created, "buffer", "from", LUDA::Library::c_buffer_from);
+        set_field(created, "luda", "u64array", LUDA::Library::c_u64array_new);
+        set_field(created, "luda", "u32array", LUDA::Library::c_u32array_new);
+        set_field(created, "luda", "u8array", LUDA::Library::c_u8array_new);
+        set_field(created, "memory", "read", LUDA::Library::c_get_bytes);
+        set_field(created, "memory", "read_buffer", LUDA::Library::c_read_buffer);
+        set_field(created, "memory", "write", LUDA::Library::c_write_bytes);
+        set_field(created, "patch", "asm_at", LUDA::Library::c_patch_asm_at);
+        LUDA::Library::push_binding<&LUDA::Library::get_imagebase>(created);
+        set_field(created, "image", "base");
+        LUDA::Library::push_binding<&LUDA::Library::get_first_address>(created);
+        set_field(created, "image", "first");
+        LUDA::Library::push_binding<&LUDA::Library::get_last_address>(created);
+        set_field(created, "image", "last");
+        lua_register(created, "assemble", LUDA::Library::c_assemble);
+        lua_register(created, "assemble_many", LUDA::Library::c_assemble_many);
+        return created;
+    }();
+    return L;
+}
+
+static std::string hex(ea_t ea) {
+    char text[32];
+    snprintf(text, sizeof(text), "0x%llX", static_cast<unsigned long long>(ea));
+    return text;
+}
+
+// rel32(to, ea) is the call or jmp operand of a 5-byte branch at ea; untouched(ea, size)
+// holds while no patch has written there
+static const std::string kHelpers =
+    "local base = image.base()\n"
+    "local target = " + hex(kTarget) + "\n"
+    "local function bytes(t) return string.char(table.unpack(t)) end\n"
+    "local function rel32(to, ea) return string.pack('<i4', to - (ea + 5)) end\n"
+    "local function untouched(ea, size) return memory.read_buffer(ea, size):tostring() == string.rep('\\xCC', size) end\n"
+    "local function raises(pattern, f, ...)\n"
+    "  local ok, err = pcall(f, ...)\n"
+    "  return not ok and tostring(err):find(pattern, 1, true) ~= nil\n"
+    "end\n";
+
+// Runs `script`, printing its error if it raises one
+static bool run(const std::string& script) {
+    lua_State* L = state();
+    if (luaL_dostring(L, (kHelpers + script).c_str()) != LUA_OK) {
+        printf("%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+TEST_CASE(BranchesDependOnTheAddress) {
+    CHECK(run(
+        "for _, ea in ipairs({ base, base + 0x123, base + 0x10000, base - 0x1000 }) do\n"
+        "  assert(bytes(assert(assemble('call ' .. target, ea))) == '\\xE8' .. rel32(target, ea))\n"
+        "  assert(bytes(assert(assemble('jmp ' .. target, ea))) == '\\xE9' .. rel32(target, ea))\n"
+        "end\n"
+        "assert(bytes(assemble('call ' .. target, base)) ~= bytes(assemble('call ' .. target, base + 1)))\n"
+        "assert(bytes(assemble('nop')) == '\\x90' and bytes(assemble('ret', base)) == '\\xC3')\n"
+        "local t, err = assemble('bogus', base)\n"
+        "assert(t == nil and err:find('Assembly failed: ', 1, true) == 1, err)"));
+}
+
+TEST_CASE(CacheHitsGiveTheSameBytes) {
+    CHECK(run(
+        "local code = 'call ' .. target\n"
+        "local a = assert(assemble(code, base))\n"
+        "local b = assert(assemble(code, base + 0x100))\n"
+        "local c = assert(assemble(code, base))\n"
+        "assert(bytes(a) == bytes(c) and bytes(a) ~= bytes(b) and bytes(b) == '\\xE8' .. rel32(target, base + 0x100))\n"
+        // Every call gets its own table
+        "assert(a ~= c)\n"
+        "a[1] = 0\n"
+        "assert(assemble(code, base)[1] == 0xE8)\n"
+        // Failures aren't cached either way
+        "assert(assemble('bogus', base) == nil and assemble('bogus', base) == nil)"));
+}
+
+TEST_CASE(AssembleManyAddresses) {
+    CHECK(run(
+        "local codes = { 'call ' .. target, 'nop', 'jmp ' .. target, 'ret' }\n"
+        "local eas = { base, base + 0x40, base + 0x80, base + 0xC0 }\n"
+        "local function expect(list, at)\n"
+        "  assert(#list == #codes)\n"
+        "  for i, buf in ipairs(list) do\n"
+        "    assert(buf:tostring() == bytes(assemble(codes[i], at(i))), i)\n"
+        "  end\n"
+        "end\n"
+        "expect(assert(assemble_many(codes, base + 0x40)), function() return base + 0x40 end)\n"
+        "expect(assert(assemble_many(codes, eas)), function(i) return eas[i] end)\n"
+        "expect(assert(assemble_many(codes, luda.u64array(eas))), function(i) return eas[i] end)\n"
+        "local plain = assert(assemble_many({ 'nop', 'ret' }))\n"
+        "assert(plain[1]:tostring() == '\\x90' and plain[2]:tostring() == '\\xC3')\n"
+        "assert(#assert(assemble_many({}, {})) == 0)\n"
+        "assert(raises('one address per snippet expected', assemble_many, codes, { base }))\n"
+        "assert(raises('one address per snippet expected', assemble_many, codes, luda.u64array({ base, base, base, base, base })))\n"
+        "assert(raises('string expected at [2]', assemble_many, { 'nop', 5 }))\n"
+        "assert(raises('integer expected at [2]', assemble_many, { 'nop', 'nop' }, { base, 'x' }))\n"
+        "local list, err = assemble_many({ 'nop', 'bogus', 'ret' }, base)\n"
+        "assert(list == nil and err:find('Assembly of snippet 2 failed', 1, true), err)"));
+}
+
+// Past assembler_cache_entries the least recently used encodings go; a hit returns the
+// cached encoding itself and makes it the most recent
+TEST_CASE(CacheEvictsTheLeastRecentlyUsed) {
+    using namespace LUDA::Library;
+    Assembler* as = get_assembler(state());
+    const std::string code = "call " + hex(kTarget);
+    auto assemble = [&](ea_t ea) {
+        const char* error = nullptr;
+        return assemble_at(as, code.data(), code.size(), ea, &error);
+    };
+    auto cached = [&](ea_t ea) {
+        std::string key = code;
+        key.append(reinterpret_cast<const char*>(&ea), sizeof(ea));
+        return as->index.count(key) != 0;
+    };
+    auto site = [](size_t i) { return kBase + 0x20000 + 0x10 * i; };  // addresses no other case uses
+
+    const std::string* first = assemble(site(0));
+    CHECK(first != nullptr && assemble(site(0)) == first);
+    const std::string first_bytes = *first;
+
+    const size_t extra = 100;
+    for (size_t i = 1; i <= assembler_cache_entries + extra; ++i) {
+        CHECK(assemble(site(i)) != nullptr);
+        if (i == assembler_cache_entries / 2) {
+            CHECK(assemble(site(0)) == first);
+        }
+    }
+    CHECK(as->recent.size() == assembler_cache_entries);
+    CHECK(as->index.size() == assembler_cache_entries);
+    CHECK(cached(site(0)) && *first == first_bytes);
+    for (size_t i = 1; i <= extra + 1; ++i) {
+        CHECK(!cached(site(i)));
+    }
+    CHECK(cached(site(extra + 2)));
+    CHECK(cached(site(assembler_cache_entries + extra)));
+
+    // An evicted encoding is assembled again, the same as before
+    const std::string* again = assemble(site(1));
+    std::string expected = "\xE8";
+    int32_t rel = static_cast<int32_t>(kTarget - (site(1) + 5));
+    expected.append(reinterpret_cast<const char*>(&rel), sizeof(rel));
+    CHECK(again != nullptr && *again == expected);
+    CHECK(as->recent.size() == assembler_cache_entries);
+}
+TEST_CASE(PatchWritesEverySite) {
+    CHECK(run(
+        "local sites = { base + 0x100, base + 0x200, base + 0x300 }\n"
+        "local sizes = assert(patch.asm_at(sites, 'call ' .. target))\n"
+        "assert(tostring(sizes) == 'u32array: 3 elements' and sizes[1] == 5 and sizes[3] == 5)\n"
+        "for _, ea in ipairs(sites) do\n"
+        "  assert(memory.read_buffer(ea, 5):tostring() == '\\xE8' .. rel32(target, ea))\n"
+        "  assert(untouched(ea - 4, 4) and untouched(ea + 5, 4))\n"
+        "end\n"
+        // A template function gets each site and its index; patches may be back to back
+        "local seen = {}\n"
+        "sizes = assert(patch.asm_at(luda.u64array({ base + 0x405, base + 0x400 }), function(ea, i)\n"
+        "  seen[i] = ea\n"
+        "  return i == 1 and 'nop' or 'jmp ' .. target\n"
+        "end))\n"
+        "assert(seen[1] == base + 0x405 and seen[2] == base + 0x400)\n"
+        "assert(sizes[1] == 1 and sizes[2] == 5)\n"
+        "assert(memory.read_buffer(base + 0x400, 7):tostring() == '\\xE9' .. rel32(target, base + 0x400) .. '\\x90\\xCC')\n"
+        "assert(#patch.asm_at({}, 'nop') == 0)"));
+}
+
+// Overlapping patches, the same site twice included, are refused before anything is written
+TEST_CASE(PatchRejectsOverlaps) {
+    CHECK(run(
+        "local ok, err = patch.asm_at({ base + 0x500, base + 0x502 }, 'call ' .. target)\n"
+        "assert(ok == nil and err == 'Patches at site 1 (0x140000500-0x140000505) and site 2 (0x140000502) overlap', err)\n"
+        "ok, err = patch.asm_at({ base + 0x600, base + 0x600 }, 'ret')\n"
+        "assert(ok == nil and err == 'Patches at site 1 (0x140000600-0x140000601) and site 2 (0x140000600) overlap', err)\n"
+        // Sites are compared in address order, whatever order they come in
+        "ok, err = patch.asm_at({ base + 0x720, base + 0x700, base + 0x71E }, 'call ' .. target)\n"
+        "assert(ok == nil and err:find('site 3 (0x14000071E-0x140000723) and site 1 (0x140000720) overlap', 1, true), err)\n"
+        "assert(untouched(base + 0x500, 8) and untouched(base + 0x600, 2) and untouched(base + 0x700, 0x30))"));
+}
+
+// One site that doesn't assemble, or a template that fails, and no site is written
+TEST_CASE(PatchFailureWritesNothing) {
+    CHECK(run(
+        "local sites = { base + 0x800, base + 0x810, base + 0x820, base + 0x830 }\n"
+        "local ok, err = patch.asm_at(sites, function(ea, i) return i == 3 and 'bogus' or 'call ' .. target end)\n"
+        "assert(ok == nil and err:find('Assembly at site 3 (0x140000820) failed: ', 1, true) == 1, err)\n"
+        "ok, err = patch.asm_at(sites, 'bogus')\n"
+        "assert(ok == nil and err:find('Assembly at site 1 (0x140000800) failed: ', 1, true) == 1, err)\n"
+        "assert(raises('template returned nil for site 2, string expected', patch.asm_at, sites,\n"
+        "  function(ea, i) if i ~= 2 then return 'nop' end end))\n"
+        "assert(raises('template failed', patch.asm_at, sites,\n"
+        "  function(ea, i) if i == 4 then error('template failed') end return 'nop' end))\n"
+        "assert(untouched(base + 0x800, 0x40))"));
+}
+
+TEST_CASE(PatchDryRun) {
+    CHECK(run(
+        "local sites = { base + 0x900, base + 0x910 }\n"
+        "local sizes = assert(patch.asm_at(sites, 'call ' .. target, { dry_run = true }))\n"
+        "assert(#sizes == 2 and sizes[1] == 5 and sizes[2] == 5)\n"
+        "assert(untouched(base + 0x900, 0x20))\n"
+        "local ok, err = patch.asm_at({ base + 0x900, base + 0x901 }, 'call ' .. target, { dry_run = true })\n"
+        "assert(ok == nil and err:find('overlap', 1, true), err)\n"
+        "ok, err = patch.asm_at(sites, 'bogus', { dry_run = true })\n"
+        "assert(ok == nil and err:find('Assembly at site 1', 1, true), err)\n"
+        "assert(patch.asm_at(sites, 'ret', { dry_run = false }) and memory.read(base + 0x910, 1)[1] == 0xC3)"));
+}
+
+// Names come from the database when the patch is assembled, not from the cache
+TEST_CASE(PatchResolvesNames) {
+    const std::string script =
+        "local sites = { base + 0xA00, base + 0xA10 }\n"
+        "assert(patch.asm_at(sites, 'call patch_target'))\n"
+        "for _, ea in ipairs(sites) do\n"
+        "  assert(memory.read_buffer(ea, 5):tostring() == '\\xE8' .. rel32(destination, ea))\n"
+        "end\n"
+        "local ok, err = patch.asm_at(sites, 'call no_such_name')\n"
+        "assert(ok == nil and err:find('Assembly at site 1 (0x140000A00) failed: ', 1, true) == 1, err)";
+    database().add_name(kBase + 0x9000, "patch_target");
+    CHECK(run("local destination = base + 0x9000\n" + script));
+    database().add_name(kBase + 0xA000, "patch_target");
+    CHECK(run("local destination = base + 0xA000\n" + script));
+}
+
+TEST_CASE(PatchArgumentsAreChecked) {
+    CHECK(run(
+        "assert(raises('bad element #2 (integer expected, got number)', patch.asm_at, { base, 1.5 }, 'nop'))\n"
+        "assert(raises('bad element #1 (integer expected, got string)', patch.asm_at, { 'x' }, 'nop'))\n"
+        "assert(raises('bad element #2 (integer expected, got table)', patch.asm_at, { base, {} }, 'nop'))\n"
+        "assert(raises('table or array expected', patch.asm_at, base, 'nop'))\n"
+        "assert(raises('string or function expected', patch.asm_at, { base }, 5))\n"
+        "assert(raises('table expected', patch.asm_at, { base }, 'nop', true))\n"
+        "assert(untouched(base, 0x10))"));
+}
+#endif
+
+RUN_TESTS()
@@ -0,0 +1,63 @@
+// Bindings generated by Libraries/binding.hpp: arguments are checked before anything is
+// built from them, and a result whose push runs out of memory is still freed
+#include "Check.h"
+
+#include <Executor/Executor.h>
+#include <Executor/MemoryBackend.h>
+
+#include <string>
+
+constexpr ea_t kBase = 0x140000000;
+constexpr ea_t kTarget = kBase + 0x1000;
+constexpr size_t kCallers = 200000;  // 1.6 MB of addresses, more than a 1 MB run may allocate
+
+static Executor& executor() {
+    static Executor* instance = [] {
+        static LUDA::MemoryBackend db;
+        db.add_segment(kBase, kBase + 0x1000000, ".text");
+        for (size_t i = 0; i < kCallers; ++i) {
+            db.add_xref(kBase + 0x2000 + i * 8, kTarget, LUDA::XrefKind::code);
+        }
+        db.set_image(std::vector<uint8_t>(0x1000000), kBase);
+        LUDA::set_backend(&db);
+        auto* created = new Executor();
+        created->initialize();
+        return created;
+    }();
+    return *instance;
+}
+
+static std::string hex(ea_t ea) {
+    char text[32];
+    snprintf(text, sizeof(text), "0x%llX", static_cast<unsigned long long>(ea));
+    return text;
+}
+
+TEST_CASE(BadArgumentsRaise) {
+    CHECK(executor().run_script(
+        "local ok, err = pcall(xrefs.get, 'nowhere')\n"
+        "assert(not ok and err:find('bad argument #1', 1, true), err)\n"
+        "ok, err = pcall(xrefs.get, 1.5)\n"
+        "assert(not ok and err:find('number has no integer representation', 1, true), err)\n"
+        "ok, err = pcall(strings.search, {})\n"
+        "assert(not ok and err:find('bad argument #1', 1, true), err)"));
+}
+
+TEST_CASE(ResultsArrive) {
+    CHECK(executor().run_script(
+        "assert(#xrefs.get(" + hex(kTarget) + ") == " + std::to_string(kCallers) + ")\n"
+        "assert(#xrefs.get(" + hex(kBase) + ") == 0)\n"
+        "assert(image.base() == " + hex(kBase) + ")"));
+}
+
+// The push of the result fails for want of heap; the binding keeps working afterwards
+TEST_CASE(FailedPushIsRecovered) {
+    // The limit counts from what is in use when a run starts, garbage of earlier runs included
+    CHECK(executor().run_script("collectgarbage()"));
+    for (int i = 0; i < 3; ++i) {
+        CHECK(!executor().run_script("--@heap_limit_mb 1\nlocal callers = xrefs.get(" + hex(kTarget) + ")"));
+    }
+    CHECK(executor().run_script("assert(#xrefs.get(" + hex(kTarget) + ") == " + std::to_string(kCallers) + ")"));
+}
+
+RUN_TESTS()
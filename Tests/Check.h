@@ -0,0 +1,55 @@
+#pragma once
+// Minimal harness for the test executables: TEST_CASE bodies run in order from
+// RUN_TESTS(), CHECK failures are reported with file and line, and the exit code
+// is the number of failed checks (0 = pass, as ctest expects).
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace check {
+
+    struct Case {
+        const char* name;
+        void (*body)();
+    };
+
+    inline std::vector<Case>& cases() {
+        static std::vector<Case> all;
+        return all;
+    }
+
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+
+    struct Register {
+        Register(const char* name, void (*body)()) { cases().push_back({ name, body }); }
+    };
+
+    inline void fail(const char* file, int line, const char* expression) {
+        printf("%s:%d: CHECK(%s) failed\n", file, line, expression);
+        failures()++;
+    }
+
+    inline int run() {
+        for (const Case& test : cases()) {
+            int before = failures();
+            test.body();
+            printf("[%s] %s\n", failures() == before ? "  OK  " : "FAILED", test.name);
+        }
+        return failures() > 255 ? 255 : failures();
+    }
+
+} // namespace check
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static check::Register name##_registered(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do { if (!(expression)) check::fail(__FILE__, __LINE__, #expression); } while (0)
+
+#define RUN_TESTS() \
+    int main() { return check::run(); }
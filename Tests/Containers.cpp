@@ -0,0 +1,306 @@
+// luda.eamap and luda.rangeset against plain-table references: random changes, bound
+// queries, iteration while changing, unsigned order past 2^63, and range set algebra
+#include "Check.h"
+
+#include <Executor/Executor.h>
+
+#include <string>
+
+static Executor& executor() {
+    static Executor* instance = [] {
+        auto* created = new Executor();
+        created->initialize();
+        return created;
+    }();
+    return *instance;
+}
+
+// A seeded generator, and key lists in unsigned order with the bound queries done on them
+static const std::string kHelpers = R"(
+local seed = 424242
+local function rand(n)
+  seed = seed * 6364136223846793005 + 1442695040888963407
+  return (seed >> 33) % n
+end
+local function keys_of(t)
+  local keys = {}
+  for k in pairs(t) do keys[#keys + 1] = k end
+  table.sort(keys, math.ult)
+  return keys
+end
+-- First position whose key is >= ea (> ea when strict), #keys + 1 if none
+local function bound(keys, ea, strict)
+  local lo, hi = 1, #keys + 1
+  while lo < hi do
+    local mid = (lo + hi) // 2
+    local k = keys[mid]
+    if math.ult(k, ea) or (strict and k == ea) then lo = mid + 1 else hi = mid end
+  end
+  return lo
+end
+local function raises(pattern, f, ...)
+  local ok, err = pcall(f, ...)
+  return not ok and tostring(err):find(pattern, 1, true) ~= nil
+end
+)";
+
+static bool run(const std::string& script) {
+    return executor().run_script(kHelpers + script);
+}
+
+// The map's entries, its length and its bound queries all match a table of the same pairs
+static const std::string kCompareMap = R"(
+local function compare(m, ref, probes)
+  local keys = keys_of(ref)
+  assert(#m == #keys, 'length ' .. #m .. ' ~= ' .. #keys)
+  local i = 0
+  for ea, v in pairs(m) do
+    i = i + 1
+    assert(ea == keys[i] and v == ref[ea], 'entry ' .. i)
+  end
+  assert(i == #keys)
+  local first, last = m:first(), m:last()
+  assert(first == keys[1] and last == keys[#keys])
+  for _ = 1, probes do
+    local ea = keys[rand(#keys + 1) + 1] or 0
+    ea = ea + rand(3) - 1
+    local lo, hi = bound(keys, ea), bound(keys, ea, true)
+    local k, v = m:lower_bound(ea)
+    assert(k == keys[lo] and v == ref[k])
+    k, v = m:upper_bound(ea)
+    assert(k == keys[hi] and v == ref[k])
+    k, v = m:floor(ea)
+    assert(k == keys[hi - 1] and v == ref[k])
+    assert(m[ea] == ref[ea] and m:get(ea) == ref[ea])
+  end
+end
+)";
+
+TEST_CASE(RandomChangesAgainstATable) {
+    // Keys around 0, across 2^63 and at the top of the address space
+    for (const char* origin : { "0", "(1 << 63) - 20000 * 8", "-50000 * 8" }) {
+        CHECK(run(kCompareMap +
+            "local origin = " + origin + "\n"
+            "local m, ref = luda.eamap(), {}\n"
+            "for step = 1, 60000 do\n"
+            "  local ea = origin + rand(40000) * 8\n"
+            "  local op = rand(10)\n"
+            "  if op < 6 then\n"
+            "    local v = rand(3) == 0 and ('v' .. step) or step\n"
+            "    m[ea] = v ref[ea] = v\n"
+            "  elseif op < 8 then\n"
+            "    m[ea] = nil ref[ea] = nil\n"
+            "  elseif op < 9 then\n"
+            "    assert(m:remove(ea) == ref[ea]) ref[ea] = nil\n"
+            "  else\n"
+            "    m:set(ea, true) ref[ea] = true\n"
+            "  end\n"
+            "  if step % 15000 == 0 then compare(m, ref, 2000) end\n"
+            "end"));
+    }
+}
+
+TEST_CASE(BoundsAndRanges) {
+    CHECK(run(
+        "local m = luda.eamap()\n"
+        "assert(m:first() == nil and m:last() == nil and m:lower_bound(0) == nil and m:floor(-1) == nil)\n"
+        "for _, ea in ipairs({ 10, 20, 30, 40 }) do m[ea] = 'at' .. ea end\n"
+        "local k, v = m:lower_bound(20) assert(k == 20 and v == 'at20')\n"
+        "k, v = m:upper_bound(20) assert(k == 30 and v == 'at30')\n"
+        "k, v = m:floor(29) assert(k == 20 and v == 'at20')\n"
+        "assert(m:floor(9) == nil and m:lower_bound(41) == nil and m:upper_bound(40) == nil)\n"
+        "assert(m:floor(-1) == 40 and m:lower_bound(-1) == nil)\n"
+        "local function collect(...) local out = {} for ea, v in m:range(...) do out[#out + 1] = ea .. '=' .. v end return table.concat(out, ' ') end\n"
+        "assert(collect(20, 40) == '20=at20 30=at30')\n"
+        "assert(collect(15, 16) == '' and collect(40, 10) == '')\n"
+        "assert(collect(25) == '30=at30 40=at40')\n"
+        "assert(collect() == '10=at10 20=at20 30=at30 40=at40')\n"
+        "assert(collect(nil, 30) == '10=at10 20=at20')\n"
+        "assert(raises('number expected', m.range, m, 'x'))\n"
+        // Large ranges cross leaves
+        "for ea = 1000, 1999 do m[ea] = ea end\n"
+        "local n, sum = 0, 0\n"
+        "for ea, v in m:range(1100, 1900) do n = n + 1 sum = sum + v end\n"
+        "assert(n == 800 and sum == (1100 + 1899) * 400)"));
+}
+
+TEST_CASE(EraseDownToEmpty) {
+    CHECK(run(kCompareMap +
+        "local m, ref = luda.eamap(), {}\n"
+        "for i = 1, 5000 do m[i * 16] = i ref[i * 16] = i end\n"
+        "compare(m, ref, 100)\n"
+        // Every other key first, then from both ends, then what's left in random order
+        "for i = 2, 5000, 2 do m[i * 16] = nil ref[i * 16] = nil end\n"
+        "compare(m, ref, 200)\n"
+        "for i = 1, 1000, 2 do assert(m:remove(i * 16) == i) ref[i * 16] = nil end\n"
+        "for i = 4999, 4001, -2 do m[i * 16] = nil ref[i * 16] = nil end\n"
+        "compare(m, ref, 200)\n"
+        "local left = keys_of(ref)\n"
+        "for i = #left, 2, -1 do local j = rand(i) + 1 left[i], left[j] = left[j], left[i] end\n"
+        "for _, ea in ipairs(left) do m[ea] = nil ref[ea] = nil end\n"
+        "compare(m, ref, 10)\n"
+        "assert(#m == 0 and next(ref) == nil)\n"
+        "for _ in pairs(m) do error('entry left') end\n"
+        "assert(m:remove(16) == nil and #m == 0)\n"
+        // An emptied map works like a new one
+        "for i = 1, 3000 do m[-i] = i ref[-i] = i end\n"
+        "compare(m, ref, 100)\n"
+        "m:clear()\n"
+        "assert(#m == 0 and m:first() == nil)\n"
+        "m[5] = 'again'\n"
+        "assert(#m == 1 and m[5] == 'again')"));
+}
+
+// An iterator continues after the last key it returned, whatever changed meanwhile
+TEST_CASE(ChangesDuringPairs) {
+    CHECK(run(
+        "local function following(ref, last)\n"
+        "  local best\n"
+        "  for k in pairs(ref) do\n"
+        "    if (last == nil or math.ult(last, k)) and (best == nil or math.ult(k, best)) then best = k end\n"
+        "  end\n"
+        "  return best\n"
+        "end\n"
+        "local m, ref = luda.eamap(), {}\n"
+        "for i = 1, 1500 do m[i * 10] = i ref[i * 10] = i end\n"
+        "local last, visited = nil, 0\n"
+        "for ea, v in pairs(m) do\n"
+        "  local expected = following(ref, last)\n"
+        "  assert(ea == expected and v == ref[ea], 'visited ' .. tostring(ea) .. ', expected ' .. tostring(expected))\n"
+        "  visited, last = visited + 1, ea\n"
+        "  local op = rand(4)\n"
+        "  if op == 0 then m[ea] = nil ref[ea] = nil\n"
+        "  elseif op == 1 then local ahead = ea + 10 * (1 + rand(5)) m[ahead] = nil ref[ahead] = nil\n"
+        "  elseif op == 2 then local behind = ea - 5 m[behind] = 'new' ref[behind] = 'new'\n"
+        "  else local ahead = ea + 5 m[ahead] = 'new' ref[ahead] = 'new' end\n"
+        "  if visited % 200 == 0 then for i = 1, 100 do local k = rand(20000) * 10 m[k] = nil ref[k] = nil end end\n"
+        "end\n"
+        "assert(visited > 500 and following(ref, last) == nil)\n"
+        // The same through range, and with the whole map cleared mid-loop
+        "local n = 0\n"
+        "for ea in m:range(0, 20000) do n = n + 1 if n == 10 then m:clear() end end\n"
+        "assert(n == 10 and #m == 0)"));
+}
+
+// Addresses compare unsigned: 2^63 and above sort after everything below
+TEST_CASE(UnsignedKeyOrder) {
+    CHECK(run(
+        "local m = luda.eamap()\n"
+        "local order = { 0, 1, math.maxinteger, math.mininteger, math.mininteger + 1, -2, -1 }\n"
+        "for i = #order, 1, -1 do m[order[i]] = i end\n"
+        "local i = 0\n"
+        "for ea, v in pairs(m) do i = i + 1 assert(ea == order[i] and v == i) end\n"
+        "assert(i == #order)\n"
+        "assert(m:first() == 0 and m:last() == -1)\n"
+        "assert(m:lower_bound(math.maxinteger + 1) == math.mininteger)\n"
+        "assert(m:upper_bound(math.maxinteger) == math.mininteger)\n"
+        "assert(m:floor(math.mininteger - 1) == math.maxinteger)\n"
+        "local n = 0 for ea in m:range(math.maxinteger, -1) do n = n + 1 end\n"
+        "assert(n == 4)"));
+}
+
+// A set's ranges are sorted, non-empty, and neither overlap nor touch
+static const std::string kCompareSet = R"(
+local function members(s, origin)
+  local set, previous_end = {}, nil
+  for start, end_ in s:ranges() do
+    assert(math.ult(start, end_), 'empty range')
+    assert(previous_end == nil or math.ult(previous_end, start), 'ranges overlap or touch')
+    for k = start - origin, end_ - origin - 1 do set[k] = true end
+    previous_end = end_
+  end
+  return set
+end
+local function same_members(s, ref, origin, universe)
+  local set = members(s, origin)
+  local size = 0
+  for k = 0, universe - 1 do
+    assert((set[k] or false) == (ref[k] or false), 'member ' .. k)
+    if ref[k] then size = size + 1 end
+    assert(s:contains(origin + k) == (ref[k] or false))
+  end
+  assert(s:size() == size)
+end
+local function random_set(origin, universe, pieces)
+  local s, ref = luda.rangeset(), {}
+  for _ = 1, pieces do
+    local a = rand(universe)
+    local b = math.min(universe, a + rand(12))
+    s:add(origin + a, origin + b)
+    for k = a, b - 1 do ref[k] = true end
+  end
+  return s, ref
+end
+)";
+
+TEST_CASE(RangeSetAgainstATable) {
+    for (const char* origin : { "0x140000000", "(1 << 63) - 100" }) {
+        CHECK(run(kCompareSet +
+            "local origin, universe = " + std::string(origin) + ", 200\n"
+            "for round = 1, 40 do\n"
+            "  local s, ref = random_set(origin, universe, rand(20))\n"
+            "  same_members(s, ref, origin, universe)\n"
+            "  for _ = 1, 10 do\n"
+            "    local a = rand(universe)\n"
+            "    local b = math.min(universe, a + rand(30))\n"
+            "    if rand(2) == 0 then\n"
+            "      assert(s:add(origin + a, origin + b) == s)\n"
+            "      for k = a, b - 1 do ref[k] = true end\n"
+            "    else\n"
+            "      assert(s:remove(origin + a, origin + b) == s)\n"
+            "      for k = a, b - 1 do ref[k] = nil end\n"
+            "    end\n"
+            "    local any = false for k = a, b - 1 do any = any or ref[k] == true end\n"
+            "    assert(s:overlaps(origin + a, origin + b) == any)\n"
+            "    same_members(s, ref, origin, universe)\n"
+            "  end\n"
+            "  local k = rand(universe)\n"
+            "  local start, end_ = s:find(origin + k)\n"
+            "  if ref[k] then\n"
+            "    local a, b = start - origin, end_ - origin\n"
+            "    assert(a <= k and k < b and ref[a] and not ref[a - 1] and not ref[b])\n"
+            "  else\n"
+            "    assert(start == nil)\n"
+            "  end\n"
+            "\n"
+            "  local o, oref = random_set(origin, universe, rand(20))\n"
+            "  local either, both, only = {}, {}, {}\n"
+            "  for k = 0, universe - 1 do\n"
+            "    either[k] = ref[k] or oref[k]\n"
+            "    both[k] = ref[k] and oref[k]\n"
+            "    only[k] = ref[k] and not oref[k]\n"
+            "  end\n"
+            "  same_members(s:union(o), either, origin, universe)\n"
+            "  same_members(s | o, either, origin, universe)\n"
+            "  same_members(s:intersect(o), both, origin, universe)\n"
+            "  same_members(s & o, both, origin, universe)\n"
+            "  same_members(s:subtract(o), only, origin, universe)\n"
+            "  same_members(s - o, only, origin, universe)\n"
+            "  same_members(s, ref, origin, universe)\n"
+            "end"));
+    }
+}
+
+TEST_CASE(RangeSetConstruction) {
+    CHECK(run(kCompareSet +
+        "local s = luda.rangeset({ { 30, 40 }, { 10, 20 }, { 20, 25 }, { 5, 5 }, { 38, 50 }, { 60, 55 } })\n"
+        "local out = {}\n"
+        "for start, end_ in s:ranges() do out[#out + 1] = start .. '-' .. end_ end\n"
+        "assert(table.concat(out, ' ') == '10-25 30-50' and #s == 2 and s:size() == 35)\n"
+        "local copy = luda.rangeset(s)\n"
+        "copy:add(25, 30)\n"
+        "assert(#copy == 1 and #s == 2)\n"
+        "assert(tostring(s) == 'rangeset: 2 ranges')\n"
+        "s:clear()\n"
+        "assert(#s == 0 and s:size() == 0 and not s:contains(10))\n"
+        "assert(raises('range expected at [2]', luda.rangeset, { { 1, 2 }, 3 }))\n"
+        "assert(raises('{start, end} expected at [1]', luda.rangeset, { { 1 } }))\n"
+        // Ranges above 2^63 sort after the ones below
+        "local high = luda.rangeset({ { -16, -8 }, { 0, 8 }, { math.maxinteger - 1, math.mininteger + 1 } })\n"
+        "out = {}\n"
+        "for start, end_ in high:ranges() do out[#out + 1] = start end\n"
+        "assert(#out == 3 and out[1] == 0 and out[2] == math.maxinteger - 1 and out[3] == -16)\n"
+        "assert(high:contains(math.mininteger) and not high:contains(math.mininteger + 1))"));
+}
+
+RUN_TESTS()
@@ -0,0 +1,216 @@
+// hex(), hexdump() and print(): digit counts, line layout at every width against a
+// reference in Lua, the address column, and what print writes for each kind of value
+#include "Check.h"
+
+#include <Executor/Executor.h>
+#include <Executor/MemoryBackend.h>
+
+#include <unistd.h>
+
+#include <string>
+
+constexpr ea_t kBase = 0x140000000;
+constexpr size_t kImageSize = 0x10000;
+
+static Executor& executor() {
+    static Executor* instance = [] {
+        static LUDA::MemoryBackend db;
+        std::vector<uint8_t> image(kImageSize);
+        for (size_t i = 0; i < image.size(); ++i) image[i] = static_cast<uint8_t>(i * 7 + 3);
+        db.set_image(std::move(image), kBase);
+        db.add_segment(kBase, kBase + kImageSize, ".data");
+        LUDA::set_backend(&db);
+        auto* created = new Executor();
+        created->initialize();
+        return created;
+    }();
+    return *instance;
+}
+
+// reference(data, base, width, ascii) builds hexdump's text a line at a time
+static const std::string kHelpers =
+    "local base = " + std::to_string(kBase) + "\n"
+    "local function raises(pattern, f, ...)\n"
+    "  local ok, err = pcall(f, ...)\n"
+    "  return not ok and tostring(err):find(pattern, 1, true) ~= nil\n"
+    "end\n"
+    "local function reference(data, base, width, ascii)\n"
+    "  local last = #data > 0 and base + #data - 1 or base\n"
+    "  local digits = (last >> 32 == 0 and not math.ult(last, base)) and 8 or 16\n"
+    "  local hex_width = width * 3 - 1 + (width - 1) // 8\n"
+    "  local lines = {}\n"
+    "  for offset = 0, #data - 1, width do\n"
+    "    local chunk = data:sub(offset + 1, offset + width)\n"
+    "    local hex = {}\n"
+    "    for i = 1, #chunk do\n"
+    "      local separator = i == 1 and '' or ((i - 1) % 8 == 0 and '  ' or ' ')\n"
+    "      hex[#hex + 1] = separator .. string.format('%02X', chunk:byte(i))\n"
+    "    end\n"
+    "    local line = string.format('%0' .. digits .. 'X', base + offset) .. '  ' .. table.concat(hex)\n"
+    "    if ascii then\n"
+    "      local printable = chunk:gsub('[^\\x20-\\x7E]', '.')\n"
+    "      line = line .. string.rep(' ', hex_width - #table.concat(hex)) .. '  |' .. printable .. '|'\n"
+    "    end\n"
+    "    lines[#lines + 1] = line\n"
+    "  end\n"
+    "  return table.concat(lines, '\\n')\n"
+    "end\n"
+    "local seed = 12345\n"
+    "local function bytes(n)\n"
+    "  local out = {}\n"
+    "  for i = 1, n do\n"
+    "    seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF\n"
+    "    out[i] = string.char(seed >> 16 & 0xFF)\n"
+    "  end\n"
+    "  return table.concat(out)\n"
+    "end\n";
+
+static bool run(const std::string& script) {
+    return executor().run_script(kHelpers + script);
+}
+
+// What `script` writes to stdout, where print goes with no client job running
+static std::string printed(const std::string& script) {
+    fflush(stdout);
+    FILE* capture = tmpfile();
+    int saved = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    bool ok = run(script);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    std::string text;
+    rewind(capture);
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), capture)) > 0) text.append(chunk, n);
+    fclose(capture);
+    return ok ? text : "(script failed) " + text;
+}
+
+TEST_CASE(HexDigits) {
+    CHECK(run(
+        "assert(hex(0) == '0' and hex(255) == 'FF' and hex(0x1234) == '1234')\n"
+        "assert(hex(0xABC, 1) == 'ABC' and hex(0xABC, 3) == 'ABC' and hex(0xABC, 4) == '0ABC')\n"
+        "assert(hex(5, 3) == '005' and hex(0, 2) == '00')\n"
+        "assert(hex(0x7FFFFFFFFFFFFFFF) == '7FFFFFFFFFFFFFFF')\n"
+        "assert(hex(1, 64) == string.rep('0', 63) .. '1')\n"
+        "assert(hex(1 << 63, 64) == string.rep('0', 48) .. '8000000000000000')"));
+}
+
+// Negative values are their 64-bit two's complement, as string.format('%X') shows them
+TEST_CASE(HexOfNegativeValues) {
+    CHECK(run(
+        "assert(hex(-1) == 'FFFFFFFFFFFFFFFF' and hex(-1, 20) == '0000FFFFFFFFFFFFFFFF')\n"
+        "for _, v in ipairs({ -2, -256, math.mininteger, -0x140000000 }) do\n"
+        "  assert(hex(v) == string.format('%X', v))\n"
+        "end"));
+}
+
+TEST_CASE(HexArgumentErrors) {
+    CHECK(run(
+        "assert(raises('digit count out of range (1-64)', hex, 1, 0))\n"
+        "assert(raises('digit count out of range (1-64)', hex, 1, 65))\n"
+        "assert(raises('digit count out of range (1-64)', hex, 1, -1))\n"
+        "assert(raises('number has no integer representation', hex, 1.5))\n"
+        "assert(raises('bad argument #1', hex, 'x'))"));
+}
+
+TEST_CASE(HexdumpLayout) {
+    CHECK(run(
+        "assert(hexdump('ABCDEFGHIJKLMNOPQ') ==\n"
+        "  '00000000  41 42 43 44 45 46 47 48  49 4A 4B 4C 4D 4E 4F 50  |ABCDEFGHIJKLMNOP|\\n' ..\n"
+        "  '00000010  51' .. string.rep(' ', 46) .. '  |Q|')\n"
+        "assert(hexdump('') == '' and hexdump('', { ascii = false }) == '')\n"
+        "assert(hexdump('\\0\\x7F\\x1F ~', { width = 8 }) == '00000000  00 7F 1F 20 7E' .. string.rep(' ', 9) .. '  |... ~|')\n"
+        "assert(hexdump(buffer.from('AB')) == hexdump('AB'))"));
+}
+
+// Every width against the reference, with and without the ASCII column, for sizes that
+// end on, before and after a line boundary
+TEST_CASE(HexdumpWidths) {
+    CHECK(run(
+        "for _, width in ipairs({ 1, 8, 16, 256 }) do\n"
+        "  for _, size in ipairs({ 1, width - 1, width, width + 1, 3 * width + 5, 600 }) do\n"
+        "    if size > 0 then\n"
+        "      local data = bytes(size)\n"
+        "      for _, ascii in ipairs({ true, false }) do\n"
+        "        local got = hexdump(data, { width = width, ascii = ascii })\n"
+        "        assert(got == reference(data, 0, width, ascii), width .. ' ' .. size .. ' ' .. tostring(ascii))\n"
+        "      end\n"
+        "    end\n"
+        "  end\n"
+        "end\n"
+        "assert(raises('width out of range (1-256)', hexdump, 'x', { width = 0 }))\n"
+        "assert(raises('width out of range (1-256)', hexdump, 'x', { width = 257 }))"));
+}
+
+// Without the ASCII column a short last line stops at its last byte
+TEST_CASE(HexdumpShortLineWithoutAscii) {
+    CHECK(run(
+        "local text = hexdump('ABCDEFGHIJKLMNOPQRSTUVWXYZ', { ascii = false })\n"
+        "assert(text == '00000000  41 42 43 44 45 46 47 48  49 4A 4B 4C 4D 4E 4F 50\\n' ..\n"
+        "  '00000010  51 52 53 54 55 56 57 58  59 5A', text)\n"
+        "assert(hexdump('ABCDEFGH', { ascii = false }) == '00000000  41 42 43 44 45 46 47 48')\n"
+        "assert(hexdump('ABCDEFGHI', { ascii = false }) == '00000000  41 42 43 44 45 46 47 48  49')\n"
+        "for size = 1, 40 do\n"
+        "  local got = hexdump(bytes(size), { ascii = false })\n"
+        "  assert(not got:find(' \\n') and not got:find(' $'), size)\n"
+        "end"));
+}
+
+// Addresses take 8 digits while the last one fits in 32 bits without wrapping, else 16
+TEST_CASE(HexdumpAddressDigits) {
+    CHECK(run(
+        "local line = string.rep('x', 16)\n"
+        "assert(hexdump(line, { address = 0xFFFFFFF0, ascii = false }):sub(1, 10) == 'FFFFFFF0  ')\n"
+        "assert(hexdump(line, { address = 0xFFFFFFF1, ascii = false }):sub(1, 18) == '00000000FFFFFFF1  ')\n"
+        "assert(hexdump(line, { address = -16, ascii = false }):sub(1, 18) == 'FFFFFFFFFFFFFFF0  ')\n"
+        // The last address wraps past zero
+        "assert(hexdump(line, { address = -8, ascii = false }):sub(1, 18) == 'FFFFFFFFFFFFFFF8  ')\n"
+        "local two = hexdump(line .. line, { address = 0xFFFFFFF0 })\n"
+        "assert(two:sub(1, 18) == '00000000FFFFFFF0  ' and two:find('\\n0000000100000000  ', 1, true))\n"
+        "assert(hexdump(line .. line, { address = 0xFFFFFFE0 }):find('\\nFFFFFFF0  ', 1, true))\n"
+        "for _, address in ipairs({ 0, 0xFFFFFF00, 0x100000000, -256 }) do\n"
+        "  local data = bytes(100)\n"
+        "  assert(hexdump(data, { address = address }) == reference(data, address, 16, true))\n"
+        "end"));
+}
+
+// hexdump(address, size) reads the database and shows its addresses
+TEST_CASE(HexdumpOfDatabaseBytes) {
+    CHECK(run(
+        "local function image(offset, size)\n"
+        "  local out = {}\n"
+        "  for i = offset, offset + size - 1 do out[#out + 1] = string.char((i * 7 + 3) & 0xFF) end\n"
+        "  return table.concat(out)\n"
+        "end\n"
+        "assert(hexdump(base, 40) == reference(image(0, 40), base, 16, true))\n"
+        "assert(hexdump(base + 0x123, 70, { width = 8, ascii = false }) == reference(image(0x123, 70), base + 0x123, 8, false))\n"
+        "assert(hexdump(base, 4, { address = 0 }) == '00000000  03 0A 11 18' .. string.rep(' ', 37) .. '  |....|')\n"
+        "assert(hexdump(base, 0) == '')\n"
+        "assert(raises('size must not be negative', hexdump, base, -1))\n"
+        "assert(raises('buffer, string or address', hexdump, {}))"));
+}
+
+TEST_CASE(PrintNumbers) {
+    CHECK(printed("print(0, -3, 42, math.maxinteger, math.mininteger)") ==
+        "0\t-3\t42\t9223372036854775807\t-9223372036854775808\n");
+    CHECK(printed("print(1.5, 1.0, -0.25, 2^63, 1/0, 0.1)") ==
+        "1.5\t1.0\t-0.25\t9.2233720368547758e+18\tinf\t0.1\n");
+    CHECK(printed("print(3 // 1, 3 / 1)") == "3\t3.0\n");
+}
+
+TEST_CASE(PrintOtherValues) {
+    CHECK(printed("print('text', true, false, nil)") == "text\ttrue\tfalse\tnil\n");
+    CHECK(printed("print()") == "\n");
+    CHECK(printed("print(setmetatable({}, { __tostring = function() return 'object' end }), 1)") ==
+        "object\t1\n");
+    CHECK(printed("print(setmetatable({}, { __name = 'thing' }))").compare(0, 7, "thing: ") == 0);
+    // __tostring runs before the line is built, so its own print comes out first
+    CHECK(printed("print(1, setmetatable({}, { __tostring = function() print('inner', 2.5) return 'outer' end }))") ==
+        "inner\t2.5\n1\touter\n");
+}
+
+RUN_TESTS()
@@ -0,0 +1,219 @@
+// FrameDecoder must give the same result however the stream is split into chunks:
+// each case feeds its frames whole, byte by byte, and at random boundaries
+#include "Check.h"
+
+#include <LudaSocket/wsframe.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+using luda::FrameDecoder;
+using luda::WsOpcode;
+
+// Client frame; masked unless told otherwise, with the shortest length encoding
+static std::string Frame(uint8_t opcode, const std::string& payload, bool fin = true, bool masked = true, uint8_t rsv = 0) {
+    const uint8_t mask[4] = { 0xA5, 0x3C, 0x0F, 0x96 };
+    std::string frame;
+    frame += static_cast<char>((fin ? 0x80 : 0x00) | rsv | opcode);
+    uint8_t maskBit = masked ? 0x80 : 0x00;
+    if (payload.size() < 126) {
+        frame += static_cast<char>(maskBit | payload.size());
+    }
+    else if (payload.size() <= 0xFFFF) {
+        frame += static_cast<char>(maskBit | 126);
+        for (int shift = 8; shift >= 0; shift -= 8) frame += static_cast<char>(payload.size() >> shift);
+    }
+    else {
+        frame += static_cast<char>(maskBit | 127);
+        for (int shift = 56; shift >= 0; shift -= 8) frame += static_cast<char>(static_cast<uint64_t>(payload.size()) >> shift);
+    }
+    if (masked) {
+        frame.append(reinterpret_cast<const char*>(mask), 4);
+    }
+    for (size_t i = 0; i < payload.size(); ++i) {
+        frame += static_cast<char>(masked ? payload[i] ^ mask[i % 4] : payload[i]);
+    }
+    return frame;
+}
+
+static std::string Pattern(size_t size) {
+    std::string text(size, '\0');
+    for (size_t i = 0; i < size; ++i) text[i] = static_cast<char>('a' + i * 7 % 26);
+    return text;
+}
+
+struct Outcome {
+    std::vector<std::pair<WsOpcode, std::string>> messages;
+    FrameDecoder::Result result = FrameDecoder::Result::Ok;
+    uint16_t closeCode = 0;
+};
+
+// Feed `stream` in the given chunk sizes (the last one repeats until the end)
+static Outcome Decode(const std::string& stream, const std::vector<size_t>& chunks, size_t maxMessageSize, bool requireMasked) {
+    FrameDecoder decoder(maxMessageSize);
+    decoder.RequireMasked(requireMasked);
+    Outcome outcome;
+    auto handler = [&](const luda::WsMessage& message) {
+        outcome.messages.emplace_back(message.opcode, std::string(reinterpret_cast<const char*>(message.data), message.size));
+        return true;
+    };
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(stream.data());
+    size_t at = 0;
+    for (size_t i = 0; at < stream.size() && outcome.result == FrameDecoder::Result::Ok; ++i) {
+        size_t take = std::min(chunks[std::min(i, chunks.size() - 1)], stream.size() - at);
+        outcome.result = decoder.Feed(data + at, take, handler);
+        at += take;
+    }
+    outcome.closeCode = decoder.CloseCode();
+    return outcome;
+}
+
+static std::mt19937& rng() {
+    static std::mt19937 generator(20240611);
+    return generator;
+}
+
+// Random chunk sizes, mostly tiny so that headers straddle boundaries, some large
+static std::vector<size_t> RandomChunks(size_t total) {
+    std::vector<size_t> chunks;
+    size_t covered = 0;
+    while (covered < total) {
+        size_t size = rng()() % 4 == 0 ? 1 + rng()() % 4096 : 1 + rng()() % 16;
+        chunks.push_back(size);
+        covered += size;
+    }
+    return chunks;
+}
+
+// Whole, byte by byte, and 50 random splits must all decode to `expected`; sessions decode
+// with RequireMasked, so that is the default here
+static bool DecodesAs(const std::string& stream, const Outcome& expected, size_t maxMessageSize = 1 << 20,
+    bool requireMasked = true) {
+    auto same = [&](const Outcome& outcome) {
+        return outcome.result == expected.result && outcome.closeCode == expected.closeCode && outcome.messages == expected.messages;
+    };
+    if (!same(Decode(stream, { stream.size() }, maxMessageSize, requireMasked)) ||
+        !same(Decode(stream, { 1 }, maxMessageSize, requireMasked))) {
+        return false;
+    }
+    for (int round = 0; round < 50; ++round) {
+        if (!same(Decode(stream, RandomChunks(stream.size()), maxMessageSize, requireMasked))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static Outcome Messages(std::vector<std::pair<WsOpcode, std::string>> messages) {
+    Outcome outcome;
+    outcome.messages = std::move(messages);
+    return outcome;
+}
+
+static Outcome Failure(uint16_t closeCode, std::vector<std::pair<WsOpcode, std::string>> before = {}) {
+    Outcome outcome = Messages(std::move(before));
+    outcome.result = FrameDecoder::Result::Error;
+    outcome.closeCode = closeCode;
+    return outcome;
+}
+
+TEST_CASE(MaskedFramesOfEveryLengthEncoding) {
+    std::string stream;
+    std::vector<std::pair<WsOpcode, std::string>> expected;
+    for (size_t size : { size_t(0), size_t(1), size_t(125), size_t(126), size_t(65535), size_t(65536), size_t(200000) }) {
+        stream += Frame(0x2, Pattern(size));
+        expected.emplace_back(WsOpcode::Binary, Pattern(size));
+    }
+    CHECK(DecodesAs(stream, Messages(expected)));
+}
+
+// Clients must mask every frame (RFC 6455 5.1), control frames and continuations included
+TEST_CASE(UnmaskedFramesAreProtocolErrors) {
+    CHECK(DecodesAs(Frame(0x1, "plain", true, false), Failure(luda::WsCloseProtocolError)));
+    CHECK(DecodesAs(Frame(0x1, "masked") + Frame(0x1, Pattern(300), true, false),
+        Failure(luda::WsCloseProtocolError, { { WsOpcode::Text, "masked" } })));
+    CHECK(DecodesAs(Frame(0x9, "ping", true, false), Failure(luda::WsCloseProtocolError)));
+    CHECK(DecodesAs(Frame(0x2, "first", false) + Frame(0x0, "second", true, false), Failure(luda::WsCloseProtocolError)));
+    // Without RequireMasked they decode like masked ones
+    CHECK(DecodesAs(Frame(0x1, "plain", true, false) + Frame(0x1, Pattern(300), true, false),
+        Messages({ { WsOpcode::Text, "plain" }, { WsOpcode::Text, Pattern(300) } }), 1 << 20, false));
+}
+
+TEST_CASE(FragmentsAreJoined) {
+    std::string text = Pattern(5000);
+    std::string stream = Frame(0x1, text.substr(0, 1), false) + Frame(0x0, text.substr(1, 2999), false) +
+        Frame(0x0, "", false) + Frame(0x0, text.substr(3000));
+    CHECK(DecodesAs(stream, Messages({ { WsOpcode::Text, text } })));
+}
+
+TEST_CASE(ControlFramesBetweenFragments) {
+    std::string stream = Frame(0x2, "first ", false) + Frame(0x9, "ping") + Frame(0x0, "second ", false) +
+        Frame(0xA, "") + Frame(0x0, "third") + Frame(0x8, "\x03\xE8");
+    CHECK(DecodesAs(stream, Messages({ { WsOpcode::Ping, "ping" }, { WsOpcode::Pong, "" },
+        { WsOpcode::Binary, "first second third" }, { WsOpcode::Close, "\x03\xE8" } })));
+}
+
+TEST_CASE(OversizeMessageIsTooBig) {
+    CHECK(DecodesAs(Frame(0x1, Pattern(1024)), Failure(luda::WsCloseTooBig), 1023));
+    CHECK(DecodesAs(Frame(0x1, Pattern(1024)), Messages({ { WsOpcode::Text, Pattern(1024) } }), 1024));
+    // The limit is on the joined message, not on each fragment
+    CHECK(DecodesAs(Frame(0x1, "ok") + Frame(0x1, Pattern(600), false) + Frame(0x0, Pattern(600)),
+        Failure(luda::WsCloseTooBig, { { WsOpcode::Text, "ok" } }), 1000));
+}
+
+TEST_CASE(OversizeControlFrameIsAProtocolError) {
+    CHECK(DecodesAs(Frame(0x9, Pattern(126)), Failure(luda::WsCloseProtocolError)));
+    CHECK(DecodesAs(Frame(0x9, Pattern(125)), Messages({ { WsOpcode::Ping, Pattern(125) } })));
+}
+
+TEST_CASE(FragmentedControlFrameIsAProtocolError) {
+    CHECK(DecodesAs(Frame(0x8, "", false), Failure(luda::WsCloseProtocolError)));
+}
+
+TEST_CASE(InvalidOpcodesAreProtocolErrors) {
+    for (uint8_t opcode : { 0x3, 0x4, 0x5, 0x6, 0x7, 0xB, 0xC, 0xD, 0xE, 0xF }) {
+        CHECK(DecodesAs(Frame(0x1, "before") + Frame(opcode, "x"),
+            Failure(luda::WsCloseProtocolError, { { WsOpcode::Text, "before" } })));
+    }
+}
+
+TEST_CASE(OutOfOrderFragmentsAreProtocolErrors) {
+    CHECK(DecodesAs(Frame(0x0, "orphan"), Failure(luda::WsCloseProtocolError)));
+    CHECK(DecodesAs(Frame(0x1, "open", false) + Frame(0x1, "again"), Failure(luda::WsCloseProtocolError)));
+}
+
+TEST_CASE(ReservedBitsAreProtocolErrors) {
+    CHECK(DecodesAs(Frame(0x1, "x", true, true, 0x40), Failure(luda::WsCloseProtocolError)));
+    CHECK(DecodesAs(Frame(0x1, "x", true, true, 0x20), Failure(luda::WsCloseProtocolError)));
+    CHECK(DecodesAs(Frame(0x1, "x", true, true, 0x10), Failure(luda::WsCloseProtocolError)));
+}
+
+// Frames of random kinds and sizes, then split at random boundaries
+TEST_CASE(RandomStreams) {
+    for (int round = 0; round < 10; ++round) {
+        std::string stream;
+        std::vector<std::pair<WsOpcode, std::string>> expected;
+        for (int message = 0; message < 20; ++message) {
+            std::string payload = Pattern(rng()() % 3 == 0 ? rng()() % 70000 : rng()() % 200);
+            size_t fragments = 1 + rng()() % 4;
+            size_t step = payload.size() / fragments + 1;
+            std::vector<std::pair<WsOpcode, std::string>> controls;
+            for (size_t at = 0, i = 0; i < fragments; at += step, ++i) {
+                bool last = i + 1 == fragments;
+                std::string part = at < payload.size() ? payload.substr(at, last ? std::string::npos : step) : std::string();
+                stream += Frame(i == 0 ? 0x2 : 0x0, part, last);
+                if (!last && rng()() % 2 == 0) {
+                    std::string ping = Pattern(rng()() % 126);
+                    stream += Frame(0x9, ping);
+                    controls.emplace_back(WsOpcode::Ping, ping);
+                }
+            }
+            expected.insert(expected.end(), controls.begin(), controls.end());
+            expected.emplace_back(WsOpcode::Binary, payload);
+        }
+        CHECK(DecodesAs(stream, Messages(expected)));
+    }
+}
+
+RUN_TESTS()
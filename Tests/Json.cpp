@@ -0,0 +1,195 @@
+// The request parser against RFC 8259: escapes, surrogate pairs, the nesting limit,
+// numbers, and input cut off anywhere
+#include "Check.h"
+
+#include <LudaSocket/json.h>
+
+#include <cstring>
+#include <string>
+
+using luda::json::ParseError;
+
+// Every event as text, so a document's parse can be compared in one string
+class Recorder : public luda::json::Handler {
+public:
+    std::string events;
+
+    bool Null() override { events += "null "; return true; }
+    bool Bool(bool value) override { events += value ? "true " : "false "; return true; }
+    bool Number(std::string_view text) override { events += "n:" + std::string(text) + " "; return true; }
+    bool String(std::string_view text) override { events += "s:" + std::string(text) + " "; return true; }
+    bool Key(std::string_view text) override { events += "k:" + std::string(text) + " "; return true; }
+    bool StartObject() override { events += "{ "; return true; }
+    bool EndObject() override { events += "} "; return true; }
+    bool StartArray() override { events += "[ "; return true; }
+    bool EndArray() override { events += "] "; return true; }
+};
+
+// Events of a document that must parse, "<error>" if it doesn't
+static std::string Events(std::string_view text) {
+    Recorder recorder;
+    return luda::json::Parse(text, recorder) ? recorder.events : "<error>";
+}
+
+// The single string a document decodes to
+static std::string Decoded(std::string_view text) {
+    std::string events = Events(text);
+    if (events.compare(0, 2, "s:") != 0) return "<error>";
+    return events.substr(2, events.size() - 3);
+}
+
+// Error message of a document that must not parse, nullptr if it parsed
+static const char* Rejection(std::string_view text, size_t* offset = nullptr) {
+    Recorder recorder;
+    ParseError error;
+    if (luda::json::Parse(text, recorder, &error)) return nullptr;
+    if (offset) *offset = error.offset;
+    return error.message;
+}
+
+static bool RejectedWith(std::string_view text, const char* message) {
+    const char* actual = Rejection(text);
+    return actual != nullptr && strcmp(actual, message) == 0;
+}
+
+TEST_CASE(SimpleEscapes) {
+    CHECK(Decoded(R"("\" \\ \/ \b \f \n \r \t")") == "\" \\ / \b \f \n \r \t");
+    CHECK(Decoded(R"("plain")") == "plain");
+    CHECK(Decoded(R"("")") == "");
+    CHECK(Decoded(R"("a long run of plain text before \n the escape and after it")") ==
+        "a long run of plain text before \n the escape and after it");
+}
+
+TEST_CASE(InvalidEscapes) {
+    CHECK(RejectedWith(R"("\x41")", "invalid escape"));
+    CHECK(RejectedWith(R"("\a")", "invalid escape"));
+    CHECK(RejectedWith(R"("\U0041")", "invalid escape"));
+    CHECK(RejectedWith(R"("\u00G1")", "invalid \\u escape"));
+    CHECK(RejectedWith(R"("\u-001")", "invalid \\u escape"));
+    CHECK(RejectedWith("\"tab\there\"", "control character in string"));
+    CHECK(RejectedWith(std::string_view("\"nul\0here\"", 10), "control character in string"));
+    CHECK(RejectedWith("\"line\nbreak\"", "control character in string"));
+}
+
+TEST_CASE(UnicodeEscapesBecomeUtf8) {
+    CHECK(Decoded(R"("\u0041")") == "A");
+    CHECK(Decoded(R"("\u0000")") == std::string(1, '\0'));
+    CHECK(Decoded(R"("\u00e9\u00E9")") == "\xC3\xA9\xC3\xA9");
+    CHECK(Decoded(R"("\u07FF")") == "\xDF\xBF");
+    CHECK(Decoded(R"("\u0800")") == "\xE0\xA0\x80");
+    CHECK(Decoded(R"("\u20AC")") == "\xE2\x82\xAC");
+    CHECK(Decoded(R"("\uFFFF")") == "\xEF\xBF\xBF");
+    // UTF-8 in the input is passed through as is
+    CHECK(Decoded("\"\xE2\x82\xAC\"") == "\xE2\x82\xAC");
+}
+
+TEST_CASE(SurrogatePairs) {
+    CHECK(Decoded(R"("\uD83D\uDE00")") == "\xF0\x9F\x98\x80");
+    CHECK(Decoded(R"("\ud800\udc00")") == "\xF0\x90\x80\x80");
+    CHECK(Decoded(R"("\uDBFF\uDFFF")") == "\xF4\x8F\xBF\xBF");
+    CHECK(Decoded(R"("x\uD83D\uDE00y")") == "x\xF0\x9F\x98\x80y");
+}
+
+TEST_CASE(UnpairedSurrogates) {
+    CHECK(RejectedWith(R"("\uD83D")", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uD83Dx")", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uD83D\n")", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uD83D\uD83D")", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uD83DA")", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uDE00")", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uDE00\uD83D")", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uD83D\uDE0")", "invalid \\u escape"));
+}
+
+TEST_CASE(EscapeRoundTrip) {
+    std::string every;
+    for (int c = 0; c < 256; ++c) every += static_cast<char>(c);
+    CHECK(Decoded("\"" + luda::json::Escape(every) + "\"") == every);
+    CHECK(luda::json::Escape("a\"b\\c\x01") == "a\\\"b\\\\c\\u0001");
+}
+
+TEST_CASE(NestingLimit) {
+    auto nested = [](int depth, const char* open, const char* close) {
+        std::string text;
+        for (int i = 0; i < depth; ++i) text += open;
+        text += "1";
+        for (int i = 0; i < depth; ++i) text += close;
+        return text;
+    };
+    CHECK(Events(nested(128, "[", "]")) != "<error>");
+    CHECK(RejectedWith(nested(129, "[", "]"), "nesting too deep"));
+    CHECK(Events(nested(128, "{\"k\":", "}")) != "<error>");
+    CHECK(RejectedWith(nested(129, "{\"k\":", "}"), "nesting too deep"));
+    // Objects and arrays count alike
+    CHECK(Events(nested(64, "[{\"k\":", "}]")) != "<error>");
+    CHECK(RejectedWith(nested(64, "[{\"k\":", "}]").insert(0, "["), "nesting too deep"));
+    // A deep document far past the limit fails cleanly instead of exhausting the stack
+    CHECK(RejectedWith(std::string(100000, '['), "nesting too deep"));
+}
+
+TEST_CASE(Numbers) {
+    CHECK(Events("[0,-0,12,-3.25,1e9,2E-3,6.02e+23]") == "[ n:0 n:-0 n:12 n:-3.25 n:1e9 n:2E-3 n:6.02e+23 ] ");
+    CHECK(RejectedWith("01", "unexpected data after the document"));
+    CHECK(RejectedWith("-", "invalid value"));
+    CHECK(RejectedWith("+1", "invalid value"));
+    CHECK(RejectedWith(".5", "invalid value"));
+    CHECK(RejectedWith("1.", "invalid number"));
+    CHECK(RejectedWith("1.e3", "invalid number"));
+    CHECK(RejectedWith("1e", "invalid number"));
+    CHECK(RejectedWith("1e+", "invalid number"));
+
+    int64_t value = 0;
+    CHECK(luda::json::ToInteger("-9223372036854775808", value) && value == INT64_MIN);
+    CHECK(!luda::json::ToInteger("9223372036854775808", value));
+    CHECK(!luda::json::ToInteger("1.5", value));
+    CHECK(!luda::json::ToInteger("1e3", value));
+}
+
+TEST_CASE(Structure) {
+    CHECK(Events(" { \"a\" : [ true , false , null ] , \"b\" : { } , \"c\" : [ ] } ") ==
+        "{ k:a [ true false null ] k:b { } k:c [ ] } ");
+    CHECK(RejectedWith("", "unexpected end of input"));
+    CHECK(RejectedWith("   ", "unexpected end of input"));
+    CHECK(RejectedWith("[1,]", "invalid value"));
+    CHECK(RejectedWith("[1 2]", "expected ',' or ']'"));
+    CHECK(RejectedWith("{\"a\" 1}", "expected ':'"));
+    CHECK(RejectedWith("{\"a\":1,}", "expected a key"));
+    CHECK(RejectedWith("{a:1}", "expected a key"));
+    CHECK(RejectedWith("{\"a\":1 \"b\":2}", "expected ',' or '}'"));
+    CHECK(RejectedWith("tru", "invalid literal"));
+    CHECK(RejectedWith("nul", "invalid literal"));
+    CHECK(RejectedWith("{} {}", "unexpected data after the document"));
+}
+
+// Every proper prefix of a document is an error, reported at or before where the input ends
+TEST_CASE(TruncatedInput) {
+    const std::string document =
+        R"({"type":"execute","id":-12.5e3,"ok":[true,false,null],)"
+        R"("script":"print(\"x\")\n\u00e9\uD83D\uDE00","options":{"gc":"batch"}})";
+    CHECK(Events(document) != "<error>");
+    for (size_t length = 0; length < document.size(); ++length) {
+        size_t offset = 0;
+        const char* message = Rejection(std::string_view(document).substr(0, length), &offset);
+        CHECK(message != nullptr);
+        CHECK(offset <= length);
+    }
+    CHECK(RejectedWith(R"("abc)", "unterminated string"));
+    CHECK(RejectedWith(R"("abc\)", "unterminated string"));
+    CHECK(RejectedWith(R"("abc\u12)", "truncated \\u escape"));
+    CHECK(RejectedWith(R"("\uD83D\)", "unpaired surrogate"));
+    CHECK(RejectedWith(R"("\uD83D\uDE)", "truncated \\u escape"));
+}
+
+TEST_CASE(HandlerCanStop) {
+    class StopAtKey : public luda::json::Handler {
+    public:
+        bool Key(std::string_view key) override { return key != "stop"; }
+    };
+    StopAtKey handler;
+    ParseError error;
+    CHECK(luda::json::Parse(R"({"go":1})", handler, &error));
+    CHECK(!luda::json::Parse(R"({"go":1,"stop":2})", handler, &error));
+    CHECK(strcmp(error.message, "rejected by handler") == 0);
+}
+
+RUN_TESTS()
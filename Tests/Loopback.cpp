@@ -0,0 +1,539 @@
+// The server end to end over a loopback connection: the WebSocket handshake, a script
+// round trip, the close handshake, the close codes of streams it rejects, and plain HTTP
+// requests on the same port
+#include "Check.h"
+
+#include <LudaSocket/ludasocket.h>
+#include <LudaSocket/platform.h>
+#include <LudaSocket/wsframe.h>
+
+#include <sys/time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// `size` letters and digits in a pattern that doesn't repeat at any power of two
+static std::string Pattern(size_t size) {
+    static const char kChars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    std::string text(size, ' ');
+    for (size_t i = 0; i < size; ++i) text[i] = kChars[(i * 7 + i / 4093) % 36];
+    return text;
+}
+
+// Stands in for the executor: "echo <text>" sends <text> back as output before the result,
+// "print <n>" prints the lines "1" to "<n>", "result <n>" succeeds with Pattern(n), any
+// other script just succeeds
+static void RunJob(const luda::Job& job) {
+    const std::string& script = job.scripts.front();
+    if (script.compare(0, 7, "result ") == 0) {
+        luda::SendSuccess(Pattern(std::stoul(script.substr(7))));
+        return;
+    }
+    if (script.compare(0, 5, "echo ") == 0) {
+        luda::SendOutput("out " + script.substr(5));
+    }
+    else if (script.compare(0, 6, "print ") == 0) {
+        int lines = std::stoi(script.substr(6));
+        for (int i = 1; i <= lines; ++i) {
+            luda::SendPrint(std::to_string(i));
+        }
+    }
+    luda::SendSuccess("ran " + script);
+}
+
+// Port the server is listening on, started once for all cases; 0 if no port was free
+static uint16_t port() {
+    static uint16_t port = [] {
+        luda::SetScriptCallback(RunJob);
+        for (uint16_t candidate = 18180; candidate < 18212; ++candidate) {
+            if (luda::Start(candidate)) return candidate;
+        }
+        return uint16_t(0);
+    }();
+    return port;
+}
+
+// Poll `condition` for up to two seconds
+template <typename Condition>
+static bool eventually(Condition condition) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// A raw client socket; every receive gives up after two seconds instead of hanging the test
+class Client {
+public:
+    Client() {
+        m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        timeval timeout = { 2, 0 };
+        setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+            closesocket(m_socket);
+            m_socket = INVALID_SOCKET;
+        }
+    }
+
+    ~Client() {
+        if (m_socket != INVALID_SOCKET) closesocket(m_socket);
+    }
+
+    bool Connected() const { return m_socket != INVALID_SOCKET; }
+
+    void SendRaw(const std::string& data) { luda::net::Send(m_socket, data.data(), data.size()); }
+
+    // Response head up to the blank line, empty if the server hung up first
+    std::string ReadHead() {
+        std::string head;
+        char c;
+        while (head.find("\r\n\r\n") == std::string::npos && luda::net::Recv(m_socket, &c, 1) == 1) {
+            head += c;
+        }
+        return head.find("\r\n\r\n") == std::string::npos ? std::string() : head;
+    }
+
+    // Head and Content-Length body of the next HTTP response, empty on timeout or hang-up
+    std::string ReadResponse() {
+        std::string head = ReadHead();
+        size_t at = head.find("Content-Length: ");
+        if (at == std::string::npos) return head;
+        std::string body(std::stoul(head.substr(at + 16)), '\0');
+        return body.empty() || ReadExactly(&body[0], body.size()) ? head + body : std::string();
+    }
+
+    // Upgrade with the RFC 6455 sample key, then read the "session" greeting; Session() is
+    // the id it gave
+    std::string Handshake() {
+        SendRaw("GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+        std::string head = ReadHead();
+        uint8_t opcode = 0;
+        std::string greeting;
+        if (!ReadFrame(opcode, greeting) || opcode != 0x1 || greeting.find("\"session\"") == std::string::npos) {
+            return std::string();
+        }
+        size_t data = greeting.find("\"data\":\"");
+        m_session = data == std::string::npos ? std::string() : greeting.substr(data + 8, greeting.find('"', data + 8) - data - 8);
+        return head;
+    }
+
+    const std::string& Session() const { return m_session; }
+
+    // From now on take at most `chunk` bytes per receive and pause after each one
+    void ReadSlowly(size_t chunk) { m_chunk = chunk; }
+
+    // One client frame: FIN set, masked as clients must
+    void SendFrame(uint8_t opcode, const std::string& payload, bool fin = true) {
+        const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+        std::string frame;
+        frame += static_cast<char>((fin ? 0x80 : 0x00) | opcode);
+        if (payload.size() < 126) {
+            frame += static_cast<char>(0x80 | payload.size());
+        }
+        else {
+            frame += static_cast<char>(0x80 | 126);
+            frame += static_cast<char>(payload.size() >> 8);
+            frame += static_cast<char>(payload.size() & 0xFF);
+        }
+        frame.append(reinterpret_cast<const char*>(mask), 4);
+        for (size_t i = 0; i < payload.size(); ++i) {
+            frame += static_cast<char>(payload[i] ^ mask[i % 4]);
+        }
+        SendRaw(frame);
+    }
+
+    // Next server frame, which is never masked; false on timeout or hang-up
+    bool ReadFrame(uint8_t& opcode, std::string& payload) {
+        uint8_t head[2];
+        if (!ReadExactly(head, 2)) return false;
+        opcode = head[0] & 0x0F;
+        uint64_t length = head[1] & 0x7F;
+        if (length >= 126) {
+            uint8_t extended[8];
+            size_t size = length == 126 ? 2 : 8;
+            if (!ReadExactly(extended, size)) return false;
+            length = 0;
+            for (size_t i = 0; i < size; ++i) length = (length << 8) | extended[i];
+        }
+        payload.resize(static_cast<size_t>(length));
+        return length == 0 || ReadExactly(&payload[0], payload.size());
+    }
+
+    // Status code of the close frame the server answers with, 0 if it sends none
+    uint16_t ReadClose() {
+        uint8_t opcode = 0;
+        std::string payload;
+        while (ReadFrame(opcode, payload)) {
+            if (opcode == 0x8) {
+                return payload.size() < 2 ? 0 : static_cast<uint16_t>(
+                    (static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]));
+            }
+        }
+        return 0;
+    }
+
+    // Skip whatever is left to read; true if the server then closed its end
+    bool HungUp() {
+        char buffer[256];
+        int n;
+        while ((n = luda::net::Recv(m_socket, buffer, sizeof(buffer))) > 0) {}
+        return n == 0;
+    }
+
+private:
+    bool ReadExactly(void* data, size_t size) {
+        char* at = static_cast<char*>(data);
+        while (size > 0) {
+            if (m_chunk != 0) std::this_thread::sleep_for(std::chrono::microseconds(500));
+            int n = luda::net::Recv(m_socket, at, m_chunk != 0 ? std::min(size, m_chunk) : size);
+            if (n <= 0) return false;
+            at += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    SOCKET m_socket;
+    std::string m_session;
+    size_t m_chunk = 0;
+};
+
+TEST_CASE(ServerStarts) {
+    CHECK(port() != 0);
+    CHECK(luda::IsRunning());
+}
+
+TEST_CASE(HandshakeAcceptsTheKey) {
+    Client client;
+    CHECK(client.Connected());
+    std::string head = client.Handshake();
+    CHECK(head.compare(0, 12, "HTTP/1.1 101") == 0);
+    CHECK(head.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos);
+    CHECK(eventually([] { return luda::SessionCount() == 1; }));
+}
+
+TEST_CASE(ScriptRoundTrip) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    client.SendFrame(0x1, "{\"type\":\"execute\",\"id\":7,\"script\":\"return 1\"}");
+
+    // The job thread may report before the receipt goes out
+    uint8_t opcode = 0;
+    std::string first, second;
+    CHECK(client.ReadFrame(opcode, first) && opcode == 0x1);
+    CHECK(client.ReadFrame(opcode, second) && opcode == 0x1);
+    const std::string& queued = first.find("\"type\":\"queued\"") != std::string::npos ? first : second;
+    const std::string& success = &queued == &first ? second : first;
+    CHECK(queued.find("\"type\":\"queued\"") != std::string::npos);
+    CHECK(queued.find("\"request\":7") != std::string::npos);
+    CHECK(success.find("\"type\":\"success\"") != std::string::npos);
+    CHECK(success.find("\"data\":\"ran return 1\"") != std::string::npos);
+    CHECK(success.find("\"request\":7") != std::string::npos);
+}
+
+TEST_CASE(MalformedJsonGetsAnError) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    client.SendFrame(0x1, "{\"type\":\"execute\",");
+    uint8_t opcode = 0;
+    std::string reply;
+    CHECK(client.ReadFrame(opcode, reply) && opcode == 0x1);
+    CHECK(reply.find("\"type\":\"error\"") != std::string::npos);
+    CHECK(reply.find("bad request") != std::string::npos);
+}
+
+TEST_CASE(PingGetsPong) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    client.SendFrame(0x9, "are you there");
+    uint8_t opcode = 0;
+    std::string payload;
+    CHECK(client.ReadFrame(opcode, payload));
+    CHECK(opcode == 0xA && payload == "are you there");
+}
+
+// An upgrade without a key is no WebSocket handshake: plain HTTP, and "/" isn't a route
+TEST_CASE(HandshakeWithoutKeyIsRejected) {
+    Client client;
+    client.SendRaw("GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Version: 13\r\nConnection: close\r\n\r\n");
+    CHECK(client.ReadHead().compare(0, 12, "HTTP/1.1 404") == 0);
+    CHECK(luda::SessionCount() == 0);
+}
+
+TEST_CASE(MalformedRequestLineIsRejected) {
+    Client client;
+    client.SendRaw("NONSENSE\r\n\r\n");
+    CHECK(client.ReadHead().compare(0, 12, "HTTP/1.1 400") == 0);
+    CHECK(client.HungUp());
+}
+
+TEST_CASE(CloseIsAnsweredAndDropsTheSession) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    CHECK(eventually([] { return luda::SessionCount() == 1; }));
+    client.SendFrame(0x8, std::string("\x03\xE8", 2));
+    CHECK(client.ReadClose() == luda::WsCloseNormal);
+    CHECK(client.HungUp());
+    CHECK(eventually([] { return luda::SessionCount() == 0; }));
+}
+
+TEST_CASE(UnknownOpcodeIsAProtocolError) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    client.SendFrame(0x3, "x");
+    CHECK(client.ReadClose() == luda::WsCloseProtocolError);
+    CHECK(client.HungUp());
+    CHECK(eventually([] { return luda::SessionCount() == 0; }));
+}
+
+TEST_CASE(FragmentedControlFrameIsAProtocolError) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    client.SendFrame(0x9, "ping", false);
+    CHECK(client.ReadClose() == luda::WsCloseProtocolError);
+    CHECK(client.HungUp());
+}
+
+TEST_CASE(ContinuationWithoutMessageIsAProtocolError) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    client.SendFrame(0x0, "orphan");
+    CHECK(client.ReadClose() == luda::WsCloseProtocolError);
+    CHECK(client.HungUp());
+}
+
+TEST_CASE(UnmaskedFrameIsAProtocolError) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    client.SendRaw(std::string("\x81\x05hello", 7));
+    CHECK(client.ReadClose() == luda::WsCloseProtocolError);
+    CHECK(client.HungUp());
+}
+
+// Frames until `client` has the result of its own job and the start and end of `jobs` jobs
+static std::vector<std::string> ReadJobFrames(Client& client, int jobs) {
+    std::vector<std::string> frames;
+    int events = 0;
+    bool done = false;
+    uint8_t opcode = 0;
+    std::string payload;
+    while ((events < 2 * jobs || !done) && client.ReadFrame(opcode, payload)) {
+        if (payload.find("\"channel\":\"jobs\"") != std::string::npos) events++;
+        if (payload.find("\"type\":\"success\"") != std::string::npos) done = true;
+        frames.push_back(payload);
+    }
+    return frames;
+}
+
+static size_t CountContaining(const std::vector<std::string>& frames, const std::string& text) {
+    size_t count = 0;
+    for (const std::string& frame : frames) {
+        if (frame.find(text) != std::string::npos) count++;
+    }
+    return count;
+}
+
+// Two sessions at once: a job's output and result go to the session that sent it, while
+// every subscriber to "jobs" hears about both jobs
+TEST_CASE(SessionsOnlyGetTheirOwnJobs) {
+    Client a, b;
+    CHECK(!a.Handshake().empty() && !b.Handshake().empty());
+    CHECK(a.Session() != b.Session());
+    for (Client* client : { &a, &b }) {
+        client->SendFrame(0x1, "{\"type\":\"subscribe\",\"channel\":\"jobs\"}");
+        // Answered after the subscription, so it is in place before either job starts
+        client->SendFrame(0x9, "sync");
+        uint8_t opcode = 0;
+        std::string payload;
+        CHECK(client->ReadFrame(opcode, payload) && opcode == 0xA);
+    }
+    a.SendFrame(0x1, "{\"type\":\"execute\",\"id\":1,\"script\":\"echo from-a\"}");
+    b.SendFrame(0x1, "{\"type\":\"execute\",\"id\":2,\"script\":\"echo from-b\"}");
+
+    std::vector<std::string> framesA = ReadJobFrames(a, 2);
+    std::vector<std::string> framesB = ReadJobFrames(b, 2);
+    CHECK(CountContaining(framesA, "{\"type\":\"output\",\"data\":\"out from-a\"") == 1);
+    CHECK(CountContaining(framesA, "{\"type\":\"success\",\"data\":\"ran echo from-a\"") == 1);
+    CHECK(CountContaining(framesB, "{\"type\":\"output\",\"data\":\"out from-b\"") == 1);
+    CHECK(CountContaining(framesB, "{\"type\":\"success\",\"data\":\"ran echo from-b\"") == 1);
+    CHECK(CountContaining(framesA, "from-b") == 0);
+    CHECK(CountContaining(framesB, "from-a") == 0);
+    for (const auto& frames : { framesA, framesB }) {
+        for (const Client* sender : { &a, &b }) {
+            std::string session = "\"session\":" + sender->Session() + ",";
+            CHECK(CountContaining(frames, "\"channel\":\"jobs\",\"data\":\"started\"," + session) == 1);
+            CHECK(CountContaining(frames, "\"channel\":\"jobs\",\"data\":\"finished\"," + session) == 1);
+        }
+    }
+}
+
+// Prints are batched: far fewer frames than lines, every line there once and in order
+TEST_CASE(PrintsArriveBatched) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    const int lines = 100000;
+    client.SendFrame(0x1, "{\"type\":\"execute\",\"script\":\"print " + std::to_string(lines) + "\"}");
+
+    const std::string prefix = "{\"type\":\"print\",\"data\":\"";
+    std::string printed;
+    size_t frames = 0;
+    uint8_t opcode = 0;
+    std::string payload;
+    while (client.ReadFrame(opcode, payload) && payload.find("\"type\":\"success\"") == std::string::npos) {
+        if (payload.compare(0, prefix.size(), prefix) != 0) continue;
+        // Lines are digits, so the only escapes are the "\n" between them
+        if (!printed.empty()) printed += '\n';
+        for (size_t at = prefix.size(); at < payload.size() && payload[at] != '"'; ++at) {
+            if (payload[at] == '\\') {
+                printed += '\n';
+                ++at;
+            }
+            else {
+                printed += payload[at];
+            }
+        }
+        frames++;
+    }
+    CHECK(payload.find("\"type\":\"success\"") != std::string::npos);
+    CHECK(frames > 0 && frames < 1000);
+
+    std::string expected;
+    for (int i = 1; i <= lines; ++i) {
+        if (i > 1) expected += '\n';
+        expected += std::to_string(i);
+    }
+    CHECK(printed == expected);
+}
+
+// A result of several MB, more than the server queues for one client, still arrives whole
+// at a client that reads it a little at a time
+TEST_CASE(LargeResultReachesASlowReader) {
+    Client client;
+    CHECK(!client.Handshake().empty());
+    const size_t size = 6 * 1024 * 1024;
+    client.SendFrame(0x1, "{\"type\":\"execute\",\"script\":\"result " + std::to_string(size) + "\"}");
+    client.ReadSlowly(8 * 1024);
+
+    uint8_t opcode = 0;
+    std::string payload;
+    while (client.ReadFrame(opcode, payload) && payload.find("\"type\":\"success\"") == std::string::npos) {}
+    const std::string prefix = "{\"type\":\"success\",\"data\":\"";
+    CHECK(payload.compare(0, prefix.size(), prefix) == 0);
+    CHECK(payload.size() > prefix.size() + size && payload.compare(prefix.size(), size, Pattern(size)) == 0);
+    CHECK(payload.compare(prefix.size() + size, 8, "\",\"job\":") == 0);
+}
+
+// Past 64 connections the server hangs up on new ones, until one of them goes away
+TEST_CASE(SixtyFifthConnectionIsRefused) {
+    CHECK(eventually([] { return luda::SessionCount() == 0; }));
+    std::vector<std::unique_ptr<Client>> clients;
+    for (int i = 0; i < 64; ++i) {
+        clients.push_back(std::make_unique<Client>());
+        CHECK(!clients.back()->Handshake().empty());
+    }
+    CHECK(luda::SessionCount() == 64);
+
+    Client refused;
+    CHECK(refused.Handshake().empty());
+    CHECK(refused.HungUp());
+
+    clients.pop_back();
+    CHECK(eventually([] { return luda::SessionCount() == 63; }));
+    Client admitted;
+    CHECK(!admitted.Handshake().empty());
+}
+
+// Plain HTTP on the same port: POST /run answers once the job has run
+TEST_CASE(HttpRunReturnsTheResult) {
+    Client client;
+    client.SendRaw("POST /run HTTP/1.1\r\nHost: localhost\r\nContent-Length: 8\r\n\r\nreturn 1");
+    std::string response = client.ReadResponse();
+    CHECK(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(response.find("Connection: keep-alive\r\n") != std::string::npos);
+    CHECK(response.find("\"ok\":true") != std::string::npos);
+    CHECK(response.find("\"data\":\"ran return 1\"") != std::string::npos);
+}
+
+TEST_CASE(HttpStatus) {
+    Client client;
+    client.SendRaw("GET /status HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+    std::string response = client.ReadResponse();
+    CHECK(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(response.find("\r\n\r\n{\"sessions\":") != std::string::npos);
+    CHECK(response.find("\"queued\":0,\"running\":") != std::string::npos);
+    CHECK(client.HungUp());
+}
+
+// Requests sent together on one keep-alive connection are answered in order, the status
+// between the two runs waiting for the first one's reply
+TEST_CASE(HttpPipelinedRequestsAnswerInOrder) {
+    Client client;
+    client.SendRaw(
+        "POST /run HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nfirst"
+        "GET /status HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        "POST /run HTTP/1.1\r\nHost: localhost\r\nContent-Length: 6\r\n\r\nsecond");
+    std::string first = client.ReadResponse();
+    std::string status = client.ReadResponse();
+    std::string second = client.ReadResponse();
+    CHECK(first.find("\"data\":\"ran first\"") != std::string::npos);
+    CHECK(status.find("{\"sessions\":") != std::string::npos);
+    CHECK(second.find("\"data\":\"ran second\"") != std::string::npos);
+
+    // The connection stays usable
+    client.SendRaw("POST /run HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nthird");
+    CHECK(client.ReadResponse().find("\"data\":\"ran third\"") != std::string::npos);
+}
+
+TEST_CASE(HttpRequestSplitAcrossSends) {
+    Client client;
+    for (const char* part : { "POST /ru", "n HTTP/1.1\r\nHost: localhost\r\nContent-Len", "gth: 9\r\n\r",
+             "\nreturn", " 42" }) {
+        client.SendRaw(part);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    std::string response = client.ReadResponse();
+    CHECK(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(response.find("\"data\":\"ran return 42\"") != std::string::npos);
+}
+
+// The client waits for 100 Continue before sending the body
+TEST_CASE(HttpExpectContinue) {
+    Client client;
+    client.SendRaw("POST /run HTTP/1.1\r\nHost: localhost\r\nExpect: 100-continue\r\nContent-Length: 8\r\n\r\n");
+    CHECK(client.ReadHead() == "HTTP/1.1 100 Continue\r\n\r\n");
+    client.SendRaw("return 7");
+    std::string response = client.ReadResponse();
+    CHECK(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(response.find("\"data\":\"ran return 7\"") != std::string::npos);
+}
+
+TEST_CASE(HttpChunkedBodyNeedsALength) {
+    Client client;
+    client.SendRaw("POST /run HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n8\r\nreturn 1\r\n0\r\n\r\n");
+    std::string response = client.ReadResponse();
+    CHECK(response.compare(0, 12, "HTTP/1.1 411") == 0);
+    CHECK(response.find("send Content-Length") != std::string::npos);
+    CHECK(client.HungUp());
+}
+
+TEST_CASE(ServerStops) {
+    luda::Stop();
+    CHECK(!luda::IsRunning());
+    Client client;
+    CHECK(!client.Connected());
+}
+
+RUN_TESTS()
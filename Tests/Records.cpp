@@ -0,0 +1,289 @@
+// Columnar record blocks on a bare Lua state: rows, lists and nested records read back
+// from their columns, the block methods, and the MessagePack luda.emit sends for a block
+#include "Check.h"
+
+#include <Executor/Libraries/records.hpp>
+#include <Executor/Libraries/channel.hpp>
+
+#include <string>
+
+namespace test {
+
+    struct Operand {
+        std::string text;
+        int64_t value;
+    };
+
+    struct Row {
+        ea_t ea;
+        std::string name;
+        std::optional<int64_t> size;       // missing on every third row
+        std::optional<std::string> comment; // only on even rows
+        double weight;
+        bool thunk;
+        std::vector<ea_t> callers;          // i callers on row i
+        std::vector<Operand> operands;      // two per row
+        Operand target;
+    };
+
+    struct Pair {
+        ea_t ea;
+        std::optional<std::string> name;
+    };
+
+} // namespace test
+
+template <>
+struct LUDA::Library::record_fields<test::Operand> {
+    static constexpr auto fields = std::make_tuple(
+        field("text", &test::Operand::text),
+        field("value", &test::Operand::value));
+};
+
+template <>
+struct LUDA::Library::record_fields<test::Row> {
+    static constexpr auto fields = std::make_tuple(
+        field("ea", &test::Row::ea),
+        field("name", &test::Row::name),
+        field("size", &test::Row::size),
+        field("comment", &test::Row::comment),
+        field("weight", &test::Row::weight),
+        field("thunk", &test::Row::thunk),
+        field("callers", &test::Row::callers),
+        field("operands", &test::Row::operands),
+        field("target", &test::Row::target));
+};
+
+template <>
+struct LUDA::Library::record_fields<test::Pair> {
+    static constexpr auto fields = std::make_tuple(
+        field("ea", &test::Pair::ea),
+        field("name", &test::Pair::name));
+};
+
+// rows(n): row i (from 0) at 0x1000 + 16i, with everything derived from i
+static LUDA::Library::Records<test::Row> rows(int count) {
+    LUDA::Library::Records<test::Row> out;
+    for (int i = 0; i < count; ++i) {
+        test::Row row;
+        row.ea = 0x1000 + 16 * i;
+        row.name = "sub_" + std::to_string(i);
+        if (i % 3 != 0) row.size = i * 4;
+        if (i % 2 == 0) row.comment = "even " + std::to_string(i);
+        row.weight = i + 0.5;
+        row.thunk = i % 5 == 0;
+        for (int c = 0; c < i; ++c) row.callers.push_back(0x9000 + c);
+        row.operands = { { "op" + std::to_string(i), i }, { "imm", -i } };
+        row.target = { "target" + std::to_string(i), 1000 + i };
+        out.push_back(std::move(row));
+    }
+    return out;
+}
+
+static LUDA::Library::Records<test::Pair> pairs() {
+    return { { 1, std::string("a") }, { 2, std::nullopt } };
+}
+
+// emitted() -> the MessagePack bytes of the last luda.emit; with no server it delivers
+// nothing but keeps what it encoded
+static int emitted(lua_State* L) {
+    const std::vector<uint8_t>& out = LUDA::Library::emit_buffer();
+    lua_pushlstring(L, reinterpret_cast<const char*>(out.data()), out.size());
+    return 1;
+}
+
+static void set_field(lua_State* L, const char* table, const char* name, lua_CFunction fn) {
+    if (lua_getglobal(L, table) == LUA_TNIL) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setglobal(L, table);
+    }
+    lua_pushcfunction(L, fn);
+    lua_setfield(L, -2, name);
+    lua_pop(L, 1);
+}
+
+// A bare state with the libraries blocks work with, registered as the executor does
+static lua_State* state() {
+    static lua_State* L = [] {
+        lua_State* created = luaL_newstate();
+        luaL_openlibs(created);
+        LUDA::Library::register_buffer_type(created);
+        LUDA::Library::register_array_type(created);
+        LUDA::Library::register_records_type(created);
+        set_field(created, "buffer", "new", LUDA::Library::c_buffer_new);
+        set_field(created, "buffer", "from", LUDA::Library::c_buffer_from);
+        set_field(created, "luda", "u64array", LUDA::Library::c_u64array_new);
+        set_field(created, "luda", "u32array", LUDA::Library::c_u32array_new);
+        set_field(created, "luda", "u8array", LUDA::Library::c_u8array_new);
+        set_field(created, "luda", "send", LUDA::Library::c_send);
+        set_field(created, "luda", "emit", LUDA::Library::c_emit);
+        LUDA::Library::push_binding<&rows>(created);
+        lua_setglobal(created, "rows");
+        LUDA::Library::push_binding<&pairs>(created);
+        lua_setglobal(created, "pairs_block");
+        lua_pushcfunction(created, emitted);
+        lua_setglobal(created, "emitted");
+        return created;
+    }();
+    return L;
+}
+
+static const std::string kHelpers = R"(
+local function encode(value)
+  local delivered, size = luda.emit(value)
+  local bytes = emitted()
+  assert(not delivered and size == #bytes)
+  return bytes
+end
+local function raises(pattern, f, ...)
+  local ok, err = pcall(f, ...)
+  return not ok and tostring(err):find(pattern, 1, true) ~= nil
+end
+)";
+
+// Runs `script`, printing its error if it raises one
+static bool run(const std::string& script) {
+    lua_State* L = state();
+    if (luaL_dostring(L, (kHelpers + script).c_str()) != LUA_OK) {
+        printf("%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+TEST_CASE(LengthAndRows) {
+    CHECK(run(
+        "local r = rows(30)\n"
+        "assert(#r == 30 and tostring(r) == 'records: 30 rows')\n"
+        "assert(r[0] == nil and r[31] == nil and r[-1] == nil and r[1.5] == nil and r.nosuch == nil)\n"
+        "local row = r[8]\n"
+        "assert(row.ea == 0x1000 + 16 * 7 and row.name == 'sub_7' and row.size == 28)\n"
+        "assert(row.comment == nil and r[9].comment == 'even 8')\n"
+        "assert(row.weight == 7.5 and math.type(row.weight) == 'float')\n"
+        "assert(row.thunk == false and r[6].thunk == true)\n"
+        "assert(row.nosuch == nil and row[1] == nil)\n"
+        "assert(tostring(row):find('record: row 8 of', 1, true))\n"
+        "assert(#rows(0) == 0 and rows(0)[1] == nil)"));
+}
+
+TEST_CASE(OptionalFieldsReadAsNil) {
+    CHECK(run(
+        "local r = rows(9)\n"
+        "for i = 1, #r do\n"
+        "  local n = i - 1\n"
+        "  assert(r[i].size == (n % 3 ~= 0 and n * 4 or nil))\n"
+        "  assert(r[i].comment == (n % 2 == 0 and 'even ' .. n or nil))\n"
+        "end"));
+}
+
+TEST_CASE(IterationOverBlocksAndRows) {
+    CHECK(run(
+        "local r = rows(12)\n"
+        "local n = 0\n"
+        "for i, row in ipairs(r) do n = n + 1 assert(row.ea == 0x1000 + 16 * (i - 1)) end\n"
+        "assert(n == 12)\n"
+        "n = 0\n"
+        "for i, row in pairs(r) do n = n + 1 assert(row.name == 'sub_' .. (i - 1)) end\n"
+        "assert(n == 12)\n"
+        // pairs over a row gives its fields in order, leaving out those without a value
+        "local names = {}\n"
+        "for name, value in pairs(r[1]) do names[#names + 1] = name end\n"
+        "assert(table.concat(names, ' ') == 'ea name comment weight thunk callers operands target')\n"
+        "names = {}\n"
+        "for name in pairs(r[2]) do names[#names + 1] = name end\n"
+        "assert(table.concat(names, ' ') == 'ea name size weight thunk callers operands target')\n"
+        "for _ in ipairs(r[1]) do error('rows have no array part') end"));
+}
+
+TEST_CASE(ListsAndNestedRecords) {
+    CHECK(run(
+        "local r = rows(6)\n"
+        "local callers = r[5].callers\n"
+        "assert(#callers == 4 and callers[1] == 0x9000 and callers[4] == 0x9003 and callers[5] == nil)\n"
+        "assert(#r[1].callers == 0 and r[1].callers[1] == nil)\n"
+        "local sum = 0 for _, ea in ipairs(callers) do sum = sum + ea end\n"
+        "assert(sum == 4 * 0x9000 + 6)\n"
+        "local ops = r[4].operands\n"
+        "assert(#ops == 2 and ops[1].text == 'op3' and ops[1].value == 3 and ops[2].text == 'imm' and ops[2].value == -3)\n"
+        "local n = 0 for i, op in pairs(ops) do n = n + 1 assert(op.text == (i == 1 and 'op3' or 'imm')) end\n"
+        "assert(n == 2)\n"
+        "assert(r[6].target.text == 'target5' and r[6].target.value == 1005)\n"
+        // Views and rows stay valid after the block itself is dropped
+        "local kept, op = r[6].callers, r[6].operands[1]\n"
+        "r = nil collectgarbage()\n"
+        "assert(#kept == 5 and kept[5] == 0x9004 and op.text == 'op5')"));
+}
+
+TEST_CASE(BlocksAreReadOnly) {
+    CHECK(run(
+        "local r = rows(3)\n"
+        "assert(raises('records are read-only', function() r[1] = 1 end))\n"
+        "assert(raises('records are read-only', function() r.extra = 1 end))\n"
+        "assert(raises('records are read-only', function() r[1].ea = 1 end))\n"
+        "assert(raises('records are read-only', function() r[2].callers[1] = 1 end))\n"
+        "assert(raises('records are read-only', function() r[2].target.value = 1 end))\n"
+        "assert(r[1].ea == 0x1000 and getmetatable(r) == 'records' and getmetatable(r[1]) == 'record')"));
+}
+
+TEST_CASE(Columns) {
+    CHECK(run(
+        "local r = rows(10)\n"
+        "local eas = r:column('ea')\n"
+        "assert(tostring(eas) == 'u64array: 10 elements' and eas[10] == 0x1000 + 16 * 9)\n"
+        // Optional integer columns have holes, so they come back as tables
+        "local sizes = r:column('size')\n"
+        "assert(type(sizes) == 'table' and sizes[1] == nil and sizes[2] == 4 and sizes[10] == nil)\n"
+        "local names = r:column('name')\n"
+        "assert(type(names) == 'table' and #names == 10 and names[3] == 'sub_2')\n"
+        "assert(r:column('weight')[2] == 1.5 and r:column('thunk')[1] == true)\n"
+        "local lists = r:column('callers')\n"
+        "assert(#lists == 10 and #lists[4] == 3)\n"
+        // Scalar lists have one unnamed column
+        "local callers = r[8].callers:column()\n"
+        "assert(tostring(callers) == 'u64array: 7 elements' and callers[7] == 0x9006)\n"
+        "assert(r[3].operands:column('value')[2] == -2)\n"
+        "assert(raises(\"no field 'nope'\", r.column, r, 'nope'))\n"
+        "assert(#rows(0):column('ea') == 0)\n"
+        "local copy = luda.u64array(#eas)\n"
+        "for i = 1, #eas do copy[i] = eas[i] end\n"
+        "assert(copy[1] == 0x1000 and copy[10] == eas[10])"));
+}
+
+TEST_CASE(ToTable) {
+    CHECK(run(
+        "local t = rows(4):totable()\n"
+        "assert(type(t) == 'table' and #t == 4)\n"
+        "local row = t[3]\n"
+        "assert(type(row) == 'table' and row.ea == 0x1020 and row.name == 'sub_2' and row.size == 8)\n"
+        "assert(row.comment == 'even 2' and row.weight == 2.5 and row.thunk == false)\n"
+        "assert(type(row.callers) == 'table' and #row.callers == 2 and row.callers[2] == 0x9001)\n"
+        "assert(type(row.operands[1]) == 'table' and row.operands[1].text == 'op2' and row.operands[2].value == -2)\n"
+        "assert(type(row.target) == 'table' and row.target.value == 1002)\n"
+        "assert(t[1].size == nil and t[2].comment == nil)\n"
+        // A plain copy: writable
+        "row.ea = 5 row.callers[1] = 0\n"
+        "assert(row.ea == 5)\n"
+        "local ops = rows(3)[2].operands:totable()\n"
+        "assert(#ops == 2 and ops[1].text == 'op1')"));
+}
+
+// A block is an array of maps, in column order, leaving out fields without a value
+TEST_CASE(EmitEncodesBlocks) {
+    CHECK(run(
+        "local bytes = encode(pairs_block())\n"
+        "local expected = '\\x92' .. '\\x82\\xA2ea\\x01\\xA4name\\xA1a' .. '\\x81\\xA2ea\\x02'\n"
+        "assert(bytes == expected, (bytes:gsub('.', function(c) return string.format('%02X ', c:byte()) end)))\n"
+        "assert(encode(pairs_block()[1]) == '\\x82\\xA2ea\\x01\\xA4name\\xA1a')\n"
+        "assert(encode(rows(4)[4].callers) == '\\x93\\xCD\\x90\\x00\\xCD\\x90\\x01\\xCD\\x90\\x02')\n"
+        "assert(encode(rows(0)) == '\\x90')\n"
+        "assert(luda.send(encode(pairs_block())) == false)\n"
+        // Everything else in a row encodes like its plain copy
+        "local r = rows(3)\n"
+        "assert(encode(r[3].operands) == '\\x92' .. '\\x82\\xA4text\\xA3op2\\xA5value\\x02' .. '\\x82\\xA4text\\xA3imm\\xA5value\\xFE')\n"
+        "assert(encode(r[3].target) == '\\x82\\xA4text\\xA7target2\\xA5value\\xCD\\x03\\xEA')"));
+}
+
+RUN_TESTS()
@@ -0,0 +1,57 @@
+// Runs share one Lua state; nothing one run writes may be visible to the next
+#include "Check.h"
+
+#include <Executor/Executor.h>
+
+static Executor& executor() {
+    static Executor* instance = [] {
+        auto* created = new Executor();
+        created->initialize();
+        return created;
+    }();
+    return *instance;
+}
+
+TEST_CASE(GlobalsStayInTheirRun) {
+    CHECK(executor().run_script("counter = 1"));
+    CHECK(executor().run_script("assert(counter == nil)"));
+}
+
+TEST_CASE(LibraryTablesAreReadOnly) {
+    CHECK(!executor().run_script("string.evil = 1"));
+    CHECK(!executor().run_script("luda.gc.evil = 1"));
+    CHECK(executor().run_script("assert(string.evil == nil and luda.gc.evil == nil)"));
+}
+
+TEST_CASE(BaseIsOutOfReach) {
+    CHECK(executor().run_script(
+        "assert(getmetatable(_ENV) == 'sandbox')\n"
+        "assert(not pcall(function() rawset(getmetatable(_ENV).__index, 'leak', 42) end))\n"
+        "assert(not pcall(function() getmetatable('').__index.evil = 1 end))\n"
+        "assert(not pcall(function() getmetatable('').__index = {} end))\n"
+        "assert(not pcall(function() package.loaded.string.evil = 1 end))\n"
+        "assert(not pcall(setmetatable, _ENV, {}))"));
+}
+
+// Whatever of these writes gets through, the next run must not see it
+TEST_CASE(WritesDoNotReachTheNextRun) {
+    CHECK(executor().run_script(
+        "pcall(function() rawset(getmetatable(_ENV).__index, 'leak', 42) end)\n"
+        "pcall(function() getmetatable('').__index.evil = 1 end)\n"
+        "pcall(function() package.loaded.string.evil = 1 end)\n"
+        "pcall(function() require('table').evil = 1 end)\n"
+        "pcall(function() getmetatable(buffer.new(1)).__index.evil = 1 end)"));
+    CHECK(executor().run_script(
+        "assert(leak == nil and string.evil == nil and table.evil == nil)\n"
+        "assert(('abc').evil == nil and buffer.new(1).evil == nil)\n"
+        "assert(('abc'):upper() == 'ABC' and package.loaded.string.upper == string.upper)"));
+}
+
+TEST_CASE(UserdataMetatablesAreHidden) {
+    CHECK(executor().run_script(
+        "for _, v in ipairs({ buffer.new(1), luda.u64array(1), luda.eamap(), luda.rangeset(), struct.compile('u8 x') }) do\n"
+        "  assert(type(getmetatable(v)) == 'string')\n"
+        "end"));
+}
+
+RUN_TESTS()
@@ -0,0 +1,206 @@
+// struct.compile and the decoders: layout errors, byte order, char arrays, counts read
+// from earlier fields, running past the data, database reads, and the layout cache
+#include "Check.h"
+
+#include <Executor/Executor.h>
+#include <Executor/MemoryBackend.h>
+
+#include <string>
+
+constexpr ea_t kBase = 0x140000000;
+constexpr size_t kImageSize = 0x100000;
+
+// Byte `i` of the image, mirrored by the scripts' byte() below
+static uint8_t image_byte(size_t i) {
+    return static_cast<uint8_t>(i * 7 + 3);
+}
+
+static Executor& executor() {
+    static Executor* instance = [] {
+        static LUDA::MemoryBackend db;
+        std::vector<uint8_t> image(kImageSize);
+        for (size_t i = 0; i < image.size(); ++i) image[i] = image_byte(i);
+        db.set_image(std::move(image), kBase);
+        db.add_segment(kBase, kBase + kImageSize, ".data");
+        LUDA::set_backend(&db);
+        auto* created = new Executor();
+        created->initialize();
+        return created;
+    }();
+    return *instance;
+}
+
+static const std::string kHelpers =
+    "local base = " + std::to_string(kBase) + "\n"
+    "local function byte(i) return (i * 7 + 3) & 0xFF end\n"
+    "local function raises(pattern, f, ...)\n"
+    "  local ok, err = pcall(f, ...)\n"
+    "  return not ok and tostring(err):find(pattern, 1, true) ~= nil\n"
+    "end\n";
+
+static bool run(const std::string& script) {
+    return executor().run_script(kHelpers + script);
+}
+
+TEST_CASE(LayoutErrors) {
+    CHECK(run(
+        "assert(raises('unknown type at position 7', struct.compile, 'u8 a; u24 b'))\n"
+        "assert(raises('unknown type at position 1', struct.compile, 'int a'))\n"
+        "assert(raises('duplicate field name', struct.compile, 'u8 a; u16 a'))\n"
+        "assert(raises('field name expected', struct.compile, 'u8 ; u8 b'))\n"
+        "assert(raises('field name expected', struct.compile, 'u8 9x'))\n"
+        "assert(raises(\"';' expected\", struct.compile, 'u8 a u8 b'))\n"
+        "assert(raises(\"']' expected\", struct.compile, 'u8 a[4'))\n"
+        "assert(raises('element count expected', struct.compile, 'u8 a[]'))\n"
+        "assert(raises('bad element count', struct.compile, 'u8 a[4x]'))\n"
+        "assert(raises('element count too large', struct.compile, 'u8 a[99999999999]'))\n"
+        "assert(raises('count must be a number or an earlier field', struct.compile, 'u8 a[n]; u8 n'))\n"
+        "assert(raises('count must be a number or an earlier field', struct.compile, 'u8 _; u8 a[_]'))\n"
+        "assert(raises('count field must be a single integer', struct.compile, 'f32 n; u8 a[n]'))\n"
+        "assert(raises('count field must be a single integer', struct.compile, 'u8 n[2]; u8 a[n]'))\n"
+        "assert(raises('count field must be a single integer', struct.compile, 'char n; u8 a[n]'))\n"
+        "assert(raises('layout has no named fields', struct.compile, 'u32 _; -- nothing else'))\n"
+        "assert(raises('layout has no named fields', struct.compile, ''))\n"
+        // Skipped fields may repeat, separators and comments go anywhere
+        "local s = struct.compile('\\n u8 a;; u8 _ -- padding\\n u16 _\\n u32 b;')\n"
+        "assert(s:size() == 8 and tostring(s) == 'struct: 4 fields, 8 bytes')"));
+}
+
+TEST_CASE(ByteOrderAndTypes) {
+    CHECK(run(
+        "local s = struct.compile('u16be a; u32be b; i16be c; u64be d; f64be e; u16 f; u32le g; i8 h; i64 k; f32 m')\n"
+        "local data = string.pack('>I2I4i2i8d', 0x1234, 0xDEADBEEF, -2, -5, 1.5) ..\n"
+        "  string.pack('<I2I4i1i8f', 0x1234, 0xDEADBEEF, -1, math.mininteger, 0.25)\n"
+        "assert(s:size() == #data)\n"
+        "local r, after = s:decode(data)\n"
+        "assert(after == #data + 1)\n"
+        "assert(r.a == 0x1234 and r.b == 0xDEADBEEF and r.c == -2 and r.d == -5 and r.e == 1.5)\n"
+        "assert(r.f == 0x1234 and r.g == 0xDEADBEEF and r.h == -1 and r.k == math.mininteger and r.m == 0.25)\n"
+        "assert(math.type(r.e) == 'float' and math.type(r.a) == 'integer')\n"
+        // u64 keeps its bits, reading as negative past 2^63
+        "assert(struct.compile('u64 x'):decode(string.rep('\\xFF', 8)).x == -1)\n"
+        "assert(struct.compile('u8 x'):decode('\\xFF').x == 255)"));
+}
+
+TEST_CASE(CharArraysStopAtNul) {
+    CHECK(run(
+        "local s = struct.compile('char tag[4]; char c; u8 n')\n"
+        "local rows = s:decode_many('ab\\0cZ\\1' .. 'abcdY\\2' .. '\\0\\0\\0\\0X\\3')\n"
+        "assert(#rows == 3)\n"
+        "assert(rows[1].tag == 'ab' and rows[1].c == 'Z' and rows[1].n == 1)\n"
+        "assert(rows[2].tag == 'abcd' and rows[2].c == 'Y' and rows[2].n == 2)\n"
+        "assert(rows[3].tag == '' and rows[3].c == 'X' and rows[3].n == 3)\n"
+        "local v = struct.compile('u8 n; char name[n]')\n"
+        "local r, after = v:decode('\\5ab\\0de!')\n"
+        "assert(r.name == 'ab' and after == 7)"));
+}
+
+TEST_CASE(ArrayFieldsAreLists) {
+    CHECK(run(
+        "local s = struct.compile('u16 vals[3]; f32 w[2]')\n"
+        "local r = s:decode(string.pack('<I2I2I2ff', 7, 8, 9, 0.5, -2))\n"
+        "assert(#r.vals == 3 and r.vals[1] == 7 and r.vals[3] == 9 and r.vals[4] == nil)\n"
+        "assert(#r.w == 2 and r.w[1] == 0.5 and r.w[2] == -2.0)"));
+}
+
+// Counts come from earlier fields of the same row, so every row has its own size
+TEST_CASE(VariableCounts) {
+    CHECK(run(
+        "local s = struct.compile('u8 n; u16be items[n]; u8 m; char text[m]; u8 tail')\n"
+        "local data = string.pack('>B I2 I2 B c3 B', 2, 0x102, 0x304, 3, 'xyz', 9) ..\n"
+        "  string.pack('>B B B', 0, 0, 8) .. string.pack('>B I2 B c1 B', 1, 0xFFFF, 1, 'q', 7)\n"
+        "assert(s:size() == nil and tostring(s):find('3+ bytes', 1, true))\n"
+        "local rows, after = s:decode_many(data, 3)\n"
+        "assert(after == #data + 1)\n"
+        "assert(#rows[1].items == 2 and rows[1].items[2] == 0x304 and rows[1].text == 'xyz' and rows[1].tail == 9)\n"
+        "assert(#rows[2].items == 0 and rows[2].text == '' and rows[2].tail == 8)\n"
+        "assert(rows[3].items[1] == 0xFFFF and rows[3].text == 'q' and rows[3].tail == 7)\n"
+        "local all = rows:column('items')\n"
+        "assert(#all == 3 and #all[1] == 2 and #all[2] == 0)\n"
+        // A count that can't be an element count is an error, not a huge allocation
+        "local bad = struct.compile('i32 n; u8 data[n]')\n"
+        "assert(raises(\"field 'n' holds a bad element count (-1)\", bad.decode, bad, string.pack('<i4', -1)))"));
+}
+
+TEST_CASE(PastTheEndOfTheData) {
+    CHECK(run(
+        "local s = struct.compile('u32 a; u32 b')\n"
+        "assert(raises('struct runs past the end of the data (8 bytes needed, 7 available)', s.decode, s, string.rep('x', 7)))\n"
+        "assert(raises('(16 bytes needed, 12 available)', s.decode_many, s, string.rep('x', 12), 2))\n"
+        "assert(raises('(8 bytes needed, 4 available)', s.decode, s, string.rep('x', 8), 5))\n"
+        "assert(raises('position out of range', s.decode, s, 'abc', 5))\n"
+        "local v = struct.compile('u8 n; u8 data[n]')\n"
+        "assert(raises('(5 bytes needed, 4 available)', v.decode, v, '\\4abc'))\n"
+        "assert(raises('(3 bytes needed, 2 available)', v.decode_many, v, '\\0\\0\\1', 3, 2))\n"
+        "local b = buffer.new(8)\n"
+        "local r, after = s:decode(b)\n"
+        "assert(r.a == 0 and after == 9)"));
+}
+
+TEST_CASE(FixedSizeDecodeManyWithoutCount) {
+    CHECK(run(
+        "local s = struct.compile('u16 a; u16 b')\n"
+        "local rows, after = s:decode_many(string.pack('<I2I2I2I2', 1, 2, 3, 4) .. 'xy')\n"
+        "assert(#rows == 2 and rows[2].b == 4 and after == 9)\n"
+        "rows, after = s:decode_many('..' .. string.pack('<I2I2', 5, 6), nil, 3)\n"
+        "assert(#rows == 1 and rows[1].a == 5 and after == 7)\n"
+        "rows, after = s:decode_many('abc')\n"
+        "assert(#rows == 0 and after == 1)\n"
+        "local v = struct.compile('u8 n; u8 data[n]')\n"
+        "assert(raises('count needed', v.decode_many, v, '\\0\\0'))\n"
+        "assert(raises('count needed', s.decode_many, s, base))\n"
+        "assert(raises('count must not be negative', s.decode_many, s, 'abcd', -1))"));
+}
+
+// Rows read from the database, the window of bytes growing as the rows need more of it
+TEST_CASE(DatabaseReads) {
+    CHECK(run(
+        "local s = struct.compile('u32 x; u8 y')\n"
+        "local rows, after = s:decode_many(base + 3, 20000)\n"
+        "assert(#rows == 20000 and after == base + 3 + 100000)\n"
+        "for i = 1, #rows, 997 do\n"
+        "  local o = 3 + (i - 1) * 5\n"
+        "  local x = byte(o) | byte(o + 1) << 8 | byte(o + 2) << 16 | byte(o + 3) << 24\n"
+        "  assert(rows[i].x == x and rows[i].y == byte(o + 4))\n"
+        "end\n"
+        "local v = struct.compile('u8 n; u8 data[n]')\n"
+        "local list, next = v:decode_many(base, 3000)\n"
+        "local o = 0\n"
+        "for i = 1, #list do\n"
+        "  local n = byte(o)\n"
+        "  assert(list[i].n == n and #list[i].data == n, i)\n"
+        "  if n > 0 then assert(list[i].data[1] == byte(o + 1) and list[i].data[n] == byte(o + n)) end\n"
+        "  o = o + 1 + n\n"
+        "end\n"
+        "assert(next == base + o)\n"
+        "local one, at = v:decode(base + 1)\n"
+        "assert(one.n == byte(1) and at == base + 2 + byte(1))"));
+}
+
+// Layouts nobody holds any more are collected, with the row metatables made for them
+TEST_CASE(UnusedLayoutsAreCollected) {
+    CHECK(run("collectgarbage() collectgarbage()"));
+    size_t before = executor().memory().stats().in_use;
+    CHECK(run(
+        "for i = 1, 20000 do\n"
+        "  local s = struct.compile('u8 len; char name[' .. i .. ']')\n"
+        "  if i % 100 == 0 then assert(s:decode(string.rep('a', i + 1)).len == 97) end\n"
+        "end"));
+    CHECK(run("collectgarbage() collectgarbage()"));
+    size_t after = executor().memory().stats().in_use;
+    CHECK(after < before + 256 * 1024);
+
+    // A block keeps its layout, however it is reached
+    CHECK(run(
+        "local rows = struct.compile('u8 a; u8 b[2]'):decode_many('\\1\\2\\3\\4\\5\\6')\n"
+        "local second, list = rows[2], rows[1].b\n"
+        "rows = nil\n"
+        "collectgarbage() collectgarbage()\n"
+        "for i = 1, 1000 do struct.compile('u16 z' .. i) end\n"
+        "assert(second.a == 4 and second.b[2] == 6 and list[1] == 2)\n"
+        "local copy = list:totable()\n"
+        "assert(copy[1] == 2 and copy[2] == 3)\n"
+        "assert(struct.compile('u8 a; u8 b[2]') == struct.compile('u8 a; u8 b[2]'))"));
+}
+
+RUN_TESTS()